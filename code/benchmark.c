@@ -2,11 +2,18 @@
 //
 // Project 8 - Skip List / B+Tree NodeStore Benchmark
 //
-// This benchmark does NOT generate data internally.
-// Instead, it reads provided input files:
+// This benchmark does NOT generate keys internally. Every testcase is three
+// input files:
 //   - insert file:  a sequence of integer keys to insert
 //   - search file:  a sequence of integer keys to query
 //   - delete file:  a sequence of integer keys to delete
+// and the optional mixed phase (--workload, --mix, --threads) only draws its
+// op stream from those keys.
+//
+// One invocation sweeps every --impl x --m x testcase, --rounds times each,
+// and writes one CSV or JSON row per run: the phase times, per-op latency
+// percentiles from sampled ops, optional hardware counters, memory, and the
+// extra phases (freeze, mmap, mixed) that were asked for.
 //
 // File format:
 //   - integers separated by any whitespace (space/tab/newline)
@@ -17,9 +24,11 @@
 //
 // Usage example:
 //   ./bench --m 128 --impl skip --insert testcases/ins.txt --search testcases/q.txt --delete testcases/del.txt --rounds 5 --csv out.csv
+//   ./bench --m 16,64,256 --impl array,simd,skiplist --case testcases/1,testcases/3 --workload ycsb-b --format json
 //
 
 #define _POSIX_C_SOURCE 200809L
+#define _DEFAULT_SOURCE             // syscall() for perf_event_open
 
 #include <stdio.h>
 #include <stdlib.h>
@@ -27,15 +36,44 @@
 #include <string.h>
 #include <errno.h>
 #include <time.h>
+#include <math.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(__GLIBC__)
+#include <malloc.h>
+#endif
 
 #include "bptree.h"
+#include "bptree_key.h"
+#include "bptree_sharded.h"
 #include "nodestore.h"
+#include "skiplist.h"
+#include "skiplist_concurrent.h"
 
 #ifndef BENCH_READ_BUF
 #define BENCH_READ_BUF (1u << 16)  // 64 KiB
 #endif
 
+// tower limit for the skip lists (skiplist, cskip); 2^24 keys before towers stop growing
+#define BENCH_SKIP_MAX_LEVEL 24
+
+// largest --value-size
+#define BENCH_VALUE_MAX 64
+
+// default --sample: one op in 64 is timed on its own
+#define BENCH_SAMPLE_EVERY 64
+
+// entries of --impl, --m and --case
+#define BENCH_LIST_MAX 32
+
 static uint64_t now_ns(void) {
     struct timespec ts;
 
@@ -56,28 +94,99 @@ static uint64_t now_ns(void) {
 static void usage(const char *prog) {
     fprintf(stderr,
         "Usage:\n"
-        "  %s --m ORDER --impl array|list|skip --insert INS.txt --search Q.txt --delete DEL.txt [options]\n"
+        "  %s --impl LIST --m LIST (--case DIR[,DIR...] | --insert INS.txt --search Q.txt --delete DEL.txt) [options]\n"
+        "\n"
+        "Runs every --impl x --m x testcase, --rounds times each, and writes one row per run.\n"
         "\n"
-        "Required arguments:\n"
-        "  --m ORDER          B+ tree order M (M >= 3)\n"
-        "  --impl KIND        NodeStore implementation: array | list | skip\n"
-        "  --insert PATH      Keys to insert (plain text integers)\n"
+        "What to run:\n"
+        "  --impl LIST        Comma-separated kinds: array | list | skip | inline | simd | packed | gapped (B+ tree\n"
+        "                     NodeStores), all (those seven), skiplist | skiplist-arena (skiplist.h, nodes from\n"
+        "                     malloc or from its arena), cskip (the lock-free skip list); skip lists ignore --m\n"
+        "                     and run once per testcase with M 0\n"
+        "  --m LIST           Comma-separated B+ tree orders, each >= 3 (not needed when only skip lists run)\n"
+        "  --case LIST        Comma-separated testcase directories, each holding ins.txt, q.txt and del.txt;\n"
+        "                     may be repeated\n"
+        "  --insert PATH      Or one testcase: keys to insert (plain text integers)\n"
         "  --search PATH      Keys to query  (plain text integers)\n"
         "  --delete PATH      Keys to delete (plain text integers)\n"
+        "  --cskip            Same as --impl cskip\n"
+        "\n"
+        "Output:\n"
+        "  --rounds R         Repeat every run R times (default: 3)\n"
+        "  --out PATH         Write the rows to PATH (default: stdout); --csv PATH is the same\n"
+        "  --format F         csv (default) | json (one array of row objects)\n"
+        "  --tag STR          Extra label written to every row (default: empty)\n"
+        "\n"
+        "Measurement:\n"
+        "  --sample K         Time every K-th op of a phase on its own for the p50/p99/p999 columns, less the\n"
+        "                     clock's own cost; 0 turns sampling off (default: %d)\n"
+        "  --perf             Count cache and branch misses of every phase (perf_event_open, user space only);\n"
+        "                     the columns stay empty where the counters cannot be opened\n"
+        "  --stats            After the inserts, walk the structure (bptree_stats / skiplist_stats, untimed)\n"
+        "                     for the tree_bytes, leaf_fill and search_path columns; in a build with\n"
+        "                     make STATS=1 trees also fill the counter columns for the whole run\n"
         "\n"
-        "Optional arguments:\n"
-        "  --rounds R         Repeat benchmark R times (default: 3)\n"
-        "  --csv PATH         Write CSV output to PATH (default: stdout)\n"
-        "  --tag STR          Extra label written to CSV (default: empty)\n"
+        "Mixed phase (after the searches, before the deletes):\n"
+        "  --workload W       ycsb-a (50%% reads, 50%% inserts) | ycsb-b (95/5) | ycsb-c (reads only), all over\n"
+        "                     zipf hot keys of the insert file; ycsb-d (95/5, inserts add new keys, reads favor\n"
+        "                     the newest) | churn (50%% reads, 25%% inserts, 25%% deletes, zipf); an insert of a\n"
+        "                     loaded key is an update (bptree_upsert with --value-size)\n"
+        "  --mix R:I:D        Custom read:insert:delete percentages instead of --workload\n"
+        "  --dist D           Keys of --mix: file (the search keys in order, default) | uniform | zipf | latest\n"
+        "  --zipf-theta T     Skew of zipf and latest, in (0, 1) (default: 0.99)\n"
+        "  --ops N            Ops in the mixed phase (default: the number of search keys)\n"
+        "  --threads N        Concurrent tree; the mixed phase runs on N threads (without --workload or --mix,\n"
+        "                     --read-ratio over the search keys)\n"
+        "  --read-ratio P     Percent of those ops that are searches; the rest insert/delete (default: 90)\n"
+        "\n"
+        "Tree options:\n"
+        "  --freeze           Also time bptree_freeze and a second search pass on the frozen layout\n"
+        "  --seed S           Seed for randomized NodeStores, skip lists and workloads; every round reuses it\n"
+        "                     (default: 1)\n"
+        "  --load MODE        Insert phase: each (bptree_insert per key, default) | sorted (bptree_insert_sorted)\n"
+        "                     | bulk (bptree_bulk_load on a sorted copy; sorting is not timed)\n"
+        "                     | parallel (bptree_bulk_load_parallel on the keys as read, sort included)\n"
+        "                     | batch (bptree_insert_batch of all keys)\n"
+        "  --fill F           Fill factor for --load bulk and parallel, in (0, 1] (default: 1)\n"
+        "  --delete-batch     Delete phase through one bptree_delete_batch of all keys\n"
+        "  --workers N        Threads for --load parallel | batch and --delete-batch (default: 0 = one per CPU)\n"
+        "  --batch N          Search through bptree_search_batch, N keys per call (default: 0 = one by one)\n"
+        "  --batch-sort       With --batch, sort each chunk before the descents (BPTREE_BATCH_SORT)\n"
+        "  --static           Use the store-specialized tree (array | inline | simd); impl becomes KIND-static\n"
+        "  --buffer N         Buffered (write-optimized) tree, flushing at N messages per node (list | skip);\n"
+        "                     impl becomes buffered-KIND; the delete phase ends with bptree_flush, timed with it\n"
+        "  --adaptive R,W     Adaptive tree (bptree_create_adaptive): internal nodes of --impl, leaves of kind R\n"
+        "                     or W by their lookup/write mix; impl becomes adaptive-KIND-R-W\n"
+        "  --finger           Keep a finger (bptree_set_finger, or the skiplist.h finger): lookups and writes near\n"
+        "                     the previous one skip the descent; impl gets a -finger suffix\n"
+        "  --shards K         Range-partitioned front-end over up to K trees (bptree_sharded.h); impl becomes\n"
+        "                     sharded-KIND, height is the tallest shard; --threads and --batch work as for the tree\n"
+        "  --value-size B     Key/value tree with B-byte values (1..%d): the each load uses bptree_upsert and\n"
+        "                     unbatched searches bptree_get; impl gets a -kvB suffix\n"
+        "  --key-type T       int (default) | int64 | str: int64 and str run on bptree_key.h trees (impl int64 or\n"
+        "                     strW, --impl not needed); str reads whitespace-separated words\n"
+        "  --key-width W      Bytes per str key, words zero-padded (default: 16)\n"
+        "  --mmap PATH        After the searches, time bptree_save to PATH, bptree_open_mmap of it and the same\n"
+        "                     searches on the mapped tree (PATH is overwritten)\n"
         "  --help             Show this help\n"
         "\n"
         "Input file format:\n"
         "  - Integers separated by whitespace.\n"
         "  - Lines starting with '#' are treated as comments.\n"
         "\n"
-        "CSV columns:\n"
-        "  tag,impl,M,n_insert,n_search,n_delete,round,insert_ns,search_ns,delete_ns,found_count,height_after_insert\n",
-        prog
+        "Columns (times in ns; an empty CSV field or JSON null is not measured):\n"
+        "  tag,case,impl,M,round,n_insert,n_search,n_delete,n_keys,insert_ns,search_ns,delete_ns,total_ns,\n"
+        "  found_count,height_after_insert,height_after_delete,\n"
+        "  {insert,search,delete}_{p50,p99,p999}_ns, {insert,search,delete}_{cache,branch}_misses,\n"
+        "  rss_bytes,bytes_per_key,peak_rss_bytes,freeze_ns,frozen_search_ns,\n"
+        "  workload,threads,mixed_ops,mixed_ns,mixed_{p50,p99,p999}_ns,mixed_{cache,branch}_misses,\n"
+        "  save_ns,open_ns,mapped_search_ns,\n"
+        "  tree_bytes,leaf_fill,search_path,splits,merges,borrows,sep_updates,descents,node_visits\n"
+        "  n_keys is the distinct insert keys; rss_bytes the resident set the run added by the end of the\n"
+        "  insert phase and peak_rss_bytes at its high-water mark (Linux); bulk, batch and parallel loads,\n"
+        "  batched searches and --delete-batch have no per-op percentiles. search_path is the mean nodes a\n"
+        "  skip list search reads; splits, merges and borrows count leaves and internal nodes.\n",
+        prog, BENCH_SAMPLE_EVERY, BENCH_VALUE_MAX
     );
 }
 
@@ -86,6 +195,10 @@ static NodeStoreKind parse_impl(const char *s) {
     if (strcmp(s, "array") == 0) return NODESTORE_ARRAY;
     if (strcmp(s, "list") == 0)  return NODESTORE_LINKED;
     if (strcmp(s, "skip") == 0)  return NODESTORE_SKIPLIST;
+    if (strcmp(s, "inline") == 0) return NODESTORE_INLINE;
+    if (strcmp(s, "simd") == 0)  return NODESTORE_ARRAY_SIMD;
+    if (strcmp(s, "packed") == 0) return NODESTORE_PACKED;
+    if (strcmp(s, "gapped") == 0) return NODESTORE_GAPPED;
     return 0;
 }
 
@@ -94,14 +207,575 @@ static const char* impl_name(NodeStoreKind k) {
         case NODESTORE_ARRAY:    return "array";
         case NODESTORE_LINKED:   return "list";
         case NODESTORE_SKIPLIST: return "skip";
+        case NODESTORE_INLINE:   return "inline";
+        case NODESTORE_ARRAY_SIMD: return "simd";
+        case NODESTORE_PACKED:   return "packed";
+        case NODESTORE_GAPPED:   return "gapped";
         default:                 return "unknown";
     }
 }
 
-static int push_int(int **arr, size_t *len, size_t *cap, int v) {
+// one --impl entry: a B+ tree over a NodeStore, or one of the skip lists
+typedef enum BenchKind {
+    BENCH_TREE,
+    BENCH_SKIPLIST,             // skiplist.h, a malloc per node
+    BENCH_SKIPLIST_ARENA,       // skiplist.h with its arena
+    BENCH_CSKIP                 // skiplist_concurrent.h
+} BenchKind;
+
+typedef struct BenchImpl {
+    BenchKind kind;
+    NodeStoreKind store;        // BENCH_TREE
+} BenchImpl;
+
+static const char* bench_kind_name(BenchKind k) {
+    switch (k) {
+        case BENCH_SKIPLIST:       return "skiplist";
+        case BENCH_SKIPLIST_ARENA: return "skiplist-arena";
+        case BENCH_CSKIP:          return "cskip";
+        default:                   return "tree";
+    }
+}
+
+// --impl LIST into impls; 0 on an unknown name or too many
+static int parse_impl_list(const char *s, BenchImpl *impls, int *n) {
+    static const NodeStoreKind all[] = {
+        NODESTORE_ARRAY, NODESTORE_LINKED, NODESTORE_SKIPLIST, NODESTORE_INLINE,
+        NODESTORE_ARRAY_SIMD, NODESTORE_PACKED, NODESTORE_GAPPED
+    };
+    char name[32];
+    while (*s) {
+        size_t len = strcspn(s, ",");
+        if (len == 0 || len >= sizeof name) return 0;
+        memcpy(name, s, len);
+        name[len] = '\0';
+        s += len + (s[len] == ',');
+
+        if (strcmp(name, "all") == 0) {
+            for (size_t i = 0; i < sizeof all / sizeof all[0]; ++i) {
+                if (*n == BENCH_LIST_MAX) return 0;
+                impls[(*n)++] = (BenchImpl){BENCH_TREE, all[i]};
+            }
+            continue;
+        }
+        BenchImpl b = {BENCH_TREE, parse_impl(name)};
+        if (strcmp(name, "skiplist") == 0) b.kind = BENCH_SKIPLIST;
+        else if (strcmp(name, "skiplist-arena") == 0) b.kind = BENCH_SKIPLIST_ARENA;
+        else if (strcmp(name, "cskip") == 0) b.kind = BENCH_CSKIP;
+        else if (!b.store) return 0;
+        if (*n == BENCH_LIST_MAX) return 0;
+        impls[(*n)++] = b;
+    }
+    return 1;
+}
+
+// --m LIST into ms; 0 on an order below 3 or too many
+static int parse_m_list(const char *s, int *ms, int *n) {
+    while (*s) {
+        char *end;
+        long v = strtol(s, &end, 10);
+        if (end == s || (*end && *end != ',') || v < 3 || v > INT_MAX || *n == BENCH_LIST_MAX) return 0;
+        ms[(*n)++] = (int)v;
+        s = end + (*end == ',');
+    }
+    return 1;
+}
+
+static int cmp_int(const void *a, const void *b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+// -------------------- Latency samples --------------------
+//
+// Every s->every'th op of a phase runs between two clock reads; the cost of
+// a clock read, calibrated once, is taken off each sample. The rest of the
+// ops run untimed, so the phase total stays close to an unsampled run.
+
+typedef struct Samples {
+    uint64_t *ns;
+    size_t n, cap;
+    size_t every;               // 0: no sampling
+    size_t left;                // untimed ops before the next sample
+} Samples;
+
+static uint64_t clock_cost_ns;
+
+static void calibrate_clock(void) {
+    uint64_t best = UINT64_MAX;
+    for (int i = 0; i < 1000; ++i) {
+        uint64_t a = now_ns(), b = now_ns();
+        if (b - a < best) best = b - a;
+    }
+    clock_cost_ns = best;
+}
+
+// room for a phase of up to max_ops ops; 0 on OOM
+static int samples_reserve(Samples *s, size_t max_ops) {
+    size_t cap = s->every ? max_ops / s->every + 1 : 0;
+    if (cap <= s->cap) return 1;
+    uint64_t *ns = (uint64_t*)realloc(s->ns, sizeof(uint64_t) * cap);
+    if (!ns) return 0;
+    s->ns = ns;
+    s->cap = cap;
+    return 1;
+}
+
+static void samples_reset(Samples *s) {
+    s->n = 0;
+    s->left = 0;
+}
+
+static void sample_add(Samples *s, uint64_t ns) {
+    s->left = s->every - 1;
+    if (s->n < s->cap) s->ns[s->n++] = ns > clock_cost_ns ? ns - clock_cost_ns : 0;
+}
+
+static void samples_merge(Samples *dst, const Samples *src) {
+    size_t c = src->n < dst->cap - dst->n ? src->n : dst->cap - dst->n;
+    memcpy(dst->ns + dst->n, src->ns, sizeof(uint64_t) * c);
+    dst->n += c;
+}
+
+// nearest-rank q-quantile of sorted samples; -1 without any
+static int64_t samples_quantile(const Samples *s, double q) {
+    if (s->n == 0) return -1;
+    size_t rank = (size_t)ceil(q * (double)s->n);
+    return (int64_t)s->ns[rank > 0 ? rank - 1 : 0];
+}
+
+// runs the statement for i in [0, n), timing every s->every'th one into s
+#define BENCH_FOR(s, i, n, ...)                                 \
+    for (size_t i = 0; i < (n); ++i) {                          \
+        if ((s)->every && (s)->left-- == 0) {                   \
+            uint64_t s0_ = now_ns();                            \
+            __VA_ARGS__;                                        \
+            sample_add((s), now_ns() - s0_);                    \
+        } else {                                                \
+            __VA_ARGS__;                                        \
+        }                                                       \
+    }
+
+// -------------------- Hardware counters --------------------
+//
+// --perf: cache and branch misses in user space of this thread and of the
+// threads it starts later (inherit), read around every phase. Without
+// perf_event_open (another OS, perf_event_paranoid, a container) the
+// counters stay unmeasured.
+
+enum { PERF_CACHE_MISSES, PERF_BRANCH_MISSES, PERF_N };
+
+typedef struct Perf {
+    int fd[PERF_N];
+    int on;
+} Perf;
+
+static int perf_open(Perf *p) {
+    p->on = 0;
+#if defined(__linux__)
+    static const uint64_t config[PERF_N] = {PERF_COUNT_HW_CACHE_MISSES, PERF_COUNT_HW_BRANCH_MISSES};
+    for (int i = 0; i < PERF_N; ++i) {
+        struct perf_event_attr a;
+        memset(&a, 0, sizeof a);
+        a.type = PERF_TYPE_HARDWARE;
+        a.size = sizeof a;
+        a.config = config[i];
+        a.disabled = 1;
+        a.inherit = 1;
+        a.exclude_kernel = 1;
+        a.exclude_hv = 1;
+        p->fd[i] = (int)syscall(SYS_perf_event_open, &a, 0, -1, -1, 0);
+        if (p->fd[i] < 0) {
+            while (i-- > 0) close(p->fd[i]);
+            return 0;
+        }
+    }
+    p->on = 1;
+#endif
+    return p->on;
+}
+
+static void perf_close(Perf *p) {
+#if defined(__linux__)
+    for (int i = 0; p->on && i < PERF_N; ++i) close(p->fd[i]);
+#endif
+    p->on = 0;
+}
+
+static void perf_start(Perf *p) {
+#if defined(__linux__)
+    for (int i = 0; p->on && i < PERF_N; ++i) {
+        ioctl(p->fd[i], PERF_EVENT_IOC_RESET, 0);
+        ioctl(p->fd[i], PERF_EVENT_IOC_ENABLE, 0);
+    }
+#else
+    (void)p;
+#endif
+}
+
+static void perf_stop(Perf *p, int64_t out[PERF_N]) {
+    for (int i = 0; i < PERF_N; ++i) {
+        out[i] = -1;
+#if defined(__linux__)
+        uint64_t v;
+        if (p->on && ioctl(p->fd[i], PERF_EVENT_IOC_DISABLE, 0) == 0 &&
+            read(p->fd[i], &v, sizeof v) == (ssize_t)sizeof v) {
+            out[i] = (int64_t)v;
+        }
+#else
+        (void)p;
+#endif
+    }
+}
+
+// -------------------- Phases --------------------
+
+typedef struct PhaseStat {
+    uint64_t ns;
+    int64_t p50, p99, p999;     // sampled per-op ns; -1 without samples
+    int64_t misses[PERF_N];     // -1 without --perf
+} PhaseStat;
+
+// the measuring state every run shares
+typedef struct Bench {
+    Samples s;
+    Perf perf;
+    uint64_t t0;
+} Bench;
+
+static void phase_begin(Bench *b) {
+    samples_reset(&b->s);
+    perf_start(&b->perf);
+    b->t0 = now_ns();
+}
+
+static void phase_end(Bench *b, PhaseStat *ps) {
+    ps->ns = now_ns() - b->t0;
+    perf_stop(&b->perf, ps->misses);
+    qsort(b->s.ns, b->s.n, sizeof(uint64_t), cmp_u64);
+    ps->p50 = samples_quantile(&b->s, 0.50);
+    ps->p99 = samples_quantile(&b->s, 0.99);
+    ps->p999 = samples_quantile(&b->s, 0.999);
+}
+
+static void phase_none(PhaseStat *ps) {
+    ps->ns = 0;
+    ps->p50 = ps->p99 = ps->p999 = -1;
+    for (int i = 0; i < PERF_N; ++i) ps->misses[i] = -1;
+}
+
+// -------------------- Memory --------------------
+//
+// Resident set sizes from /proc/self/status (Linux; -1 elsewhere). A run
+// first hands freed heap back (malloc_trim) and resets the high-water mark
+// (clear_refs 5), so both numbers are the run's own over its starting RSS.
+
+static int64_t proc_status_bytes(const char *field) {
+    FILE *fp = fopen("/proc/self/status", "r");
+    if (!fp) return -1;
+    char line[256];
+    int64_t v = -1;
+    size_t len = strlen(field);
+    while (fgets(line, sizeof line, fp)) {
+        if (strncmp(line, field, len) == 0) {
+            v = strtoll(line + len, NULL, 10) * 1024;
+            break;
+        }
+    }
+    fclose(fp);
+    return v;
+}
+
+// the RSS a run starts from
+static int64_t mem_begin(void) {
+#if defined(__GLIBC__)
+    malloc_trim(0);
+#endif
+    FILE *fp = fopen("/proc/self/clear_refs", "w");
+    if (fp) {
+        fputs("5", fp);
+        fclose(fp);
+    }
+    return proc_status_bytes("VmRSS:");
+}
+
+// what field (VmRSS: now, VmHWM: the peak) grew over base
+static int64_t mem_since(const char *field, int64_t base) {
+    int64_t v = proc_status_bytes(field);
+    if (v < 0 || base < 0) return -1;
+    return v > base ? v - base : 0;
+}
+
+// -------------------- Mixed workloads --------------------
+//
+// The mixed phase is an op stream generated before it is timed, once per
+// testcase, so every impl and round replays the same ops. Read and delete
+// keys come from the insert file; zipf ranks are scrambled over it (as in
+// YCSB) so the hot keys are not neighbours in the tree.
+
+enum { OP_READ, OP_INSERT, OP_DELETE };
+
+typedef enum BenchDist {
+    DIST_FILE,                  // the search keys in order
+    DIST_UNIFORM,
+    DIST_ZIPF,
+    DIST_LATEST                 // inserts add new keys; zipf over the newest first
+} BenchDist;
+
+typedef struct Workload {
+    const char *name;
+    int read, insert, del;      // percent
+    BenchDist dist;
+} Workload;
+
+static const Workload workloads[] = {
+    {"ycsb-a", 50, 50, 0, DIST_ZIPF},
+    {"ycsb-b", 95, 5, 0, DIST_ZIPF},
+    {"ycsb-c", 100, 0, 0, DIST_ZIPF},
+    {"ycsb-d", 95, 5, 0, DIST_LATEST},
+    {"churn", 50, 25, 25, DIST_ZIPF},
+};
+
+typedef struct OpStream {
+    int *key;
+    uint8_t *kind;
+    size_t n;
+} OpStream;
+
+static uint64_t rng_next(uint64_t *s) {
+    *s ^= *s >> 12;
+    *s ^= *s << 25;
+    *s ^= *s >> 27;
+    return *s * 0x2545F4914F6CDD1Dull;
+}
+
+static double rng_unit(uint64_t *s) {
+    return (double)(rng_next(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+// Gray et al., "Quickly generating billion-record synthetic databases":
+// ranks in [0, n), rank 0 hottest
+typedef struct Zipf {
+    size_t n;
+    double theta, alpha, zetan, eta, half_pow;
+} Zipf;
+
+static void zipf_init(Zipf *z, size_t n, double theta) {
+    double zeta2 = 1.0 + pow(0.5, theta);
+    z->n = n;
+    z->theta = theta;
+    z->zetan = 0.0;
+    for (size_t i = 1; i <= n; ++i) z->zetan += pow((double)i, -theta);
+    z->alpha = 1.0 / (1.0 - theta);
+    z->eta = (1.0 - pow(2.0 / (double)n, 1.0 - theta)) / (1.0 - zeta2 / z->zetan);
+    z->half_pow = pow(0.5, theta);
+}
+
+static size_t zipf_next(const Zipf *z, uint64_t *rng) {
+    double u = rng_unit(rng);
+    double uz = u * z->zetan;
+    if (z->n < 2 || uz < 1.0) return 0;
+    if (uz < 1.0 + z->half_pow) return 1;
+    size_t r = (size_t)((double)z->n * pow(z->eta * u - z->eta + 1.0, z->alpha));
+    return r < z->n ? r : z->n - 1;
+}
+
+// FNV-1a of the rank: where zipf rank r lands among n keys
+static size_t scramble(size_t r, size_t n) {
+    uint64_t h = 0xCBF29CE484222325ull;
+    for (int i = 0; i < 8; ++i) {
+        h ^= (r >> (8 * i)) & 0xFF;
+        h *= 0x100000001B3ull;
+    }
+    return (size_t)(h % n);
+}
+
+// n ops of w over keys[0, nk) (file order = insertion order) and qry[0, nq); 0 on OOM
+static int gen_ops(const Workload *w, const int *keys, size_t nk, const int *qry, size_t nq,
+                   size_t n, double theta, uint64_t seed, OpStream *out) {
+    out->n = 0;
+    out->key = (int*)malloc(sizeof(int) * (n ? n : 1));
+    out->kind = (uint8_t*)malloc(n ? n : 1);
+    int *seq = NULL;            // latest: the keys in insertion order, new ones appended
+    if (w->dist == DIST_LATEST) seq = (int*)malloc(sizeof(int) * (nk + n + 1));
+    if (!out->key || !out->kind || (w->dist == DIST_LATEST && !seq)) {
+        free(out->key);
+        free(out->kind);
+        free(seq);
+        return 0;
+    }
+    if ((w->dist == DIST_FILE && nq == 0) || (w->dist != DIST_FILE && nk == 0)) n = 0;
+
+    Zipf z;
+    if (w->dist == DIST_ZIPF || w->dist == DIST_LATEST) zipf_init(&z, nk, theta);
+    size_t len = nk;
+    int fresh = INT_MIN;        // latest: the next new key, one past the largest loaded
+    if (seq) {
+        memcpy(seq, keys, sizeof(int) * nk);
+        for (size_t i = 0; i < nk; ++i) {
+            if (keys[i] >= fresh) fresh = keys[i] == INT_MAX ? INT_MAX : keys[i] + 1;
+        }
+    }
+
+    uint64_t rng = seed * 0x9E3779B97F4A7C15ull + 1;
+    for (size_t i = 0; i < n; ++i) {
+        int p = (int)(rng_next(&rng) % 100);
+        uint8_t kind = p < w->read ? OP_READ : p < w->read + w->insert ? OP_INSERT : OP_DELETE;
+        int key;
+        switch (w->dist) {
+            case DIST_FILE:    key = qry[i % nq]; break;
+            case DIST_UNIFORM: key = keys[rng_next(&rng) % nk]; break;
+            case DIST_ZIPF:    key = keys[scramble(zipf_next(&z, &rng), nk)]; break;
+            default:
+                if (kind == OP_INSERT && fresh < INT_MAX) {
+                    key = seq[len++] = fresh++;
+                } else {
+                    if (kind == OP_INSERT) kind = OP_READ; // out of new keys
+                    key = seq[len - 1 - zipf_next(&z, &rng)];
+                }
+                break;
+        }
+        out->key[i] = key;
+        out->kind[i] = kind;
+    }
+    out->n = n;
+    free(seq);
+    return 1;
+}
+
+// the structure a run measures; exactly one pointer is set
+typedef struct Target {
+    BPTree *t;
+    ShardedBPTree *st;
+    SkipList *sl;
+    ConcurrentSkipList *cs;
+    size_t value_size;          // t: a key/value tree
+} Target;
+
+// --value-size: the value stored with key, derived from it
+static void make_value(unsigned char *val, size_t n, int key) {
+    for (size_t i = 0; i < n; ++i) val[i] = (unsigned char)((unsigned)key >> (8 * (i % 4)));
+}
+
+static void target_op(const Target *x, int kind, int key, unsigned char *val) {
+    if (x->st) {
+        if (kind == OP_READ) bptree_sharded_search(x->st, key);
+        else if (kind == OP_INSERT) bptree_sharded_insert(x->st, key);
+        else bptree_sharded_delete(x->st, key);
+    } else if (x->sl) {
+        if (kind == OP_READ) skiplist_search(x->sl, key);
+        else if (kind == OP_INSERT) skiplist_insert(x->sl, key);
+        else skiplist_erase(x->sl, key);
+    } else if (x->cs) {
+        if (kind == OP_READ) cskiplist_search(x->cs, key);
+        else if (kind == OP_INSERT) cskiplist_insert(x->cs, key);
+        else cskiplist_erase(x->cs, key);
+    } else if (x->value_size > 0) {
+        if (kind == OP_READ) {
+            bptree_get(x->t, key, val);
+        } else if (kind == OP_INSERT) {
+            make_value(val, x->value_size, key);
+            bptree_upsert(x->t, key, val);
+        } else {
+            bptree_delete(x->t, key);
+        }
+    } else {
+        if (kind == OP_READ) bptree_search(x->t, key);
+        else if (kind == OP_INSERT) bptree_insert(x->t, key);
+        else bptree_delete(x->t, key);
+    }
+}
+
+// mixed phase: one thread's slice [lo, hi) of the op stream
+typedef struct MixedArg {
+    const Target *x;
+    const OpStream *ops;
+    size_t lo, hi;
+    Samples s;
+} MixedArg;
+
+static void *mixed_worker(void *p) {
+    MixedArg *a = (MixedArg*)p;
+    unsigned char val[BENCH_VALUE_MAX];
+    const int *key = a->ops->key + a->lo;
+    const uint8_t *kind = a->ops->kind + a->lo;
+    BENCH_FOR(&a->s, i, a->hi - a->lo, target_op(a->x, kind[i], key[i], val));
+    return NULL;
+}
+
+// the ops on the caller (nthreads <= 1) or split over nthreads threads, their
+// samples merged; 0 if a thread could not start
+static int run_mixed(Bench *b, const Target *x, const OpStream *ops, int nthreads, PhaseStat *ps) {
+    if (nthreads <= 1) {
+        phase_begin(b);
+        MixedArg a = {x, ops, 0, ops->n, b->s};
+        mixed_worker(&a);
+        b->s = a.s;
+        phase_end(b, ps);
+        return 1;
+    }
+
+    pthread_t *th = (pthread_t*)malloc(sizeof(pthread_t) * (size_t)nthreads);
+    MixedArg *args = (MixedArg*)calloc((size_t)nthreads, sizeof(MixedArg));
+    int ok = th && args;
+    size_t per = ops->n / (size_t)nthreads;
+    for (int i = 0; ok && i < nthreads; ++i) {
+        args[i].x = x;
+        args[i].ops = ops;
+        args[i].lo = per * (size_t)i;
+        args[i].hi = (i == nthreads - 1) ? ops->n : per * (size_t)(i + 1);
+        args[i].s.every = b->s.every;
+        ok = samples_reserve(&args[i].s, args[i].hi - args[i].lo);
+    }
+
+    int started = 0;
+    if (ok) {
+        phase_begin(b);
+        for (int i = 0; i < nthreads; ++i) {
+            if (pthread_create(&th[i], NULL, mixed_worker, &args[i]) != 0) break;
+            started++;
+        }
+        for (int i = 0; i < started; ++i) pthread_join(th[i], NULL);
+        for (int i = 0; i < started; ++i) samples_merge(&b->s, &args[i].s);
+        phase_end(b, ps);
+    }
+    for (int i = 0; args && i < nthreads; ++i) free(args[i].s.ns);
+    free(th);
+    free(args);
+    if (started != nthreads) phase_none(ps);
+    return started == nthreads;
+}
+
+// one search pass over qry; batch > 0 goes through bptree_search_batch_ex
+static int run_queries(const BPTree *t, const int *qry, size_t n, size_t batch, unsigned flags, uint8_t *hit,
+                       Samples *s) {
+    int found = 0;
+    if (batch == 0 && bptree_value_size(t) > 0) { // key/value tree: fetch the values too
+        unsigned char val[BENCH_VALUE_MAX];
+        BENCH_FOR(s, i, n, found += bptree_get(t, qry[i], val));
+        return found;
+    }
+    if (batch == 0) {
+        BENCH_FOR(s, i, n, found += bptree_search(t, qry[i]));
+        return found;
+    }
+    for (size_t i = 0; i < n; i += batch) {
+        size_t c = (n - i < batch) ? n - i : batch;
+        bptree_search_batch_ex(t, qry + i, c, hit, flags);
+        for (size_t j = 0; j < c; ++j) found += hit[j];
+    }
+    return found;
+}
+
+static int push_i64(int64_t **arr, size_t *len, size_t *cap, int64_t v) {
     if (*len == *cap) {
         size_t ncap = (*cap == 0) ? 1024 : (*cap * 2);
-        int *tmp = (int*)realloc(*arr, ncap * sizeof(int));
+        int64_t *tmp = (int64_t*)realloc(*arr, ncap * sizeof(int64_t));
         if (!tmp) return 0;
         *arr = tmp;
         *cap = ncap;
@@ -112,8 +786,9 @@ static int push_int(int **arr, size_t *len, size_t *cap, int v) {
 
 // Fast integer reader:
 // - supports optional leading '-'
-// - ignores comments starting with '#' 
-static int read_int_file(const char *path, int **out_arr, size_t *out_len) {
+// - ignores comments starting with '#'
+// - every value must lie in [lo, hi] (and in int64_t while it is parsed)
+static int read_i64_file(const char *path, int64_t lo, int64_t hi, int64_t **out_arr, size_t *out_len) {
     FILE *fp = fopen(path, "rb");
     if (!fp) {
         fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
@@ -127,20 +802,26 @@ static int read_int_file(const char *path, int **out_arr, size_t *out_len) {
         return 0;
     }
 
-    int *arr = NULL;
+    int64_t *arr = NULL;
     size_t len = 0, cap = 0;
 
     int in_num = 0;
     int sign = 1;
-    long long val = 0;
+    uint64_t mag = 0;           // magnitude; up to 2^63 for a negative value
+    int ok = 1;
 
     int in_comment = 0;
 
-    while (1) {
+    for (int eof = 0; ok && !eof;) {
         size_t n = fread(buf, 1, BENCH_READ_BUF, fp);
-        if (n == 0) break;
+        if (n == 0) {
+            eof = 1;
+            if (!in_num) break;
+            buf[0] = '\n';      // finalize last number if file ended while parsing
+            n = 1;
+        }
 
-        for (size_t i = 0; i < n; ++i) {
+        for (size_t i = 0; ok && i < n; ++i) {
             unsigned char c = (unsigned char)buf[i];
 
             if (in_comment) {
@@ -157,99 +838,891 @@ static int read_int_file(const char *path, int **out_arr, size_t *out_len) {
                 if (c == '-') {
                     in_num = 1;
                     sign = -1;
-                    val = 0;
+                    mag = 0;
                 } else if (c >= '0' && c <= '9') {
                     in_num = 1;
                     sign = 1;
-                    val = (long long)(c - '0');
+                    mag = (uint64_t)(c - '0');
                 } else {
                     // separator
                 }
+            } else if (c >= '0' && c <= '9') {
+                uint64_t limit = sign < 0 ? (uint64_t)INT64_MAX + 1 : (uint64_t)INT64_MAX;
+                uint64_t d = (uint64_t)(c - '0');
+                if (mag > (limit - d) / 10) {
+                    fprintf(stderr, "Error: integer out of range in '%s'\n", path);
+                    ok = 0;
+                    break;
+                }
+                mag = mag * 10 + d;
             } else {
-                if (c >= '0' && c <= '9') {
-                    val = val * 10 + (long long)(c - '0');
-                } else {
-                    long long x = (long long)sign * val;
-                    if (x < (long long)INT32_MIN || x > (long long)INT32_MAX) {
-                        fprintf(stderr, "Error: integer out of range in '%s'\n", path);
-                        free(arr);
-                        free(buf);
-                        fclose(fp);
-                        return 0;
-                    }
-                    if (!push_int(&arr, &len, &cap, (int)x)) {
+                int64_t x = sign < 0 ? (int64_t)(0 - mag) : (int64_t)mag;
+                if (x < lo || x > hi) {
+                    fprintf(stderr, "Error: integer out of range in '%s'\n", path);
+                    ok = 0;
+                    break;
+                }
+                if (!push_i64(&arr, &len, &cap, x)) {
+                    fprintf(stderr, "Error: realloc failed while reading '%s'\n", path);
+                    ok = 0;
+                    break;
+                }
+                in_num = 0;
+                sign = 1;
+                mag = 0;
+
+                if (c == '#') in_comment = 1;
+            }
+        }
+    }
+
+    free(buf);
+    fclose(fp);
+    if (!ok) {
+        free(arr);
+        return 0;
+    }
+
+    *out_arr = arr;
+    *out_len = len;
+    return 1;
+}
+
+// int keys: read_i64_file limited to INT32_MIN..INT32_MAX
+static int read_int_file(const char *path, int **out_arr, size_t *out_len) {
+    int64_t *wide = NULL;
+    size_t n = 0;
+    if (!read_i64_file(path, INT32_MIN, INT32_MAX, &wide, &n)) return 0;
+    int *arr = (int*)malloc(sizeof(int) * (n ? n : 1));
+    if (!arr) {
+        fprintf(stderr, "Error: malloc failed while reading '%s'\n", path);
+        free(wide);
+        return 0;
+    }
+    for (size_t i = 0; i < n; ++i) arr[i] = (int)wide[i];
+    free(wide);
+    *out_arr = arr;
+    *out_len = n;
+    return 1;
+}
+
+// --key-type str: whitespace-separated words, '#' starting a comment, each
+// stored zero-padded in width bytes; a longer word is an error
+static int read_str_file(const char *path, size_t width, unsigned char **out_keys, size_t *out_len) {
+    FILE *fp = fopen(path, "rb");
+    if (!fp) {
+        fprintf(stderr, "Error: cannot open '%s': %s\n", path, strerror(errno));
+        return 0;
+    }
+
+    unsigned char *keys = NULL;
+    size_t len = 0, cap = 0, wlen = 0;
+    int in_word = 0, in_comment = 0, ok = 1;
+
+    for (int c = fgetc(fp); ok; c = fgetc(fp)) {
+        int space = (c == EOF || c == ' ' || c == '\t' || c == '\n' || c == '\r');
+        if (in_comment) {
+            if (c == '\n' || c == '\r') in_comment = 0;
+        } else if (!in_word && c == '#') {
+            in_comment = 1;
+        } else if (!space) {
+            if (!in_word) {
+                if (len == cap) {
+                    size_t ncap = (cap == 0) ? 1024 : cap * 2;
+                    unsigned char *tmp = (unsigned char*)realloc(keys, ncap * width);
+                    if (!tmp) {
                         fprintf(stderr, "Error: realloc failed while reading '%s'\n", path);
-                        free(arr);
-                        free(buf);
-                        fclose(fp);
-                        return 0;
+                        ok = 0;
+                        break;
                     }
-                    in_num = 0;
-                    sign = 1;
-                    val = 0;
-
-                    if (c == '#') in_comment = 1;
+                    keys = tmp;
+                    cap = ncap;
                 }
+                memset(keys + len * width, 0, width);
+                in_word = 1;
+                wlen = 0;
+            }
+            if (wlen == width) {
+                fprintf(stderr, "Error: word longer than --key-width %zu in '%s'\n", width, path);
+                ok = 0;
+                break;
             }
+            keys[len * width + wlen++] = (unsigned char)c;
+        } else if (in_word) {
+            in_word = 0;
+            len++;
         }
+        if (c == EOF) break;
     }
 
-    // finalize last number if file ended while parsing
-    if (in_num) {
-        long long x = (long long)sign * val;
-        if (x < (long long)INT32_MIN || x > (long long)INT32_MAX) {
-            fprintf(stderr, "Error: integer out of range in '%s'\n", path);
-            free(arr);
-            free(buf);
-            fclose(fp);
-            return 0;
+    fclose(fp);
+    if (!ok) {
+        free(keys);
+        return 0;
+    }
+    *out_keys = keys;
+    *out_len = len;
+    return 1;
+}
+
+// -------------------- Runs --------------------
+
+// the options every run reads
+typedef struct Config {
+    const char *tag;
+    int rounds;
+    uint64_t seed;
+    int freeze;
+    const char *mmap_path;
+    int use_static;
+    int shards;
+    int buffer;
+    const char *adaptive;
+    NodeStoreKind adapt_read, adapt_write;
+    int finger;
+    int value_size;
+    const char *load;
+    double fill;
+    size_t batch;
+    unsigned batch_flags;
+    int delete_batch;
+    int workers;
+    int threads;
+    const Workload *workload;   // NULL: no mixed phase
+    size_t n_ops;               // 0: one per search key
+    double theta;
+    int stats;
+} Config;
+
+// one testcase, read once for every impl and M
+typedef struct Case {
+    const char *name;
+    int *ins, *qry, *del;
+    size_t n_ins, n_qry, n_del;
+    int *ins_sorted;            // --load bulk
+    size_t n_keys;              // distinct insert keys
+    uint8_t *hit;               // --batch
+    OpStream ops;               // the mixed phase
+} Case;
+
+typedef struct Result {
+    const char *tag;
+    const char *case_name;
+    char impl[64];
+    int m;
+    int round;
+    size_t n_insert, n_search, n_delete, n_keys;
+    PhaseStat insert, search, del, mixed;
+    int found;
+    int height_insert, height_delete;
+    int64_t rss_bytes, peak_rss_bytes;
+    uint64_t freeze_ns, frozen_search_ns;
+    const char *workload;
+    int threads;
+    size_t mixed_ops;
+    uint64_t save_ns, open_ns, mapped_search_ns;
+    int64_t tree_bytes;         // --stats, after the inserts; -1 without
+    double leaf_fill, search_path;
+    int counted;                // --stats in a BPTREE_STATS build: counters of the run
+    BPTreeCounters counters;
+} Result;
+
+static void result_init(Result *r, const Config *c, const Case *k, int m, int round) {
+    memset(r, 0, sizeof *r);
+    r->tag = c->tag;
+    r->case_name = k->name;
+    r->m = m;
+    r->round = round;
+    r->n_insert = k->n_ins;
+    r->n_search = k->n_qry;
+    r->n_delete = k->n_del;
+    r->n_keys = k->n_keys;
+    phase_none(&r->insert);
+    phase_none(&r->search);
+    phase_none(&r->del);
+    phase_none(&r->mixed);
+    r->rss_bytes = r->peak_rss_bytes = -1;
+    r->tree_bytes = -1;
+    r->leaf_fill = r->search_path = -1;
+    r->workload = "";
+}
+
+// appends "-kvB" / "-finger" to the impl label
+static void result_suffixes(Result *r, const Config *c) {
+    size_t len = strlen(r->impl);
+    if (c->value_size > 0) {
+        snprintf(r->impl + len, sizeof r->impl - len, "-kv%d", c->value_size);
+        len = strlen(r->impl);
+    }
+    if (c->finger) snprintf(r->impl + len, sizeof r->impl - len, "-finger");
+}
+
+// the mixed phase of a run, if the config has one
+static void run_mixed_phase(const Config *c, const Case *k, Bench *b, const Target *x, Result *res) {
+    if (!c->workload) return;
+    res->workload = c->workload->name;
+    res->threads = c->threads > 0 ? c->threads : 1;
+    res->mixed_ops = k->ops.n;
+    if (!run_mixed(b, x, &k->ops, c->threads, &res->mixed)) {
+        fprintf(stderr, "Warning: could not start %d threads\n", c->threads);
+    }
+}
+
+static BPTree *create_tree(const Config *c, NodeStoreKind impl, int m) {
+    return c->threads > 0 ? bptree_create_concurrent(m, impl)
+         : c->buffer > 0  ? bptree_create_buffered(m, impl, c->buffer)
+         : c->use_static  ? bptree_create_static(m, impl)
+         : c->adaptive    ? bptree_create_adaptive(m, impl, c->adapt_read, c->adapt_write)
+         : bptree_create(m, nodestore_get_ops(impl));
+}
+
+// the phases on one B+ tree; 0 if it could not be created
+static int run_tree(const Config *c, const Case *k, NodeStoreKind impl, int m, Bench *b, Result *res) {
+    int64_t base = mem_begin();
+    nodestore_set_seed(c->seed);
+    BPTree *t = create_tree(c, impl, m);
+    if (!t) {
+        fprintf(stderr, "Error: bptree_create failed\n");
+        return 0;
+    }
+
+    if (c->value_size > 0) bptree_set_value_size(t, (size_t)c->value_size);
+    if (c->finger) bptree_set_finger(t, 1);
+    bptree_stats_reset(t);
+
+    phase_begin(b);
+    if (k->ins_sorted) {
+        if (!bptree_bulk_load(t, k->ins_sorted, k->n_ins, c->fill)) fprintf(stderr, "Warning: bptree_bulk_load failed\n");
+    } else if (strcmp(c->load, "sorted") == 0) {
+        bptree_insert_sorted(t, k->ins, k->n_ins);
+    } else if (strcmp(c->load, "parallel") == 0) {
+        if (!bptree_bulk_load_parallel(t, k->ins, k->n_ins, c->fill, c->workers)) {
+            fprintf(stderr, "Warning: bptree_bulk_load_parallel failed\n");
         }
-        if (!push_int(&arr, &len, &cap, (int)x)) {
-            fprintf(stderr, "Error: realloc failed while reading '%s'\n", path);
-            free(arr);
-            free(buf);
-            fclose(fp);
-            return 0;
+    } else if (strcmp(c->load, "batch") == 0) {
+        bptree_insert_batch(t, k->ins, k->n_ins, c->workers);
+    } else if (c->value_size > 0) {
+        unsigned char val[BENCH_VALUE_MAX];
+        BENCH_FOR(&b->s, i, k->n_ins, make_value(val, (size_t)c->value_size, k->ins[i]); bptree_upsert(t, k->ins[i], val));
+    } else {
+        BENCH_FOR(&b->s, i, k->n_ins, bptree_insert(t, k->ins[i]));
+    }
+    phase_end(b, &res->insert);
+    res->rss_bytes = mem_since("VmRSS:", base);
+    res->height_insert = bptree_height(t);
+    BPTreeStats st;
+    if (c->stats && bptree_stats(t, &st)) {
+        res->tree_bytes = (int64_t)st.bytes;
+        res->leaf_fill = st.level[st.height - 1].fill;
+    }
+
+    phase_begin(b);
+    int found = run_queries(t, k->qry, k->n_qry, c->batch, c->batch_flags, k->hit, &b->s);
+    phase_end(b, &res->search);
+    res->found = found;
+
+    // optional read-mostly phase: freeze, then repeat the queries on the frozen layout
+    Samples untimed = {0};
+    if (c->freeze) {
+        uint64_t f0 = now_ns();
+        if (!bptree_freeze(t)) fprintf(stderr, "Warning: bptree_freeze failed\n");
+        uint64_t f1 = now_ns();
+        int frozen_found = run_queries(t, k->qry, k->n_qry, c->batch, c->batch_flags, k->hit, &untimed);
+        uint64_t f2 = now_ns();
+        if (frozen_found != found) {
+            fprintf(stderr, "Warning: frozen search found %d keys, live search %d\n", frozen_found, found);
         }
+        res->freeze_ns = f1 - f0;
+        res->frozen_search_ns = f2 - f1;
     }
 
-    free(buf);
-    fclose(fp);
+    // optional persistence phase: save, map the file back, repeat the queries on it
+    if (c->mmap_path) {
+        uint64_t s0 = now_ns();
+        if (!bptree_save(t, c->mmap_path)) fprintf(stderr, "Warning: bptree_save to '%s' failed\n", c->mmap_path);
+        uint64_t s1 = now_ns();
+        BPTree *mt = bptree_open_mmap(c->mmap_path);
+        uint64_t s2 = now_ns();
+        if (mt) {
+            int mapped_found = run_queries(mt, k->qry, k->n_qry, c->batch, c->batch_flags, k->hit, &untimed);
+            uint64_t s3 = now_ns();
+            if (mapped_found != found) {
+                fprintf(stderr, "Warning: mapped search found %d keys, live search %d\n", mapped_found, found);
+            }
+            res->mapped_search_ns = s3 - s2;
+            bptree_destroy(mt);
+        } else {
+            fprintf(stderr, "Warning: bptree_open_mmap of '%s' failed\n", c->mmap_path);
+        }
+        res->save_ns = s1 - s0;
+        res->open_ns = s2 - s1;
+    }
 
-    *out_arr = arr;
-    *out_len = len;
+    Target x = {t, NULL, NULL, NULL, (size_t)c->value_size};
+    run_mixed_phase(c, k, b, &x, res);
+
+    phase_begin(b);
+    if (c->delete_batch) {
+        bptree_delete_batch(t, k->del, k->n_del, c->workers);
+    } else {
+        BENCH_FOR(&b->s, i, k->n_del, bptree_delete(t, k->del[i]));
+    }
+    bptree_flush(t); // buffered: the deferred work belongs to this phase
+    phase_end(b, &res->del);
+    res->height_delete = bptree_height(t);
+    res->peak_rss_bytes = mem_since("VmHWM:", base);
+
+    if (c->buffer > 0) snprintf(res->impl, sizeof res->impl, "buffered-%s", impl_name(impl));
+    else if (c->adaptive) snprintf(res->impl, sizeof res->impl, "adaptive-%s-%s-%s",
+                                   impl_name(impl), impl_name(c->adapt_read), impl_name(c->adapt_write));
+    else snprintf(res->impl, sizeof res->impl, "%s",
+                  (c->use_static || c->threads > 0) ? bptree_impl_name(t) : impl_name(impl));
+    result_suffixes(res, c);
+    if (c->stats && bptree_stats(t, &st) && st.counted) {
+        res->counted = 1;
+        res->counters = st.counters;
+    }
+
+    bptree_destroy(t);
+    return 1;
+}
+
+// the phases on a bptree_sharded.h front-end; 0 if it could not be created
+static int run_sharded(const Config *c, const Case *k, NodeStoreKind impl, int m, Bench *b, Result *res) {
+    int64_t base = mem_begin();
+    nodestore_set_seed(c->seed);
+    ShardedBPTree *st = bptree_sharded_create(m, impl, c->shards);
+    if (!st) {
+        fprintf(stderr, "Error: bptree_sharded_create failed\n");
+        return 0;
+    }
+
+    phase_begin(b);
+    BENCH_FOR(&b->s, i, k->n_ins, bptree_sharded_insert(st, k->ins[i]));
+    phase_end(b, &res->insert);
+    res->rss_bytes = mem_since("VmRSS:", base);
+    res->height_insert = bptree_sharded_height(st);
+
+    int found = 0;
+    phase_begin(b);
+    if (c->batch == 0) {
+        BENCH_FOR(&b->s, i, k->n_qry, found += bptree_sharded_search(st, k->qry[i]));
+    } else {
+        for (size_t i = 0; i < k->n_qry; i += c->batch) {
+            size_t n = (k->n_qry - i < c->batch) ? k->n_qry - i : c->batch;
+            bptree_sharded_search_batch(st, k->qry + i, n, k->hit);
+            for (size_t j = 0; j < n; ++j) found += k->hit[j];
+        }
+    }
+    phase_end(b, &res->search);
+    res->found = found;
+
+    Target x = {NULL, st, NULL, NULL, 0};
+    run_mixed_phase(c, k, b, &x, res);
+
+    phase_begin(b);
+    BENCH_FOR(&b->s, i, k->n_del, bptree_sharded_delete(st, k->del[i]));
+    phase_end(b, &res->del);
+    res->height_delete = bptree_sharded_height(st);
+    res->peak_rss_bytes = mem_since("VmHWM:", base);
+
+    snprintf(res->impl, sizeof res->impl, "sharded-%s", bptree_sharded_impl_name(st));
+    bptree_sharded_destroy(st);
+    return 1;
+}
+
+// the phases on skiplist.h or the lock-free skip list; height is its level
+static int run_skiplist(const Config *c, const Case *k, BenchKind kind, Bench *b, Result *res) {
+    int64_t base = mem_begin();
+    SkipList *sl = NULL;
+    ConcurrentSkipList *cs = NULL;
+    if (kind == BENCH_CSKIP) {
+        cs = cskiplist_create(BENCH_SKIP_MAX_LEVEL, 0.5);
+    } else {
+        SkipListOptions o = {kind == BENCH_SKIPLIST_ARENA, 0, c->seed, c->finger != 0};
+        sl = skiplist_create_ex(BENCH_SKIP_MAX_LEVEL, 0.5, &o);
+    }
+    if (!sl && !cs) {
+        fprintf(stderr, "Error: %s create failed\n", bench_kind_name(kind));
+        return 0;
+    }
+
+    phase_begin(b);
+    if (cs) {
+        BENCH_FOR(&b->s, i, k->n_ins, cskiplist_insert(cs, k->ins[i]));
+    } else {
+        BENCH_FOR(&b->s, i, k->n_ins, skiplist_insert(sl, k->ins[i]));
+    }
+    phase_end(b, &res->insert);
+    res->rss_bytes = mem_since("VmRSS:", base);
+    res->height_insert = cs ? cskiplist_level(cs) : sl->level;
+    if (c->stats && sl) {
+        SkipListStats st;
+        skiplist_stats(sl, &st);
+        res->tree_bytes = (int64_t)st.bytes;
+        res->search_path = st.avg_search_path;
+    }
+
+    int found = 0;
+    phase_begin(b);
+    if (cs) {
+        BENCH_FOR(&b->s, i, k->n_qry, found += cskiplist_search(cs, k->qry[i]));
+    } else {
+        BENCH_FOR(&b->s, i, k->n_qry, found += skiplist_search(sl, k->qry[i]));
+    }
+    phase_end(b, &res->search);
+    res->found = found;
+
+    Target x = {NULL, NULL, sl, cs, 0};
+    run_mixed_phase(c, k, b, &x, res);
+
+    phase_begin(b);
+    if (cs) {
+        BENCH_FOR(&b->s, i, k->n_del, cskiplist_erase(cs, k->del[i]));
+    } else {
+        BENCH_FOR(&b->s, i, k->n_del, skiplist_erase(sl, k->del[i]));
+    }
+    phase_end(b, &res->del);
+    res->height_delete = cs ? cskiplist_level(cs) : sl->level;
+    res->peak_rss_bytes = mem_since("VmHWM:", base);
+
+    snprintf(res->impl, sizeof res->impl, "%s", bench_kind_name(kind));
+    if (sl) result_suffixes(res, c);
+
+    skiplist_destroy(sl);
+    cskiplist_destroy(cs);
+    return 1;
+}
+
+// -------------------- Output --------------------
+//
+// CSV: a header line, then one line per run. JSON: one array with an object
+// per run. The same field list writes both, and the header.
+
+typedef struct Writer {
+    FILE *out;
+    int json;
+    int header;                 // writing the CSV header: names instead of values
+    int col;                    // fields so far in this row
+    size_t rows;
+} Writer;
+
+// starts a field; 0 while the header prints its name instead
+static int put_field(Writer *w, const char *name) {
+    if (w->col++) fputc(',', w->out);
+    if (w->header) {
+        fputs(name, w->out);
+        return 0;
+    }
+    if (w->json) fprintf(w->out, "\"%s\":", name);
+    return 1;
+}
+
+static void put_u64(Writer *w, const char *name, uint64_t v) {
+    if (put_field(w, name)) fprintf(w->out, "%" PRIu64, v);
+}
+
+// v < 0: not measured, an empty field / null
+static void put_opt(Writer *w, const char *name, int64_t v) {
+    if (!put_field(w, name)) return;
+    if (v >= 0) fprintf(w->out, "%" PRId64, v);
+    else if (w->json) fputs("null", w->out);
+}
+
+static void put_real(Writer *w, const char *name, double v) {
+    if (!put_field(w, name)) return;
+    if (v >= 0) fprintf(w->out, "%.2f", v);
+    else if (w->json) fputs("null", w->out);
+}
+
+static void put_str(Writer *w, const char *name, const char *s) {
+    if (!put_field(w, name)) return;
+    if (w->json) {
+        fputc('"', w->out);
+        for (const unsigned char *p = (const unsigned char*)s; *p; ++p) {
+            if (*p == '"' || *p == '\\') fprintf(w->out, "\\%c", *p);
+            else if (*p < 0x20) fprintf(w->out, "\\u%04x", *p);
+            else fputc(*p, w->out);
+        }
+        fputc('"', w->out);
+    } else if (strpbrk(s, ",\"\r\n")) {
+        fputc('"', w->out);
+        for (const char *p = s; *p; ++p) {
+            if (*p == '"') fputc('"', w->out);
+            fputc(*p, w->out);
+        }
+        fputc('"', w->out);
+    } else {
+        fputs(s, w->out);
+    }
+}
+
+static void put_quantiles(Writer *w, const char *phase, const PhaseStat *p) {
+    char name[32];
+    snprintf(name, sizeof name, "%s_p50_ns", phase);
+    put_opt(w, name, p->p50);
+    snprintf(name, sizeof name, "%s_p99_ns", phase);
+    put_opt(w, name, p->p99);
+    snprintf(name, sizeof name, "%s_p999_ns", phase);
+    put_opt(w, name, p->p999);
+}
+
+static void put_misses(Writer *w, const char *phase, const PhaseStat *p) {
+    char name[32];
+    snprintf(name, sizeof name, "%s_cache_misses", phase);
+    put_opt(w, name, p->misses[PERF_CACHE_MISSES]);
+    snprintf(name, sizeof name, "%s_branch_misses", phase);
+    put_opt(w, name, p->misses[PERF_BRANCH_MISSES]);
+}
+
+static void put_result(Writer *w, const Result *r) {
+    put_str(w, "tag", r->tag);
+    put_str(w, "case", r->case_name);
+    put_str(w, "impl", r->impl);
+    put_u64(w, "M", (uint64_t)r->m);
+    put_u64(w, "round", (uint64_t)r->round);
+    put_u64(w, "n_insert", r->n_insert);
+    put_u64(w, "n_search", r->n_search);
+    put_u64(w, "n_delete", r->n_delete);
+    put_u64(w, "n_keys", r->n_keys);
+    put_u64(w, "insert_ns", r->insert.ns);
+    put_u64(w, "search_ns", r->search.ns);
+    put_u64(w, "delete_ns", r->del.ns);
+    put_u64(w, "total_ns", r->insert.ns + r->search.ns + r->del.ns);
+    put_u64(w, "found_count", (uint64_t)r->found);
+    put_u64(w, "height_after_insert", (uint64_t)r->height_insert);
+    put_u64(w, "height_after_delete", (uint64_t)r->height_delete);
+    put_quantiles(w, "insert", &r->insert);
+    put_quantiles(w, "search", &r->search);
+    put_quantiles(w, "delete", &r->del);
+    put_misses(w, "insert", &r->insert);
+    put_misses(w, "search", &r->search);
+    put_misses(w, "delete", &r->del);
+    put_opt(w, "rss_bytes", r->rss_bytes);
+    put_real(w, "bytes_per_key", r->rss_bytes >= 0 && r->n_keys ? (double)r->rss_bytes / (double)r->n_keys : -1);
+    put_opt(w, "peak_rss_bytes", r->peak_rss_bytes);
+    put_u64(w, "freeze_ns", r->freeze_ns);
+    put_u64(w, "frozen_search_ns", r->frozen_search_ns);
+    put_str(w, "workload", r->workload);
+    put_u64(w, "threads", (uint64_t)r->threads);
+    put_u64(w, "mixed_ops", r->mixed_ops);
+    put_u64(w, "mixed_ns", r->mixed.ns);
+    put_quantiles(w, "mixed", &r->mixed);
+    put_misses(w, "mixed", &r->mixed);
+    put_u64(w, "save_ns", r->save_ns);
+    put_u64(w, "open_ns", r->open_ns);
+    put_u64(w, "mapped_search_ns", r->mapped_search_ns);
+    put_opt(w, "tree_bytes", r->tree_bytes);
+    put_real(w, "leaf_fill", r->leaf_fill);
+    put_real(w, "search_path", r->search_path);
+    const BPTreeCounters *n = &r->counters;
+    put_opt(w, "splits", r->counted ? (int64_t)(n->leaf_splits + n->internal_splits) : -1);
+    put_opt(w, "merges", r->counted ? (int64_t)(n->leaf_merges + n->internal_merges) : -1);
+    put_opt(w, "borrows", r->counted ? (int64_t)(n->leaf_borrows + n->internal_borrows) : -1);
+    put_opt(w, "sep_updates", r->counted ? (int64_t)n->sep_updates : -1);
+    put_opt(w, "descents", r->counted ? (int64_t)n->descents : -1);
+    put_opt(w, "node_visits", r->counted ? (int64_t)n->node_visits : -1);
+}
+
+static void writer_begin(Writer *w) {
+    if (w->json) {
+        fputs("[", w->out);
+        return;
+    }
+    Result none;
+    memset(&none, 0, sizeof none);
+    w->header = 1;
+    w->col = 0;
+    put_result(w, &none);
+    w->header = 0;
+    fputc('\n', w->out);
+}
+
+static void writer_row(Writer *w, const Result *r) {
+    w->col = 0;
+    if (w->json) fputs(w->rows ? ",\n  {" : "\n  {", w->out);
+    put_result(w, r);
+    fputs(w->json ? "}" : "\n", w->out);
+    w->rows++;
+    fflush(w->out);
+}
+
+static void writer_end(Writer *w) {
+    if (w->json) fputs("\n]\n", w->out);
+}
+
+// -------------------- Testcases --------------------
+
+// one testcase: DIR/ins.txt, DIR/q.txt and DIR/del.txt
+typedef struct CasePaths {
+    char name[4096];    // the directory, also for --insert/--search/--delete
+    char insert[4096], search[4096], del[4096];
+} CasePaths;
+
+static int case_paths(CasePaths *p, const char *dir) {
+    return snprintf(p->name, sizeof p->name, "%s", dir) < (int)sizeof p->name &&
+           snprintf(p->insert, sizeof p->insert, "%s/ins.txt", dir) < (int)sizeof p->insert &&
+           snprintf(p->search, sizeof p->search, "%s/q.txt", dir) < (int)sizeof p->search &&
+           snprintf(p->del, sizeof p->del, "%s/del.txt", dir) < (int)sizeof p->del;
+}
+
+static void case_free(Case *k) {
+    free(k->ins);
+    free(k->qry);
+    free(k->del);
+    free(k->ins_sorted);
+    free(k->hit);
+    free(k->ops.key);
+    free(k->ops.kind);
+    memset(k, 0, sizeof *k);
+}
+
+// reads a testcase and prepares what its runs share; 0 on failure
+static int case_load(Case *k, const CasePaths *p, const Config *c) {
+    memset(k, 0, sizeof *k);
+    k->name = p->name;
+    if (!read_int_file(p->insert, &k->ins, &k->n_ins) ||
+        !read_int_file(p->search, &k->qry, &k->n_qry) ||
+        !read_int_file(p->del, &k->del, &k->n_del)) {
+        case_free(k);
+        return 0;
+    }
+    if (k->n_ins == 0) fprintf(stderr, "Warning: insert file '%s' is empty.\n", p->insert);
+    if (k->n_qry == 0) fprintf(stderr, "Warning: search file '%s' is empty.\n", p->search);
+    if (k->n_del == 0) fprintf(stderr, "Warning: delete file '%s' is empty.\n", p->del);
+
+    // a sorted copy counts the distinct keys; --load bulk keeps it as ascending input
+    k->ins_sorted = (int*)malloc(sizeof(int) * (k->n_ins ? k->n_ins : 1));
+    k->hit = c->batch > 0 ? (uint8_t*)malloc(c->batch) : NULL;
+    size_t n_ops = c->n_ops ? c->n_ops : k->n_qry;
+    if (!k->ins_sorted || (c->batch > 0 && !k->hit) ||
+        (c->workload && !gen_ops(c->workload, k->ins, k->n_ins, k->qry, k->n_qry, n_ops, c->theta, c->seed, &k->ops))) {
+        fprintf(stderr, "Error: out of memory\n");
+        case_free(k);
+        return 0;
+    }
+    memcpy(k->ins_sorted, k->ins, sizeof(int) * k->n_ins);
+    qsort(k->ins_sorted, k->n_ins, sizeof(int), cmp_int);
+    for (size_t i = 0; i < k->n_ins; ++i) k->n_keys += (i == 0 || k->ins_sorted[i] != k->ins_sorted[i - 1]);
+    if (strcmp(c->load, "bulk") != 0) {
+        free(k->ins_sorted);
+        k->ins_sorted = NULL;
+    }
+    return 1;
+}
+
+// --key-type int64 | str: the three phases on a bptree_key.h tree for every M
+// and round of one testcase; impl is int64 or strW
+static int run_keyed(const char *key_type, size_t width, const int *ms, int nm, const Config *c,
+                     const CasePaths *p, Bench *b, Writer *w) {
+    int is_str = strcmp(key_type, "str") == 0;
+    void *ins = NULL, *qry = NULL, *del = NULL;
+    size_t n_ins = 0, n_qry = 0, n_del = 0;
+    int ok;
+    if (is_str) {
+        ok = read_str_file(p->insert, width, (unsigned char**)&ins, &n_ins) &&
+             read_str_file(p->search, width, (unsigned char**)&qry, &n_qry) &&
+             read_str_file(p->del, width, (unsigned char**)&del, &n_del);
+    } else {
+        width = sizeof(int64_t);
+        ok = read_i64_file(p->insert, INT64_MIN, INT64_MAX, (int64_t**)&ins, &n_ins) &&
+             read_i64_file(p->search, INT64_MIN, INT64_MAX, (int64_t**)&qry, &n_qry) &&
+             read_i64_file(p->del, INT64_MIN, INT64_MAX, (int64_t**)&del, &n_del);
+    }
+    if (!ok || !samples_reserve(&b->s, n_ins > n_qry ? (n_ins > n_del ? n_ins : n_del) : (n_qry > n_del ? n_qry : n_del))) {
+        free(ins); free(qry); free(del);
+        return 0;
+    }
+
+    Case k;
+    memset(&k, 0, sizeof k);
+    k.name = p->name;
+    k.n_ins = n_ins;
+    k.n_qry = n_qry;
+    k.n_del = n_del;
+
+    const unsigned char *ik = (const unsigned char*)ins, *qk = (const unsigned char*)qry;
+    const unsigned char *dk = (const unsigned char*)del;
+    const int64_t *i64 = (const int64_t*)ins, *q64 = (const int64_t*)qry, *d64 = (const int64_t*)del;
+    for (int mi = 0; mi < nm; ++mi) {
+        for (int r = 1; r <= c->rounds; ++r) {
+            Result res;
+            result_init(&res, c, &k, ms[mi], r);
+            int64_t base = mem_begin();
+            BPTree64 *t64 = is_str ? NULL : bptree64_create(ms[mi]);
+            BPTreeBytes *tb = is_str ? bptree_bytes_create(ms[mi], width, NULL) : NULL;
+            if (!t64 && !tb) {
+                fprintf(stderr, "Error: tree create failed\n");
+                free(ins); free(qry); free(del);
+                return 0;
+            }
+            int found = 0;
+
+            phase_begin(b);
+            if (t64) {
+                BENCH_FOR(&b->s, i, n_ins, bptree64_insert(t64, i64[i]));
+            } else {
+                BENCH_FOR(&b->s, i, n_ins, bptree_bytes_insert(tb, ik + i * width));
+            }
+            phase_end(b, &res.insert);
+            res.rss_bytes = mem_since("VmRSS:", base);
+            res.n_keys = t64 ? bptree64_size(t64) : bptree_bytes_size(tb);
+            res.height_insert = t64 ? bptree64_height(t64) : bptree_bytes_height(tb);
+
+            phase_begin(b);
+            if (t64) {
+                BENCH_FOR(&b->s, i, n_qry, found += bptree64_search(t64, q64[i]));
+            } else {
+                BENCH_FOR(&b->s, i, n_qry, found += bptree_bytes_search(tb, qk + i * width));
+            }
+            phase_end(b, &res.search);
+            res.found = found;
+
+            phase_begin(b);
+            if (t64) {
+                BENCH_FOR(&b->s, i, n_del, bptree64_delete(t64, d64[i]));
+            } else {
+                BENCH_FOR(&b->s, i, n_del, bptree_bytes_delete(tb, dk + i * width));
+            }
+            phase_end(b, &res.del);
+            res.height_delete = t64 ? bptree64_height(t64) : bptree_bytes_height(tb);
+            res.peak_rss_bytes = mem_since("VmHWM:", base);
+
+            if (is_str) snprintf(res.impl, sizeof res.impl, "str%zu", width);
+            else snprintf(res.impl, sizeof res.impl, "int64");
+            writer_row(w, &res);
+
+            bptree64_destroy(t64);
+            bptree_bytes_destroy(tb);
+        }
+    }
+
+    free(ins);
+    free(qry);
+    free(del);
     return 1;
 }
 
 int main(int argc, char **argv) {
-    int m = 0;
-    int rounds = 3;
-    NodeStoreKind impl = 0;
+    BenchImpl impls[BENCH_LIST_MAX];
+    int n_impl = 0;
+    int ms[BENCH_LIST_MAX];
+    int n_m = 0;
+    const char *case_dirs[BENCH_LIST_MAX];
+    int n_case = 0;
+    int bad_list = 0;
 
     const char *path_insert = NULL;
     const char *path_search = NULL;
     const char *path_delete = NULL;
 
-    const char *csv_path = NULL;
-    const char *tag = "";
+    const char *out_path = NULL;
+    const char *format = "csv";
+    size_t sample_every = BENCH_SAMPLE_EVERY;
+    int perf = 0;
+    int cskip = 0;
+    const char *key_type = "int";
+    int key_width = 16;
+    int read_pct = 90;
+    const char *workload = NULL;
+    const char *mix = NULL;
+    const char *dist = "file";
+    long long n_ops = 0;
+
+    Config c;
+    memset(&c, 0, sizeof c);
+    c.tag = "";
+    c.rounds = 3;
+    c.seed = 1;
+    c.load = "each";
+    c.fill = 1.0;
+    c.theta = 0.99;
 
     for (int i = 1; i < argc; ++i) {
         if (strcmp(argv[i], "--m") == 0 && i + 1 < argc) {
-            m = atoi(argv[++i]);
+            bad_list |= !parse_m_list(argv[++i], ms, &n_m);
         } else if (strcmp(argv[i], "--rounds") == 0 && i + 1 < argc) {
-            rounds = atoi(argv[++i]);
+            c.rounds = atoi(argv[++i]);
         } else if (strcmp(argv[i], "--impl") == 0 && i + 1 < argc) {
-            impl = parse_impl(argv[++i]);
+            bad_list |= !parse_impl_list(argv[++i], impls, &n_impl);
+        } else if (strcmp(argv[i], "--case") == 0 && i + 1 < argc) {
+            // split in place: argv strings are writable
+            for (char *s = argv[++i]; *s; ) {
+                size_t len = strcspn(s, ",");
+                int last = s[len] == '\0';
+                s[len] = '\0';
+                if (len == 0 || n_case == BENCH_LIST_MAX) bad_list = 1;
+                else case_dirs[n_case++] = s;
+                s += len + !last;
+            }
         } else if (strcmp(argv[i], "--insert") == 0 && i + 1 < argc) {
             path_insert = argv[++i];
         } else if (strcmp(argv[i], "--search") == 0 && i + 1 < argc) {
             path_search = argv[++i];
         } else if (strcmp(argv[i], "--delete") == 0 && i + 1 < argc) {
             path_delete = argv[++i];
-        } else if (strcmp(argv[i], "--csv") == 0 && i + 1 < argc) {
-            csv_path = argv[++i];
+        } else if ((strcmp(argv[i], "--out") == 0 || strcmp(argv[i], "--csv") == 0) && i + 1 < argc) {
+            out_path = argv[++i];
+        } else if (strcmp(argv[i], "--format") == 0 && i + 1 < argc) {
+            format = argv[++i];
         } else if (strcmp(argv[i], "--tag") == 0 && i + 1 < argc) {
-            tag = argv[++i];
+            c.tag = argv[++i];
+        } else if (strcmp(argv[i], "--sample") == 0 && i + 1 < argc) {
+            sample_every = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--perf") == 0) {
+            perf = 1;
+        } else if (strcmp(argv[i], "--stats") == 0) {
+            c.stats = 1;
+        } else if (strcmp(argv[i], "--workload") == 0 && i + 1 < argc) {
+            workload = argv[++i];
+        } else if (strcmp(argv[i], "--mix") == 0 && i + 1 < argc) {
+            mix = argv[++i];
+        } else if (strcmp(argv[i], "--dist") == 0 && i + 1 < argc) {
+            dist = argv[++i];
+        } else if (strcmp(argv[i], "--zipf-theta") == 0 && i + 1 < argc) {
+            c.theta = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--ops") == 0 && i + 1 < argc) {
+            n_ops = atoll(argv[++i]);
+        } else if (strcmp(argv[i], "--freeze") == 0) {
+            c.freeze = 1;
+        } else if (strcmp(argv[i], "--load") == 0 && i + 1 < argc) {
+            c.load = argv[++i];
+        } else if (strcmp(argv[i], "--fill") == 0 && i + 1 < argc) {
+            c.fill = atof(argv[++i]);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            c.batch = strtoull(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--batch-sort") == 0) {
+            c.batch_flags |= BPTREE_BATCH_SORT;
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            c.threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--delete-batch") == 0) {
+            c.delete_batch = 1;
+        } else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            c.workers = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--read-ratio") == 0 && i + 1 < argc) {
+            read_pct = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--static") == 0) {
+            c.use_static = 1;
+        } else if (strcmp(argv[i], "--buffer") == 0 && i + 1 < argc) {
+            c.buffer = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--adaptive") == 0 && i + 1 < argc) {
+            c.adaptive = argv[++i];
+        } else if (strcmp(argv[i], "--finger") == 0) {
+            c.finger = 1;
+        } else if (strcmp(argv[i], "--key-type") == 0 && i + 1 < argc) {
+            key_type = argv[++i];
+        } else if (strcmp(argv[i], "--key-width") == 0 && i + 1 < argc) {
+            key_width = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--value-size") == 0 && i + 1 < argc) {
+            c.value_size = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shards") == 0 && i + 1 < argc) {
+            c.shards = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--mmap") == 0 && i + 1 < argc) {
+            c.mmap_path = argv[++i];
+        } else if (strcmp(argv[i], "--cskip") == 0) {
+            cskip = 1;
+        } else if (strcmp(argv[i], "--seed") == 0 && i + 1 < argc) {
+            c.seed = strtoull(argv[++i], NULL, 10);
         } else if (strcmp(argv[i], "--help") == 0) {
             usage(argv[0]);
             return 0;
@@ -260,77 +1733,279 @@ int main(int argc, char **argv) {
         }
     }
 
-    if (m < 3 || rounds <= 0 || !impl || !path_insert || !path_search || !path_delete) {
-        usage(argv[0]);
+    if (bad_list) {
+        fprintf(stderr, "Error: bad --impl, --m or --case list (at most %d entries each)\n", BENCH_LIST_MAX);
         return 1;
     }
+    if (cskip) {
+        if (n_impl == BENCH_LIST_MAX) {
+            fprintf(stderr, "Error: too many --impl entries\n");
+            return 1;
+        }
+        impls[n_impl++] = (BenchImpl){BENCH_CSKIP, 0};
+    }
+    int has_tree = 0;
+    for (int i = 0; i < n_impl; ++i) has_tree |= impls[i].kind == BENCH_TREE;
 
-    const NodeStoreOps *ops = nodestore_get_ops(impl);
-    if (!ops) {
-        fprintf(stderr, "Error: nodestore_get_ops() does not support impl='%s'\n", impl_name(impl));
+    // the testcases: --case directories, or the three files as one
+    int explicit_files = path_insert || path_search || path_delete;
+    if (explicit_files && (!path_insert || !path_search || !path_delete || n_case > 0)) {
+        fprintf(stderr, "Error: give --insert, --search and --delete together, or --case instead\n");
         return 1;
     }
-
-    int *ins = NULL, *qry = NULL, *del = NULL;
-    size_t n_ins = 0, n_qry = 0, n_del = 0;
-
-    if (!read_int_file(path_insert, &ins, &n_ins)) return 1;
-    if (!read_int_file(path_search, &qry, &n_qry)) { free(ins); return 1; }
-    if (!read_int_file(path_delete, &del, &n_del)) { free(ins); free(qry); return 1; }
-
-    if (n_ins == 0) fprintf(stderr, "Warning: insert file '%s' is empty.\n", path_insert);
-    if (n_qry == 0) fprintf(stderr, "Warning: search file '%s' is empty.\n", path_search);
-    if (n_del == 0) fprintf(stderr, "Warning: delete file '%s' is empty.\n", path_delete);
-
-    FILE *out = stdout;
-    if (csv_path) {
-        out = fopen(csv_path, "w");
-        if (!out) {
-            fprintf(stderr, "Error: cannot open '%s' for write: %s\n", csv_path, strerror(errno));
-            free(ins); free(qry); free(del);
+    int n_paths = explicit_files ? 1 : n_case;
+    CasePaths *paths = (CasePaths*)malloc(sizeof(CasePaths) * (size_t)(n_paths ? n_paths : 1));
+    if (!paths) {
+        fprintf(stderr, "Error: out of memory\n");
+        return 1;
+    }
+    if (explicit_files) {
+        // label the row like --case would: the insert file's directory
+        snprintf(paths[0].name, sizeof paths[0].name, "%s", path_insert);
+        char *slash = strrchr(paths[0].name, '/');
+        if (slash) *slash = '\0';
+        else snprintf(paths[0].name, sizeof paths[0].name, ".");
+        snprintf(paths[0].insert, sizeof paths[0].insert, "%s", path_insert);
+        snprintf(paths[0].search, sizeof paths[0].search, "%s", path_search);
+        snprintf(paths[0].del, sizeof paths[0].del, "%s", path_delete);
+    }
+    for (int i = 0; i < n_case; ++i) {
+        if (!case_paths(&paths[i], case_dirs[i])) {
+            fprintf(stderr, "Error: testcase path '%s' is too long\n", case_dirs[i]);
+            free(paths);
             return 1;
         }
     }
 
-    fprintf(out, "tag,impl,M,n_insert,n_search,n_delete,round,insert_ns,search_ns,delete_ns,found_count,height_after_insert\n");
+    int keyed = strcmp(key_type, "int") != 0;
+    if (keyed && strcmp(key_type, "int64") != 0 && strcmp(key_type, "str") != 0) {
+        fprintf(stderr, "Error: unknown --key-type '%s'\n", key_type);
+        free(paths);
+        return 1;
+    }
+    if ((!keyed && n_impl == 0) || ((keyed || has_tree) && n_m == 0) || c.rounds <= 0 || n_paths == 0) {
+        usage(argv[0]);
+        free(paths);
+        return 1;
+    }
+    int json = strcmp(format, "json") == 0;
+    if (!json && strcmp(format, "csv") != 0) {
+        fprintf(stderr, "Error: unknown --format '%s'\n", format);
+        free(paths);
+        return 1;
+    }
 
-    uint64_t tottime = 0;
-    for (int r = 1; r <= rounds; ++r) {
-        BPTree *t = bptree_create(m, ops);
-        if (!t) {
-            fprintf(stderr, "Error: bptree_create failed\n");
-            free(ins); free(qry); free(del);
-            if (out != stdout) fclose(out);
+    // the mixed phase: a preset, a custom --mix, or --threads over the search keys
+    Workload custom = {"custom", read_pct, (100 - read_pct + 1) / 2, (100 - read_pct) / 2, DIST_FILE};
+    if (workload) {
+        for (size_t i = 0; i < sizeof workloads / sizeof workloads[0]; ++i) {
+            if (strcmp(workload, workloads[i].name) == 0) c.workload = &workloads[i];
+        }
+        if (!c.workload || mix) {
+            fprintf(stderr, "Error: unknown --workload '%s', or given with --mix\n", workload);
+            free(paths);
             return 1;
         }
+    } else if (mix || c.threads > 0) {
+        if (mix && (sscanf(mix, "%d:%d:%d", &custom.read, &custom.insert, &custom.del) != 3 ||
+                    custom.read < 0 || custom.insert < 0 || custom.del < 0 ||
+                    custom.read + custom.insert + custom.del != 100)) {
+            fprintf(stderr, "Error: --mix takes R:I:D percentages that add up to 100\n");
+            free(paths);
+            return 1;
+        }
+        if (strcmp(dist, "file") == 0) custom.dist = DIST_FILE;
+        else if (strcmp(dist, "uniform") == 0) custom.dist = DIST_UNIFORM;
+        else if (strcmp(dist, "zipf") == 0) custom.dist = DIST_ZIPF;
+        else if (strcmp(dist, "latest") == 0) custom.dist = DIST_LATEST;
+        else {
+            fprintf(stderr, "Error: unknown --dist '%s'\n", dist);
+            free(paths);
+            return 1;
+        }
+        c.workload = &custom;
+    }
+    if (!(c.theta > 0.0 && c.theta < 1.0) || n_ops < 0) {
+        fprintf(stderr, "Error: --zipf-theta takes a value in (0, 1) and --ops a count >= 0\n");
+        free(paths);
+        return 1;
+    }
+    c.n_ops = (size_t)n_ops;
 
-        uint64_t t0 = now_ns();
-        for (size_t i = 0; i < n_ins; ++i) bptree_insert(t, ins[i]);
-        uint64_t t1 = now_ns();
-
-        int found = 0;
-        for (size_t i = 0; i < n_qry; ++i) found += bptree_search(t, qry[i]);
-        uint64_t t2 = now_ns();
+    if (keyed) {
+        if (n_impl || c.shards || c.buffer > 0 || c.adaptive || c.finger || c.threads > 0 || c.freeze ||
+            c.use_static || c.batch > 0 || c.value_size > 0 || c.mmap_path || strcmp(c.load, "each") != 0 ||
+            c.delete_batch || c.workload || c.stats || key_width <= 0) {
+            fprintf(stderr, "Error: --key-type %s takes only --m, --rounds, --out, --format, --tag, --sample,\n"
+                            "--perf and --key-width > 0\n", key_type);
+            free(paths);
+            return 1;
+        }
+    }
+    if (strcmp(c.load, "each") != 0 && strcmp(c.load, "sorted") != 0 && strcmp(c.load, "bulk") != 0 &&
+        strcmp(c.load, "parallel") != 0 && strcmp(c.load, "batch") != 0) {
+        fprintf(stderr, "Error: unknown --load mode '%s'\n", c.load);
+        free(paths);
+        return 1;
+    }
+    if (c.threads < 0 || c.workers < 0 || read_pct < 0 || read_pct > 100) {
+        usage(argv[0]);
+        free(paths);
+        return 1;
+    }
+    for (int i = 0; i < n_impl; ++i) {
+        BenchKind kind = impls[i].kind;
+        if (kind == BENCH_TREE) continue;
+        if (c.freeze || c.use_static || c.batch > 0 || c.delete_batch || strcmp(c.load, "each") != 0 ||
+            c.shards || c.buffer > 0 || c.adaptive || c.value_size > 0 || c.mmap_path) {
+            fprintf(stderr, "Error: %s takes only --load each, without --freeze, --static, --batch, --delete-batch,\n"
+                            "--shards, --buffer, --adaptive, --value-size or --mmap\n", bench_kind_name(kind));
+            free(paths);
+            return 1;
+        }
+        if ((kind == BENCH_CSKIP && c.finger) || (kind != BENCH_CSKIP && c.threads > 0)) {
+            fprintf(stderr, "Error: --finger is for skiplist.h and --threads for cskip, not for %s\n",
+                    bench_kind_name(kind));
+            free(paths);
+            return 1;
+        }
+    }
+    if (c.shards < 0 || (c.shards > 0 && (c.freeze || c.use_static || c.delete_batch || strcmp(c.load, "each") != 0))) {
+        fprintf(stderr, "Error: --shards takes only --load each, without --cskip, --freeze, --static or --delete-batch\n");
+        free(paths);
+        return 1;
+    }
+    if (c.buffer < 0 || (c.buffer > 0 && (c.shards || c.threads > 0 || c.use_static))) {
+        fprintf(stderr, "Error: --buffer does not combine with --cskip, --shards, --threads or --static\n");
+        free(paths);
+        return 1;
+    }
+    if (c.value_size < 0 || c.value_size > BENCH_VALUE_MAX ||
+        (c.value_size > 0 && (c.shards || c.buffer > 0 ||
+                              (c.threads > 0 && (size_t)c.value_size > BPTREE_VALUE_INLINE_MAX)))) {
+        fprintf(stderr, "Error: --value-size takes 1..%d bytes, not with --cskip, --shards or --buffer;"
+                        " with --threads at most %d\n", BENCH_VALUE_MAX, (int)BPTREE_VALUE_INLINE_MAX);
+        free(paths);
+        return 1;
+    }
+    if (c.finger && has_tree && (c.shards || c.buffer > 0 || c.threads > 0)) {
+        fprintf(stderr, "Error: --finger does not combine with --cskip, --shards, --buffer or --threads\n");
+        free(paths);
+        return 1;
+    }
+    if (c.mmap_path && c.shards) {
+        fprintf(stderr, "Error: --mmap needs a single tree, not --cskip or --shards\n");
+        free(paths);
+        return 1;
+    }
+    if (c.threads > 0 && c.freeze) {
+        fprintf(stderr, "Error: --freeze is not available on the concurrent tree (--threads)\n");
+        free(paths);
+        return 1;
+    }
+    if (c.adaptive) {
+        char rd[16] = "", wr[16] = "";
+        const char *comma = strchr(c.adaptive, ',');
+        if (comma && (size_t)(comma - c.adaptive) < sizeof rd && strlen(comma + 1) < sizeof wr) {
+            memcpy(rd, c.adaptive, (size_t)(comma - c.adaptive));
+            strcpy(wr, comma + 1);
+        }
+        c.adapt_read = parse_impl(rd);
+        c.adapt_write = parse_impl(wr);
+        if (!c.adapt_read || !c.adapt_write || c.shards || c.buffer > 0 || c.threads > 0 || c.use_static) {
+            fprintf(stderr, "Error: --adaptive takes two kinds R,W other than inline, with an --impl other than\n"
+                            "inline, and not with --cskip, --shards, --buffer, --threads or --static\n");
+            free(paths);
+            return 1;
+        }
+    }
+    // every impl x M a tree run needs, built once before any input is read
+    for (int i = 0; i < n_impl; ++i) {
+        if (impls[i].kind != BENCH_TREE) continue;
+        for (int j = 0; j < n_m && !c.shards; ++j) {
+            BPTree *probe = create_tree(&c, impls[i].store, ms[j]);
+            if (!probe) {
+                const char *what = c.threads > 0 ? "--threads needs an array-layout impl (array | inline | simd)"
+                                 : c.buffer > 0  ? "--buffer needs a list or skip impl"
+                                 : c.use_static  ? "no static specialization"
+                                 : c.adaptive    ? "--adaptive takes two kinds R,W other than inline, with an --impl other than inline"
+                                 : "nodestore_get_ops() does not support this impl";
+                fprintf(stderr, "Error: %s; impl='%s', M=%d\n", what, impl_name(impls[i].store), ms[j]);
+                free(paths);
+                return 1;
+            }
+            bptree_destroy(probe);
+        }
+    }
 
-        for (size_t i = 0; i < n_del; ++i) bptree_delete(t, del[i]);
-        uint64_t t3 = now_ns();
+    Writer w;
+    memset(&w, 0, sizeof w);
+    w.out = stdout;
+    w.json = json;
+    if (out_path) {
+        w.out = fopen(out_path, "w");
+        if (!w.out) {
+            fprintf(stderr, "Error: cannot open '%s' for write: %s\n", out_path, strerror(errno));
+            free(paths);
+            return 1;
+        }
+    }
 
-        int h = bptree_height(t);
+    Bench b;
+    memset(&b, 0, sizeof b);
+    b.s.every = sample_every;
+    calibrate_clock();
+    if (perf && !perf_open(&b.perf)) {
+        fprintf(stderr, "Warning: perf_event_open failed (%s); the miss columns stay empty\n", strerror(errno));
+    }
 
-        fprintf(out, "%s,%s,%d,%zu,%zu,%zu,%d,%llu,%llu,%llu,%d,%d,total time=%llu\n",
-                tag, impl_name(impl), m, n_ins, n_qry, n_del, r,
-                (t1 - t0), (t2 - t1), (t3 - t2), found, h, (t3 - t0));
+    writer_begin(&w);
+    int status = 0;
+    for (int p = 0; p < n_paths && !status; ++p) {
+        if (keyed) {
+            if (!run_keyed(key_type, (size_t)key_width, ms, n_m, &c, &paths[p], &b, &w)) status = 1;
+            continue;
+        }
 
-        tottime += (t3 - t0);
+        Case k;
+        if (!case_load(&k, &paths[p], &c)) {
+            status = 1;
+            break;
+        }
+        size_t most = k.n_ins > k.n_qry ? k.n_ins : k.n_qry;
+        if (k.n_del > most) most = k.n_del;
+        if (k.ops.n > most) most = k.ops.n;
+        if (!samples_reserve(&b.s, most)) {
+            fprintf(stderr, "Error: out of memory\n");
+            case_free(&k);
+            status = 1;
+            break;
+        }
 
-        bptree_destroy(t);
+        for (int i = 0; i < n_impl && !status; ++i) {
+            int skip = impls[i].kind != BENCH_TREE;
+            for (int j = 0; j < (skip ? 1 : n_m) && !status; ++j) {
+                for (int r = 1; r <= c.rounds; ++r) {
+                    Result res;
+                    result_init(&res, &c, &k, skip ? 0 : ms[j], r);
+                    int ok = skip     ? run_skiplist(&c, &k, impls[i].kind, &b, &res)
+                           : c.shards ? run_sharded(&c, &k, impls[i].store, ms[j], &b, &res)
+                           : run_tree(&c, &k, impls[i].store, ms[j], &b, &res);
+                    if (!ok) {
+                        status = 1;
+                        break;
+                    }
+                    writer_row(&w, &res);
+                }
+            }
+        }
+        case_free(&k);
     }
+    writer_end(&w);
 
-    fprintf(out, "total time for all rounds: %llu ns\n", tottime);
-
-    if (out != stdout) fclose(out);
-    free(ins);
-    free(qry);
-    free(del);
-    return 0;
+    perf_close(&b.perf);
+    free(b.s.ns);
+    if (w.out != stdout) fclose(w.out);
+    free(paths);
+    return status;
 }
@@ -1,586 +1,575 @@
 // bptree.c  (B+ Tree, Scheme A: parent key[i] = min(child[i+1]) copy-key semantics)
-#include "bptree.h"
+//
+// Public API plus the generic instantiation of bptree_impl.h, where every
+// store access goes through the NodeStoreOps table of the node's store.
+#include "bptree_internal.h"
+#include "epoch.h"
 #include <assert.h>
 #include <stdlib.h>
+#include <string.h>
+
+#define NS_SIZE(t, x)                  ((void)(t), (x)->ops->size((x)->store))
+#define NS_KEY_AT(t, x, i)             ((void)(t), (x)->ops->key_at((x)->store, (i)))
+#define NS_VAL_AT(t, x, i)             ((void)(t), (x)->ops->val_at((x)->store, (i)))
+#define NS_SET_VAL(t, x, i, v)         ((void)(t), (x)->ops->set_val((x)->store, (i), (v)))
+#define NS_SET_KEY(t, x, i, k)         ((void)(t), (x)->ops->set_key((x)->store, (i), (k)))
+#define NS_LOWER_BOUND(t, x, k)        ((void)(t), (x)->ops->lower_bound((x)->store, (k)))
+#define NS_INSERT_AT(t, x, i, k, v)    ((void)(t), (x)->ops->insert_at((x)->store, (i), (k), (v)))
+#define NS_ERASE_AT(t, x, i)           ((void)(t), (x)->ops->erase_at((x)->store, (i)))
+#define NS_CLEAR(t, x)                 ((void)(t), (x)->ops->clear((x)->store))
+#define NS_APPEND_FROM(t, x, y, i)     ((void)(t), (x)->ops->append_from((x)->store, (y)->store, (i)))
+#define NS_KEY_DATA(t, x) \
+    ((void)(t), (x)->ops->key_data ? (x)->ops->key_data((x)->store) : (const int*)0)
+#define NS_VAL_DATA(t, x) \
+    ((void)(t), (x)->ops->val_data ? (x)->ops->val_data((x)->store) : (void* const*)0)
+#define NS_PREFETCH(t, x) \
+    do { (void)(t); if ((x)->ops->prefetch) (x)->ops->prefetch((x)->store); } while (0)
+
+#define BPTREE_IMPL_NAME  bptree_generic_impl
+#define BPTREE_IMPL_LABEL "generic"
+#define BPTREE_IMPL_ADAPTIVE 1
+#include "bptree_impl.h"
+
+// -------------------- Frozen (Eytzinger) snapshot --------------------
+
+#define FROZEN_PREFETCH_STRIDE 16   // 16 ints = one cache line = four levels ahead
+
+// in-order walk of the implicit tree rooted at k, filling it from the sorted keys
+static void eytzinger_fill(const int* sorted, size_t* next, int* out, size_t k, size_t n) {
+    if (k > n) return;
+    eytzinger_fill(sorted, next, out, 2 * k, n);
+    out[k] = sorted[(*next)++];
+    eytzinger_fill(sorted, next, out, 2 * k + 1, n);
+}
+
+static int frozen_search(const BPTree* t, int key) {
+    const int* b = t->frozen;
+    size_t n = t->frozen_n;
+    size_t k = 1;
+    while (k <= n) {
+        __builtin_prefetch(b + k * FROZEN_PREFETCH_STRIDE);
+        k = 2 * k + (size_t)(b[k] < key);
+    }
+    // strip the trailing right-turns plus one: k is the first slot with b[k] >= key
+    k >>= __builtin_ffsll((long long)~k);
+    return k != 0 && b[k] == key;
+}
 
-typedef struct BPTreeNode {
-    int is_leaf;
-    int max_keys;
-    struct BPTreeNode* parent;
-    struct BPTreeNode* next;    // leaf chain
-    struct BPTreeNode* child0;  // internal: leftmost child
-    NodeStore* store;           // internal: key[i], val[i]=child[i+1]; leaf: key[i], val unused
-} BPTreeNode;
-
-struct BPTree {
-    int order_M;                // M (max children)
-    int max_keys;               // M-1
-    const NodeStoreOps* ops;
-    BPTreeNode* root;
-};
-
-// -------------------- Node helpers --------------------
+// -------------------- Public API --------------------
 
-static BPTreeNode* node_create(BPTree* t, int is_leaf) {
-    BPTreeNode* x = (BPTreeNode*)calloc(1, sizeof(BPTreeNode));
-    assert(x);
-    x->is_leaf = is_leaf;
-    x->max_keys = t->max_keys;
-    x->parent = 0;
-    x->next = 0;
-    x->child0 = 0;
-    x->store = t->ops->create(t->max_keys + 1); // allow overflow then split
-    assert(x->store);
-    return x;
-}
+static BPTree* tree_create(int order_M, const NodeStoreOps* ops, const BPTreeImpl* impl) {
+    if (order_M < 3) order_M = 3;
 
-static void node_destroy(BPTree* t, BPTreeNode* x) {
-    if (!x) return;
-    t->ops->destroy(x->store);
-    free(x);
-}
+    BPTree* t = (BPTree*)calloc(1, sizeof(BPTree));
+    assert(t);
 
-static int node_keys(const BPTree* t, const BPTreeNode* x) {
-    (void)t;
-    return t->ops->size(x->store);
-}
+    t->order_M = order_M;
+    t->max_keys = order_M - 1;
+    t->ops = ops;
+    t->leaf_ops = ops;
+    t->impl = impl;
 
-static int node_overflow(const BPTree* t, const BPTreeNode* x) {
-    return node_keys(t, x) > x->max_keys;
-}
+    if (ops->footprint && ops->init) {
+        size_t bytes = bptree_node_header_bytes() + ops->footprint(t->max_keys + 1);
+        t->node_bytes = (bytes + BPTREE_CACHE_LINE - 1) & ~(size_t)(BPTREE_CACHE_LINE - 1);
+    }
 
-static int min_leaf_keys(const BPTree* t) {
-    // ceil((M-1)/2) = ceil(max_keys/2)
-    return (t->max_keys + 1) / 2;
+    bptree_pool_init(t);
+    t->root = node_create(t, 1);
+    return t;
 }
 
-static int min_internal_keys(const BPTree* t) {
-    // ceil(M/2) - 1
-    int min_children = (t->order_M + 1) / 2; // ceil(M/2)
-    return min_children - 1;
+BPTree* bptree_create(int order_M, const NodeStoreOps* ops) {
+    if (!ops) ops = nodestore_get_ops(NODESTORE_ARRAY);
+    return tree_create(order_M, ops, &bptree_generic_impl);
+}
+
+BPTree* bptree_create_adaptive(int order_M, NodeStoreKind internal_kind,
+                               NodeStoreKind read_kind, NodeStoreKind write_kind) {
+    const NodeStoreOps* ops = nodestore_get_ops(internal_kind);
+    const NodeStoreOps* rd = nodestore_get_ops(read_kind);
+    const NodeStoreOps* wr = nodestore_get_ops(write_kind);
+    if (!ops || !rd || !wr) return 0;
+    if (ops->init || rd->init || wr->init) return 0; // node_bytes fixes one kind per tree
+
+    BPTree* t = tree_create(order_M, ops, &bptree_generic_impl);
+    t->adaptive = 1;
+    t->adapt_read = rd;
+    t->adapt_write = wr;
+    t->leaf_ops = wr; // a new leaf fills up by inserts
+    node_convert(t, t->root, wr);
+    return t;
 }
 
-static int store_set_key(const BPTree* t, NodeStore* s, int idx, int new_key) {
-    int n = t->ops->size(s);
-    if (idx < 0 || idx >= n) return 0;
-    void* v = t->ops->val_at(s, idx);
-    t->ops->erase_at(s, idx);
-    t->ops->insert_at(s, idx, new_key, v);
-    return 1;
+int bptree_is_adaptive(const BPTree* t) {
+    return t && t->adaptive;
 }
 
-static BPTreeNode* parent_child_at(const BPTree* t, const BPTreeNode* parent, int child_index) {
-    // child_index in [0..nchildren-1], where nchildren = nkeys+1
-    if (child_index == 0) return parent->child0;
-    return (BPTreeNode*)t->ops->val_at(parent->store, child_index - 1);
+BPTree* bptree_create_static(int order_M, NodeStoreKind kind) {
+    const BPTreeImpl* impl;
+    switch (kind) {
+        case NODESTORE_ARRAY:      impl = &bptree_array_impl;  break;
+        case NODESTORE_ARRAY_SIMD: impl = &bptree_simd_impl;   break;
+        case NODESTORE_INLINE:     impl = &bptree_inline_impl; break;
+        default: return 0;  // no specialization for this store
+    }
+    return tree_create(order_M, nodestore_get_ops(kind), impl);
 }
 
-static int parent_child_index(const BPTree* t, const BPTreeNode* parent, const BPTreeNode* child) {
-    // return j such that parent_child_at(parent,j)==child, j in [0..n]
-    if (parent->child0 == child) return 0;
-    int n = t->ops->size(parent->store);
-    for (int i = 0; i < n; ++i) {
-        if ((BPTreeNode*)t->ops->val_at(parent->store, i) == child) return i + 1;
+BPTree* bptree_create_concurrent(int order_M, NodeStoreKind kind) {
+    BPTree* t = bptree_create_static(order_M, kind); // exactly the array-layout stores
+    if (!t) return 0;
+    if (!bptree_olc_init(t)) {
+        bptree_destroy(t);
+        return 0;
     }
-    return -1;
+    return t;
 }
 
-// minimal key in subtree rooted at x (descend child0 until leaf)
-static int subtree_first_key(const BPTree* t, const BPTreeNode* x) {
-    const BPTreeNode* cur = x;
-    while (cur && !cur->is_leaf) cur = cur->child0;
-    assert(cur);
-    assert(t->ops->size(cur->store) > 0);
-    return t->ops->key_at(cur->store, 0);
+int bptree_is_concurrent(const BPTree* t) {
+    return t && t->concurrent;
 }
 
-// parent separator update: if x is parent's child j>0, then parent.key[j-1]=min(x)
-static void update_parent_sep_if_needed(BPTree* t, BPTreeNode* x) {
-    if (!x || !x->parent) return;
-    int nmin;
-    // x may be temporarily empty during delete; skip if no keys
-    if (x->is_leaf) {
-        if (t->ops->size(x->store) <= 0) return;
-        nmin = t->ops->key_at(x->store, 0);
-    } else {
-        // internal: need subtree min (may assert if subtree empty)
-        // if its leftmost leaf empty, tree is already broken; assume rebalance will prevent that
-        nmin = subtree_first_key(t, x);
-    }
+BPTree* bptree_create_buffered(int order_M, NodeStoreKind kind, int buffer_msgs) {
+    // array-backed stores rebalance with a memmove: buffering only adds work
+    if (kind != NODESTORE_LINKED && kind != NODESTORE_SKIPLIST) return 0;
+    BPTree* t = bptree_create(order_M, nodestore_get_ops(kind));
+    t->buffered = 1;
+    t->buffer_msgs = buffer_msgs > 0 ? buffer_msgs : BPTREE_BUFFER_DEFAULT;
 
-    BPTreeNode* p = x->parent;
-    int idx = parent_child_index(t, p, x);
-    if (idx > 0) {
-        store_set_key(t, p->store, idx - 1, nmin);
+    // a flush takes at most buffer_msgs + 1 messages, unless a merge of two
+    // buffered nodes piled up more (bptree_impl.h flush_reserve grows it then)
+    t->flush_cap = t->max_keys + t->buffer_msgs + 1;
+    t->flush_msgs = (BPTreeMsg*)malloc(sizeof(BPTreeMsg) * (size_t)t->flush_cap);
+    t->flush_keys = (int*)malloc(sizeof(int) * (size_t)t->flush_cap);
+    if (!t->flush_msgs || !t->flush_keys) {
+        bptree_destroy(t);
+        return 0;
     }
+    return t;
 }
 
-// -------------------- Search helpers --------------------
-
-// B+ tree descent uses upper_bound semantics (equal goes right)
-static BPTreeNode* find_leaf(const BPTree* t, int key) {
-    BPTreeNode* x = t->root;
-    while (x && !x->is_leaf) {
-        int n = t->ops->size(x->store);
-        int idx = t->ops->lower_bound(x->store, key); // first >= key
-        if (idx < n && t->ops->key_at(x->store, idx) == key) idx++; // make it upper_bound
-        if (idx == 0) x = x->child0;
-        else x = (BPTreeNode*)t->ops->val_at(x->store, idx - 1);
-    }
-    return x;
+int bptree_is_buffered(const BPTree* t) {
+    return t && t->buffered;
 }
 
-static int leaf_find(const BPTree* t, const BPTreeNode* leaf, int key, int* out_idx) {
-    int n = t->ops->size(leaf->store);
-    int idx = t->ops->lower_bound(leaf->store, key);
-    if (out_idx) *out_idx = idx;
-    if (idx < n && t->ops->key_at(leaf->store, idx) == key) return 1;
-    return 0;
+void bptree_flush(BPTree* t) {
+    if (t && t->buffered) t->impl->flush(t);
 }
 
-// -------------------- Insert: split / insert_into_parent --------------------
-
-static void insert_into_parent(BPTree* t, BPTreeNode* left, int sep_key, BPTreeNode* right);
-
-static void split_leaf(BPTree* t, BPTreeNode* leaf) {
-    int total = t->ops->size(leaf->store);
-    assert(total == t->max_keys + 1);
-
-    // typical B+ leaf split: left gets ceil(total/2)
-    int left_sz  = (total + 1) / 2;
-    int right_sz = total - left_sz;
-
-    int* keys = (int*)malloc(sizeof(int) * (size_t)total);
-    assert(keys);
-
-    for (int i = 0; i < total; ++i) keys[i] = t->ops->key_at(leaf->store, i);
-
-    BPTreeNode* right = node_create(t, 1);
-    right->parent = leaf->parent;
-
-    t->ops->clear(leaf->store);
-    t->ops->clear(right->store);
-
-    for (int i = 0; i < left_sz; ++i)  t->ops->insert_at(leaf->store, i, keys[i], 0);
-    for (int i = 0; i < right_sz; ++i) t->ops->insert_at(right->store, i, keys[left_sz + i], 0);
-
-    right->next = leaf->next;
-    leaf->next = right;
-
-    // separator is min(right)
-    int sep = t->ops->key_at(right->store, 0);
-    free(keys);
-
-    insert_into_parent(t, leaf, sep, right);
+// buffered mode: calls that read the leaves directly first apply every
+// message; like the writer mutex, the buffers are logically mutable
+static void flush_pending(const BPTree* t) {
+    if (t->buffered) bptree_flush((BPTree*)t);
 }
 
-// split internal with copy-key semantics:
-// parent key to insert = min(right) = subtree_first_key(right)
-static void split_internal(BPTree* t, BPTreeNode* x) {
-    int k = t->ops->size(x->store);
-    assert(k == t->max_keys + 1);
-
-    // materialize children and keys
-    BPTreeNode** ch = (BPTreeNode**)malloc(sizeof(BPTreeNode*) * (size_t)(k + 1));
-    int* keys = (int*)malloc(sizeof(int) * (size_t)k);
-    assert(ch && keys);
-
-    ch[0] = x->child0;
-    for (int i = 0; i < k; ++i) {
-        keys[i] = t->ops->key_at(x->store, i);
-        ch[i + 1] = (BPTreeNode*)t->ops->val_at(x->store, i);
-    }
-
-    int nchildren = k + 1;
-    int left_children = (nchildren + 1) / 2; // ceil(nchildren/2)
-    int left_keys = left_children - 1;
-
-    // right children start at index left_children
-    BPTreeNode* right = node_create(t, 0);
-    right->parent = x->parent;
-
-    // rebuild left (x)
-    t->ops->clear(x->store);
-    x->child0 = ch[0];
-    if (x->child0) x->child0->parent = x;
-
-    for (int i = 0; i < left_keys; ++i) {
-        BPTreeNode* c = ch[i + 1];
-        t->ops->insert_at(x->store, i, keys[i], c);
-        if (c) c->parent = x;
-    }
-
-    // rebuild right
-    right->child0 = ch[left_children];
-    if (right->child0) right->child0->parent = right;
-
-    int rkeys = k - left_children; // keys[left_children .. k-1]
-    for (int i = 0; i < rkeys; ++i) {
-        int kk = keys[left_children + i];
-        BPTreeNode* c = ch[left_children + 1 + i];
-        t->ops->insert_at(right->store, i, kk, c);
-        if (c) c->parent = right;
-    }
-
-    int sep_key = subtree_first_key(t, right);
-
-    free(ch);
-    free(keys);
-
-    insert_into_parent(t, x, sep_key, right);
+// a mapped tree (bptree_open_mmap) has no root, its impl reads the file
+static int has_nodes(const BPTree* t) {
+    return t->root || t->map;
 }
 
-// Insert separator into parent at correct position determined by left's child index
-static void insert_into_parent(BPTree* t, BPTreeNode* left, int sep_key, BPTreeNode* right) {
-    BPTreeNode* parent = left->parent;
-
-    if (!parent) {
-        BPTreeNode* root = node_create(t, 0);
-        root->child0 = left;
-        left->parent = root;
-        t->ops->insert_at(root->store, 0, sep_key, right); // key[0] = min(right), val[0]=right
-        right->parent = root;
-        t->root = root;
-        return;
-    }
-
-    int j = parent_child_index(t, parent, left);
-    assert(j >= 0);
-
-    // parent.key[j] corresponds to child[j+1] (new right)
-    t->ops->insert_at(parent->store, j, sep_key, right);
-    right->parent = parent;
-
-    if (node_overflow(t, parent)) split_internal(t, parent);
+// concurrent mode: the read-only calls that walk more than one leaf
+// (range scans, height) hold the writer mutex; it is a logically mutable member
+static BPTree* writer_lock(const BPTree* t) {
+    BPTree* w = (BPTree*)t;
+    if (w->concurrent) bptree_olc_begin_write(w);
+    return w;
 }
 
-// -------------------- Delete: borrow / merge / rebalance --------------------
-
-static void fix_root_after_delete(BPTree* t) {
-    // if root internal has no keys, shrink height
-    while (t->root && !t->root->is_leaf && t->ops->size(t->root->store) == 0) {
-        BPTreeNode* old = t->root;
-        BPTreeNode* nr = old->child0;
-        if (nr) nr->parent = 0;
-        t->root = nr;
-        node_destroy(t, old);
-    }
+static void writer_unlock(BPTree* t) {
+    if (t->concurrent) bptree_olc_end_write(t);
 }
 
-// leaf borrow from left: move left last key -> leaf front; update parent sep for leaf
-static int borrow_from_left_leaf(BPTree* t, BPTreeNode* leaf, BPTreeNode* left, int leaf_idx_in_parent) {
-    int ln = t->ops->size(left->store);
-    if (ln <= min_leaf_keys(t)) return 0;
-
-    int k = t->ops->key_at(left->store, ln - 1);
-    t->ops->erase_at(left->store, ln - 1);
-
-    t->ops->insert_at(leaf->store, 0, k, 0);
-
-    // parent key[leaf_idx-1] = min(leaf)
-    store_set_key(t, leaf->parent->store, leaf_idx_in_parent - 1, t->ops->key_at(leaf->store, 0));
-    return 1;
+const char* bptree_impl_name(const BPTree* t) {
+    return t ? t->impl->name : "";
 }
 
-// leaf borrow from right: move right first key -> leaf end; update parent sep for right
-static int borrow_from_right_leaf(BPTree* t, BPTreeNode* leaf, BPTreeNode* right, int leaf_idx_in_parent) {
-    int rn = t->ops->size(right->store);
-    if (rn <= min_leaf_keys(t)) return 0;
-
-    int k = t->ops->key_at(right->store, 0);
-    t->ops->erase_at(right->store, 0);
-
-    int ln = t->ops->size(leaf->store);
-    t->ops->insert_at(leaf->store, ln, k, 0);
-
-    // parent key[leaf_idx] = min(right) (if right not empty)
-    if (t->ops->size(right->store) > 0) {
-        store_set_key(t, leaf->parent->store, leaf_idx_in_parent, t->ops->key_at(right->store, 0));
-    }
-    return 1;
+void bptree_destroy(BPTree* t) {
+    if (!t) return;
+    if (t->wal) bptree_wal_close(t);
+    int concurrent = t->concurrent;
+    t->concurrent = 0; // no readers left: free nodes directly
+    t->impl->destroy_nodes(t);
+    if (concurrent) bptree_olc_fini(t);
+    bptree_pool_fini(t);
+    free(t->frozen);
+    free(t->flush_msgs);
+    free(t->flush_keys);
+    free(t);
 }
 
-// merge leaf into left (left is left sibling), remove parent entry (idx-1)
-static void merge_leaf_into_left(BPTree* t, BPTreeNode* left, BPTreeNode* leaf, int leaf_idx_in_parent) {
-    int ln = t->ops->size(left->store);
-    int n  = t->ops->size(leaf->store);
-    for (int i = 0; i < n; ++i) {
-        int k = t->ops->key_at(leaf->store, i);
-        t->ops->insert_at(left->store, ln + i, k, 0);
-    }
-    left->next = leaf->next;
-
-    assert(leaf_idx_in_parent > 0);
-    t->ops->erase_at(left->parent->store, leaf_idx_in_parent - 1); // remove pointer to leaf
+int bptree_freeze(BPTree* t) {
+    if (!t || !has_nodes(t)) return 0;
+    if (t->concurrent) return 0; // the snapshot is single-threaded
+    flush_pending(t);
 
-    node_destroy(t, leaf);
-}
+    // collect keys in order from the leaf chain
+    size_t n = t->impl->collect_keys(t, 0);
+    int* sorted = (int*)malloc(sizeof(int) * (n ? n : 1));
+    if (!sorted) return 0;
+    t->impl->collect_keys(t, sorted);
 
-// merge right into leaf (leaf is left), remove parent entry (idx)
-static void merge_right_leaf_into_leaf(BPTree* t, BPTreeNode* leaf, BPTreeNode* right, int leaf_idx_in_parent) {
-    int ln = t->ops->size(leaf->store);
-    int rn = t->ops->size(right->store);
-    for (int i = 0; i < rn; ++i) {
-        int k = t->ops->key_at(right->store, i);
-        t->ops->insert_at(leaf->store, ln + i, k, 0);
+    if (n + 1 > t->frozen_cap) {
+        int* b = (int*)realloc(t->frozen, sizeof(int) * (n + 1));
+        if (!b) {
+            free(sorted);
+            return 0;
+        }
+        t->frozen = b;
+        t->frozen_cap = n + 1;
     }
-    leaf->next = right->next;
-
-    t->ops->erase_at(leaf->parent->store, leaf_idx_in_parent); // remove pointer to right
-
-    node_destroy(t, right);
-}
 
-// internal borrow from left (copy-key semantics):
-// move left's last child to x's front; parent sep becomes min(x) after move.
-static int borrow_from_left_internal(BPTree* t, BPTreeNode* x, BPTreeNode* left, int x_idx_in_parent) {
-    int lkeys = t->ops->size(left->store);
-    if (lkeys <= min_internal_keys(t)) return 0;
+    size_t next = 0;
+    eytzinger_fill(sorted, &next, t->frozen, 1, n);
+    free(sorted);
 
-    // parent sep for x is key[x_idx-1] = min(x)
-    int parent_sep = t->ops->key_at(x->parent->store, x_idx_in_parent - 1);
-
-    // take left's last child (val[last]) and erase that entry
-    BPTreeNode* borrow_child = (BPTreeNode*)t->ops->val_at(left->store, lkeys - 1);
-    int borrow_child_min = subtree_first_key(t, borrow_child);
-    t->ops->erase_at(left->store, lkeys - 1);
-
-    // x: insert new key at front = old parent_sep, val = old child0
-    BPTreeNode* old_c0 = x->child0;
-    x->child0 = borrow_child;
-    if (borrow_child) borrow_child->parent = x;
-
-    t->ops->insert_at(x->store, 0, parent_sep, old_c0);
-    if (old_c0) old_c0->parent = x;
-
-    // update parent sep for x to new min(x) = min(borrow_child)
-    store_set_key(t, x->parent->store, x_idx_in_parent - 1, borrow_child_min);
+    t->frozen_n = n;
+    t->frozen_stale = 0;
     return 1;
 }
 
-// internal borrow from right (copy-key semantics):
-// move right's child0 to x's end; x appends parent's sep; parent sep becomes new min(right)
-static int borrow_from_right_internal(BPTree* t, BPTreeNode* x, BPTreeNode* right, int x_idx_in_parent) {
-    int rkeys = t->ops->size(right->store);
-    if (rkeys <= min_internal_keys(t)) return 0;
-
-    // parent sep for right is key[x_idx] = min(right)
-    int parent_sep = t->ops->key_at(x->parent->store, x_idx_in_parent);
-
-    // borrow right.child0
-    BPTreeNode* borrow_child = right->child0;
-
-    // right: shift child0 to old child1 (val[0]), erase entry 0
-    BPTreeNode* new_c0 = (BPTreeNode*)t->ops->val_at(right->store, 0); // old child1
-    int new_right_min = t->ops->key_at(right->store, 0);              // min(new_c0)
-    t->ops->erase_at(right->store, 0);
-    right->child0 = new_c0;
-    if (new_c0) new_c0->parent = right;
-
-    // x append: key = parent_sep (min(borrow_child)), val = borrow_child
-    int xn = t->ops->size(x->store);
-    t->ops->insert_at(x->store, xn, parent_sep, borrow_child);
-    if (borrow_child) borrow_child->parent = x;
-
-    // parent sep becomes min(right) after shift
-    store_set_key(t, x->parent->store, x_idx_in_parent, new_right_min);
-    return 1;
+void bptree_thaw(BPTree* t) {
+    if (!t) return;
+    free(t->frozen);
+    t->frozen = 0;
+    t->frozen_n = 0;
+    t->frozen_cap = 0;
+    t->frozen_stale = 0;
 }
 
-// merge internal x into left (left is left sibling), using parent sep key[x_idx-1]
-static void merge_internal_into_left(BPTree* t, BPTreeNode* left, BPTreeNode* x, int x_idx_in_parent) {
-    int sep = t->ops->key_at(left->parent->store, x_idx_in_parent - 1);
-
-    int ln = t->ops->size(left->store);
-
-    // append sep with val = x->child0 (because sep == min(x))
-    t->ops->insert_at(left->store, ln, sep, x->child0);
-    if (x->child0) x->child0->parent = left;
-
-    // append x's (key,val) entries as-is
-    int xn = t->ops->size(x->store);
-    for (int i = 0; i < xn; ++i) {
-        int k = t->ops->key_at(x->store, i);
-        BPTreeNode* c = (BPTreeNode*)t->ops->val_at(x->store, i);
-        t->ops->insert_at(left->store, ln + 1 + i, k, c);
-        if (c) c->parent = left;
-    }
+int bptree_is_frozen(const BPTree* t) {
+    return t && t->frozen && !t->frozen_stale;
+}
 
-    // remove parent entry that pointed to x
-    t->ops->erase_at(left->parent->store, x_idx_in_parent - 1);
+static int search_concurrent(const BPTree* t, int key) {
+    epoch_enter(t->epoch);
+    int hit = t->impl->search_olc(t, key);
+    epoch_exit(t->epoch);
+    return hit;
+}
 
-    node_destroy(t, x);
+int bptree_search(const BPTree* t, int key) {
+    if (!t) return 0;
+    if (t->concurrent) return search_concurrent(t, key);
+    if (!has_nodes(t)) return 0;
+    if (bptree_is_frozen(t)) return frozen_search(t, key);
+    return t->impl->search(t, key);
 }
 
-// merge right into x (x is left sibling), using parent sep key[x_idx]
-static void merge_right_internal_into_x(BPTree* t, BPTreeNode* x, BPTreeNode* right, int x_idx_in_parent) {
-    int sep = t->ops->key_at(x->parent->store, x_idx_in_parent);
+// -------------------- Batched search --------------------
 
-    int xn = t->ops->size(x->store);
+typedef struct BatchKey {
+    int key;
+    int idx;    // position within the chunk
+} BatchKey;
 
-    // append sep with val = right->child0 (sep == min(right))
-    t->ops->insert_at(x->store, xn, sep, right->child0);
-    if (right->child0) right->child0->parent = x;
+static int cmp_batch_key(const void* a, const void* b) {
+    int x = ((const BatchKey*)a)->key, y = ((const BatchKey*)b)->key;
+    return (x > y) - (x < y);
+}
 
-    int rn = t->ops->size(right->store);
-    for (int i = 0; i < rn; ++i) {
-        int k = t->ops->key_at(right->store, i);
-        BPTreeNode* c = (BPTreeNode*)t->ops->val_at(right->store, i);
-        t->ops->insert_at(x->store, xn + 1 + i, k, c);
-        if (c) c->parent = x;
+static void search_run(const BPTree* t, const int* keys, size_t n, uint8_t* found) {
+    if (bptree_is_frozen(t)) {
+        for (size_t i = 0; i < n; ++i) found[i] = (uint8_t)frozen_search(t, keys[i]);
+        return;
+    }
+    for (size_t i = 0; i < n; i += BPTREE_BATCH_GROUP) {
+        size_t g = (n - i < BPTREE_BATCH_GROUP) ? n - i : BPTREE_BATCH_GROUP;
+        t->impl->search_group(t, keys + i, g, found + i);
     }
-
-    t->ops->erase_at(x->parent->store, x_idx_in_parent);
-
-    node_destroy(t, right);
 }
 
-static void rebalance_after_delete(BPTree* t, BPTreeNode* x) {
-    if (!x) return;
+void bptree_search_batch(const BPTree* t, const int* keys, size_t n, uint8_t* found) {
+    bptree_search_batch_ex(t, keys, n, found, 0);
+}
 
-    if (x == t->root) {
-        fix_root_after_delete(t);
+void bptree_search_batch_ex(const BPTree* t, const int* keys, size_t n, uint8_t* found,
+                            unsigned flags) {
+    if (!found || n == 0) return;
+    if (!t || !has_nodes(t) || !keys) {
+        memset(found, 0, n);
         return;
     }
-
-    BPTreeNode* parent = x->parent;
-    int x_idx = parent_child_index(t, parent, x);
-    assert(x_idx >= 0);
-
-    int nkeys = t->ops->size(x->store);
-
-    if (x->is_leaf) {
-        // not underflow
-        if (nkeys >= min_leaf_keys(t)) {
-            update_parent_sep_if_needed(t, x); // leaf min may change after deletion
-            return;
-        }
-
-        // underflow
-        BPTreeNode* left  = (x_idx > 0) ? parent_child_at(t, parent, x_idx - 1) : NULL;
-        BPTreeNode* right = (x_idx < t->ops->size(parent->store)) ? parent_child_at(t, parent, x_idx + 1) : NULL;
-
-        if (left  && borrow_from_left_leaf(t, x, left, x_idx)) return;
-        if (right && borrow_from_right_leaf(t, x, right, x_idx)) return;
-
-        // merge
-        if (left) {
-            merge_leaf_into_left(t, left, x, x_idx);
-            rebalance_after_delete(t, parent);
-        } else if (right) {
-            merge_right_leaf_into_leaf(t, x, right, x_idx);
-            rebalance_after_delete(t, parent);
-        }
+    if (t->concurrent) { // one epoch for the whole batch
+        epoch_enter(t->epoch);
+        for (size_t i = 0; i < n; ++i) found[i] = (uint8_t)t->impl->search_olc(t, keys[i]);
+        epoch_exit(t->epoch);
         return;
     }
-
-    // internal node
-    if (nkeys >= min_internal_keys(t)) {
-        // internal min can change if its child0 changed in previous ops; keep parent consistent
-        update_parent_sep_if_needed(t, x);
+    if (!(flags & BPTREE_BATCH_SORT)) {
+        search_run(t, keys, n, found);
         return;
     }
 
-    BPTreeNode* left  = (x_idx > 0) ? parent_child_at(t, parent, x_idx - 1) : NULL;
-    BPTreeNode* right = (x_idx < t->ops->size(parent->store)) ? parent_child_at(t, parent, x_idx + 1) : NULL;
-
-    if (left  && borrow_from_left_internal(t, x, left, x_idx)) return;
-    if (right && borrow_from_right_internal(t, x, right, x_idx)) return;
-
-    // merge
-    if (left) {
-        merge_internal_into_left(t, left, x, x_idx);
-        rebalance_after_delete(t, parent);
-    } else if (right) {
-        merge_right_internal_into_x(t, x, right, x_idx);
-        rebalance_after_delete(t, parent);
+    BatchKey bk[BPTREE_BATCH_SORT_CHUNK];
+    int sorted[BPTREE_BATCH_SORT_CHUNK];
+    uint8_t hit[BPTREE_BATCH_SORT_CHUNK];
+    for (size_t base = 0; base < n; base += BPTREE_BATCH_SORT_CHUNK) {
+        int c = (n - base < BPTREE_BATCH_SORT_CHUNK) ? (int)(n - base) : BPTREE_BATCH_SORT_CHUNK;
+        for (int i = 0; i < c; ++i) {
+            bk[i].key = keys[base + (size_t)i];
+            bk[i].idx = i;
+        }
+        qsort(bk, (size_t)c, sizeof(BatchKey), cmp_batch_key);
+        for (int i = 0; i < c; ++i) sorted[i] = bk[i].key;
+        search_run(t, sorted, (size_t)c, hit);
+        for (int i = 0; i < c; ++i) found[base + (size_t)bk[i].idx] = hit[i];
     }
 }
 
-// -------------------- Public API --------------------
-
-BPTree* bptree_create(int order_M, const NodeStoreOps* ops) {
-    if (order_M < 3) order_M = 3;
-    if (!ops) ops = nodestore_get_ops(NODESTORE_ARRAY);
-
-    BPTree* t = (BPTree*)calloc(1, sizeof(BPTree));
-    assert(t);
-
-    t->order_M = order_M;
-    t->max_keys = order_M - 1;
-    t->ops = ops;
-    t->root = node_create(t, 1);
-    return t;
-}
-
-static void destroy_subtree(BPTree* t, BPTreeNode* x) {
-    if (!x) return;
-    if (!x->is_leaf) {
-        int n = t->ops->size(x->store);
-        destroy_subtree(t, x->child0);
-        for (int i = 0; i < n; ++i) {
-            BPTreeNode* c = (BPTreeNode*)t->ops->val_at(x->store, i);
-            destroy_subtree(t, c);
+int bptree_insert(BPTree* t, int key) {
+    if (!t) return 0;
+    if (t->concurrent) bptree_olc_begin_write(t);
+    int added = t->impl->insert(t, key);
+    if (added) t->frozen_stale = 1;
+    if (added && t->wal) bptree_wal_log(t, BPTREE_WAL_INSERT, key, key, 0);
+    if (t->concurrent) bptree_olc_end_write(t);
+    return added;
+}
+
+int bptree_delete(BPTree* t, int key) {
+    if (!t) return 0;
+    if (t->concurrent) bptree_olc_begin_write(t);
+    int removed = t->impl->erase(t, key);
+    if (removed) t->frozen_stale = 1;
+    if (removed && t->wal) bptree_wal_log(t, BPTREE_WAL_DELETE, key, key, 0);
+    if (t->concurrent) bptree_olc_end_write(t);
+    return removed;
+}
+
+size_t bptree_delete_range(BPTree* t, int lo, int hi) {
+    if (!t || !t->root || lo > hi) return 0;
+    flush_pending(t);
+    if (t->concurrent) bptree_olc_begin_write(t);
+    size_t removed = t->impl->delete_range(t, lo, hi);
+    if (removed) t->frozen_stale = 1;
+    if (removed && t->wal) bptree_wal_log(t, BPTREE_WAL_DELETE_RANGE, lo, hi, 0);
+    if (t->concurrent) bptree_olc_end_write(t);
+    return removed;
+}
+
+// logged trees: the sorted and bulk loads log one insert per key
+static void log_inserts(BPTree* t, const int* keys, size_t n) {
+    for (size_t i = 0; i < n; ++i) bptree_wal_log(t, BPTREE_WAL_INSERT, keys[i], keys[i], 0);
+}
+
+int bptree_bulk_load(BPTree* t, const int* keys, size_t n, double fill_factor) {
+    if (!t || !t->root || (n && !keys)) return 0;
+    flush_pending(t);
+    if (!t->root->is_leaf || t->root->ops->size(t->root->store) != 0) return 0; // not empty
+    for (size_t i = 1; i < n; ++i) {
+        if (keys[i] < keys[i - 1]) return 0;
+    }
+    if (!(fill_factor > 0.0 && fill_factor <= 1.0)) fill_factor = 1.0;
+
+    if (t->concurrent) bptree_olc_begin_write(t);
+    int ok = t->impl->bulk_load(t, keys, 0, n, fill_factor);
+    if (ok && n) t->frozen_stale = 1;
+    if (ok && t->wal) log_inserts(t, keys, n);
+    if (t->concurrent) bptree_olc_end_write(t);
+    return ok;
+}
+
+size_t bptree_insert_sorted(BPTree* t, const int* keys, size_t n) {
+    if (!t || !t->root || !keys) return 0;
+    flush_pending(t);
+    if (t->concurrent) bptree_olc_begin_write(t);
+    size_t added = t->impl->insert_sorted(t, keys, n);
+    if (added) t->frozen_stale = 1;
+    if (added && t->wal) log_inserts(t, keys, n); // replaying a present key is a no-op
+    if (t->concurrent) bptree_olc_end_write(t);
+    return added;
+}
+
+// -------------------- Key/value --------------------
+
+int bptree_set_value_size(BPTree* t, size_t value_size) {
+    if (!t || !t->root || !t->root->is_leaf || t->root->ops->size(t->root->store) != 0) return 0; // not empty
+    if (t->buffered && value_size) return 0;  // messages carry no values
+    if (t->concurrent && value_size > BPTREE_VALUE_INLINE_MAX) return 0; // blocks would need epochs
+    BPTreeNode* root = t->root;
+    const NodeStoreOps* ops = root->ops;
+    int keys_only = bptree_node_keys_only(t, 1, ops);
+    size_t old = t->value_size;
+    t->value_size = value_size;
+    if (bptree_node_keys_only(t, 1, ops) != keys_only) { // the empty root leaf needs the other store kind
+        NodeStore* s = keys_only ? ops->create(t->max_keys + 1) : ops->create_keys(t->max_keys + 1);
+        if (!s) {
+            t->value_size = old;
+            return 0;
         }
+        ops->destroy(root->store);
+        root->store = s;
     }
-    node_destroy(t, x);
+    return 1;
 }
 
-void bptree_destroy(BPTree* t) {
-    if (!t) return;
-    destroy_subtree(t, t->root);
-    free(t);
+size_t bptree_value_size(const BPTree* t) {
+    return t ? t->value_size : 0;
 }
 
-int bptree_search(const BPTree* t, int key) {
-    if (!t || !t->root) return 0;
-    BPTreeNode* leaf = find_leaf(t, key);
-    if (!leaf) return 0;
-    return leaf_find(t, leaf, key, 0);
+int bptree_get(const BPTree* t, int key, void* val) {
+    if (!t || !has_nodes(t)) return 0;
+    if (!t->value_size) return bptree_search(t, key);
+    void* slot = 0;
+    int hit;
+    if (t->concurrent) {
+        epoch_enter(t->epoch);
+        hit = t->impl->get_olc(t, key, &slot);
+        epoch_exit(t->epoch);
+    } else {
+        hit = t->impl->get(t, key, &slot); // the frozen snapshot has no values
+    }
+    if (hit && val) bptree_value_load(t, slot, val);
+    return hit;
 }
 
-void bptree_insert(BPTree* t, int key) {
-    if (!t || !t->root) return;
-    BPTreeNode* leaf = find_leaf(t, key);
-    assert(leaf);
-
-    int idx = 0;
-    if (leaf_find(t, leaf, key, &idx)) return; // no duplicates
+int bptree_upsert(BPTree* t, int key, const void* val) {
+    if (!t) return 0;
+    if (!t->value_size) return bptree_insert(t, key);
+    if (t->concurrent) bptree_olc_begin_write(t);
+    int added = t->impl->upsert(t, key, val);
+    if (added) t->frozen_stale = 1; // an update leaves the key set as it was
+    if (t->wal) bptree_wal_log(t, BPTREE_WAL_UPSERT, key, key, val);
+    if (t->concurrent) bptree_olc_end_write(t);
+    return added;
+}
 
-    t->ops->insert_at(leaf->store, idx, key, 0);
+// -------------------- Cursor / range --------------------
 
-    if (node_overflow(t, leaf)) split_leaf(t, leaf);
+int bptree_cursor_seek(const BPTree* t, int key, BPTreeCursor* c) {
+    if (!c) return 0;
+    c->tree = t;
+    c->leaf = 0;
+    c->idx = 0;
+    if (!t || !t->root) return 0;
+    flush_pending(t);
+    c->leaf = t->impl->seek(t, key, &c->idx);
+    return c->leaf != 0;
+}
 
-    // after insert, leaf min might change (if inserted at 0), update parent sep
-    update_parent_sep_if_needed(t, leaf);
+int bptree_cursor_valid(const BPTreeCursor* c) {
+    return c && c->leaf;
 }
 
-void bptree_delete(BPTree* t, int key) {
-    if (!t || !t->root) return;
+int bptree_cursor_key(const BPTreeCursor* c) {
+    assert(bptree_cursor_valid(c));
+    const BPTreeNode* leaf = (const BPTreeNode*)c->leaf;
+    return leaf->ops->key_at(leaf->store, c->idx);
+}
 
-    BPTreeNode* leaf = find_leaf(t, key);
-    if (!leaf) return;
+int bptree_cursor_next(BPTreeCursor* c) {
+    if (!bptree_cursor_valid(c)) return 0;
+    const BPTreeNode* leaf = (const BPTreeNode*)c->leaf;
+    if (++c->idx >= leaf->ops->size(leaf->store)) {
+        do {
+            leaf = leaf->next;
+        } while (leaf && leaf->ops->size(leaf->store) == 0);
+        c->leaf = leaf;
+        c->idx = 0;
+    }
+    return c->leaf != 0;
+}
 
-    int idx = 0;
-    if (!leaf_find(t, leaf, key, &idx)) return;
+size_t bptree_range_count(const BPTree* t, int lo, int hi) {
+    return bptree_range_scan(t, lo, hi, 0, 0);
+}
 
-    // delete from leaf
-    t->ops->erase_at(leaf->store, idx);
+size_t bptree_range_scan(const BPTree* t, int lo, int hi, BPTreeSliceFn fn, void* arg) {
+    if (!t || !has_nodes(t) || lo > hi) return 0;
+    flush_pending(t);
 
-    // rebalance upward
-    rebalance_after_delete(t, leaf);
+    int* scratch = 0; // only stores without key_data copy their slices
+    int key_data = t->adaptive ? t->adapt_read->key_data && t->adapt_write->key_data : t->ops->key_data != 0;
+    if (fn && !key_data) {
+        scratch = (int*)malloc(sizeof(int) * (size_t)(t->max_keys + 1));
+        if (!scratch) return 0;
+    }
+    BPTree* w = writer_lock(t);
+    size_t n = t->impl->range_scan(t, lo, hi, fn, arg, scratch);
+    writer_unlock(w);
+    free(scratch);
+    return n;
+}
 
-    // ensure root shrink
-    fix_root_after_delete(t);
+int bptree_set_finger(BPTree* t, int on) {
+    if (!t || t->concurrent || t->buffered || t->map) return 0;
+    t->finger = on != 0;
+    t->finger_lo = t->finger_hi = 0; // nothing cached yet
+    return 1;
 }
 
 int bptree_height(const BPTree* t) {
-    if (!t || !t->root) return 0;
+    if (!t || !has_nodes(t)) return 0;
+    if (t->map) return bptree_map_height(t);
+    BPTree* w = writer_lock(t);
     int h = 1;
     BPTreeNode* x = t->root;
     while (x && !x->is_leaf) {
         h++;
         x = x->child0;
     }
+    writer_unlock(w);
     return h;
-}
\ No newline at end of file
+}
+
+// -------------------- Statistics --------------------
+
+// x and everything below it, x on level d
+static void stats_walk(const BPTree* t, const BPTreeNode* x, int d, BPTreeStats* out) {
+    const NodeStoreOps* ops = x->ops;
+    int n = ops->size(x->store);
+    BPTreeLevelStats* l = &out->level[d];
+    l->nodes++;
+    l->keys += (size_t)n;
+    out->nodes++;
+    if (d + 1 > out->height) out->height = d + 1;
+    if (!t->node_bytes && ops->bytes) out->bytes += ops->bytes(x->store); // else in the pool chunk
+    if (x->buf) out->bytes += sizeof(BPTreeBuffer) + sizeof(BPTreeMsg) * (size_t)x->buf->cap;
+
+    if (x->is_leaf) {
+        out->leaves++;
+        out->keys += (size_t)n;
+        if (!bptree_value_inline(t)) { // NULL: all zero bytes, no block
+            for (int i = 0; i < n; ++i) out->bytes += ops->val_at(x->store, i) ? t->value_size : 0;
+        }
+        return;
+    }
+    stats_walk(t, x->child0, d + 1, out);
+    for (int i = 0; i < n; ++i) stats_walk(t, (const BPTreeNode*)ops->val_at(x->store, i), d + 1, out);
+}
+
+int bptree_stats(const BPTree* t, BPTreeStats* out) {
+    if (!out) return 0;
+    memset(out, 0, sizeof(*out));
+    if (!t || !t->root) return 0; // a mapped tree's nodes are file pages
+
+    BPTree* w = writer_lock(t);
+    stats_walk(t, t->root, 0, out);
+    for (int d = 0; d < out->height; ++d) {
+        BPTreeLevelStats* l = &out->level[d];
+        l->fill = (double)l->keys / ((double)l->nodes * (double)t->max_keys);
+    }
+    out->bytes += sizeof(BPTree) + bptree_pool_bytes(t) + sizeof(int) * t->frozen_cap;
+    writer_unlock(w);
+
+#ifdef BPTREE_STATS
+    out->counted = 1;
+    const uint64_t* c = (const uint64_t*)&t->counters; // all uint64_t, see bptree_pool_absorb
+    uint64_t* o = (uint64_t*)&out->counters;
+    for (size_t i = 0; i < sizeof(BPTreeCounters) / sizeof(uint64_t); ++i) {
+        o[i] = __atomic_load_n(&c[i], __ATOMIC_RELAXED);
+    }
+    nodestore_counters(&out->store);
+#endif
+    return 1;
+}
+
+void bptree_stats_reset(BPTree* t) {
+    if (!t) return;
+    uint64_t* c = (uint64_t*)&t->counters;
+    for (size_t i = 0; i < sizeof(BPTreeCounters) / sizeof(uint64_t); ++i) {
+        __atomic_store_n(&c[i], 0, __ATOMIC_RELAXED);
+    }
+    nodestore_counters_reset();
+}
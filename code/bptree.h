@@ -9,10 +9,238 @@ typedef struct BPTree BPTree;
 BPTree* bptree_create(int order_M, const NodeStoreOps* ops);
 void    bptree_destroy(BPTree* t);
 
+// Same tree, with the algorithms compiled against one store kind so that store
+// calls inline instead of going through NodeStoreOps. Specializations exist for
+// NODESTORE_ARRAY, NODESTORE_ARRAY_SIMD and NODESTORE_INLINE; NULL otherwise.
+BPTree* bptree_create_static(int order_M, NodeStoreKind kind);
+const char* bptree_impl_name(const BPTree* t);  // "generic", "array-static", ...
+
+// Tree whose leaves pick their store kind from the workload they see: every
+// leaf counts its lookups and writes, and whenever a split or merge rewrites
+// it anyway it is rebuilt as write_kind if it took at least one write per four
+// lookups lately, as read_kind otherwise. New leaves start as write_kind,
+// bulk-loaded ones as read_kind; internal nodes are always internal_kind.
+// Uses the generic tree. NULL for unknown kinds and for NODESTORE_INLINE,
+// whose store shares one block with the node header.
+BPTree* bptree_create_adaptive(int order_M, NodeStoreKind internal_kind,
+                               NodeStoreKind read_kind, NodeStoreKind write_kind);
+int     bptree_is_adaptive(const BPTree* t);
+
+// Thread-safe tree (optimistic lock coupling). Searches, including batches,
+// run from any number of threads without locks and without writing shared
+// memory: every node carries a version counter that a reader checks after
+// using the node, restarting on a change. Writers (insert, delete, bulk ops)
+// are serialized by a tree mutex and version-lock only the nodes they modify,
+// the leaf plus whatever a split or merge touches, so lookups elsewhere in the
+// tree proceed. Nodes freed by merges are reclaimed once no reader can hold
+// them (epoch.h). Range scans and height take the writer mutex; cursors and
+// bptree_freeze are not supported concurrently (freeze returns 0). Needs an
+// array-layout store (array, inline, simd); NULL otherwise.
+BPTree* bptree_create_concurrent(int order_M, NodeStoreKind kind);
+int     bptree_is_concurrent(const BPTree* t);
+
+// Write-optimized tree (B-epsilon style message buffers). An insert or delete
+// becomes a message in the buffer of the leaf's parent: one descent, the leaf
+// is only read, nothing is rebalanced. A parent holding more than buffer_msgs
+// messages flushes those of its busiest child into that leaf in one merge, so
+// splits, borrows and merges run once per batch rather than once per key.
+// Searches check the buffers on the way down. Cursors, range scans, freeze
+// and the sorted/bulk loads first apply every message (bptree_flush).
+// buffer_msgs <= 0 means BPTREE_BUFFER_DEFAULT.
+//
+// This only pays off where rebalancing a node is expensive: the list and
+// skip-list stores (NODESTORE_LINKED, NODESTORE_SKIPLIST). Every write still
+// reads its leaf (insert and delete report whether the key set changed), so
+// on the array-backed stores, whose splits and shifts are one memmove, the
+// buffers are pure overhead; NULL for those kinds.
+#define BPTREE_BUFFER_DEFAULT 1024
+BPTree* bptree_create_buffered(int order_M, NodeStoreKind kind, int buffer_msgs);
+int     bptree_is_buffered(const BPTree* t);
+void    bptree_flush(BPTree* t);
+
 int     bptree_search(const BPTree* t, int key);
-void    bptree_insert(BPTree* t, int key);
-void    bptree_delete(BPTree* t, int key);
+int     bptree_insert(BPTree* t, int key);      // 1 if the key was added, 0 if already present
+int     bptree_delete(BPTree* t, int key);      // 1 if the key was removed, 0 if absent
+
+// Removes every key in [lo, hi] and returns how many there were. Subtrees
+// and leaves inside the range are unlinked and freed whole, only the two
+// boundary leaves are trimmed, and the repair walks the two boundary paths:
+// O(log n + nodes freed) rather than one bptree_delete per key.
+size_t  bptree_delete_range(BPTree* t, int lo, int hi);
+
+// Key/value use. bptree_set_value_size gives every key a value of that many
+// bytes (0, the default, keeps keys only); call it while the tree is empty.
+// A value of at most BPTREE_VALUE_INLINE_MAX bytes is stored in the leaf slot
+// next to its key, a larger one in a block of its own that the slot points
+// to. Keys added without a value (bptree_insert, the sorted and bulk loads)
+// get all zero bytes. Returns 0 if the tree is not empty, for buffered trees,
+// and for concurrent trees with values above BPTREE_VALUE_INLINE_MAX.
+#define BPTREE_VALUE_INLINE_MAX sizeof(void*)
+int     bptree_set_value_size(BPTree* t, size_t value_size);
+size_t  bptree_value_size(const BPTree* t);
+// 1 if key is present, copying its value to val (unless NULL); one descent
+int     bptree_get(const BPTree* t, int key, void* val);
+// Sets key's value, adding the key if absent: 1 if it was added, 0 if an
+// existing value was overwritten in place (no split, no separator change).
+int     bptree_upsert(BPTree* t, int key, const void* val);
+
+// Finger for local workloads (sorted or clustered streams): with it on,
+// search, get, insert, upsert and delete keep the path of their latest
+// descent and the key range of its leaf, and a key in that range skips the
+// descent. Any split, merge, borrow or separator change drops the finger, so
+// it is never stale. Off by default; returns 0 for concurrent, buffered and
+// mapped trees, which keep their own descents.
+int     bptree_set_finger(BPTree* t, int on);
 
 int     bptree_height(const BPTree* t);
 
+// Statistics. bptree_stats walks the tree once and reports its shape: nodes,
+// keys and fill (keys over nodes * (M-1)) per level, level[0] being the root,
+// and the bytes the tree allocated: node pool chunks, stores not co-allocated
+// with their node, value blocks, message buffers and the frozen snapshot.
+// Pending messages of a buffered tree are not in keys. Concurrent trees are
+// walked under the writer mutex. Returns 1, or 0 for mapped trees and NULL.
+//
+// Builds with -DBPTREE_STATS (make STATS=1) also count the hot-path work in
+// counters, zeroed by bptree_stats_reset; the store counters are process-wide
+// (nodestore_counters). Otherwise counted is 0, every counter stays 0 and the
+// hot paths carry no trace of them. Counting is relaxed atomic adds, so
+// concurrent lookups then do write shared memory.
+#define BPTREE_STATS_LEVELS 64
+
+typedef struct BPTreeCounters {
+    uint64_t descents;          // root-to-leaf descents (lookups, writes, batch lanes, seeks)
+    uint64_t node_visits;       // nodes they passed through, leaf included
+    uint64_t finger_hits;       // descents the finger saved
+    uint64_t leaf_splits;
+    uint64_t internal_splits;
+    uint64_t leaf_merges;
+    uint64_t internal_merges;
+    uint64_t leaf_borrows;      // entries moved from a sibling instead of a merge
+    uint64_t internal_borrows;
+    uint64_t sep_updates;       // separators rewritten in place
+} BPTreeCounters;
+
+typedef struct BPTreeLevelStats {
+    size_t nodes;
+    size_t keys;
+    double fill;
+} BPTreeLevelStats;
+
+typedef struct BPTreeStats {
+    int height;
+    size_t nodes;
+    size_t leaves;
+    size_t keys;                // keys in the leaves
+    size_t bytes;
+    BPTreeLevelStats level[BPTREE_STATS_LEVELS]; // [0, height)
+    int counted;                // built with BPTREE_STATS
+    BPTreeCounters counters;
+    NodeStoreCounters store;
+} BPTreeStats;
+
+int     bptree_stats(const BPTree* t, BPTreeStats* out);
+void    bptree_stats_reset(BPTree* t);  // tree and store counters
+
+// Persistent form. bptree_save writes the tree to path as fixed-size,
+// page-aligned nodes whose child and leaf-chain links are file offsets, with
+// the values in the leaves (concurrent trees are saved under the writer
+// mutex, buffered ones flushed first). bptree_open_mmap maps such a file
+// read-only and serves it as is: nothing is rebuilt, and pages fault in as
+// lookups first reach them. The mapped tree takes bptree_search, _get,
+// _search_batch(_ex), _range_scan/_count, _height and _freeze; writes and
+// bptree_save return 0 and cursors stay invalid. bptree_destroy unmaps it.
+// The file is in native byte order. bptree_save returns 1 on success, 0 on
+// I/O errors (the partial file is removed); bptree_open_mmap returns NULL if
+// the file is missing or not a saved tree.
+int     bptree_save(const BPTree* t, const char* path);
+BPTree* bptree_open_mmap(const char* path);
+
+// Durability. bptree_wal_open makes an empty tree a logged one: first it
+// recovers the contents of the checkpoint image at image_path (the
+// bptree_save format) plus the write-ahead log at wal_path, either of which
+// may be missing, merging the two as sorted arrays into one bulk load; then
+// every insert, delete, upsert, range delete and sorted/bulk load appends a
+// record to the log. Records reach the file in groups; sync_every > 0 makes
+// every sync_every-th record fdatasync the log, covering all before it, and 0
+// leaves syncing to bptree_wal_sync, bptree_checkpoint and bptree_destroy.
+// A crash loses at most the records after the last sync. bptree_checkpoint
+// writes the nodes changed since the previous checkpoint into the image, in
+// place behind a journal (the first checkpoint, and any after most nodes
+// changed, rewrite the image whole), then empties the log, so recovery
+// replays at most one checkpoint interval. The image stays a valid
+// bptree_open_mmap file between checkpoints. The tree's value size comes
+// from the image if the tree has none. Return 1 on success, 0 on I/O errors;
+// a failed log write also makes later bptree_wal_sync calls return 0 until a
+// checkpoint succeeds. bptree_wal_open fails on a non-empty tree and on files
+// not made by a tree of this value size.
+int     bptree_wal_open(BPTree* t, const char* image_path, const char* wal_path, unsigned sync_every);
+int     bptree_wal_sync(BPTree* t);
+int     bptree_checkpoint(BPTree* t);
+
+// Sorted ingest. bptree_bulk_load builds an empty tree bottom-up in O(n) from
+// ascending keys (duplicates are skipped): leaves get about fill_factor*(M-1)
+// keys and internal nodes about fill_factor*M children, within the usual node
+// bounds. fill_factor outside (0, 1] means 1, i.e. fully packed. Returns 1 on
+// success, 0 if the tree is not empty, the keys are not ascending, or on OOM.
+int     bptree_bulk_load(BPTree* t, const int* keys, size_t n, double fill_factor);
+// Inserts keys in order, any order allowed. A key above the current maximum is
+// appended to the rightmost leaf without a descent; others go through the
+// normal insert. Returns the number of keys added.
+size_t  bptree_insert_sorted(BPTree* t, const int* keys, size_t n);
+
+// Parallel ingest on nthreads threads (<= 0: one per online CPU; small inputs
+// use fewer). Keys may come in any order and repeat: they are sorted and
+// deduplicated on the same threads first. bptree_bulk_load_parallel is
+// bptree_bulk_load with every level built by all threads at once; it returns
+// 1 on success, 0 if the tree is not empty or on OOM. The batches apply one
+// insert or delete per distinct key and return the keys added or removed:
+// the tree is cut at the separators of its top levels into a few subtrees
+// per thread, every thread applies the keys of its subtrees, and the
+// subtrees are joined back into one tree. Concurrent, buffered and logged
+// trees apply batches on the calling thread, and logged ones bulk load there.
+int     bptree_bulk_load_parallel(BPTree* t, const int* keys, size_t n, double fill_factor, int nthreads);
+size_t  bptree_insert_batch(BPTree* t, const int* keys, size_t n, int nthreads);
+size_t  bptree_delete_batch(BPTree* t, const int* keys, size_t n, int nthreads);
+
+// Batched lookups: found[i] = bptree_search(t, keys[i]). The descents run in
+// groups, level by level in lockstep, prefetching the next node of every
+// lookup before any is searched so their cache misses overlap.
+// BPTREE_BATCH_SORT first sorts each chunk of up to BPTREE_BATCH_SORT_CHUNK
+// keys, so that neighbouring lookups share the upper levels.
+#define BPTREE_BATCH_SORT       1u
+#define BPTREE_BATCH_SORT_CHUNK 256
+void    bptree_search_batch(const BPTree* t, const int* keys, size_t n, uint8_t* found);
+void    bptree_search_batch_ex(const BPTree* t, const int* keys, size_t n, uint8_t* found,
+                               unsigned flags);
+
+// Ordered access over the leaf chain; both do one descent, then stream leaves.
+// Any insert/delete invalidates open cursors.
+typedef struct BPTreeCursor {
+    const BPTree* tree;
+    const void* leaf;       // current leaf (opaque); NULL once exhausted
+    int idx;                // slot in that leaf
+} BPTreeCursor;
+
+int     bptree_cursor_seek(const BPTree* t, int key, BPTreeCursor* c); // first key >= key; 0 if none
+int     bptree_cursor_valid(const BPTreeCursor* c);
+int     bptree_cursor_key(const BPTreeCursor* c);                      // requires a valid cursor
+int     bptree_cursor_next(BPTreeCursor* c);                           // 0 once past the last key
+
+// Keys in [lo, hi], ascending. scan passes them leaf by leaf as slices: for
+// array-backed stores (array, inline, simd) a slice points into the leaf
+// itself, otherwise into a scratch buffer; slices are valid only during the
+// call. fn returns nonzero to stop early. Both return the keys visited.
+typedef int (*BPTreeSliceFn)(const int* keys, size_t n, void* arg);
+size_t  bptree_range_count(const BPTree* t, int lo, int hi);
+size_t  bptree_range_scan(const BPTree* t, int lo, int hi, BPTreeSliceFn fn, void* arg);
+
+// Read-mostly mode. bptree_freeze snapshots every key (gathered from the leaf
+// chain) into a static, branch-free Eytzinger layout that bptree_search then
+// answers from. Writes still go to the tree and only mark the snapshot stale:
+// searches fall back to the normal descent until the next bptree_freeze.
+int     bptree_freeze(BPTree* t);       // 1 on success, 0 on allocation failure
+void    bptree_thaw(BPTree* t);         // drop the snapshot
+int     bptree_is_frozen(const BPTree* t);
+
 #endif
@@ -0,0 +1,2076 @@
+// bptree_impl.h  (B+ Tree, Scheme A: parent key[i] = min(child[i+1]) copy-key semantics)
+//
+// The tree algorithms, written against NS_* store-access macros. Each
+// translation unit that includes this file defines the macros and
+// BPTREE_IMPL_NAME first and gets one BPTreeImpl:
+//
+//   bptree.c               NS_* -> x->ops->...   (generic, any NodeStoreOps)
+//   bptree_static_*.c      NS_* -> the store's static inline functions
+//
+// The generic one also defines BPTREE_IMPL_ADAPTIVE to 1: its nodes may hold
+// different store kinds (bptree_create_adaptive), so moves between two nodes
+// check that the kinds match. Elsewhere every node's ops is t->ops.
+//
+// Every macro takes the tree t and the node x whose store is accessed:
+//   NS_SIZE(t,x)  NS_KEY_AT(t,x,i)  NS_VAL_AT(t,x,i)  NS_SET_VAL(t,x,i,v)  NS_SET_KEY(t,x,i,k)
+//   NS_LOWER_BOUND(t,x,k)  NS_INSERT_AT(t,x,i,k,v)  NS_ERASE_AT(t,x,i)  NS_CLEAR(t,x)
+//   NS_APPEND_FROM(t,x,y,i)  (y's entries [i..) move to the end of x)
+//   NS_PREFETCH(t,x)       (a statement; may expand to nothing)
+//   NS_KEY_DATA(t,x)  NS_VAL_DATA(t,x)   (contiguous keys / vals of x, or NULL)
+//
+// Every function that modifies a node first passes it to node_write, which in
+// concurrent mode version-locks it for the rest of the operation and, with a
+// log attached (bptree_wal.c), queues it for the next checkpoint. A write to
+// an internal node also makes the finger stale (see Finger below).
+#include "bptree_internal.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(BPTREE_IMPL_NAME) || !defined(BPTREE_IMPL_LABEL)
+#error "define BPTREE_IMPL_NAME, BPTREE_IMPL_LABEL and the NS_* macros before including bptree_impl.h"
+#endif
+
+#ifndef BPTREE_IMPL_ADAPTIVE
+#define BPTREE_IMPL_ADAPTIVE 0
+#endif
+
+// -------------------- Node helpers --------------------
+
+// a new node whose store is of kind ops
+static BPTreeNode* node_create_as(BPTree* t, int is_leaf, const NodeStoreOps* ops) {
+    int keys_only = bptree_node_keys_only(t, is_leaf, ops);
+    BPTreeNode* x = bptree_pool_get(t, ops, keys_only);
+    assert(x);
+    x->ops = ops;
+    if (t->node_bytes) {
+        // one cache-line-aligned block: node header, then the store in place
+        x->store = ops->init((char*)x + bptree_node_header_bytes(), t->max_keys + 1);
+    } else if (x->store) {
+        NS_CLEAR(t, x); // a pooled node keeps its store
+    } else if (keys_only) {
+        x->store = ops->create_keys(t->max_keys + 1); // leaf vals unused
+    } else {
+        x->store = ops->create(t->max_keys + 1); // allow overflow then split
+    }
+    assert(x->store);
+    x->is_leaf = is_leaf;
+    x->max_keys = t->max_keys;
+    x->parent = 0;
+    x->next = 0;
+    x->child0 = 0;
+    x->version = 0;
+    x->buf = 0;
+    x->slot = 0;
+    x->dirty = 0;
+    x->reads = 0;
+    x->writes = 0;
+    x->last_insert = -2;
+    x->insert_run = 0;
+    if (t->wal) bptree_wal_dirty(t, x); // not in the image yet
+    return x;
+}
+
+static BPTreeNode* node_create(BPTree* t, int is_leaf) {
+    return node_create_as(t, is_leaf, is_leaf ? t->leaf_ops : t->ops);
+}
+
+static void node_destroy(BPTree* t, BPTreeNode* x) {
+    if (!x) return;
+    t->shape++; // x may be on the finger
+    if (t->wal) bptree_wal_forget(t, x);
+    if (t->concurrent) { // readers may still be inside x
+        bptree_olc_retire(t, x);
+        return;
+    }
+    free(x->buf);
+    bptree_pool_put(t, x);
+}
+
+static void node_write(BPTree* t, BPTreeNode* x) {
+    if (!x->is_leaf) t->shape++; // a leaf's key range is its ancestors' separators
+    if (t->concurrent) bptree_olc_lock(t, x);
+    if (t->wal && !x->dirty) bptree_wal_dirty(t, x);
+}
+
+static int node_keys(const BPTree* t, const BPTreeNode* x) {
+    return NS_SIZE(t, x);
+}
+
+static int node_overflow(const BPTree* t, const BPTreeNode* x) {
+    return node_keys(t, x) > x->max_keys;
+}
+
+static int min_leaf_keys(const BPTree* t) {
+    // ceil((M-1)/2) = ceil(max_keys/2)
+    return (t->max_keys + 1) / 2;
+}
+
+static int min_internal_keys(const BPTree* t) {
+    // ceil(M/2) - 1
+    int min_children = (t->order_M + 1) / 2; // ceil(M/2)
+    return min_children - 1;
+}
+
+static int store_set_key(BPTree* t, BPTreeNode* x, int idx, int new_key) {
+    int n = NS_SIZE(t, x);
+    if (idx < 0 || idx >= n) return 0;
+    node_write(t, x);
+    NS_SET_KEY(t, x, idx, new_key);
+    BPTREE_COUNT(t, sep_updates, 1);
+    return 1;
+}
+
+static BPTreeNode* parent_child_at(const BPTree* t, const BPTreeNode* parent, int child_index) {
+    // child_index in [0..nchildren-1], where nchildren = nkeys+1
+    if (child_index == 0) return parent->child0;
+    return (BPTreeNode*)NS_VAL_AT(t, parent, child_index - 1);
+}
+
+// minimal key in subtree rooted at x (descend child0 until leaf)
+static int subtree_first_key(const BPTree* t, const BPTreeNode* x) {
+    const BPTreeNode* cur = x;
+    while (cur && !cur->is_leaf) cur = cur->child0;
+    assert(cur);
+    assert(NS_SIZE(t, cur) > 0);
+    return NS_KEY_AT(t, cur, 0);
+}
+
+// internal x: the children from entry `from` on (and child0 with from == 0)
+// get x as their parent, after they moved in with NS_APPEND_FROM
+static void adopt_children(const BPTree* t, BPTreeNode* x, int from) {
+    if (from == 0 && x->child0) x->child0->parent = x;
+    int n = NS_SIZE(t, x);
+    for (int i = from; i < n; ++i) {
+        BPTreeNode* c = (BPTreeNode*)NS_VAL_AT(t, x, i);
+        if (c) c->parent = x;
+    }
+}
+
+// -------------------- Adaptive leaves (bptree_create_adaptive) --------------------
+//
+// A leaf counts its lookups and writes. When a split or merge rewrites the
+// leaf anyway, the counts pick its store kind from then on: adapt_write at one
+// write or more per BPTREE_ADAPT_READS_PER_WRITE lookups, adapt_read below
+// that. The counters are 16 bits and both halve when one fills up, so older
+// operations weigh less. Lookups bump the counter through a const tree: an
+// adaptive tree is never concurrent, so nothing else reads it meanwhile.
+
+#define BPTREE_ADAPT_READS_PER_WRITE 4
+
+static void leaf_count(const BPTree* t, const BPTreeNode* leaf, int write) {
+    if (!BPTREE_IMPL_ADAPTIVE || !t->adaptive) return;
+    BPTreeNode* x = (BPTreeNode*)leaf;
+    uint16_t* c = write ? &x->writes : &x->reads;
+    if (++*c == UINT16_MAX) {
+        x->reads >>= 1;
+        x->writes >>= 1;
+    }
+}
+
+// leaf store kind for reads lookups against writes writes
+static const NodeStoreOps* leaf_kind_for(const BPTree* t, uint32_t reads, uint32_t writes) {
+    return writes * BPTREE_ADAPT_READS_PER_WRITE >= reads ? t->adapt_write : t->adapt_read;
+}
+
+// x's entries into a new store of kind ops, which replaces x's
+static void node_convert(BPTree* t, BPTreeNode* x, const NodeStoreOps* ops) {
+    int cap = t->max_keys + 1;
+    NodeStore* s = bptree_node_keys_only(t, x->is_leaf, ops) ? ops->create_keys(cap) : ops->create(cap);
+    assert(s);
+    int n = NS_SIZE(t, x);
+    for (int i = 0; i < n; ++i) ops->insert_at(s, i, NS_KEY_AT(t, x, i), NS_VAL_AT(t, x, i));
+    x->ops->destroy(x->store);
+    x->store = s;
+    x->ops = ops;
+}
+
+// NS_APPEND_FROM between two nodes that may hold different store kinds
+static void node_append_from(BPTree* t, BPTreeNode* x, BPTreeNode* y, int from) {
+    if (!BPTREE_IMPL_ADAPTIVE || x->ops == y->ops) {
+        NS_APPEND_FROM(t, x, y, from);
+        return;
+    }
+    int xn = NS_SIZE(t, x), n = NS_SIZE(t, y);
+    for (int i = from; i < n; ++i) NS_INSERT_AT(t, x, xn++, NS_KEY_AT(t, y, i), NS_VAL_AT(t, y, i));
+    while (n > from) NS_ERASE_AT(t, y, --n);
+}
+
+// kind for both halves of a split of leaf, each of which keeps half the counts
+static const NodeStoreOps* leaf_split_kind(const BPTree* t, BPTreeNode* leaf) {
+    if (!BPTREE_IMPL_ADAPTIVE || !t->adaptive) return leaf->ops;
+    const NodeStoreOps* kind = leaf_kind_for(t, leaf->reads, leaf->writes);
+    leaf->reads >>= 1;
+    leaf->writes >>= 1;
+    return kind;
+}
+
+// before y merges into x: x takes the kind for the counts of both
+static void leaf_merge_kind(BPTree* t, BPTreeNode* x, const BPTreeNode* y) {
+    if (!BPTREE_IMPL_ADAPTIVE || !t->adaptive) return;
+    uint32_t reads = (uint32_t)x->reads + y->reads;
+    uint32_t writes = (uint32_t)x->writes + y->writes;
+    const NodeStoreOps* kind = leaf_kind_for(t, reads, writes);
+    if (x->ops != kind) node_convert(t, x, kind);
+    x->reads = (uint16_t)(reads >> 1); // halved into range
+    x->writes = (uint16_t)(writes >> 1);
+}
+
+// -------------------- Values (key/value trees) --------------------
+
+// leaf val i; 0 without reading it when the tree holds keys only
+static void* leaf_val(const BPTree* t, const BPTreeNode* leaf, int i) {
+    return t->value_size ? NS_VAL_AT(t, leaf, i) : 0;
+}
+
+// frees the block behind leaf val i, if values have blocks
+static void leaf_val_release(const BPTree* t, const BPTreeNode* leaf, int i) {
+    if (!bptree_value_inline(t)) free(NS_VAL_AT(t, leaf, i));
+}
+
+// the leaf val holding the value bytes at val (NULL: all zero)
+static void* value_make(const BPTree* t, const void* val) {
+    void* slot = 0;
+    if (!val) return 0;
+    if (bptree_value_inline(t)) {
+        memcpy(&slot, val, t->value_size);
+        return slot;
+    }
+    slot = malloc(t->value_size);
+    assert(slot);
+    memcpy(slot, val, t->value_size);
+    return slot;
+}
+
+// -------------------- Descent path --------------------
+
+// The path of one insert/delete (BPTreePath, bptree_internal.h). Split and
+// rebalance walk it back up instead of searching each parent for the child.
+typedef BPTreePath DescentPath;
+
+// parent separator update: if x = path->node[d] is its parent's child j>0,
+// then parent.key[j-1]=min(x)
+static void update_parent_sep_if_needed(BPTree* t, const DescentPath* path, int d) {
+    if (d <= 0) return;
+    BPTreeNode* x = path->node[d];
+    int nmin;
+    if (t->buffered && !x->is_leaf) return; // would shrink a buffered range (see message buffers)
+    // x may be temporarily empty during delete; skip if no keys
+    if (x->is_leaf) {
+        if (NS_SIZE(t, x) <= 0) return;
+        nmin = NS_KEY_AT(t, x, 0);
+    } else {
+        // internal: need subtree min (may assert if subtree empty)
+        // if its leftmost leaf empty, tree is already broken; assume rebalance will prevent that
+        nmin = subtree_first_key(t, x);
+    }
+
+    int idx = path->slot[d];
+    if (idx > 0) {
+        store_set_key(t, path->node[d - 1], idx - 1, nmin);
+    }
+}
+
+// -------------------- Search helpers --------------------
+
+// B+ tree descent uses upper_bound semantics (equal goes right)
+static int child_slot(const BPTree* t, const BPTreeNode* x, int key) {
+    int n = NS_SIZE(t, x);
+    int idx = NS_LOWER_BOUND(t, x, key); // first >= key
+    if (idx < n && NS_KEY_AT(t, x, idx) == key) idx++; // make it upper_bound
+    return idx;
+}
+
+static BPTreeNode* find_leaf(const BPTree* t, int key) {
+    BPTreeNode* x = t->root;
+    BPTREE_COUNT(t, descents, 1);
+    BPTREE_COUNT(t, node_visits, 1); // the leaf
+    while (x && !x->is_leaf) {
+        BPTREE_COUNT(t, node_visits, 1);
+        x = parent_child_at(t, x, child_slot(t, x, key));
+    }
+    return x;
+}
+
+// rightmost leaf: every slot on the path is the last child
+static BPTreeNode* find_right_edge(const BPTree* t, DescentPath* path) {
+    BPTreeNode* x = t->root;
+    int d = 0;
+    path->node[0] = x;
+    path->slot[0] = 0;
+    while (x && !x->is_leaf) {
+        int idx = NS_SIZE(t, x);
+        x = parent_child_at(t, x, idx);
+        ++d;
+        assert(d < BPTREE_MAX_HEIGHT);
+        path->node[d] = x;
+        path->slot[d] = idx;
+    }
+    path->depth = d;
+    BPTREE_COUNT(t, descents, 1);
+    BPTREE_COUNT(t, node_visits, d + 1);
+    return x;
+}
+
+static BPTreeNode* find_leaf_path(const BPTree* t, int key, DescentPath* path) {
+    BPTreeNode* x = t->root;
+    int d = 0;
+    path->node[0] = x;
+    path->slot[0] = 0;
+    while (x && !x->is_leaf) {
+        int idx = child_slot(t, x, key);
+        x = parent_child_at(t, x, idx);
+        ++d;
+        assert(d < BPTREE_MAX_HEIGHT);
+        path->node[d] = x;
+        path->slot[d] = idx;
+    }
+    path->depth = d;
+    BPTREE_COUNT(t, descents, 1);
+    BPTREE_COUNT(t, node_visits, d + 1);
+    return x;
+}
+
+static int leaf_find(const BPTree* t, const BPTreeNode* leaf, int key, int* out_idx) {
+    int n = NS_SIZE(t, leaf);
+    int idx = NS_LOWER_BOUND(t, leaf, key);
+    if (out_idx) *out_idx = idx;
+    if (idx < n && NS_KEY_AT(t, leaf, idx) == key) return 1;
+    return 0;
+}
+
+// -------------------- Finger (bptree_set_finger) --------------------
+//
+// The finger keeps the path of the latest descent and the key range routed to
+// its leaf: the separators on either side of the slot taken, the deepest ones
+// being the tightest. A key in that range is looked up, inserted or deleted
+// from the cached path without a descent. Only internal nodes decide the
+// range, and every write to one, every node freed and every new root bumps
+// t->shape, so a finger taken at an older shape is ignored: a split or merge
+// never leaves a stale path behind, while plain leaf writes keep the finger.
+// Lookups retake it through a const tree, as leaf_count does: a fingered tree
+// is never concurrent (nor buffered, whose lookups must see every buffer).
+
+static void finger_take(const BPTree* t, const DescentPath* path) {
+    BPTree* w = (BPTree*)t;
+    int64_t lo = INT64_MIN, hi = INT64_MAX;
+    for (int d = path->depth; d > 0; --d) {
+        const BPTreeNode* p = path->node[d - 1];
+        int s = path->slot[d];
+        if (lo == INT64_MIN && s > 0) lo = NS_KEY_AT(t, p, s - 1);
+        if (hi == INT64_MAX && s < NS_SIZE(t, p)) hi = NS_KEY_AT(t, p, s);
+    }
+    w->finger_lo = lo;
+    w->finger_hi = hi;
+    w->finger_shape = t->shape;
+    w->finger_path.depth = path->depth;
+    memcpy(w->finger_path.node, path->node, sizeof(path->node[0]) * (size_t)(path->depth + 1));
+    memcpy(w->finger_path.slot, path->slot, sizeof(path->slot[0]) * (size_t)(path->depth + 1));
+}
+
+static int finger_hit(const BPTree* t, int key) {
+    return t->finger_shape == t->shape && key >= t->finger_lo && key < t->finger_hi;
+}
+
+// find_leaf_path through the finger, which it retakes on a miss
+static BPTreeNode* finger_leaf_path(const BPTree* t, int key, DescentPath* path) {
+    if (!t->finger) return find_leaf_path(t, key, path);
+    if (finger_hit(t, key)) {
+        BPTREE_COUNT(t, finger_hits, 1);
+        const DescentPath* f = &t->finger_path;
+        path->depth = f->depth;
+        memcpy(path->node, f->node, sizeof(f->node[0]) * (size_t)(f->depth + 1));
+        memcpy(path->slot, f->slot, sizeof(f->slot[0]) * (size_t)(f->depth + 1));
+        return path->node[path->depth];
+    }
+    BPTreeNode* leaf = find_leaf_path(t, key, path);
+    finger_take(t, path);
+    return leaf;
+}
+
+// the leaf for key through the finger (t->finger set)
+static BPTreeNode* finger_leaf(const BPTree* t, int key) {
+    if (finger_hit(t, key)) {
+        BPTREE_COUNT(t, finger_hits, 1);
+        return t->finger_path.node[t->finger_path.depth];
+    }
+    DescentPath path;
+    BPTreeNode* leaf = find_leaf_path(t, key, &path);
+    finger_take(t, &path);
+    return leaf;
+}
+
+// -------------------- Message buffers (buffered mode) --------------------
+//
+// Only parents of leaves carry buffers, and every message lies in its node's
+// key range, so a lookup meets the message for its key on the way down and a
+// flush routes messages with child_slot like keys. To keep those ranges
+// fixed, buffered mode never raises a separator above the leaves: an internal
+// split pushes up its old middle key, a borrow from the left takes the old
+// separator (a separator below its subtree's minimum is still valid), and a
+// split, borrow or merge of a buffered node moves the messages of the moved
+// range along with it.
+
+// first message with key >= key
+static int buf_lower(const BPTreeBuffer* b, int key) {
+    int lo = 0, hi = b->n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (b->msg[mid].key < key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// 1/0 as the message for key in x says, -1 if x has none
+static int buf_lookup(const BPTreeNode* x, int key) {
+    const BPTreeBuffer* b = x->buf;
+    if (!b || b->n == 0) return -1;
+    int i = buf_lower(b, key);
+    return (i < b->n && b->msg[i].key == key) ? b->msg[i].insert : -1;
+}
+
+static BPTreeBuffer* buf_reserve(BPTreeNode* x, int extra) {
+    BPTreeBuffer* b = x->buf;
+    int need = (b ? b->n : 0) + extra;
+    if (b && need <= b->cap) return b;
+    int cap = b ? b->cap : 0;
+    while (cap < need) cap = cap ? cap * 2 : 16;
+    BPTreeBuffer* nb = (BPTreeBuffer*)realloc(b, sizeof(BPTreeBuffer) + sizeof(BPTreeMsg) * (size_t)cap);
+    assert(nb);
+    if (!b) nb->n = 0;
+    nb->cap = cap;
+    x->buf = nb;
+    return nb;
+}
+
+// record the newest write for key, replacing an older message
+static void buf_put(BPTreeNode* x, int key, int insert) {
+    BPTreeBuffer* b = buf_reserve(x, 1);
+    int i = buf_lower(b, key);
+    if (i < b->n && b->msg[i].key == key) {
+        b->msg[i].insert = insert;
+        return;
+    }
+    memmove(&b->msg[i + 1], &b->msg[i], sizeof(BPTreeMsg) * (size_t)(b->n - i));
+    b->msg[i].key = key;
+    b->msg[i].insert = insert;
+    b->n++;
+}
+
+// move from's messages [lo, hi) to the front of to's buffer (front: they are
+// all below to's keys) or to its back (all above)
+static void buf_transfer(BPTreeNode* to, BPTreeNode* from, int lo, int hi, int front) {
+    int c = hi - lo;
+    if (c <= 0) return;
+    BPTreeBuffer* b = buf_reserve(to, c);
+    BPTreeBuffer* f = from->buf;
+    if (front) {
+        memmove(&b->msg[c], &b->msg[0], sizeof(BPTreeMsg) * (size_t)b->n);
+        memcpy(&b->msg[0], &f->msg[lo], sizeof(BPTreeMsg) * (size_t)c);
+    } else {
+        memcpy(&b->msg[b->n], &f->msg[lo], sizeof(BPTreeMsg) * (size_t)c);
+    }
+    b->n += c;
+    memmove(&f->msg[lo], &f->msg[hi], sizeof(BPTreeMsg) * (size_t)(f->n - hi));
+    f->n -= c;
+}
+
+// -------------------- Optimistic search (concurrent mode) --------------------
+
+// Lock-free descent (optimistic lock coupling): no shared writes; a node is
+// used only if its version is unchanged afterwards, else restart from the
+// root. A racing writer can leave size and contents inconsistent until that
+// check, so reads go to the raw key/child arrays with indexes clamped to the
+// capacity. Retired nodes stay readable until the caller's epoch ends.
+// With val, a hit also reads key's leaf val, validated with the leaf.
+static int impl_get_olc(const BPTree* t, int key, void** val) {
+    int cap = t->max_keys + 1;
+    BPTREE_COUNT(t, descents, 1);
+restart:;
+    const BPTreeNode* x = __atomic_load_n(&t->root, __ATOMIC_ACQUIRE);
+    uint64_t v = bptree_olc_read_begin(x);
+    // x may have stopped being the root before v was read
+    if ((v & BPTREE_OLC_OBSOLETE) || __atomic_load_n(&t->root, __ATOMIC_ACQUIRE) != x) goto restart;
+
+    for (;;) {
+        BPTREE_COUNT(t, node_visits, 1); // restarts included
+        int n = NS_SIZE(t, x);
+        if (n > cap) n = cap;
+        int idx = NS_LOWER_BOUND(t, x, key);
+        if (idx > n) idx = n;
+        int hit = idx < n && NS_KEY_DATA(t, x)[idx] == key;
+        if (x->is_leaf) {
+            void* slot = (hit && val) ? NS_VAL_DATA(t, x)[idx] : 0;
+            if (!bptree_olc_validate(x, v)) goto restart;
+            if (hit && val) *val = slot;
+            return hit;
+        }
+
+        idx += hit; // upper_bound
+        const BPTreeNode* c = idx == 0 ? x->child0 : (const BPTreeNode*)NS_VAL_DATA(t, x)[idx - 1];
+        if (!bptree_olc_validate(x, v)) goto restart; // c is a real child of x
+        uint64_t cv = bptree_olc_read_begin(c);
+        if ((cv & BPTREE_OLC_OBSOLETE) || !bptree_olc_validate(x, v)) goto restart; // and still is
+        x = c;
+        v = cv;
+    }
+}
+
+static int impl_search_olc(const BPTree* t, int key) {
+    return impl_get_olc(t, key, 0);
+}
+
+// -------------------- Batched search --------------------
+
+// G descents in lockstep, one level per step: every lookup moves to its child
+// and prefetches it, then every lookup prefetches that child's keys, and only
+// the next step searches them, so the misses of the whole group overlap.
+static void impl_search_group(const BPTree* t, const int* keys, size_t g, uint8_t* found) {
+    const BPTreeNode* cur[BPTREE_BATCH_GROUP];
+    int msg[BPTREE_BATCH_GROUP]; // buffered mode: answer from a message, or -1
+    assert(g <= BPTREE_BATCH_GROUP);
+    if (g == 0) return;
+    for (size_t i = 0; i < g; ++i) {
+        cur[i] = t->root;
+        msg[i] = -1;
+    }
+    BPTREE_COUNT(t, descents, g);
+    BPTREE_COUNT(t, node_visits, g); // the leaves
+
+    while (!cur[0]->is_leaf) { // balanced: all lookups reach the leaves together
+        BPTREE_COUNT(t, node_visits, g);
+        for (size_t i = 0; i < g; ++i) {
+            if (cur[i]->buf && msg[i] < 0) msg[i] = buf_lookup(cur[i], keys[i]);
+            cur[i] = parent_child_at(t, cur[i], child_slot(t, cur[i], keys[i]));
+            __builtin_prefetch(cur[i]);
+        }
+        for (size_t i = 0; i < g; ++i) NS_PREFETCH(t, cur[i]);
+    }
+    for (size_t i = 0; i < g; ++i) {
+        leaf_count(t, cur[i], 0);
+        found[i] = (uint8_t)(msg[i] >= 0 ? msg[i] : leaf_find(t, cur[i], keys[i], 0));
+    }
+}
+
+// -------------------- Range scan --------------------
+
+// leaf and slot of the first key >= key; NULL past the last key
+static const BPTreeNode* impl_seek(const BPTree* t, int key, int* out_idx) {
+    const BPTreeNode* leaf = find_leaf(t, key);
+    if (leaf) leaf_count(t, leaf, 0);
+    int idx = leaf ? NS_LOWER_BOUND(t, leaf, key) : 0;
+    while (leaf && idx >= NS_SIZE(t, leaf)) { // all of this leaf is < key: go right
+        leaf = leaf->next;
+        idx = 0;
+    }
+    *out_idx = idx;
+    return leaf;
+}
+
+// number of keys <= hi in leaf
+static int leaf_upper(const BPTree* t, const BPTreeNode* leaf, int hi) {
+    int n = NS_SIZE(t, leaf);
+    int idx = NS_LOWER_BOUND(t, leaf, hi);
+    if (idx < n && NS_KEY_AT(t, leaf, idx) == hi) idx++;
+    return idx;
+}
+
+// one descent to lo, then leaf by leaf; each leaf's keys in [lo, hi] go to fn
+// as one slice: zero-copy from NS_KEY_DATA, else copied into scratch
+// (max_keys ints). fn == NULL only counts.
+static size_t impl_range_scan(const BPTree* t, int lo, int hi, BPTreeSliceFn fn, void* arg, int* scratch) {
+    size_t total = 0;
+    int idx = 0;
+    const BPTreeNode* leaf = impl_seek(t, lo, &idx);
+    for (; leaf; leaf = leaf->next, idx = 0) {
+        int n = NS_SIZE(t, leaf);
+        if (n == 0) continue;
+        int end = (NS_KEY_AT(t, leaf, n - 1) <= hi) ? n : leaf_upper(t, leaf, hi);
+        if (end > idx) {
+            total += (size_t)(end - idx);
+            if (fn) {
+                const int* keys = NS_KEY_DATA(t, leaf);
+                if (keys) {
+                    keys += idx;
+                } else {
+                    for (int i = idx; i < end; ++i) scratch[i - idx] = NS_KEY_AT(t, leaf, i);
+                    keys = scratch;
+                }
+                if (fn(keys, (size_t)(end - idx), arg)) break;
+            }
+        }
+        if (end < n) break; // reached hi inside this leaf
+    }
+    return total;
+}
+
+// -------------------- Insert: split / insert_into_parent --------------------
+//
+// A leaf whose inserts keep landing right behind the previous one (ascending
+// keys, at its tail or ahead of a few larger keys) is being filled by a run.
+// Its split leaves the left part, which the run has passed, up to
+// BPTREE_SEQ_LEFT_PCT percent full instead of half, and moves the run's
+// position to the right leaf, so sorted input fills leaves and splits less.
+// That right leaf deliberately starts below min_leaf_keys and stays there
+// until more keys arrive: if the run stops (or never resumes after mixed
+// workloads), such short leaves persist, so minimum occupancy does not hold
+// for every leaf. Deletes borrow from and merge them like any short leaf.
+
+#define BPTREE_SEQ_RUN 4            // inserts in a row that make a run
+#define BPTREE_SEQ_LEFT_PCT 90
+
+static void leaf_note_insert(BPTreeNode* leaf, int idx) {
+    if (idx != leaf->last_insert + 1) leaf->insert_run = 0;
+    else if (leaf->insert_run < BPTREE_SEQ_RUN) leaf->insert_run++;
+    leaf->last_insert = idx;
+}
+
+// entries the left leaf keeps when leaf (total entries) splits
+static int leaf_split_point(const BPTreeNode* leaf, int total) {
+    int half = (total + 1) / 2; // typical B+ leaf split: left gets ceil(total/2)
+    if (leaf->insert_run < BPTREE_SEQ_RUN || leaf->last_insert < half) return half;
+    int biased = total * BPTREE_SEQ_LEFT_PCT / 100;
+    int at = leaf->last_insert < biased ? leaf->last_insert : biased;
+    return at > half ? at : half;
+}
+
+static void insert_into_parent(BPTree* t, const DescentPath* path, int d, int sep_key, BPTreeNode* right);
+
+static void split_leaf(BPTree* t, const DescentPath* path) {
+    BPTreeNode* leaf = path->node[path->depth];
+    int total = NS_SIZE(t, leaf);
+    assert(total == t->max_keys + 1);
+    node_write(t, leaf);
+    BPTREE_COUNT(t, leaf_splits, 1);
+
+    int left_sz = leaf_split_point(leaf, total);
+
+    const NodeStoreOps* kind = leaf_split_kind(t, leaf);
+    BPTreeNode* right = node_create_as(t, 1, kind);
+    right->parent = leaf->parent;
+    node_append_from(t, right, leaf, left_sz);
+    if (BPTREE_IMPL_ADAPTIVE && leaf->ops != kind) node_convert(t, leaf, kind); // left too, the larger part
+    right->reads = leaf->reads;
+    right->writes = leaf->writes;
+    if (leaf->last_insert >= left_sz) { // the run goes on in right
+        right->last_insert = leaf->last_insert - left_sz;
+        right->insert_run = leaf->insert_run;
+        leaf->last_insert = -2;
+        leaf->insert_run = 0;
+    }
+
+    right->next = leaf->next;
+    leaf->next = right;
+
+    // separator is min(right)
+    int sep = NS_KEY_AT(t, right, 0);
+
+    insert_into_parent(t, path, path->depth, sep, right);
+}
+
+// split internal with copy-key semantics:
+// parent key to insert = min(right) = subtree_first_key(right)
+static void split_internal(BPTree* t, const DescentPath* path, int d) {
+    BPTreeNode* x = path->node[d];
+    int k = NS_SIZE(t, x);
+    assert(k == t->max_keys + 1);
+    node_write(t, x);
+    BPTREE_COUNT(t, internal_splits, 1);
+
+    int nchildren = k + 1;
+    int left_children = (nchildren + 1) / 2; // ceil(nchildren/2)
+    int left_keys = left_children - 1;
+
+    // x keeps child0 and entries [0, left_keys); entry left_keys gives right
+    // its child0, entries after it move over as they are
+    BPTreeNode* right = node_create(t, 0);
+    right->parent = x->parent;
+    int mid_key = NS_KEY_AT(t, x, left_keys);
+    right->child0 = (BPTreeNode*)NS_VAL_AT(t, x, left_keys);
+    NS_APPEND_FROM(t, right, x, left_children);
+    NS_ERASE_AT(t, x, left_keys);
+    adopt_children(t, right, 0);
+
+    // buffered mode pushes up the old middle key, so that no range below shrinks,
+    // and hands the right half its messages
+    int sep_key = t->buffered ? mid_key : subtree_first_key(t, right);
+    if (x->buf) buf_transfer(right, x, buf_lower(x->buf, sep_key), x->buf->n, 0);
+
+    insert_into_parent(t, path, d, sep_key, right);
+}
+
+// Insert separator into parent at the position given by left's slot on the path
+// (left = path->node[d] keeps its slot across the split)
+static void insert_into_parent(BPTree* t, const DescentPath* path, int d, int sep_key, BPTreeNode* right) {
+    BPTreeNode* left = path->node[d];
+
+    if (d == 0) {
+        BPTreeNode* root = node_create(t, 0);
+        root->child0 = left;
+        left->parent = root;
+        NS_INSERT_AT(t, root, 0, sep_key, right); // key[0] = min(right), val[0]=right
+        right->parent = root;
+        bptree_set_root(t, root);
+        return;
+    }
+
+    BPTreeNode* parent = path->node[d - 1];
+    int j = path->slot[d];
+    assert(parent == left->parent);
+
+    // parent.key[j] corresponds to child[j+1] (new right)
+    node_write(t, parent);
+    NS_INSERT_AT(t, parent, j, sep_key, right);
+    right->parent = parent;
+
+    if (node_overflow(t, parent)) split_internal(t, path, d - 1);
+}
+
+// -------------------- Delete: borrow / merge / rebalance --------------------
+
+static void fix_root_after_delete(BPTree* t) {
+    // if root internal has no keys, shrink height; a root with pending messages
+    // stays until they are flushed into its only child
+    while (t->root && !t->root->is_leaf && NS_SIZE(t, t->root) == 0 &&
+           !(t->root->buf && t->root->buf->n > 0)) {
+        BPTreeNode* old = t->root;
+        BPTreeNode* nr = old->child0;
+        if (nr) nr->parent = 0;
+        node_write(t, old);
+        bptree_set_root(t, nr);
+        node_destroy(t, old);
+    }
+}
+
+// leaf borrow from left: move left last key -> leaf front; update parent sep for leaf
+static int borrow_from_left_leaf(BPTree* t, BPTreeNode* leaf, BPTreeNode* left, int leaf_idx_in_parent) {
+    int ln = NS_SIZE(t, left);
+    if (ln <= min_leaf_keys(t)) return 0;
+    node_write(t, left);
+    node_write(t, leaf);
+    BPTREE_COUNT(t, leaf_borrows, 1);
+
+    int k = NS_KEY_AT(t, left, ln - 1);
+    void* v = leaf_val(t, left, ln - 1);
+    NS_ERASE_AT(t, left, ln - 1);
+
+    NS_INSERT_AT(t, leaf, 0, k, v);
+
+    // parent key[leaf_idx-1] = min(leaf)
+    store_set_key(t, leaf->parent, leaf_idx_in_parent - 1, NS_KEY_AT(t, leaf, 0));
+    return 1;
+}
+
+// leaf borrow from right: move right first key -> leaf end; update parent sep for right
+static int borrow_from_right_leaf(BPTree* t, BPTreeNode* leaf, BPTreeNode* right, int leaf_idx_in_parent) {
+    int rn = NS_SIZE(t, right);
+    if (rn <= min_leaf_keys(t)) return 0;
+    node_write(t, right);
+    node_write(t, leaf);
+    BPTREE_COUNT(t, leaf_borrows, 1);
+
+    int k = NS_KEY_AT(t, right, 0);
+    void* v = leaf_val(t, right, 0);
+    NS_ERASE_AT(t, right, 0);
+
+    int ln = NS_SIZE(t, leaf);
+    NS_INSERT_AT(t, leaf, ln, k, v);
+
+    // parent key[leaf_idx] = min(right) (if right not empty)
+    if (NS_SIZE(t, right) > 0) {
+        store_set_key(t, leaf->parent, leaf_idx_in_parent, NS_KEY_AT(t, right, 0));
+    }
+    return 1;
+}
+
+// merge leaf into left (left is left sibling), remove parent entry (idx-1)
+static void merge_leaf_into_left(BPTree* t, BPTreeNode* left, BPTreeNode* leaf, int leaf_idx_in_parent) {
+    node_write(t, left);
+    node_write(t, leaf);
+    node_write(t, left->parent);
+    BPTREE_COUNT(t, leaf_merges, 1);
+    leaf_merge_kind(t, left, leaf);
+    node_append_from(t, left, leaf, 0);
+    left->next = leaf->next;
+
+    assert(leaf_idx_in_parent > 0);
+    NS_ERASE_AT(t, left->parent, leaf_idx_in_parent - 1); // remove pointer to leaf
+
+    node_destroy(t, leaf);
+}
+
+// merge right into leaf (leaf is left), remove parent entry (idx)
+static void merge_right_leaf_into_leaf(BPTree* t, BPTreeNode* leaf, BPTreeNode* right, int leaf_idx_in_parent) {
+    node_write(t, leaf);
+    node_write(t, right);
+    node_write(t, leaf->parent);
+    BPTREE_COUNT(t, leaf_merges, 1);
+    leaf_merge_kind(t, leaf, right);
+    node_append_from(t, leaf, right, 0);
+    leaf->next = right->next;
+
+    NS_ERASE_AT(t, leaf->parent, leaf_idx_in_parent); // remove pointer to right
+
+    node_destroy(t, right);
+}
+
+// internal borrow from left (copy-key semantics):
+// move left's last child to x's front; parent sep becomes min(x) after move.
+static int borrow_from_left_internal(BPTree* t, BPTreeNode* x, BPTreeNode* left, int x_idx_in_parent) {
+    int lkeys = NS_SIZE(t, left);
+    if (lkeys <= min_internal_keys(t)) return 0;
+    node_write(t, left);
+    node_write(t, x);
+    BPTREE_COUNT(t, internal_borrows, 1);
+
+    // parent sep for x is key[x_idx-1] = min(x)
+    int parent_sep = NS_KEY_AT(t, x->parent, x_idx_in_parent - 1);
+
+    // take left's last child (val[last]) and erase that entry
+    BPTreeNode* borrow_child = (BPTreeNode*)NS_VAL_AT(t, left, lkeys - 1);
+    int borrow_child_min = subtree_first_key(t, borrow_child);
+    int borrow_child_sep = NS_KEY_AT(t, left, lkeys - 1);
+    NS_ERASE_AT(t, left, lkeys - 1);
+
+    // x: insert new key at front = old parent_sep, val = old child0
+    BPTreeNode* old_c0 = x->child0;
+    x->child0 = borrow_child;
+    if (borrow_child) borrow_child->parent = x;
+
+    NS_INSERT_AT(t, x, 0, parent_sep, old_c0);
+    if (old_c0) old_c0->parent = x;
+
+    // update parent sep for x to new min(x) = min(borrow_child); buffered mode
+    // keeps left's old separator and moves the messages of borrow_child's range
+    int new_sep = t->buffered ? borrow_child_sep : borrow_child_min;
+    if (left->buf) buf_transfer(x, left, buf_lower(left->buf, new_sep), left->buf->n, 1);
+    store_set_key(t, x->parent, x_idx_in_parent - 1, new_sep);
+    return 1;
+}
+
+// internal borrow from right (copy-key semantics):
+// move right's child0 to x's end; x appends parent's sep; parent sep becomes new min(right)
+static int borrow_from_right_internal(BPTree* t, BPTreeNode* x, BPTreeNode* right, int x_idx_in_parent) {
+    int rkeys = NS_SIZE(t, right);
+    if (rkeys <= min_internal_keys(t)) return 0;
+    node_write(t, right);
+    node_write(t, x);
+    BPTREE_COUNT(t, internal_borrows, 1);
+
+    // parent sep for right is key[x_idx] = min(right)
+    int parent_sep = NS_KEY_AT(t, x->parent, x_idx_in_parent);
+
+    // borrow right.child0
+    BPTreeNode* borrow_child = right->child0;
+
+    // right: shift child0 to old child1 (val[0]), erase entry 0
+    BPTreeNode* new_c0 = (BPTreeNode*)NS_VAL_AT(t, right, 0); // old child1
+    int new_right_min = NS_KEY_AT(t, right, 0);              // min(new_c0)
+    NS_ERASE_AT(t, right, 0);
+    right->child0 = new_c0;
+    if (new_c0) new_c0->parent = right;
+
+    // x append: key = parent_sep (min(borrow_child)), val = borrow_child
+    int xn = NS_SIZE(t, x);
+    NS_INSERT_AT(t, x, xn, parent_sep, borrow_child);
+    if (borrow_child) borrow_child->parent = x;
+
+    // parent sep becomes min(right) after shift
+    if (right->buf) buf_transfer(x, right, 0, buf_lower(right->buf, new_right_min), 0);
+    store_set_key(t, x->parent, x_idx_in_parent, new_right_min);
+    return 1;
+}
+
+// merge internal x into left (left is left sibling), using parent sep key[x_idx-1]
+static void merge_internal_into_left(BPTree* t, BPTreeNode* left, BPTreeNode* x, int x_idx_in_parent) {
+    node_write(t, left);
+    node_write(t, x);
+    node_write(t, left->parent);
+    BPTREE_COUNT(t, internal_merges, 1);
+    int sep = NS_KEY_AT(t, left->parent, x_idx_in_parent - 1);
+
+    int ln = NS_SIZE(t, left);
+
+    // append sep with val = x->child0 (because sep == min(x))
+    NS_INSERT_AT(t, left, ln, sep, x->child0);
+    if (x->child0) x->child0->parent = left;
+
+    // append x's (key,val) entries as-is
+    NS_APPEND_FROM(t, left, x, 0);
+    adopt_children(t, left, ln + 1);
+
+    // remove parent entry that pointed to x
+    NS_ERASE_AT(t, left->parent, x_idx_in_parent - 1);
+
+    if (x->buf) buf_transfer(left, x, 0, x->buf->n, 0);
+    node_destroy(t, x);
+}
+
+// merge right into x (x is left sibling), using parent sep key[x_idx]
+static void merge_right_internal_into_x(BPTree* t, BPTreeNode* x, BPTreeNode* right, int x_idx_in_parent) {
+    node_write(t, x);
+    node_write(t, right);
+    node_write(t, x->parent);
+    BPTREE_COUNT(t, internal_merges, 1);
+    int sep = NS_KEY_AT(t, x->parent, x_idx_in_parent);
+
+    int xn = NS_SIZE(t, x);
+
+    // append sep with val = right->child0 (sep == min(right))
+    NS_INSERT_AT(t, x, xn, sep, right->child0);
+    if (right->child0) right->child0->parent = x;
+
+    NS_APPEND_FROM(t, x, right, 0);
+    adopt_children(t, x, xn + 1);
+
+    NS_ERASE_AT(t, x->parent, x_idx_in_parent);
+
+    if (right->buf) buf_transfer(x, right, 0, right->buf->n, 0);
+    node_destroy(t, right);
+}
+
+static void rebalance_after_delete(BPTree* t, const DescentPath* path, int d) {
+    BPTreeNode* x = path->node[d];
+    if (!x) return;
+
+    if (d == 0) {
+        fix_root_after_delete(t);
+        return;
+    }
+
+    BPTreeNode* parent = path->node[d - 1];
+    int x_idx = path->slot[d];
+    assert(parent == x->parent);
+
+    int nkeys = NS_SIZE(t, x);
+
+    if (x->is_leaf) {
+        // not underflow
+        if (nkeys >= min_leaf_keys(t)) {
+            update_parent_sep_if_needed(t, path, d); // leaf min may change after deletion
+            return;
+        }
+
+        // underflow
+        BPTreeNode* left  = (x_idx > 0) ? parent_child_at(t, parent, x_idx - 1) : NULL;
+        BPTreeNode* right = (x_idx < NS_SIZE(t, parent)) ? parent_child_at(t, parent, x_idx + 1) : NULL;
+
+        if (left  && borrow_from_left_leaf(t, x, left, x_idx)) return;
+        if (right && borrow_from_right_leaf(t, x, right, x_idx)) return;
+
+        // merge
+        if (left) {
+            merge_leaf_into_left(t, left, x, x_idx);
+            rebalance_after_delete(t, path, d - 1);
+        } else if (right) {
+            merge_right_leaf_into_leaf(t, x, right, x_idx);
+            rebalance_after_delete(t, path, d - 1);
+        }
+        return;
+    }
+
+    // internal node
+    if (nkeys >= min_internal_keys(t)) {
+        // internal min can change if its child0 changed in previous ops; keep parent consistent
+        update_parent_sep_if_needed(t, path, d);
+        return;
+    }
+
+    BPTreeNode* left  = (x_idx > 0) ? parent_child_at(t, parent, x_idx - 1) : NULL;
+    BPTreeNode* right = (x_idx < NS_SIZE(t, parent)) ? parent_child_at(t, parent, x_idx + 1) : NULL;
+
+    if (left  && borrow_from_left_internal(t, x, left, x_idx)) return;
+    if (right && borrow_from_right_internal(t, x, right, x_idx)) return;
+
+    // merge
+    if (left) {
+        merge_internal_into_left(t, left, x, x_idx);
+        rebalance_after_delete(t, path, d - 1);
+    } else if (right) {
+        merge_right_internal_into_x(t, x, right, x_idx);
+        rebalance_after_delete(t, path, d - 1);
+    }
+}
+
+// x = path->node[d] (d > 0, so x has a sibling) is below the minimum, by any
+// amount: merge it with a sibling when both fit in one node, otherwise even
+// the two out, which leaves both at least minimal. Returns 1 on a merge, where
+// the parent lost a key and may be short in turn.
+static int fix_short_node(BPTree* t, const DescentPath* path, int d) {
+    BPTreeNode* x = path->node[d];
+    BPTreeNode* parent = path->node[d - 1];
+    int idx = path->slot[d];
+    int n = NS_SIZE(t, x);
+    BPTreeNode* left  = (idx > 0) ? parent_child_at(t, parent, idx - 1) : NULL;
+    BPTreeNode* right = (idx < NS_SIZE(t, parent)) ? parent_child_at(t, parent, idx + 1) : NULL;
+
+    if (!x->is_leaf) {
+        // a merge also pulls the parent separator down
+        if (left && NS_SIZE(t, left) + n + 1 <= t->max_keys) {
+            merge_internal_into_left(t, left, x, idx);
+            return 1;
+        }
+        if (right && n + NS_SIZE(t, right) + 1 <= t->max_keys) {
+            merge_right_internal_into_x(t, x, right, idx);
+            return 1;
+        }
+        while (NS_SIZE(t, x) < min_internal_keys(t)) {
+            if (left && borrow_from_left_internal(t, x, left, idx)) continue;
+            if (right && borrow_from_right_internal(t, x, right, idx)) continue;
+            break;
+        }
+        return 0;
+    }
+
+    if (left && NS_SIZE(t, left) + n <= t->max_keys) {
+        merge_leaf_into_left(t, left, x, idx);
+        return 1;
+    }
+    if (right && n + NS_SIZE(t, right) <= t->max_keys) {
+        merge_right_leaf_into_leaf(t, x, right, idx);
+        return 1;
+    }
+    // one move and one separator update rather than a borrow per key
+    if (left) { // left's tail -> x's front
+        node_write(t, left);
+        node_write(t, x);
+        BPTREE_COUNT(t, leaf_borrows, 1);
+        int ln = NS_SIZE(t, left);
+        for (int c = (ln - n) / 2; c > 0; --c, --ln) {
+            NS_INSERT_AT(t, x, 0, NS_KEY_AT(t, left, ln - 1), leaf_val(t, left, ln - 1));
+            NS_ERASE_AT(t, left, ln - 1);
+        }
+        store_set_key(t, parent, idx - 1, NS_KEY_AT(t, x, 0));
+    } else if (right) { // right's head -> x's tail
+        node_write(t, right);
+        node_write(t, x);
+        BPTREE_COUNT(t, leaf_borrows, 1);
+        for (int c = (NS_SIZE(t, right) - n) / 2; c > 0; --c) {
+            NS_INSERT_AT(t, x, NS_SIZE(t, x), NS_KEY_AT(t, right, 0), leaf_val(t, right, 0));
+            NS_ERASE_AT(t, right, 0);
+        }
+        store_set_key(t, parent, idx, NS_KEY_AT(t, right, 0));
+    }
+    return 0;
+}
+
+// -------------------- Range delete --------------------
+
+// frees the subtree at x; returns the keys its leaves held
+static size_t destroy_subtree(BPTree* t, BPTreeNode* x) {
+    if (!x) return 0;
+    size_t keys = 0;
+    if (!x->is_leaf) {
+        int n = NS_SIZE(t, x);
+        keys += destroy_subtree(t, x->child0);
+        for (int i = 0; i < n; ++i) {
+            BPTreeNode* c = (BPTreeNode*)NS_VAL_AT(t, x, i);
+            keys += destroy_subtree(t, c);
+        }
+    } else {
+        keys = (size_t)NS_SIZE(t, x);
+        if (!bptree_value_inline(t)) {
+            for (size_t i = 0; i < keys; ++i) leaf_val_release(t, x, (int)i);
+        }
+    }
+    node_destroy(t, x);
+    return keys;
+}
+
+// rightmost leaf holding a key < key; NULL if there is none
+static BPTreeNode* leaf_before(const BPTree* t, int key) {
+    if (key == INT_MIN) return NULL;
+    BPTreeNode* x = t->root;
+    BPTreeNode* left = NULL; // deepest left neighbour of the path: all its keys are < key
+    while (!x->is_leaf) {
+        int i = child_slot(t, x, key - 1);
+        if (i > 0) left = parent_child_at(t, x, i - 1);
+        x = parent_child_at(t, x, i);
+    }
+    if (NS_SIZE(t, x) > 0 && NS_KEY_AT(t, x, 0) < key) return x;
+    if (!left) return NULL;
+    while (!left->is_leaf) left = parent_child_at(t, left, NS_SIZE(t, left));
+    return left;
+}
+
+// leftmost leaf holding a key > key; NULL if there is none
+static BPTreeNode* leaf_after(const BPTree* t, int key) {
+    if (key == INT_MAX) return NULL;
+    BPTreeNode* x = find_leaf(t, key + 1);
+    int n = NS_SIZE(t, x);
+    return (n > 0 && NS_KEY_AT(t, x, n - 1) > key) ? x : x->next;
+}
+
+// Removes the keys in [lo, hi] below x, whose key range [xlo, xhi) overlaps
+// it. Children inside [lo, hi] are freed whole, at most the first and the
+// last overlapping child are descended into, and the emptied ones go too.
+// Nothing is rebalanced here. *emptied: nothing is left below x (x itself is
+// then the caller's to free). Returns the keys removed.
+static size_t range_trim(BPTree* t, BPTreeNode* x, int lo, int hi,
+                         int64_t xlo, int64_t xhi, int* emptied) {
+    node_write(t, x);
+    if (x->is_leaf) {
+        int i = NS_LOWER_BOUND(t, x, lo);
+        int j = leaf_upper(t, x, hi);
+        for (int c = i; c < j; ++c) {
+            leaf_val_release(t, x, i);
+            NS_ERASE_AT(t, x, i);
+        }
+        *emptied = NS_SIZE(t, x) == 0;
+        return (size_t)(j > i ? j - i : 0);
+    }
+
+    int nk = NS_SIZE(t, x);
+    int first = child_slot(t, x, lo);
+    int last = child_slot(t, x, hi);
+    size_t removed = 0;
+
+    // children strictly between first and last lie inside [lo, hi]
+    int keep_first = 0, keep_last = 0;
+    for (int e = 0; e < 2; ++e) {
+        int i = e ? last : first;
+        if (e && last == first) {
+            keep_last = keep_first;
+            break;
+        }
+        int64_t clo = (i == 0) ? xlo : NS_KEY_AT(t, x, i - 1);
+        int64_t chi = (i == nk) ? xhi : NS_KEY_AT(t, x, i);
+        BPTreeNode* c = parent_child_at(t, x, i);
+        int gone = 1;
+        if (clo >= lo && chi - 1 <= hi) {
+            removed += destroy_subtree(t, c);
+        } else {
+            removed += range_trim(t, c, lo, hi, clo, chi, &gone);
+            if (gone) node_destroy(t, c);
+        }
+        if (e) keep_last = !gone;
+        else keep_first = !gone;
+    }
+    for (int i = first + 1; i < last; ++i) removed += destroy_subtree(t, parent_child_at(t, x, i));
+
+    // drop children a..b from x: the entries that point at them and the
+    // separator left of each (right of b's, if child0 goes)
+    int a = first + keep_first, b = last - keep_last;
+    *emptied = (a == 0 && b == nk);
+    if (*emptied || a > b) return removed;
+    if (a == 0) {
+        x->child0 = parent_child_at(t, x, b + 1);
+        for (int c = 0; c <= b; ++c) NS_ERASE_AT(t, x, 0);
+    } else {
+        for (int c = a; c <= b; ++c) NS_ERASE_AT(t, x, a - 1);
+    }
+    return removed;
+}
+
+// fixes the shallowest short node on the descent to key, after shrinking the
+// root; 0 if there was none. Top-down, every parent is already valid.
+static int repair_one(BPTree* t, int key) {
+    DescentPath path;
+    fix_root_after_delete(t);
+    find_leaf_path(t, key, &path);
+    for (int d = 1; d <= path.depth; ++d) {
+        BPTreeNode* x = path.node[d];
+        if (NS_SIZE(t, x) < (x->is_leaf ? min_leaf_keys(t) : min_internal_keys(t))) {
+            fix_short_node(t, &path, d);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+// Every node left short or emptied by range_trim had a key range holding lo-1
+// or hi+1, and still has, so the repair walks those two paths only.
+static size_t impl_delete_range(BPTree* t, int lo, int hi) {
+    BPTreeNode* before = leaf_before(t, lo);
+    BPTreeNode* after = leaf_after(t, hi);
+
+    int emptied = 0;
+    size_t removed = range_trim(t, t->root, lo, hi, INT_MIN, (int64_t)INT_MAX + 1, &emptied);
+    if (emptied && !t->root->is_leaf) {
+        node_destroy(t, t->root);
+        bptree_set_root(t, node_create(t, 1));
+        return removed;
+    }
+
+    // the leaves in between are gone
+    if (before && before != after) {
+        node_write(t, before);
+        before->next = after;
+    }
+
+    for (int more = 1; more;) {
+        more = 0;
+        if (lo > INT_MIN) more |= repair_one(t, lo - 1);
+        if (hi < INT_MAX) more |= repair_one(t, hi + 1);
+    }
+    fix_root_after_delete(t);
+    return removed;
+}
+
+// -------------------- Bulk load --------------------
+
+// per-node fill target, clamped to the node bounds [lo, hi]
+static int bulk_target(double fill, int lo, int hi) {
+    int c = (int)(fill * hi + 0.5);
+    return c < lo ? lo : (c > hi ? hi : c);
+}
+
+// number of nodes to spread total entries over: about target each, and with
+// an even spread none falls outside [lo, hi] (a single node is the root)
+static size_t bulk_groups(size_t total, int target, int lo, int hi) {
+    size_t g = (total + (size_t)target - 1) / (size_t)target;
+    if (g > 1 && total / g < (size_t)lo) g = total / (size_t)lo;
+    if (g == 0) g = 1;
+    assert((total + g - 1) / g <= (size_t)hi);
+    (void)hi;
+    return g;
+}
+
+// build leaves, then each internal level from the one below, left to right.
+// Precondition (checked by bptree_bulk_load): tree empty, keys ascending.
+// vals, if not NULL, holds value_size bytes per key (the first of duplicates kept).
+static int bulk_build(BPTree* t, const int* keys, const void* vals, size_t n, double fill) {
+    size_t nu = 0; // distinct keys
+    for (size_t i = 0; i < n; ++i) {
+        if (i == 0 || keys[i] != keys[i - 1]) ++nu;
+    }
+    if (nu == 0) return 1;
+    node_write(t, t->root);
+
+    int leaf_lo = min_leaf_keys(t);
+    size_t nleaves = bulk_groups(nu, bulk_target(fill, leaf_lo, t->max_keys), leaf_lo, t->max_keys);
+
+    // level being built: its nodes and their subtree minimums
+    BPTreeNode** level = (BPTreeNode**)malloc(sizeof(BPTreeNode*) * nleaves);
+    int* mins = (int*)malloc(sizeof(int) * nleaves);
+    if (!level || !mins) {
+        free(level);
+        free(mins);
+        return 0;
+    }
+
+    // an adaptive tree's bulk-loaded leaves have seen no writes yet
+    const NodeStoreOps* leaf_ops = t->leaf_ops;
+    if (BPTREE_IMPL_ADAPTIVE && t->adaptive) leaf_ops = t->adapt_read;
+    if (BPTREE_IMPL_ADAPTIVE && t->root->ops != leaf_ops) node_convert(t, t->root, leaf_ops); // still empty
+
+    size_t base = nu / nleaves, extra = nu % nleaves, src = 0;
+    BPTreeNode* prev = 0;
+    for (size_t g = 0; g < nleaves; ++g) {
+        BPTreeNode* leaf = (g == 0) ? t->root : node_create_as(t, 1, leaf_ops); // reuse the empty root leaf
+        int cnt = (int)(base + (g < extra));
+        for (int i = 0; i < cnt; ++i) {
+            while (src > 0 && keys[src] == keys[src - 1]) ++src; // skip duplicates
+            void* v = vals ? value_make(t, (const unsigned char*)vals + t->value_size * src) : 0;
+            NS_INSERT_AT(t, leaf, i, keys[src++], v);
+        }
+        if (prev) prev->next = leaf;
+        prev = leaf;
+        level[g] = leaf;
+        mins[g] = NS_KEY_AT(t, leaf, 0);
+    }
+
+    // internal levels, rebuilt in place: group g is written after its children are read
+    int child_lo = min_internal_keys(t) + 1;
+    int child_target = bulk_target(fill, child_lo, t->order_M);
+    size_t count = nleaves;
+    while (count > 1) {
+        size_t groups = bulk_groups(count, child_target, child_lo, t->order_M);
+        base = count / groups;
+        extra = count % groups;
+        src = 0;
+        for (size_t g = 0; g < groups; ++g) {
+            size_t cnt = base + (g < extra);
+            BPTreeNode* x = node_create(t, 0);
+            int xmin = mins[src];
+            x->child0 = level[src];
+            x->child0->parent = x;
+            for (size_t j = 1; j < cnt; ++j) {
+                BPTreeNode* c = level[src + j];
+                NS_INSERT_AT(t, x, (int)j - 1, mins[src + j], c); // key = min(child)
+                c->parent = x;
+            }
+            src += cnt;
+            level[g] = x;
+            mins[g] = xmin;
+        }
+        count = groups;
+    }
+
+    level[0]->parent = 0;
+    bptree_set_root(t, level[0]);
+    free(level);
+    free(mins);
+    return 1;
+}
+
+// -------------------- Buffered mode: flushing --------------------
+
+// exclusive upper bound of the keys routed to path's leaf: the tightest
+// separator to the right of the path; 0 if the leaf is the rightmost
+static int path_upper(const BPTree* t, const DescentPath* path, int* hi) {
+    int found = 0;
+    for (int d = path->depth; d > 0; --d) {
+        const BPTreeNode* p = path->node[d - 1];
+        if (path->slot[d] < NS_SIZE(t, p)) {
+            int k = NS_KEY_AT(t, p, path->slot[d]);
+            if (!found || k < *hi) *hi = k;
+            found = 1;
+        }
+    }
+    return found;
+}
+
+// leaf (shortened by a batch) below the minimum
+static void rebalance_short_leaf(BPTree* t, DescentPath* path) {
+    if (fix_short_node(t, path, path->depth)) rebalance_after_delete(t, path, path->depth - 1);
+    fix_root_after_delete(t);
+}
+
+// Apply m[0..cnt), sorted and all routed to path's leaf, as one batch. While
+// the leaf has room the messages go in place; if it would overflow, its keys
+// and the rest of the messages are merged and spread evenly over as many
+// leaves as they need. Only the final leaf size is rebalanced, once.
+static void apply_to_leaf(BPTree* t, DescentPath* path, const BPTreeMsg* m, int cnt) {
+    BPTreeNode* leaf = path->node[path->depth];
+    node_write(t, leaf);
+
+    int j = 0;
+    for (; j < cnt; ++j) {
+        int idx = 0;
+        int present = leaf_find(t, leaf, m[j].key, &idx);
+        if (m[j].insert == present) continue; // nothing to change
+        if (!present) {
+            if (NS_SIZE(t, leaf) == t->max_keys) break; // would overflow
+            NS_INSERT_AT(t, leaf, idx, m[j].key, 0);
+        } else {
+            NS_ERASE_AT(t, leaf, idx);
+        }
+    }
+
+    if (j == cnt) {
+        if (NS_SIZE(t, leaf) > 0) update_parent_sep_if_needed(t, path, path->depth);
+        if (NS_SIZE(t, leaf) < min_leaf_keys(t) && path->depth > 0) rebalance_short_leaf(t, path);
+        return;
+    }
+
+    int n = NS_SIZE(t, leaf);
+    int* keys = t->flush_keys; // n + cnt - j <= max_keys + cnt: flush_reserve(t, cnt) ran
+    int s = 0, i = 0;
+    while (i < n || j < cnt) {
+        int k = i < n ? NS_KEY_AT(t, leaf, i) : 0;
+        if (j == cnt || (i < n && k < m[j].key)) {
+            keys[s++] = k;
+            ++i;
+            continue;
+        }
+        if (i < n && k == m[j].key) ++i; // the message replaces the leaf's state
+        if (m[j].insert) keys[s++] = m[j].key;
+        ++j;
+    }
+
+    // s >= max_keys: every piece is within the leaf bounds
+    size_t groups = bulk_groups((size_t)s, t->max_keys, min_leaf_keys(t), t->max_keys);
+    int base = s / (int)groups, extra = s % (int)groups, src = 0;
+
+    NS_CLEAR(t, leaf);
+    for (int c = base + (extra > 0); src < c; ++src) NS_INSERT_AT(t, leaf, src, keys[src], 0);
+    update_parent_sep_if_needed(t, path, path->depth);
+
+    BPTreeNode* left = leaf;
+    for (size_t g = 1; g < groups; ++g) {
+        int c = base + ((int)g < extra);
+        BPTreeNode* right = node_create(t, 1);
+        right->parent = left->parent;
+        for (int q = 0; q < c; ++q) NS_INSERT_AT(t, right, q, keys[src + q], 0);
+        right->next = left->next;
+        left->next = right;
+        node_write(t, left);
+        insert_into_parent(t, path, path->depth, keys[src], right);
+        // splits above may have moved right: find it again
+        find_leaf_path(t, keys[src], path);
+        assert(path->node[path->depth] == right);
+        src += c;
+        left = right;
+    }
+}
+
+// the flush scratch holds a flush of cnt messages (allocated with the tree;
+// grows only after merges of buffered nodes)
+static void flush_reserve(BPTree* t, int cnt) {
+    int need = t->max_keys + cnt;
+    if (need <= t->flush_cap) return;
+    BPTreeMsg* m = (BPTreeMsg*)realloc(t->flush_msgs, sizeof(BPTreeMsg) * (size_t)need);
+    assert(m);
+    t->flush_msgs = m;
+    int* k = (int*)realloc(t->flush_keys, sizeof(int) * (size_t)need);
+    assert(k);
+    t->flush_keys = k;
+    t->flush_cap = need;
+}
+
+// x = path->node[path->depth - 1] is over its buffer limit: flush the
+// messages of its child with the most of them
+static void buffer_flush_one(BPTree* t, BPTreeNode* x) {
+    BPTreeBuffer* b = x->buf;
+    int nk = NS_SIZE(t, x);
+    int best_lo = 0, best_hi = 0, lo = 0;
+    for (int c = 0; c <= nk && lo < b->n; ++c) {
+        int hi = (c < nk) ? buf_lower(b, NS_KEY_AT(t, x, c)) : b->n;
+        if (hi - lo > best_hi - best_lo) {
+            best_lo = lo;
+            best_hi = hi;
+        }
+        lo = hi;
+    }
+
+    int cnt = best_hi - best_lo;
+    flush_reserve(t, cnt);
+    BPTreeMsg* m = t->flush_msgs;
+    memcpy(m, &b->msg[best_lo], sizeof(BPTreeMsg) * (size_t)cnt);
+    memmove(&b->msg[best_lo], &b->msg[best_hi], sizeof(BPTreeMsg) * (size_t)(b->n - best_hi));
+    b->n -= cnt;
+
+    DescentPath path;
+    find_leaf_path(t, m[0].key, &path);
+    apply_to_leaf(t, &path, m, cnt);
+    fix_root_after_delete(t); // a root emptied of keys may hold no messages any more
+}
+
+// buffered insert/delete: one message in the leaf's parent, which flushes a
+// child's worth of messages whenever it holds more than buffer_msgs
+static int buffered_put(BPTree* t, int key, int insert) {
+    DescentPath path;
+    BPTreeNode* leaf = find_leaf_path(t, key, &path);
+    if (path.depth == 0) return -1; // no buffer above a root leaf
+
+    BPTreeNode* x = path.node[path.depth - 1];
+    int present = buf_lookup(x, key);
+    if (present < 0) present = leaf_find(t, leaf, key, 0);
+    if (present == insert) return 0;
+
+    buf_put(x, key, insert);
+    while (x->buf->n > t->buffer_msgs) {
+        buffer_flush_one(t, x);
+        if (!find_leaf_path(t, key, &path) || path.depth == 0) break;
+        x = path.node[path.depth - 1];
+        if (!x->buf) break;
+    }
+    return 1;
+}
+
+// pending messages below x in key order (node ranges are ordered and
+// disjoint); with out, copies them there and empties the buffers
+static size_t gather_msgs(const BPTree* t, BPTreeNode* x, BPTreeMsg* out) {
+    if (!x || x->is_leaf) return 0;
+    if (x->child0->is_leaf) {
+        size_t n = x->buf ? (size_t)x->buf->n : 0;
+        if (out && n) {
+            memcpy(out, x->buf->msg, sizeof(BPTreeMsg) * n);
+            x->buf->n = 0;
+        }
+        return n;
+    }
+    size_t n = gather_msgs(t, x->child0, out);
+    int nk = NS_SIZE(t, x);
+    for (int i = 0; i < nk; ++i) n += gather_msgs(t, (BPTreeNode*)NS_VAL_AT(t, x, i), out ? out + n : 0);
+    return n;
+}
+
+// every message, applied leaf by leaf
+static void impl_flush(BPTree* t) {
+    if (!t->buffered) return;
+    size_t total = gather_msgs(t, t->root, 0);
+    if (total == 0) return;
+    BPTreeMsg* m = (BPTreeMsg*)malloc(sizeof(BPTreeMsg) * total);
+    assert(m);
+    gather_msgs(t, t->root, m);
+
+    DescentPath path;
+    for (size_t i = 0; i < total;) {
+        find_leaf_path(t, m[i].key, &path);
+        int hi = 0;
+        int bounded = path_upper(t, &path, &hi);
+        size_t j = i + 1;
+        while (j < total && (!bounded || m[j].key < hi)) ++j;
+        flush_reserve(t, (int)(j - i)); // m is not the scratch: it may move
+        apply_to_leaf(t, &path, m + i, (int)(j - i));
+        i = j;
+    }
+    free(m);
+    fix_root_after_delete(t);
+}
+
+// -------------------- Entry points --------------------
+
+static int impl_search(const BPTree* t, int key) {
+    const BPTreeNode* x;
+    if (t->finger) {
+        x = finger_leaf(t, key);
+    } else {
+        x = t->root;
+        BPTREE_COUNT(t, descents, 1);
+        BPTREE_COUNT(t, node_visits, 1); // the leaf
+    }
+    while (x && !x->is_leaf) {
+        BPTREE_COUNT(t, node_visits, 1);
+        if (x->buf) { // buffered mode: a pending message is the newest state
+            int m = buf_lookup(x, key);
+            if (m >= 0) return m;
+        }
+        x = parent_child_at(t, x, child_slot(t, x, key));
+    }
+    if (!x) return 0;
+    leaf_count(t, x, 0);
+    return leaf_find(t, x, key, 0);
+}
+
+static int impl_get(const BPTree* t, int key, void** val) {
+    const BPTreeNode* leaf = t->finger ? finger_leaf(t, key) : find_leaf(t, key);
+    int idx = 0;
+    if (!leaf) return 0;
+    leaf_count(t, leaf, 0);
+    if (!leaf_find(t, leaf, key, &idx)) return 0;
+    *val = NS_VAL_AT(t, leaf, idx);
+    return 1;
+}
+
+static int direct_insert(BPTree* t, int key);
+static int direct_erase(BPTree* t, int key);
+
+static int impl_insert(BPTree* t, int key) {
+    int r = t->buffered ? buffered_put(t, key, 1) : -1;
+    return r >= 0 ? r : direct_insert(t, key);
+}
+
+static int impl_erase(BPTree* t, int key) {
+    int r = t->buffered ? buffered_put(t, key, 0) : -1;
+    return r >= 0 ? r : direct_erase(t, key);
+}
+
+// key goes in at slot idx of path's leaf
+static void leaf_insert_at(BPTree* t, const DescentPath* path, int idx, int key, void* val) {
+    BPTreeNode* leaf = path->node[path->depth];
+    node_write(t, leaf);
+    leaf_count(t, leaf, 1);
+    leaf_note_insert(leaf, idx);
+    NS_INSERT_AT(t, leaf, idx, key, val);
+
+    // leaf min changed: fix its parent separator before a split can move the leaf
+    if (idx == 0) update_parent_sep_if_needed(t, path, path->depth);
+
+    if (node_overflow(t, leaf)) split_leaf(t, path);
+}
+
+static int direct_insert(BPTree* t, int key) {
+    DescentPath path;
+    BPTreeNode* leaf = finger_leaf_path(t, key, &path);
+    assert(leaf);
+
+    int idx = 0;
+    if (leaf_find(t, leaf, key, &idx)) return 0; // no duplicates
+
+    leaf_insert_at(t, &path, idx, key, 0);
+    return 1;
+}
+
+// an existing value changes in place: a value block is rewritten, an inline
+// value is one val store; the tree shape is untouched
+static int impl_upsert(BPTree* t, int key, const void* val) {
+    DescentPath path;
+    BPTreeNode* leaf = finger_leaf_path(t, key, &path);
+    assert(leaf);
+
+    int idx = 0;
+    if (!leaf_find(t, leaf, key, &idx)) {
+        leaf_insert_at(t, &path, idx, key, value_make(t, val));
+        return 1;
+    }
+    void* slot = NS_VAL_AT(t, leaf, idx);
+    node_write(t, leaf);
+    leaf_count(t, leaf, 1);
+    if (!bptree_value_inline(t) && slot) {
+        if (val) memcpy(slot, val, t->value_size);
+        else memset(slot, 0, t->value_size);
+    } else {
+        NS_SET_VAL(t, leaf, idx, value_make(t, val));
+    }
+    return 0;
+}
+
+static int direct_erase(BPTree* t, int key) {
+    DescentPath path;
+    BPTreeNode* leaf = finger_leaf_path(t, key, &path);
+    if (!leaf) return 0;
+
+    int idx = 0;
+    if (!leaf_find(t, leaf, key, &idx)) return 0;
+
+    // delete from leaf
+    node_write(t, leaf);
+    leaf_count(t, leaf, 1);
+    leaf_val_release(t, leaf, idx);
+    NS_ERASE_AT(t, leaf, idx);
+
+    // rebalance upward
+    rebalance_after_delete(t, &path, path.depth);
+
+    // ensure root shrink
+    fix_root_after_delete(t);
+    return 1;
+}
+
+// appends go straight to the rightmost leaf (the cursor); the path to it is
+// only recomputed after something changed the right edge
+static size_t impl_insert_sorted(BPTree* t, const int* keys, size_t n) {
+    DescentPath path;
+    BPTreeNode* tail = find_right_edge(t, &path);
+    int tn = NS_SIZE(t, tail);
+    int tail_max = tn > 0 ? NS_KEY_AT(t, tail, tn - 1) : 0;
+    size_t added = 0;
+
+    for (size_t i = 0; i < n; ++i) {
+        int key = keys[i];
+        if (tn > 0 && key > tail_max) {
+            // key > every key in the tree: no separator on the path changes
+            node_write(t, tail);
+            leaf_count(t, tail, 1);
+            leaf_note_insert(tail, tn);
+            NS_INSERT_AT(t, tail, tn, key, 0);
+            ++added;
+            tail_max = key;
+            if (!node_overflow(t, tail)) {
+                ++tn;
+                continue;
+            }
+            split_leaf(t, &path);
+        } else {
+            added += (size_t)impl_insert(t, key);
+        }
+        tail = find_right_edge(t, &path);
+        tn = NS_SIZE(t, tail);
+        tail_max = tn > 0 ? NS_KEY_AT(t, tail, tn - 1) : 0;
+    }
+    return added;
+}
+
+// -------------------- Parallel ingest (bptree_parallel.c) --------------------
+//
+// The bulk load builds each level as nthreads runs of consecutive nodes, one
+// run per worker, the leaves from the keys and every internal level from the
+// one below. A batch cuts the tree into at least BPTREE_PARALLEL_PIECES
+// subtrees per worker, the nodes of the shallowest level with that many;
+// the nodes above are freed, and every worker applies the keys of a run of
+// pieces to each as a tree of its own. The pieces, changed or not, are then
+// joined back left to right, which rebuilds the levels above them and brings
+// a piece that grew, shrank or lost its minimum back into shape.
+
+// first of the total entries in group g, when group g takes base of them
+// plus one if g < extra
+static size_t bulk_start(size_t g, size_t base, size_t extra) {
+    return g * base + (g < extra ? g : extra);
+}
+
+typedef struct BulkLevel {
+    BPTree* t;
+    BPTree* w;                  // one worker tree per thread
+    int nthreads;
+    const int* keys;            // leaf level; NULL on internal levels
+    const NodeStoreOps* leaf_ops;
+    BPTreeNode** in;            // internal levels: the level below and its minimums
+    const int* in_min;
+    BPTreeNode** out;           // the level being built and its subtree minimums
+    int* out_min;
+    size_t groups, base, extra;
+} BulkLevel;
+
+// worker i builds nodes [groups*i/nthreads, groups*(i+1)/nthreads) of the
+// level and links its leaves among themselves
+static void bulk_level_run(void* arg, int i) {
+    BulkLevel* b = (BulkLevel*)arg;
+    BPTree* w = &b->w[i];
+    size_t g0 = b->groups * (size_t)i / (size_t)b->nthreads;
+    size_t g1 = b->groups * (size_t)(i + 1) / (size_t)b->nthreads;
+    for (size_t g = g0; g < g1; ++g) {
+        size_t src = bulk_start(g, b->base, b->extra);
+        int cnt = (int)(b->base + (g < b->extra));
+        BPTreeNode* x;
+        if (b->keys) {
+            x = (g == 0) ? b->t->root : node_create_as(w, 1, b->leaf_ops); // reuse the empty root leaf
+            for (int j = 0; j < cnt; ++j) NS_INSERT_AT(w, x, j, b->keys[src + (size_t)j], 0);
+            if (g > g0) b->out[g - 1]->next = x;
+            b->out_min[g] = b->keys[src];
+        } else {
+            x = node_create(w, 0);
+            x->child0 = b->in[src];
+            x->child0->parent = x;
+            for (int j = 1; j < cnt; ++j) {
+                BPTreeNode* c = b->in[src + (size_t)j];
+                NS_INSERT_AT(w, x, j - 1, b->in_min[src + (size_t)j], c); // key = min(child)
+                c->parent = x;
+            }
+            b->out_min[g] = b->in_min[src];
+        }
+        b->out[g] = x;
+    }
+}
+
+// workers for entries split into runs, at least BPTREE_PARALLEL_MIN_KEYS each
+static int bulk_threads(size_t entries, int nthreads) {
+    size_t most = entries / BPTREE_PARALLEL_MIN_KEYS + 1;
+    return (size_t)nthreads < most ? nthreads : (int)most;
+}
+
+// bulk_build on nthreads threads; keys ascending and distinct, tree empty
+static int impl_bulk_parallel(BPTree* t, const int* keys, size_t n, double fill, int nthreads) {
+    if (n == 0) return 1;
+    int leaf_lo = min_leaf_keys(t);
+    size_t nleaves = bulk_groups(n, bulk_target(fill, leaf_lo, t->max_keys), leaf_lo, t->max_keys);
+    if ((size_t)nthreads > nleaves) nthreads = (int)nleaves;
+
+    BPTree* w = (BPTree*)malloc(sizeof(BPTree) * (size_t)nthreads);
+    BPTreeNode** level[2] = {
+        (BPTreeNode**)malloc(sizeof(BPTreeNode*) * nleaves),
+        (BPTreeNode**)malloc(sizeof(BPTreeNode*) * nleaves),
+    };
+    int* mins[2] = {(int*)malloc(sizeof(int) * nleaves), (int*)malloc(sizeof(int) * nleaves)};
+    if (!w || !level[0] || !level[1] || !mins[0] || !mins[1]) {
+        free(w);
+        for (int k = 0; k < 2; ++k) {
+            free(level[k]);
+            free(mins[k]);
+        }
+        return 0;
+    }
+    node_write(t, t->root);
+    for (int i = 0; i < nthreads; ++i) bptree_worker_init(&w[i], t);
+
+    // an adaptive tree's bulk-loaded leaves have seen no writes yet
+    const NodeStoreOps* leaf_ops = t->leaf_ops;
+    if (BPTREE_IMPL_ADAPTIVE && t->adaptive) leaf_ops = t->adapt_read;
+    if (BPTREE_IMPL_ADAPTIVE && t->root->ops != leaf_ops) node_convert(t, t->root, leaf_ops); // still empty
+
+    BulkLevel b = {t, w, nthreads, keys, leaf_ops, 0, 0, level[0], mins[0], nleaves, n / nleaves, n % nleaves};
+    bptree_parallel_run(nthreads, bulk_level_run, &b);
+    for (int i = 1; i < nthreads; ++i) { // the leaf chain across the runs
+        size_t g = nleaves * (size_t)i / (size_t)nthreads;
+        level[0][g - 1]->next = level[0][g];
+    }
+
+    int child_lo = min_internal_keys(t) + 1;
+    int child_target = bulk_target(fill, child_lo, t->order_M);
+    size_t count = nleaves;
+    int cur = 0;
+    while (count > 1) {
+        size_t groups = bulk_groups(count, child_target, child_lo, t->order_M);
+        b.keys = 0;
+        b.in = level[cur];
+        b.in_min = mins[cur];
+        b.out = level[!cur];
+        b.out_min = mins[!cur];
+        b.groups = groups;
+        b.base = count / groups;
+        b.extra = count % groups;
+        b.nthreads = bulk_threads(count, nthreads);
+        if ((size_t)b.nthreads > groups) b.nthreads = (int)groups;
+        bptree_parallel_run(b.nthreads, bulk_level_run, &b);
+        cur = !cur;
+        count = groups;
+    }
+
+    level[cur][0]->parent = 0;
+    bptree_set_root(t, level[cur][0]);
+    for (int i = 0; i < nthreads; ++i) bptree_pool_absorb(t, &w[i]);
+    free(w);
+    for (int k = 0; k < 2; ++k) {
+        free(level[k]);
+        free(mins[k]);
+    }
+    return 1;
+}
+
+// levels in the subtree at x, 1 for a leaf
+static int subtree_height(const BPTreeNode* x) {
+    int h = 1;
+    for (; !x->is_leaf; x = x->child0) ++h;
+    return h;
+}
+
+// root to depth along the left (right = 0) or right edge
+static void edge_path(const BPTree* t, int right, int depth, DescentPath* path) {
+    BPTreeNode* x = t->root;
+    path->node[0] = x;
+    path->slot[0] = 0;
+    for (int d = 1; d <= depth; ++d) {
+        int idx = right ? NS_SIZE(t, x) : 0;
+        x = parent_child_at(t, x, idx);
+        path->node[d] = x;
+        path->slot[d] = idx;
+    }
+    path->depth = depth;
+}
+
+// x = path->node[d] just became its parent's child: a short x is evened out
+// with or merged into a sibling (fix_short_node); unless it merged, the
+// parent is one child larger and splits if it overflows
+static void join_settle(BPTree* t, DescentPath* path, int d) {
+    BPTreeNode* x = path->node[d];
+    int lo = x->is_leaf ? min_leaf_keys(t) : min_internal_keys(t);
+    if (NS_SIZE(t, x) < lo && fix_short_node(t, path, d)) {
+        rebalance_after_delete(t, path, d - 1);
+        fix_root_after_delete(t);
+        return;
+    }
+    if (node_overflow(t, path->node[d - 1])) split_internal(t, path, d - 1);
+}
+
+// Appends the detached subtree at s, every key of which is above the tree's:
+// the lower one of the two goes in as the last (first) child of the taller
+// one's right (left) edge node one level above it. A root of equal height
+// gets a new root above it first. Empty leaves are dropped.
+static void tree_join(BPTree* t, BPTreeNode* s) {
+    if (!t->root || (t->root->is_leaf && NS_SIZE(t, t->root) == 0)) {
+        if (t->root) node_destroy(t, t->root);
+        s->parent = 0;
+        bptree_set_root(t, s);
+        return;
+    }
+    if (s->is_leaf && NS_SIZE(t, s) == 0) {
+        node_destroy(t, s);
+        return;
+    }
+
+    DescentPath path;
+    BPTreeNode* first = s;
+    while (!first->is_leaf) first = first->child0;
+    find_right_edge(t, &path)->next = first;
+
+    int ht = subtree_height(t->root), hs = subtree_height(s);
+    BPTreeNode* grown = 0;
+    if (ht == hs) {
+        grown = node_create(t, 0);
+        grown->child0 = t->root;
+        t->root->parent = grown;
+        bptree_set_root(t, grown);
+        ++ht;
+    }
+    if (ht > hs) {
+        edge_path(t, 1, ht - hs - 1, &path);
+        BPTreeNode* p = path.node[path.depth];
+        int at = NS_SIZE(t, p);
+        node_write(t, p);
+        NS_INSERT_AT(t, p, at, subtree_first_key(t, s), s);
+        s->parent = p;
+        path.node[++path.depth] = s;
+        path.slot[path.depth] = at + 1;
+        join_settle(t, &path, path.depth);
+        if (grown && t->root == grown) { // the old root is a child now, maybe a short one
+            path.node[1] = grown->child0;
+            path.slot[1] = 0;
+            path.depth = 1;
+            join_settle(t, &path, 1);
+        }
+        return;
+    }
+    BPTreeNode* old = t->root;
+    bptree_set_root(t, s);
+    edge_path(t, 0, hs - ht - 1, &path);
+    BPTreeNode* p = path.node[path.depth];
+    node_write(t, p);
+    NS_INSERT_AT(t, p, 0, subtree_first_key(t, p->child0), p->child0);
+    p->child0 = old;
+    old->parent = p;
+    path.node[++path.depth] = old;
+    path.slot[path.depth] = 0;
+    join_settle(t, &path, path.depth);
+}
+
+typedef struct BatchJob {
+    BPTree* w;                  // one worker tree per thread
+    int insert;
+    const int* keys;
+    const size_t* lo;           // piece j takes keys [lo[j], lo[j + 1])
+    const size_t* first;        // worker i takes pieces [first[i], first[i + 1])
+    BPTreeNode** piece;         // detached subtrees; what became of them
+    size_t* done;               // per worker: keys added / removed
+} BatchJob;
+
+static void batch_run(void* arg, int i) {
+    BatchJob* b = (BatchJob*)arg;
+    BPTree* w = &b->w[i];
+    size_t done = 0;
+    w->finger = 1; // every piece takes its keys in order
+    for (size_t j = b->first[i]; j < b->first[i + 1]; ++j) {
+        if (b->lo[j] == b->lo[j + 1]) continue;
+        w->root = b->piece[j];
+        w->finger_lo = w->finger_hi = 0;
+        for (size_t k = b->lo[j]; k < b->lo[j + 1]; ++k) {
+            done += (size_t)(b->insert ? impl_insert(w, b->keys[k]) : impl_erase(w, b->keys[k]));
+        }
+        b->piece[j] = w->root;
+    }
+    b->done[i] = done;
+}
+
+// first of keys[from, n) that is >= key
+static size_t keys_lower(const int* keys, size_t from, size_t n, int key) {
+    while (from < n) {
+        size_t mid = from + (n - from) / 2;
+        if (keys[mid] < key) from = mid + 1;
+        else n = mid;
+    }
+    return from;
+}
+
+// Cuts the tree into pieces (see above), at most want * order_M of them:
+// piece[j] with the least key bound[j] it takes (j > 0). The nodes above are
+// freed and the tree is left without a root. Returns the piece count.
+static size_t batch_cut(BPTree* t, size_t want, BPTreeNode** piece, int* bound,
+                        BPTreeNode** next, int* next_bound) {
+    size_t cnt = 1;
+    piece[0] = t->root;
+    bound[0] = INT_MIN;
+    while (cnt < want && !piece[0]->is_leaf) {
+        size_t m = 0;
+        for (size_t j = 0; j < cnt; ++j) {
+            BPTreeNode* x = piece[j];
+            int k = NS_SIZE(t, x);
+            next[m] = x->child0;
+            next_bound[m++] = bound[j];
+            for (int c = 0; c < k; ++c) {
+                next[m] = (BPTreeNode*)NS_VAL_AT(t, x, c);
+                next_bound[m++] = NS_KEY_AT(t, x, c);
+            }
+            node_destroy(t, x);
+        }
+        memcpy(piece, next, sizeof(BPTreeNode*) * m);
+        memcpy(bound, next_bound, sizeof(int) * m);
+        cnt = m;
+    }
+    bptree_set_root(t, 0);
+    for (size_t j = 0; j < cnt; ++j) {
+        piece[j]->parent = 0;
+        if (j + 1 < cnt) { // end the leaf chain at the piece's last leaf
+            BPTreeNode* x = piece[j];
+            while (!x->is_leaf) x = parent_child_at(t, x, NS_SIZE(t, x));
+            x->next = 0;
+        }
+    }
+    return cnt;
+}
+
+// keys ascending and distinct; the batch applied through impl_insert or
+// impl_erase, on nthreads workers when the tree has more than one leaf
+static size_t impl_apply_batch(BPTree* t, const int* keys, size_t n, int insert, int nthreads) {
+    size_t done = 0;
+    size_t want = (size_t)nthreads * BPTREE_PARALLEL_PIECES;
+    size_t cap = want * (size_t)t->order_M;
+    BPTree* w = 0;
+    BPTreeNode** piece = 0;
+    BPTreeNode** next = 0;
+    int* bound = 0;
+    int* next_bound = 0;
+    size_t* lo = 0;
+    size_t* first = 0;
+    size_t* per = 0;
+    if (nthreads > 1 && !t->root->is_leaf) {
+        w = (BPTree*)malloc(sizeof(BPTree) * (size_t)nthreads);
+        piece = (BPTreeNode**)malloc(sizeof(BPTreeNode*) * cap);
+        next = (BPTreeNode**)malloc(sizeof(BPTreeNode*) * cap);
+        bound = (int*)malloc(sizeof(int) * cap);
+        next_bound = (int*)malloc(sizeof(int) * cap);
+        lo = (size_t*)malloc(sizeof(size_t) * (cap + 1));
+        first = (size_t*)malloc(sizeof(size_t) * ((size_t)nthreads + 1));
+        per = (size_t*)malloc(sizeof(size_t) * (size_t)nthreads);
+    }
+    if (!w || !piece || !next || !bound || !next_bound || !lo || !first || !per) { // one leaf, one thread or OOM
+        int finger = t->finger;
+        if (!t->concurrent && !t->buffered) t->finger = 1; // the keys come in order
+        for (size_t k = 0; k < n; ++k) done += (size_t)(insert ? impl_insert(t, keys[k]) : impl_erase(t, keys[k]));
+        t->finger = finger;
+        free(w);
+        free(piece);
+        free(next);
+        free(bound);
+        free(next_bound);
+        free(lo);
+        free(first);
+        free(per);
+        return done;
+    }
+
+    size_t cnt = batch_cut(t, want, piece, bound, next, next_bound);
+    lo[0] = 0;
+    for (size_t j = 1; j < cnt; ++j) lo[j] = keys_lower(keys, lo[j - 1], n, bound[j]);
+    lo[cnt] = n;
+    // runs of pieces with about n / nthreads keys each
+    first[0] = 0;
+    for (int i = 1; i < nthreads; ++i) {
+        size_t target = n * (size_t)i / (size_t)nthreads, j = first[i - 1];
+        while (j < cnt && lo[j] < target) ++j;
+        first[i] = j;
+    }
+    first[nthreads] = cnt;
+
+    for (int i = 0; i < nthreads; ++i) bptree_worker_init(&w[i], t);
+    BatchJob b = {w, insert, keys, lo, first, piece, per};
+    bptree_parallel_run(nthreads, batch_run, &b);
+    for (int i = 0; i < nthreads; ++i) {
+        bptree_pool_absorb(t, &w[i]);
+        done += per[i];
+    }
+    for (size_t j = 0; j < cnt; ++j) tree_join(t, piece[j]);
+
+    free(w);
+    free(piece);
+    free(next);
+    free(bound);
+    free(next_bound);
+    free(lo);
+    free(first);
+    free(per);
+    return done;
+}
+
+static void impl_destroy_nodes(BPTree* t) {
+    destroy_subtree(t, t->root);
+    t->root = 0;
+}
+
+static size_t impl_collect_keys(const BPTree* t, int* out) {
+    size_t n = 0;
+    const BPTreeNode* leaf = t->root;
+    while (leaf && !leaf->is_leaf) leaf = leaf->child0;
+    for (; leaf; leaf = leaf->next) {
+        int ln = NS_SIZE(t, leaf);
+        if (out) {
+            for (int i = 0; i < ln; ++i) out[n + (size_t)i] = NS_KEY_AT(t, leaf, i);
+        }
+        n += (size_t)ln;
+    }
+    return n;
+}
+
+const BPTreeImpl BPTREE_IMPL_NAME = {
+    .name          = BPTREE_IMPL_LABEL,
+    .search        = impl_search,
+    .search_olc    = impl_search_olc,
+    .get           = impl_get,
+    .get_olc       = impl_get_olc,
+    .upsert        = impl_upsert,
+    .insert        = impl_insert,
+    .erase         = impl_erase,
+    .destroy_nodes = impl_destroy_nodes,
+    .collect_keys  = impl_collect_keys,
+    .search_group  = impl_search_group,
+    .seek          = impl_seek,
+    .range_scan    = impl_range_scan,
+    .bulk_load     = bulk_build,
+    .insert_sorted = impl_insert_sorted,
+    .flush         = impl_flush,
+    .delete_range  = impl_delete_range,
+    .bulk_parallel = impl_bulk_parallel,
+    .apply_batch   = impl_apply_batch,
+};
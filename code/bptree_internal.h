@@ -0,0 +1,302 @@
+// bptree_internal.h
+//
+// Node/tree layout shared by bptree.c and the store-specialized instantiations
+// of bptree_impl.h. Not part of the public API.
+#ifndef BPTREE_INTERNAL_H
+#define BPTREE_INTERNAL_H
+
+#include "bptree.h"
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+struct Epoch;
+typedef struct BPTreeMap BPTreeMap;    // bptree_mmap.c
+typedef struct BPTreeWal BPTreeWal;    // bptree_wal.c
+
+#define BPTREE_CACHE_LINE 64
+#define BPTREE_BATCH_GROUP 16       // lookups in flight in bptree_search_batch
+#define BPTREE_POOL_KINDS 3         // store kinds of one tree: ops, adapt_read, adapt_write
+
+// Buffered mode (bptree_create_buffered): the pending writes of one node on
+// the lowest internal level, sorted by key, at most one message per key. A
+// message overrides whatever the leaf below holds for its key.
+typedef struct BPTreeMsg {
+    int key;
+    int insert;                 // 1: key present, 0: key deleted
+} BPTreeMsg;
+
+typedef struct BPTreeBuffer {
+    int n;
+    int cap;
+    BPTreeMsg msg[];
+} BPTreeBuffer;
+
+typedef struct BPTreeNode {
+    int is_leaf;
+    int max_keys;
+    struct BPTreeNode* parent;
+    struct BPTreeNode* next;    // leaf chain
+    struct BPTreeNode* child0;  // internal: leftmost child
+    NodeStore* store;           // internal: key[i], val[i]=child[i+1]; leaf: key[i], val unused
+    const NodeStoreOps* ops;    // store's kind: t->ops, or in adaptive trees a leaf kind
+    uint64_t version;           // concurrent mode: BPTREE_OLC_* bits + write count
+    BPTreeBuffer* buf;          // buffered mode, parents of leaves only; may be NULL
+    uint32_t slot;              // logged trees: 1 + the node's slot in the image, 0 if none
+    uint32_t dirty;             // logged trees: 1 + index in the dirty list, 0 if clean
+    uint16_t reads;             // adaptive trees, leaves: lookups and writes since the
+    uint16_t writes;            // last rewrite, both halved when one saturates
+    int last_insert;            // leaves: slot of the latest insert
+    int insert_run;             // leaves: inserts in a row right behind the one before (capped)
+} BPTreeNode;
+
+// Root-to-leaf path of one descent: node[0] is the root, node[depth] the
+// leaf, and slot[d] is node[d]'s child index in node[d-1]. Every internal
+// node has >= 2 children, so a tree of int keys is < 33 levels high.
+#define BPTREE_MAX_HEIGHT 64
+
+typedef struct BPTreePath {
+    int depth;
+    BPTreeNode* node[BPTREE_MAX_HEIGHT];
+    int slot[BPTREE_MAX_HEIGHT];
+} BPTreePath;
+
+// Entry points of one instantiation of bptree_impl.h. The generic one goes
+// through NodeStoreOps for every store access; the static ones call a single
+// store kind directly, so those calls inline.
+typedef struct BPTreeImpl {
+    const char* name;
+    int    (*search)(const BPTree* t, int key);
+    int    (*search_olc)(const BPTree* t, int key);  // concurrent mode, inside an epoch
+    int    (*get)(const BPTree* t, int key, void** val);      // 1 and key's leaf val if present
+    int    (*get_olc)(const BPTree* t, int key, void** val);  // same, concurrent mode
+    void   (*search_group)(const BPTree* t, const int* keys, size_t g, uint8_t* found); // g <= BPTREE_BATCH_GROUP
+    const BPTreeNode* (*seek)(const BPTree* t, int key, int* out_idx); // first key >= key
+    size_t (*range_scan)(const BPTree* t, int lo, int hi, BPTreeSliceFn fn, void* arg, int* scratch);
+    int    (*insert)(BPTree* t, int key);           // 1 if the key was added
+    int    (*erase)(BPTree* t, int key);            // 1 if the key was removed
+    int    (*upsert)(BPTree* t, int key, const void* val); // 1 if added, 0 if updated in place
+    void   (*destroy_nodes)(BPTree* t);
+    size_t (*collect_keys)(const BPTree* t, int* out); // leaf-chain order; out may be NULL
+    int    (*bulk_load)(BPTree* t, const int* keys, const void* vals, size_t n, double fill); // 0 on OOM
+    size_t (*insert_sorted)(BPTree* t, const int* keys, size_t n);         // keys added
+    void   (*flush)(BPTree* t);                     // buffered mode: apply every message
+    size_t (*delete_range)(BPTree* t, int lo, int hi); // lo <= hi; keys removed
+    // bptree_parallel.c; keys ascending and distinct, nthreads >= 1
+    int    (*bulk_parallel)(BPTree* t, const int* keys, size_t n, double fill, int nthreads); // 0 on OOM
+    size_t (*apply_batch)(BPTree* t, const int* keys, size_t n, int insert, int nthreads); // keys added / removed
+} BPTreeImpl;
+
+struct BPTree {
+    int order_M;                // M (max children)
+    int max_keys;               // M-1
+    const NodeStoreOps* ops;            // internal nodes, and every node unless adaptive
+    const NodeStoreOps* leaf_ops;       // new leaves: ops, or adapt_write
+    const BPTreeImpl* impl;
+    BPTreeNode* root;
+    size_t node_bytes;          // >0: node header and store share one aligned block of this size
+
+    // adaptive mode (bptree_create_adaptive): a leaf's kind follows its counters
+    int adaptive;
+    const NodeStoreOps* adapt_read;     // leaves serving mostly lookups
+    const NodeStoreOps* adapt_write;    // leaves taking a write per few lookups
+
+    // node pool (bptree_pool.c)
+    BPTreeNode* pool_free[2 * BPTREE_POOL_KINDS]; // freed nodes by store kind, linked through next
+    void* pool_chunks;
+    size_t pool_chunk_nodes;    // nodes in the next chunk
+
+    // frozen snapshot (bptree_freeze): all keys in Eytzinger order, 1-based
+    int* frozen;
+    size_t frozen_n;
+    size_t frozen_cap;
+    int frozen_stale;           // a write happened after the last freeze
+
+    // concurrent mode (bptree_create_concurrent, bptree_olc.c)
+    int concurrent;
+    pthread_mutex_t writer;     // serializes insert/delete/bulk ops
+    struct Epoch* epoch;        // reclaims nodes retired by merges and root shrinks
+    BPTreeNode** locked;        // nodes version-locked by the write in progress
+    int n_locked;
+    int cap_locked;
+
+    size_t value_size;          // bptree_set_value_size; 0: keys only, every leaf val 0
+
+    // buffered mode (bptree_create_buffered)
+    int buffered;
+    int buffer_msgs;            // a node holding more messages flushes one child's worth
+    BPTreeMsg* flush_msgs;      // flush scratch: the messages of the child being flushed,
+    int* flush_keys;            // and its leaf merged with them; flush_cap entries each
+    int flush_cap;              // >= max_keys + messages of one flush
+
+    // finger (bptree_set_finger): the path of the latest descent, and the
+    // keys its leaf takes, finger_lo <= key < finger_hi (int64: open ends)
+    int finger;
+    uint64_t shape;             // writes to internal nodes, node frees and root changes so far
+    uint64_t finger_shape;      // shape when the finger was taken: stale once they differ
+    int64_t finger_lo;
+    int64_t finger_hi;
+    BPTreePath finger_path;
+
+    // mapped tree (bptree_open_mmap): root is NULL, impl reads the pages
+    BPTreeMap* map;
+
+    // logged tree (bptree_wal_open): every write is appended to the log
+    BPTreeWal* wal;
+
+    // bptree_stats: bytes of the pool chunks, and the counters of BPTREE_STATS builds
+    size_t pool_bytes;
+    BPTreeCounters counters;
+};
+
+// Hot-path counter (bptree_stats): a relaxed atomic add with -DBPTREE_STATS,
+// nothing otherwise, so the arguments must have no side effects. Lookups
+// count through a const tree, as leaf_count does.
+#ifdef BPTREE_STATS
+#define BPTREE_COUNT(t, field, n) \
+    ((void)__atomic_add_fetch(&((BPTree*)(t))->counters.field, (uint64_t)(n), __ATOMIC_RELAXED))
+#else
+#define BPTREE_COUNT(t, field, n) ((void)0)
+#endif
+
+// header size rounded so the co-allocated store starts 8-byte aligned
+static inline size_t bptree_node_header_bytes(void) {
+    return (sizeof(BPTreeNode) + 7u) & ~(size_t)7u;
+}
+
+// -------------------- Node pool --------------------
+//
+// bptree_pool.c. bptree_pool_get hands out a node (node_bytes of memory when
+// that is set) whose store is NULL or, without node_bytes, a store of kind ops
+// from a node freed earlier; bptree_pool_put takes a node back, store and all.
+// Every store kind, and keys-only stores (bptree_node_keys_only) of a kind,
+// have a free list of their own.
+
+// a leaf of a key-only tree whose store kind ops can drop the vals
+static inline int bptree_node_keys_only(const BPTree* t, int is_leaf, const NodeStoreOps* ops) {
+    return is_leaf && !t->value_size && !t->node_bytes && ops->create_keys;
+}
+
+void        bptree_pool_init(BPTree* t);
+BPTreeNode* bptree_pool_get(BPTree* t, const NodeStoreOps* ops, int keys_only); // NULL on allocation failure
+void        bptree_pool_put(BPTree* t, BPTreeNode* x);
+void        bptree_pool_fini(BPTree* t);   // every node is back in the pool
+size_t      bptree_pool_bytes(const BPTree* t); // chunks, plus the stores free nodes keep
+
+// -------------------- Parallel ingest --------------------
+//
+// bptree_parallel.c. bptree_parallel_run calls fn(arg, i) for every i in
+// [0, nthreads), each on a thread of its own (i = 0 on the caller's), and
+// returns once all are done. The parallel bulk load and batches of
+// bptree_impl.h have their workers build or change disjoint parts of one
+// tree, each through a worker tree: a copy of the tree's settings with a node
+// pool of its own, so node_create and node_destroy need no lock. Once the
+// workers are done, bptree_pool_absorb hands every worker pool to the tree.
+
+#define BPTREE_PARALLEL_MIN_KEYS 4096   // entries per worker below which fewer workers run
+#define BPTREE_PARALLEL_PIECES   4      // subtrees per worker a batch is cut into
+
+void bptree_parallel_run(int nthreads, void (*fn)(void* arg, int i), void* arg);
+void bptree_worker_init(BPTree* w, const BPTree* t);   // w: no nodes, t's settings
+void bptree_pool_absorb(BPTree* t, BPTree* w);         // w's nodes, chunks and counters become t's
+
+// -------------------- Values --------------------
+//
+// The leaf val of a key in a key/value tree: a value of at most
+// BPTREE_VALUE_INLINE_MAX bytes is the val itself; a larger one lives in a
+// block of its own that the val points to, NULL standing for all zero bytes.
+
+static inline int bptree_value_inline(const BPTree* t) {
+    return t->value_size <= BPTREE_VALUE_INLINE_MAX;
+}
+
+// val -> value bytes
+static inline void bptree_value_load(const BPTree* t, void* slot, void* out) {
+    if (bptree_value_inline(t)) memcpy(out, &slot, t->value_size);
+    else if (slot) memcpy(out, slot, t->value_size);
+    else memset(out, 0, t->value_size);
+}
+
+// -------------------- Mapped trees --------------------
+//
+// The image format of bptree_mmap.c: a header page, then node slots of
+// bptree_map_node_bytes each, the first at offset BPTREE_PAGE_SIZE.
+
+#define BPTREE_PAGE_SIZE 4096
+
+int      bptree_map_height(const BPTree* t);    // t->map set
+uint64_t bptree_map_wal_gen(const BPTree* t);   // t->map set
+// t->map set: keys and (value_size bytes each) values in order; either may
+// be NULL; returns the key count
+size_t   bptree_map_entries(const BPTree* t, int* keys, unsigned char* vals);
+
+size_t   bptree_map_node_bytes(const BPTree* t);
+// the full image, breadth-first, to f; assign_slots: node->slot = its slot.
+// Returns the slots written, 0 on I/O errors.
+size_t   bptree_map_write(BPTree* t, FILE* f, uint64_t wal_gen, int assign_slots);
+// x as the node_bytes page of its slot; every node it links to has a slot
+void     bptree_map_node_page(const BPTree* t, const BPTreeNode* x, unsigned char* page);
+// the header page of an image of n_slots slots
+void     bptree_map_header_page(const BPTree* t, unsigned char* page, uint64_t n_slots,
+                                uint64_t root_slot, uint64_t first_leaf_slot, uint64_t wal_gen);
+
+// -------------------- Logged trees --------------------
+//
+// bptree_wal.c. The public writes append their record once applied, under
+// the writer mutex in concurrent mode; node_create, node_write and
+// node_destroy keep the dirty list and the slots of the image.
+
+enum { BPTREE_WAL_INSERT = 1, BPTREE_WAL_DELETE, BPTREE_WAL_UPSERT, BPTREE_WAL_DELETE_RANGE };
+
+void bptree_wal_log(BPTree* t, int op, int key, int hi, const void* val); // val: upsert only
+void bptree_wal_dirty(BPTree* t, BPTreeNode* x);   // x new or changing; x->dirty is 0
+void bptree_wal_forget(BPTree* t, BPTreeNode* x);  // x is being freed
+void bptree_wal_close(BPTree* t);                  // syncs and detaches the log
+
+// -------------------- Concurrent mode --------------------
+//
+// node->version: bit 0 locked by the writer, bit 1 obsolete (retired node),
+// the rest counts completed writes. Readers take a version, read, and
+// validate that it is unchanged; the writer locks a node before its first
+// change in an operation and bptree_olc_end_write unlocks them all.
+
+#define BPTREE_OLC_LOCKED   1u
+#define BPTREE_OLC_OBSOLETE 2u
+
+int  bptree_olc_init(BPTree* t);               // 0 on allocation failure
+void bptree_olc_fini(BPTree* t);
+void bptree_olc_begin_write(BPTree* t);        // takes the writer mutex
+void bptree_olc_end_write(BPTree* t);          // unlocks nodes, reclaims, drops the mutex
+void bptree_olc_lock(BPTree* t, BPTreeNode* x);   // writer: lock x for this op (idempotent)
+void bptree_olc_retire(BPTree* t, BPTreeNode* x); // writer: x is unlinked; free after readers leave
+
+// version of x once it is not locked (may have BPTREE_OLC_OBSOLETE set)
+static inline uint64_t bptree_olc_read_begin(const BPTreeNode* x) {
+    uint64_t v;
+    while ((v = __atomic_load_n(&x->version, __ATOMIC_ACQUIRE)) & BPTREE_OLC_LOCKED) {
+#if defined(__x86_64__) || defined(__i386__)
+        __builtin_ia32_pause();
+#endif
+    }
+    return v;
+}
+
+// 1 if nothing was written to x since bptree_olc_read_begin returned v
+static inline int bptree_olc_validate(const BPTreeNode* x, uint64_t v) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+    return __atomic_load_n(&x->version, __ATOMIC_RELAXED) == v;
+}
+
+static inline void bptree_set_root(BPTree* t, BPTreeNode* r) {
+    t->shape++;
+    __atomic_store_n(&t->root, r, __ATOMIC_RELEASE);
+}
+
+extern const BPTreeImpl bptree_generic_impl;
+extern const BPTreeImpl bptree_array_impl;
+extern const BPTreeImpl bptree_simd_impl;
+extern const BPTreeImpl bptree_inline_impl;
+
+#endif
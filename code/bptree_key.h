@@ -0,0 +1,57 @@
+#ifndef BPTREE_KEY_H
+#define BPTREE_KEY_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// B+ trees over keys other than int, generated from one template
+// (bptree_key_impl.h) per key mode so that each gets its own comparison
+// compiled in rather than a callback per compare:
+//
+//   BPTree64     int64_t keys, compared inline
+//   BPTreeBytes  fixed-width byte keys of key_width bytes, compared with
+//                memcmp or a caller's comparator
+//
+// Nodes are arrays with the keys packed side by side (key_width bytes
+// each), separators copy the first key of their right child as in bptree.h,
+// and each tree keeps its own size. Keys only; single-threaded.
+
+// -------------------- 64-bit integer keys --------------------
+
+typedef struct BPTree64 BPTree64;
+
+BPTree64* bptree64_create(int order_M);
+void    bptree64_destroy(BPTree64* t);
+
+int     bptree64_search(const BPTree64* t, int64_t key);
+int     bptree64_insert(BPTree64* t, int64_t key);  // 1 if the key was added, 0 if already present
+int     bptree64_delete(BPTree64* t, int64_t key);  // 1 if the key was removed, 0 if absent
+
+int     bptree64_height(const BPTree64* t);
+size_t  bptree64_size(const BPTree64* t);
+
+// -------------------- Fixed-width byte keys --------------------
+
+// <0, 0, >0 as a orders before, equal to, after b; both are width bytes
+typedef int (*BPTreeKeyCmp)(const void* a, const void* b, size_t width);
+
+typedef struct BPTreeBytes BPTreeBytes;
+
+// Every key is key_width bytes (a short string goes in zero-padded, see
+// bptree_bytes_pad). cmp NULL means memcmp: bytewise order, which for padded
+// strings is their lexicographic order. NULL if key_width is 0.
+BPTreeBytes* bptree_bytes_create(int order_M, size_t key_width, BPTreeKeyCmp cmp);
+void    bptree_bytes_destroy(BPTreeBytes* t);
+
+int     bptree_bytes_search(const BPTreeBytes* t, const void* key);
+int     bptree_bytes_insert(BPTreeBytes* t, const void* key);  // 1 if the key was added
+int     bptree_bytes_delete(BPTreeBytes* t, const void* key);  // 1 if the key was removed
+
+int     bptree_bytes_height(const BPTreeBytes* t);
+size_t  bptree_bytes_size(const BPTreeBytes* t);
+size_t  bptree_bytes_key_width(const BPTreeBytes* t);
+
+// out = the first width bytes of the string s, zero-padded; 0 if s is longer
+int     bptree_bytes_pad(void* out, size_t width, const char* s);
+
+#endif
@@ -0,0 +1,51 @@
+// bptree_key64.c
+//
+// bptree_key_impl.h for int64_t keys: 8-byte keys compared as integers, so
+// every compare and key copy inlines.
+#include "bptree_key.h"
+#include <string.h>
+
+static inline int kt_cmp64(const void* a, const void* b) {
+    int64_t x, y;
+    memcpy(&x, a, sizeof x);
+    memcpy(&y, b, sizeof y);
+    return (x > y) - (x < y);
+}
+
+#define KT_TREE         BPTree64
+#define KT_WIDTH(t)     ((void)(t), sizeof(int64_t))
+#define KT_CMP(t, a, b) ((void)(t), kt_cmp64((a), (b)))
+#include "bptree_key_impl.h"
+
+BPTree64* bptree64_create(int order_M) {
+    BPTree64* t = (BPTree64*)malloc(sizeof(BPTree64));
+    if (!t) return 0;
+    kt_init(t, order_M, sizeof(int64_t), 0);
+    return t;
+}
+
+void bptree64_destroy(BPTree64* t) {
+    if (!t) return;
+    kt_destroy_subtree(t->root);
+    free(t);
+}
+
+int bptree64_search(const BPTree64* t, int64_t key) {
+    return t ? kt_search(t, &key) : 0;
+}
+
+int bptree64_insert(BPTree64* t, int64_t key) {
+    return t ? kt_insert(t, &key) : 0;
+}
+
+int bptree64_delete(BPTree64* t, int64_t key) {
+    return t ? kt_erase(t, &key) : 0;
+}
+
+int bptree64_height(const BPTree64* t) {
+    return t ? kt_height(t) : 0;
+}
+
+size_t bptree64_size(const BPTree64* t) {
+    return t ? t->size : 0;
+}
@@ -0,0 +1,56 @@
+// bptree_key_bytes.c
+//
+// bptree_key_impl.h for fixed-width byte keys: the width is per tree, the
+// order memcmp unless the tree was given a comparator.
+#include "bptree_key.h"
+
+#define KT_TREE         BPTreeBytes
+#define KT_WIDTH(t)     ((t)->width)
+#define KT_CMP(t, a, b) ((t)->cmp ? (t)->cmp((a), (b), (t)->width) : memcmp((a), (b), (t)->width))
+#include "bptree_key_impl.h"
+
+BPTreeBytes* bptree_bytes_create(int order_M, size_t key_width, BPTreeKeyCmp cmp) {
+    if (key_width == 0) return 0;
+    BPTreeBytes* t = (BPTreeBytes*)malloc(sizeof(BPTreeBytes));
+    if (!t) return 0;
+    kt_init(t, order_M, key_width, cmp);
+    return t;
+}
+
+void bptree_bytes_destroy(BPTreeBytes* t) {
+    if (!t) return;
+    kt_destroy_subtree(t->root);
+    free(t);
+}
+
+int bptree_bytes_search(const BPTreeBytes* t, const void* key) {
+    return (t && key) ? kt_search(t, key) : 0;
+}
+
+int bptree_bytes_insert(BPTreeBytes* t, const void* key) {
+    return (t && key) ? kt_insert(t, key) : 0;
+}
+
+int bptree_bytes_delete(BPTreeBytes* t, const void* key) {
+    return (t && key) ? kt_erase(t, key) : 0;
+}
+
+int bptree_bytes_height(const BPTreeBytes* t) {
+    return t ? kt_height(t) : 0;
+}
+
+size_t bptree_bytes_size(const BPTreeBytes* t) {
+    return t ? t->size : 0;
+}
+
+size_t bptree_bytes_key_width(const BPTreeBytes* t) {
+    return t ? t->width : 0;
+}
+
+int bptree_bytes_pad(void* out, size_t width, const char* s) {
+    size_t n = strlen(s);
+    if (n > width) return 0;
+    memcpy(out, s, n);
+    memset((unsigned char*)out + n, 0, width - n);
+    return 1;
+}
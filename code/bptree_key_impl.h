@@ -0,0 +1,323 @@
+// bptree_key_impl.h  (B+ tree over opaque fixed-width keys, copy-key separators)
+//
+// The search/insert/delete algorithms of bptree_impl.h restated for keys
+// that are not int. A key is KT_WIDTH(t) bytes handled through pointers;
+// every comparison is KT_CMP(t, a, b). Each translation unit that includes
+// this file defines, first:
+//
+//   KT_TREE         the tree struct tag (the template defines the struct)
+//   KT_WIDTH(t)     key width in bytes (a constant when the mode has one)
+//   KT_CMP(t,a,b)   <0 / 0 / >0 for the keys at a and b
+//
+//   bptree_key64.c      KT_CMP inline int64_t compare, KT_WIDTH 8
+//   bptree_key_bytes.c  memcmp or the tree's comparator, KT_WIDTH t->width
+//
+// and gets static kt_* functions to wrap in its public API. With a constant
+// width and an inline compare, the key copies and compares compile down to
+// plain loads and stores.
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(KT_TREE) || !defined(KT_WIDTH) || !defined(KT_CMP)
+#error "define KT_TREE, KT_WIDTH and KT_CMP before including bptree_key_impl.h"
+#endif
+
+// Same bound as bptree_impl.h: every internal node has >= 2 children
+#define KT_MAX_HEIGHT 64
+
+typedef struct KTNode {
+    int is_leaf;
+    int n;                      // keys
+    struct KTNode* next;        // leaf chain
+    struct KTNode** child;      // internal: n + 1 children; NULL in leaves
+    unsigned char* keys;        // n keys of KT_WIDTH bytes, ascending
+} KTNode;
+
+struct KT_TREE {
+    int order_M;                // M (max children)
+    int max_keys;               // M-1
+    size_t width;               // key bytes
+    BPTreeKeyCmp cmp;           // byte keys: NULL means memcmp
+    KTNode* root;
+    size_t size;                // keys in the tree
+};
+
+typedef struct KTPath {
+    int depth;
+    KTNode* node[KT_MAX_HEIGHT];
+    int slot[KT_MAX_HEIGHT];    // node[d]'s child index in node[d-1]
+} KTPath;
+
+// -------------------- Node helpers --------------------
+
+#define KT_KEY(t, x, i) ((x)->keys + (size_t)(i) * KT_WIDTH(t))
+
+// one block: header, then (internal) the child array, then the keys; room
+// for one key and child over the maximum, which split removes right away
+static KTNode* kt_node_create(const struct KT_TREE* t, int is_leaf) {
+    size_t cap = (size_t)t->max_keys + 1;
+    size_t kids = is_leaf ? 0 : (cap + 1) * sizeof(KTNode*);
+    KTNode* x = (KTNode*)malloc(sizeof(KTNode) + kids + cap * KT_WIDTH(t));
+    assert(x);
+    x->is_leaf = is_leaf;
+    x->n = 0;
+    x->next = 0;
+    x->child = is_leaf ? 0 : (KTNode**)(x + 1);
+    x->keys = (unsigned char*)(x + 1) + kids;
+    return x;
+}
+
+static int kt_min_keys(const struct KT_TREE* t, const KTNode* x) {
+    // leaves ceil((M-1)/2), internal nodes ceil(M/2) - 1
+    return x->is_leaf ? (t->max_keys + 1) / 2 : (t->order_M + 1) / 2 - 1;
+}
+
+// first slot whose key is >= key
+static int kt_lower_bound(const struct KT_TREE* t, const KTNode* x, const void* key) {
+    int lo = 0, hi = x->n;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (KT_CMP(t, KT_KEY(t, x, mid), key) < 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// descent uses upper_bound semantics (equal goes right)
+static int kt_child_slot(const struct KT_TREE* t, const KTNode* x, const void* key) {
+    int lo = 0, hi = x->n;
+    while (lo < hi) {
+        int mid = (lo + hi) >> 1;
+        if (KT_CMP(t, KT_KEY(t, x, mid), key) <= 0) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo;
+}
+
+// key goes in at slot i
+static void kt_insert_key(const struct KT_TREE* t, KTNode* x, int i, const void* key) {
+    memmove(KT_KEY(t, x, i + 1), KT_KEY(t, x, i), (size_t)(x->n - i) * KT_WIDTH(t));
+    memcpy(KT_KEY(t, x, i), key, KT_WIDTH(t));
+    x->n++;
+}
+
+static void kt_erase_key(const struct KT_TREE* t, KTNode* x, int i) {
+    memmove(KT_KEY(t, x, i), KT_KEY(t, x, i + 1), (size_t)(x->n - i - 1) * KT_WIDTH(t));
+    x->n--;
+}
+
+// internal: key at slot i with child[i + 1] = c
+static void kt_insert_entry(const struct KT_TREE* t, KTNode* x, int i, const void* key, KTNode* c) {
+    memmove(&x->child[i + 2], &x->child[i + 1], (size_t)(x->n - i) * sizeof(KTNode*));
+    x->child[i + 1] = c;
+    kt_insert_key(t, x, i, key);
+}
+
+// internal: drops key i and child[i + 1]
+static void kt_erase_entry(const struct KT_TREE* t, KTNode* x, int i) {
+    memmove(&x->child[i + 1], &x->child[i + 2], (size_t)(x->n - i - 1) * sizeof(KTNode*));
+    kt_erase_key(t, x, i);
+}
+
+static KTNode* kt_find_leaf_path(const struct KT_TREE* t, const void* key, KTPath* path) {
+    KTNode* x = t->root;
+    int d = 0;
+    path->node[0] = x;
+    path->slot[0] = 0;
+    while (!x->is_leaf) {
+        int idx = kt_child_slot(t, x, key);
+        x = x->child[idx];
+        ++d;
+        assert(d < KT_MAX_HEIGHT);
+        path->node[d] = x;
+        path->slot[d] = idx;
+    }
+    path->depth = d;
+    return x;
+}
+
+// -------------------- Create / destroy --------------------
+
+static void kt_init(struct KT_TREE* t, int order_M, size_t width, BPTreeKeyCmp cmp) {
+    if (order_M < 3) order_M = 3;
+    t->order_M = order_M;
+    t->max_keys = order_M - 1;
+    t->width = width;
+    t->cmp = cmp;
+    t->size = 0;
+    t->root = kt_node_create(t, 1);
+}
+
+static void kt_destroy_subtree(KTNode* x) {
+    if (!x->is_leaf) {
+        for (int i = 0; i <= x->n; ++i) kt_destroy_subtree(x->child[i]);
+    }
+    free(x);
+}
+
+// -------------------- Search --------------------
+
+static int kt_search(const struct KT_TREE* t, const void* key) {
+    const KTNode* x = t->root;
+    while (!x->is_leaf) x = x->child[kt_child_slot(t, x, key)];
+    int idx = kt_lower_bound(t, x, key);
+    return idx < x->n && KT_CMP(t, KT_KEY(t, x, idx), key) == 0;
+}
+
+static int kt_height(const struct KT_TREE* t) {
+    int h = 1;
+    for (const KTNode* x = t->root; !x->is_leaf; x = x->child[0]) ++h;
+    return h;
+}
+
+// -------------------- Insert: split --------------------
+
+static void kt_split_internal(struct KT_TREE* t, const KTPath* path, int d);
+
+// right becomes left's right neighbour in path->node[d - 1], under separator sep
+static void kt_insert_into_parent(struct KT_TREE* t, const KTPath* path, int d, const void* sep, KTNode* right) {
+    KTNode* left = path->node[d];
+    if (d == 0) {
+        KTNode* root = kt_node_create(t, 0);
+        root->child[0] = left;
+        kt_insert_entry(t, root, 0, sep, right);
+        t->root = root;
+        return;
+    }
+    KTNode* parent = path->node[d - 1];
+    kt_insert_entry(t, parent, path->slot[d], sep, right);
+    if (parent->n > t->max_keys) kt_split_internal(t, path, d - 1);
+}
+
+static void kt_split_leaf(struct KT_TREE* t, const KTPath* path) {
+    KTNode* leaf = path->node[path->depth];
+    int left_n = (leaf->n + 1) / 2;
+    KTNode* right = kt_node_create(t, 1);
+    right->n = leaf->n - left_n;
+    memcpy(right->keys, KT_KEY(t, leaf, left_n), (size_t)right->n * KT_WIDTH(t));
+    leaf->n = left_n;
+    right->next = leaf->next;
+    leaf->next = right;
+    kt_insert_into_parent(t, path, path->depth, right->keys, right); // separator = min(right)
+}
+
+// the middle key moves up; the keys right of it and their children go right
+static void kt_split_internal(struct KT_TREE* t, const KTPath* path, int d) {
+    KTNode* x = path->node[d];
+    int mid = x->n / 2;
+    KTNode* right = kt_node_create(t, 0);
+    right->n = x->n - mid - 1;
+    memcpy(right->keys, KT_KEY(t, x, mid + 1), (size_t)right->n * KT_WIDTH(t));
+    memcpy(right->child, &x->child[mid + 1], (size_t)(right->n + 1) * sizeof(KTNode*));
+    x->n = mid;
+    // x keeps its key block past n, so the separator stays readable here
+    kt_insert_into_parent(t, path, d, KT_KEY(t, x, mid), right);
+}
+
+static int kt_insert(struct KT_TREE* t, const void* key) {
+    KTPath path;
+    KTNode* leaf = kt_find_leaf_path(t, key, &path);
+    int idx = kt_lower_bound(t, leaf, key);
+    if (idx < leaf->n && KT_CMP(t, KT_KEY(t, leaf, idx), key) == 0) return 0; // no duplicates
+
+    // a new leaf minimum is still >= the separator that routed it here
+    kt_insert_key(t, leaf, idx, key);
+    t->size++;
+    if (leaf->n > t->max_keys) kt_split_leaf(t, &path);
+    return 1;
+}
+
+// -------------------- Delete: borrow / merge / rebalance --------------------
+
+// x = path->node[d] lost a key; borrow from a sibling that can spare one,
+// else merge with a sibling and continue at the parent
+static void kt_rebalance(struct KT_TREE* t, const KTPath* path, int d) {
+    KTNode* x = path->node[d];
+    if (d == 0) {
+        if (!x->is_leaf && x->n == 0) { // shrink height
+            t->root = x->child[0];
+            free(x);
+        }
+        return;
+    }
+    int min = kt_min_keys(t, x);
+    if (x->n >= min) return;
+
+    KTNode* p = path->node[d - 1];
+    int s = path->slot[d];
+    KTNode* left  = (s > 0) ? p->child[s - 1] : NULL;
+    KTNode* right = (s < p->n) ? p->child[s + 1] : NULL;
+
+    if (x->is_leaf) {
+        if (left && left->n > min) {            // left's last key -> x's front
+            kt_insert_key(t, x, 0, KT_KEY(t, left, left->n - 1));
+            left->n--;
+            memcpy(KT_KEY(t, p, s - 1), KT_KEY(t, x, 0), KT_WIDTH(t));
+            return;
+        }
+        if (right && right->n > min) {          // right's first key -> x's end
+            kt_insert_key(t, x, x->n, KT_KEY(t, right, 0));
+            kt_erase_key(t, right, 0);
+            memcpy(KT_KEY(t, p, s), KT_KEY(t, right, 0), KT_WIDTH(t));
+            return;
+        }
+        if (left) {                             // x into left
+            memcpy(KT_KEY(t, left, left->n), x->keys, (size_t)x->n * KT_WIDTH(t));
+            left->n += x->n;
+            left->next = x->next;
+            kt_erase_entry(t, p, s - 1);
+            free(x);
+        } else {                                // right into x
+            memcpy(KT_KEY(t, x, x->n), right->keys, (size_t)right->n * KT_WIDTH(t));
+            x->n += right->n;
+            x->next = right->next;
+            kt_erase_entry(t, p, s);
+            free(right);
+        }
+        kt_rebalance(t, path, d - 1);
+        return;
+    }
+
+    // internal: rotate through the parent separator
+    if (left && left->n > min) {
+        memmove(&x->child[1], &x->child[0], (size_t)(x->n + 1) * sizeof(KTNode*));
+        x->child[0] = left->child[left->n];
+        kt_insert_key(t, x, 0, KT_KEY(t, p, s - 1));
+        memcpy(KT_KEY(t, p, s - 1), KT_KEY(t, left, left->n - 1), KT_WIDTH(t));
+        left->n--;
+        return;
+    }
+    if (right && right->n > min) {
+        x->child[x->n + 1] = right->child[0];
+        kt_insert_key(t, x, x->n, KT_KEY(t, p, s));
+        memcpy(KT_KEY(t, p, s), KT_KEY(t, right, 0), KT_WIDTH(t));
+        memmove(&right->child[0], &right->child[1], (size_t)right->n * sizeof(KTNode*));
+        kt_erase_key(t, right, 0);
+        return;
+    }
+
+    // merge, pulling the separator down between the two halves
+    KTNode* l = left ? left : x;
+    KTNode* r = left ? x : right;
+    int sep = left ? s - 1 : s;
+    memcpy(KT_KEY(t, l, l->n), KT_KEY(t, p, sep), KT_WIDTH(t));
+    memcpy(KT_KEY(t, l, l->n + 1), r->keys, (size_t)r->n * KT_WIDTH(t));
+    memcpy(&l->child[l->n + 1], r->child, (size_t)(r->n + 1) * sizeof(KTNode*));
+    l->n += r->n + 1;
+    kt_erase_entry(t, p, sep);
+    free(r);
+    kt_rebalance(t, path, d - 1);
+}
+
+static int kt_erase(struct KT_TREE* t, const void* key) {
+    KTPath path;
+    KTNode* leaf = kt_find_leaf_path(t, key, &path);
+    int idx = kt_lower_bound(t, leaf, key);
+    if (idx >= leaf->n || KT_CMP(t, KT_KEY(t, leaf, idx), key) != 0) return 0;
+
+    kt_erase_key(t, leaf, idx);
+    t->size--;
+    kt_rebalance(t, &path, path.depth);
+    return 1;
+}
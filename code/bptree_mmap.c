@@ -0,0 +1,491 @@
+// bptree_mmap.c  (persistent form: bptree_save / bptree_open_mmap)
+//
+// File layout, native byte order:
+//
+//   page 0      MapHeader, zero-padded to BPTREE_PAGE_SIZE
+//   pages 1..   the nodes in breadth-first order (root first, then each level
+//               left to right, the leaves last and in leaf-chain order), each
+//               in a slot of node_bytes
+//
+// node_bytes is a power of two of at least BPTREE_CACHE_LINE when a node fits
+// in a page, so no node straddles a page, and a whole number of pages
+// otherwise. A node is a MapNode header, its keys at MapNode.keys, then at
+// map_refs_at the child offsets (internal, n + 1 of them) or the values
+// (leaf, value_size bytes each). Every reference is a byte offset from the
+// start of the file, 0 meaning none, so the mapping can sit at any address.
+// bptree_save lays the nodes out breadth-first; the checkpoints of a logged
+// tree (bptree_wal.c) keep every node in its slot and rewrite only the
+// changed ones, so there the order is arbitrary and some slots are unused.
+//
+// An opened tree is a BPTree whose root is NULL and whose map is set; its
+// BPTreeImpl descends the mapped pages with the same upper_bound child_slot
+// as find_leaf. Nothing is read up front beyond the header: a lookup faults
+// in the pages on its path, and hot upper levels share the first pages.
+#define _POSIX_C_SOURCE 200809L     // mmap, fstat, fileno under -std=c11
+
+#include "bptree_internal.h"
+#include "nodestore_search.h"
+#include <assert.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BPTREE_MAP_MAGIC   "BPTMAP01"
+#define BPTREE_MAP_VERSION 1u
+#define BPTREE_MAP_ENDIAN  0x01020304u  // read back as another value on a foreign byte order
+
+typedef struct MapHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t endian;
+    uint32_t page_size;
+    int32_t order_M;
+    int32_t max_keys;
+    int32_t height;
+    uint64_t node_bytes;
+    uint64_t value_size;
+    uint64_t n_nodes;           // node slots in the file
+    uint64_t wal_gen;           // logged trees: the first log generation not in the image
+    uint64_t root;              // offset of the root node
+    uint64_t first_leaf;        // offset of the leftmost leaf
+} MapHeader;
+
+typedef struct MapNode {
+    uint32_t is_leaf;
+    uint32_t n;                 // keys
+    uint64_t next;              // leaf: offset of the next leaf, 0 for the last
+    int32_t keys[];             // max_keys slots
+} MapNode;
+
+struct BPTreeMap {
+    const unsigned char* base;
+    size_t bytes;
+    size_t refs_at;             // map_refs_at(max_keys)
+    int height;
+    uint64_t root;
+    uint64_t first_leaf;
+    uint64_t wal_gen;
+};
+
+// start of the child offsets / values within a node
+static size_t map_refs_at(int max_keys) {
+    size_t b = sizeof(MapNode) + sizeof(int32_t) * (size_t)max_keys;
+    return (b + 7u) & ~(size_t)7u;
+}
+
+static size_t map_node_bytes(int max_keys, size_t value_size) {
+    size_t children = sizeof(uint64_t) * (size_t)(max_keys + 1);
+    size_t values = value_size * (size_t)max_keys;
+    size_t need = map_refs_at(max_keys) + (children > values ? children : values);
+    if (need > BPTREE_PAGE_SIZE) {
+        return (need + BPTREE_PAGE_SIZE - 1) & ~(size_t)(BPTREE_PAGE_SIZE - 1);
+    }
+    size_t b = BPTREE_CACHE_LINE;
+    while (b < need) b <<= 1;
+    return b;
+}
+
+// -------------------- Save --------------------
+
+static BPTreeNode* child_at(const BPTreeNode* x, int i) {
+    return i == 0 ? x->child0 : (BPTreeNode*)x->ops->val_at(x->store, i - 1);
+}
+
+static uint64_t slot_offset(size_t node_bytes, uint64_t slot) {
+    return BPTREE_PAGE_SIZE + slot * node_bytes;
+}
+
+size_t bptree_map_node_bytes(const BPTree* t) {
+    return map_node_bytes(t->max_keys, t->value_size);
+}
+
+// x as a page of node_bytes, but for the child offsets of an internal node:
+// the caller stores those n + 1 at the returned address
+static uint64_t* map_fill(const BPTree* t, const BPTreeNode* x, unsigned char* page, uint64_t next) {
+    size_t node_bytes = bptree_map_node_bytes(t);
+    size_t refs_at = map_refs_at(t->max_keys);
+    int n = x->ops->size(x->store);
+    memset(page, 0, node_bytes);
+    MapNode* m = (MapNode*)page;
+    m->is_leaf = (uint32_t)x->is_leaf;
+    m->n = (uint32_t)n;
+    for (int k = 0; k < n; ++k) m->keys[k] = x->ops->key_at(x->store, k);
+    if (x->is_leaf) {
+        m->next = next;
+        for (int k = 0; k < n && t->value_size; ++k) {
+            bptree_value_load(t, x->ops->val_at(x->store, k), page + refs_at + t->value_size * (size_t)k);
+        }
+    }
+    return (uint64_t*)(page + refs_at);
+}
+
+void bptree_map_node_page(const BPTree* t, const BPTreeNode* x, unsigned char* page) {
+    size_t node_bytes = bptree_map_node_bytes(t);
+    uint64_t next = (x->is_leaf && x->next) ? slot_offset(node_bytes, x->next->slot - 1) : 0;
+    uint64_t* child = map_fill(t, x, page, next);
+    if (!x->is_leaf) {
+        int n = x->ops->size(x->store);
+        for (int c = 0; c <= n; ++c) child[c] = slot_offset(node_bytes, child_at(x, c)->slot - 1);
+    }
+}
+
+void bptree_map_header_page(const BPTree* t, unsigned char* page, uint64_t n_slots,
+                            uint64_t root_slot, uint64_t first_leaf_slot, uint64_t wal_gen) {
+    size_t node_bytes = bptree_map_node_bytes(t);
+    MapHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, BPTREE_MAP_MAGIC, sizeof h.magic);
+    h.version = BPTREE_MAP_VERSION;
+    h.endian = BPTREE_MAP_ENDIAN;
+    h.page_size = BPTREE_PAGE_SIZE;
+    h.order_M = t->order_M;
+    h.max_keys = t->max_keys;
+    h.node_bytes = node_bytes;
+    h.value_size = t->value_size;
+    h.n_nodes = n_slots;
+    h.wal_gen = wal_gen;
+    h.root = slot_offset(node_bytes, root_slot);
+    h.first_leaf = slot_offset(node_bytes, first_leaf_slot);
+    h.height = 1;
+    for (const BPTreeNode* x = t->root; !x->is_leaf; x = x->child0) h.height++;
+    memset(page, 0, BPTREE_PAGE_SIZE);
+    memcpy(page, &h, sizeof h);
+}
+
+size_t bptree_map_write(BPTree* t, FILE* f, uint64_t wal_gen, int assign_slots) {
+    // breadth-first order: q[i] goes to slot i and its children are appended
+    // as a block, so their slots are known when q[i] itself is written
+    size_t cap = 64, len = 1;
+    BPTreeNode** q = (BPTreeNode**)malloc(sizeof(*q) * cap);
+    size_t node_bytes = bptree_map_node_bytes(t);
+    unsigned char* page = (unsigned char*)malloc(node_bytes > BPTREE_PAGE_SIZE ? node_bytes : BPTREE_PAGE_SIZE);
+    if (!q || !page) {
+        free(q);
+        free(page);
+        return 0;
+    }
+    q[0] = t->root;
+
+    memset(page, 0, BPTREE_PAGE_SIZE); // the header is written once every node has its slot
+    int ok = fwrite(page, BPTREE_PAGE_SIZE, 1, f) == 1;
+
+    size_t first_leaf = 0;
+    for (size_t i = 0; ok && i < len; ++i) {
+        BPTreeNode* x = q[i];
+        int n = x->ops->size(x->store);
+        uint64_t next = 0;
+        if (assign_slots) x->slot = (uint32_t)(i + 1);
+        if (x->is_leaf) {
+            if (!first_leaf) first_leaf = i; // 0 only if the root is the one leaf
+            if (x->next) {
+                assert(i + 1 < len && q[i + 1] == x->next);
+                next = slot_offset(node_bytes, i + 1);
+            }
+        }
+        uint64_t* child = map_fill(t, x, page, next);
+        if (!x->is_leaf) {
+            if (len + (size_t)n + 1 > cap) {
+                while (len + (size_t)n + 1 > cap) cap *= 2;
+                BPTreeNode** nq = (BPTreeNode**)realloc(q, sizeof(*q) * cap);
+                if (!nq) {
+                    ok = 0;
+                    break;
+                }
+                q = nq;
+            }
+            for (int c = 0; c <= n; ++c) {
+                child[c] = slot_offset(node_bytes, len);
+                q[len++] = child_at(x, c);
+            }
+        }
+        ok = fwrite(page, node_bytes, 1, f) == 1;
+    }
+
+    if (ok) {
+        bptree_map_header_page(t, page, len, 0, first_leaf, wal_gen);
+        ok = fseek(f, 0, SEEK_SET) == 0 && fwrite(page, BPTREE_PAGE_SIZE, 1, f) == 1;
+    }
+    free(q);
+    free(page);
+    return ok ? len : 0;
+}
+
+int bptree_save(const BPTree* t, const char* path) {
+    if (!t || !t->root || !path) return 0; // a mapped tree has no nodes to write
+    BPTree* w = (BPTree*)t;
+    if (w->buffered) bptree_flush(w);
+    if (w->concurrent) bptree_olc_begin_write(w); // readers carry on, writers wait
+
+    int ok = 0;
+    FILE* f = fopen(path, "wb");
+    if (f) {
+        ok = bptree_map_write(w, f, 0, 0) != 0; // a logged tree keeps the slots of its own image
+        ok = (fflush(f) == 0) && ok;
+        ok = (fsync(fileno(f)) == 0) && ok;
+        ok = (fclose(f) == 0) && ok;
+        if (!ok) remove(path);
+    }
+
+    if (w->concurrent) bptree_olc_end_write(w);
+    return ok;
+}
+
+// -------------------- Mapped search --------------------
+
+static inline const MapNode* map_node(const BPTreeMap* m, uint64_t off) {
+    return (const MapNode*)(m->base + off);
+}
+
+static inline const uint64_t* map_children(const BPTreeMap* m, const MapNode* x) {
+    return (const uint64_t*)((const unsigned char*)x + m->refs_at);
+}
+
+// find_leaf's child_slot: upper_bound, equal goes right
+static inline int map_child_slot(const MapNode* x, int key) {
+    int n = (int)x->n;
+    int idx = ns_lower_bound_simd(x->keys, n, key);
+    if (idx < n && x->keys[idx] == key) idx++;
+    return idx;
+}
+
+static const MapNode* map_find_leaf(const BPTreeMap* m, int key) {
+    const MapNode* x = map_node(m, m->root);
+    while (!x->is_leaf) x = map_node(m, map_children(m, x)[map_child_slot(x, key)]);
+    return x;
+}
+
+static int map_leaf_find(const MapNode* leaf, int key, int* out_idx) {
+    int n = (int)leaf->n;
+    int idx = ns_lower_bound_simd(leaf->keys, n, key);
+    *out_idx = idx;
+    return idx < n && leaf->keys[idx] == key;
+}
+
+static int map_search(const BPTree* t, int key) {
+    int idx;
+    return map_leaf_find(map_find_leaf(t->map, key), key, &idx);
+}
+
+// the leaf val as bptree_value_load reads it: inline values copied into it,
+// larger ones pointed at in place
+static int map_get(const BPTree* t, int key, void** val) {
+    const BPTreeMap* m = t->map;
+    const MapNode* leaf = map_find_leaf(m, key);
+    int idx;
+    if (!map_leaf_find(leaf, key, &idx)) return 0;
+    const unsigned char* v = (const unsigned char*)leaf + m->refs_at + t->value_size * (size_t)idx;
+    *val = 0;
+    if (bptree_value_inline(t)) memcpy(val, v, t->value_size);
+    else *val = (void*)v;
+    return 1;
+}
+
+// the batch descent in lockstep: every lookup of the group steps one level,
+// its next page prefetched, before any steps again
+static void map_search_group(const BPTree* t, const int* keys, size_t g, uint8_t* found) {
+    const BPTreeMap* m = t->map;
+    const MapNode* cur[BPTREE_BATCH_GROUP];
+    for (size_t i = 0; i < g; ++i) cur[i] = map_node(m, m->root);
+    for (int level = 1; level < m->height; ++level) {
+        for (size_t i = 0; i < g; ++i) {
+            cur[i] = map_node(m, map_children(m, cur[i])[map_child_slot(cur[i], keys[i])]);
+            __builtin_prefetch(cur[i]);
+        }
+    }
+    for (size_t i = 0; i < g; ++i) {
+        int idx;
+        found[i] = (uint8_t)map_leaf_find(cur[i], keys[i], &idx);
+    }
+}
+
+// slices point into the mapped leaves
+static size_t map_range_scan(const BPTree* t, int lo, int hi, BPTreeSliceFn fn, void* arg, int* scratch) {
+    (void)scratch;
+    const BPTreeMap* m = t->map;
+    size_t total = 0;
+    int idx;
+    const MapNode* leaf = map_find_leaf(m, lo);
+    map_leaf_find(leaf, lo, &idx);
+    for (;;) {
+        int n = (int)leaf->n;
+        int end = n;
+        if (n > 0 && leaf->keys[n - 1] > hi) {
+            end = ns_lower_bound_simd(leaf->keys, n, hi);
+            if (end < n && leaf->keys[end] == hi) end++;
+        }
+        if (end > idx) {
+            total += (size_t)(end - idx);
+            if (fn && fn(leaf->keys + idx, (size_t)(end - idx), arg)) break;
+        }
+        if (end < n || !leaf->next) break; // reached hi inside this leaf
+        leaf = map_node(m, leaf->next);
+        idx = 0;
+    }
+    return total;
+}
+
+static size_t map_collect_keys(const BPTree* t, int* out) {
+    return bptree_map_entries(t, out, 0);
+}
+
+static const BPTreeNode* map_seek(const BPTree* t, int key, int* out_idx) {
+    (void)t; (void)key;
+    *out_idx = 0;
+    return 0; // no cursors over the mapping
+}
+
+static int map_insert(BPTree* t, int key) {
+    (void)t; (void)key;
+    return 0;
+}
+
+static int map_upsert(BPTree* t, int key, const void* val) {
+    (void)t; (void)key; (void)val;
+    return 0;
+}
+
+static int map_bulk_load(BPTree* t, const int* keys, const void* vals, size_t n, double fill) {
+    (void)t; (void)keys; (void)vals; (void)n; (void)fill;
+    return 0;
+}
+
+static size_t map_insert_sorted(BPTree* t, const int* keys, size_t n) {
+    (void)t; (void)keys; (void)n;
+    return 0;
+}
+
+static int map_bulk_parallel(BPTree* t, const int* keys, size_t n, double fill, int nthreads) {
+    (void)t; (void)keys; (void)n; (void)fill; (void)nthreads;
+    return 0;
+}
+
+static size_t map_apply_batch(BPTree* t, const int* keys, size_t n, int insert, int nthreads) {
+    (void)t; (void)keys; (void)n; (void)insert; (void)nthreads;
+    return 0;
+}
+
+static void map_flush(BPTree* t) {
+    (void)t;
+}
+
+static size_t map_delete_range(BPTree* t, int lo, int hi) {
+    (void)t; (void)lo; (void)hi;
+    return 0;
+}
+
+static void map_destroy(BPTree* t) {
+    BPTreeMap* m = t->map;
+    munmap((void*)m->base, m->bytes);
+    free(m);
+    t->map = 0;
+}
+
+static const BPTreeImpl bptree_mapped_impl = {
+    .name          = "mapped",
+    .search        = map_search,
+    .search_olc    = map_search,
+    .get           = map_get,
+    .get_olc       = map_get,
+    .upsert        = map_upsert,
+    .insert        = map_insert,
+    .erase         = map_insert,
+    .destroy_nodes = map_destroy,
+    .collect_keys  = map_collect_keys,
+    .search_group  = map_search_group,
+    .seek          = map_seek,
+    .range_scan    = map_range_scan,
+    .bulk_load     = map_bulk_load,
+    .insert_sorted = map_insert_sorted,
+    .flush         = map_flush,
+    .delete_range  = map_delete_range,
+    .bulk_parallel = map_bulk_parallel,
+    .apply_batch   = map_apply_batch,
+};
+
+// -------------------- Open --------------------
+
+// the header fields a lookup relies on, checked against the file size
+static int map_header_valid(const MapHeader* h, size_t bytes) {
+    if (memcmp(h->magic, BPTREE_MAP_MAGIC, sizeof h->magic) != 0) return 0;
+    if (h->version != BPTREE_MAP_VERSION || h->endian != BPTREE_MAP_ENDIAN) return 0;
+    if (h->page_size != BPTREE_PAGE_SIZE || h->order_M < 3 || h->max_keys != h->order_M - 1) return 0;
+    if (h->height < 1 || (uint64_t)h->height > h->n_nodes) return 0;
+    if (h->node_bytes != map_node_bytes(h->max_keys, (size_t)h->value_size)) return 0;
+    if (h->n_nodes > (bytes - BPTREE_PAGE_SIZE) / h->node_bytes) return 0;
+    uint64_t end = BPTREE_PAGE_SIZE + h->n_nodes * h->node_bytes;
+    return h->root >= BPTREE_PAGE_SIZE && h->root < end && (h->root - BPTREE_PAGE_SIZE) % h->node_bytes == 0 &&
+           h->first_leaf >= BPTREE_PAGE_SIZE && h->first_leaf < end &&
+           (h->first_leaf - BPTREE_PAGE_SIZE) % h->node_bytes == 0;
+}
+
+BPTree* bptree_open_mmap(const char* path) {
+    if (!path) return 0;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return 0;
+    struct stat st;
+    void* base = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size >= BPTREE_PAGE_SIZE) {
+        base = mmap(0, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    }
+    close(fd); // the mapping keeps the file
+    if (base == MAP_FAILED) return 0;
+
+    size_t bytes = (size_t)st.st_size;
+    const MapHeader* h = (const MapHeader*)base;
+    BPTreeMap* m = 0;
+    BPTree* t = 0;
+    if (map_header_valid(h, bytes)) {
+        m = (BPTreeMap*)calloc(1, sizeof(BPTreeMap));
+        t = (BPTree*)calloc(1, sizeof(BPTree));
+    }
+    if (!m || !t) {
+        free(m);
+        free(t);
+        munmap(base, bytes);
+        return 0;
+    }
+
+    m->base = (const unsigned char*)base;
+    m->bytes = bytes;
+    m->refs_at = map_refs_at(h->max_keys);
+    m->height = h->height;
+    m->root = h->root;
+    m->first_leaf = h->first_leaf;
+    m->wal_gen = h->wal_gen;
+
+    t->order_M = h->order_M;
+    t->max_keys = h->max_keys;
+    t->ops = nodestore_get_ops(NODESTORE_ARRAY); // the pages are key arrays: scans slice them in place
+    t->leaf_ops = t->ops;
+    t->impl = &bptree_mapped_impl;
+    t->value_size = (size_t)h->value_size;
+    t->map = m;
+    return t;
+}
+
+int bptree_map_height(const BPTree* t) {
+    return t->map->height;
+}
+
+uint64_t bptree_map_wal_gen(const BPTree* t) {
+    return t->map->wal_gen;
+}
+
+size_t bptree_map_entries(const BPTree* t, int* keys, unsigned char* vals) {
+    const BPTreeMap* m = t->map;
+    size_t n = 0;
+    for (uint64_t off = m->first_leaf; off; ) {
+        const MapNode* leaf = map_node(m, off);
+        if (keys) memcpy(keys + n, leaf->keys, sizeof(int) * leaf->n);
+        if (vals) {
+            memcpy(vals + t->value_size * n, (const unsigned char*)leaf + m->refs_at, t->value_size * leaf->n);
+        }
+        n += leaf->n;
+        off = leaf->next;
+    }
+    return n;
+}
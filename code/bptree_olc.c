@@ -0,0 +1,81 @@
+// bptree_olc.c  (concurrent mode: writer side and node reclamation)
+//
+// One writer at a time holds t->writer. It version-locks every node it
+// modifies (bptree_olc_lock, called through node_write in bptree_impl.h) and
+// unlocks them together when the operation ends, so a reader never validates
+// a half-made change. Nodes unlinked by merges and root shrinks are marked
+// obsolete and handed to the tree's epoch, which frees them once no reader
+// can still be inside.
+#include "bptree_internal.h"
+#include "epoch.h"
+#include <assert.h>
+#include <stdlib.h>
+
+int bptree_olc_init(BPTree* t) {
+    t->epoch = epoch_create();
+    if (!t->epoch) return 0;
+    if (pthread_mutex_init(&t->writer, 0) != 0) {
+        epoch_destroy(t->epoch);
+        t->epoch = 0;
+        return 0;
+    }
+    t->concurrent = 1;
+    return 1;
+}
+
+// called after the nodes reachable from the root are gone
+void bptree_olc_fini(BPTree* t) {
+    if (!t->epoch) return;
+    epoch_destroy(t->epoch); // frees the retired nodes
+    t->epoch = 0;
+    pthread_mutex_destroy(&t->writer);
+    free(t->locked);
+    t->locked = 0;
+    t->n_locked = t->cap_locked = 0;
+    t->concurrent = 0;
+}
+
+void bptree_olc_begin_write(BPTree* t) {
+    pthread_mutex_lock(&t->writer);
+}
+
+void bptree_olc_end_write(BPTree* t) {
+    for (int i = 0; i < t->n_locked; ++i) {
+        BPTreeNode* x = t->locked[i];
+        uint64_t v = __atomic_load_n(&x->version, __ATOMIC_RELAXED);
+        // bump the count, drop the lock bit, keep the obsolete bit
+        __atomic_store_n(&x->version, (v + 4) & ~(uint64_t)BPTREE_OLC_LOCKED, __ATOMIC_RELEASE);
+    }
+    t->n_locked = 0;
+    epoch_collect(t->epoch);
+    pthread_mutex_unlock(&t->writer);
+}
+
+void bptree_olc_lock(BPTree* t, BPTreeNode* x) {
+    uint64_t v = __atomic_load_n(&x->version, __ATOMIC_RELAXED);
+    if (v & BPTREE_OLC_LOCKED) return; // only this writer locks, so already ours
+
+    if (t->n_locked == t->cap_locked) {
+        int ncap = t->cap_locked ? t->cap_locked * 2 : 32;
+        BPTreeNode** a = (BPTreeNode**)realloc(t->locked, sizeof(BPTreeNode*) * (size_t)ncap);
+        assert(a);
+        t->locked = a;
+        t->cap_locked = ncap;
+    }
+    t->locked[t->n_locked++] = x;
+
+    __atomic_store_n(&x->version, v | BPTREE_OLC_LOCKED, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE); // lock is visible before any change to x
+}
+
+// runs in bptree_olc_end_write or bptree_olc_fini, so the pool is the writer's
+static void free_retired(void* p, void* ctx) {
+    bptree_pool_put((BPTree*)ctx, (BPTreeNode*)p);
+}
+
+void bptree_olc_retire(BPTree* t, BPTreeNode* x) {
+    bptree_olc_lock(t, x);
+    uint64_t v = __atomic_load_n(&x->version, __ATOMIC_RELAXED);
+    __atomic_store_n(&x->version, v | BPTREE_OLC_OBSOLETE, __ATOMIC_RELAXED);
+    epoch_retire(t->epoch, x, free_retired, t);
+}
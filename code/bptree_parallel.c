@@ -0,0 +1,282 @@
+// bptree_parallel.c  (parallel bulk load and batches)
+//
+// The calling side of the parallel ingest in bptree_impl.h: threads, worker
+// trees and the sort. Keys that do not come ascending are sorted on the same
+// threads: every thread sorts a slice with qsort, the sorted runs are merged
+// pairwise, each merge split among the threads by merge path (co_rank), and
+// the duplicates are dropped, each thread compacting its slice.
+#define _POSIX_C_SOURCE 200809L     // sysconf under -std=c11
+
+#include "bptree_internal.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// -------------------- Threads --------------------
+
+typedef struct RunArg {
+    void (*fn)(void* arg, int i);
+    void* arg;
+    int i;
+    int started;                // 0: pthread_create failed, the caller runs it
+    pthread_t th;
+} RunArg;
+
+static void* run_thread(void* p) {
+    RunArg* r = (RunArg*)p;
+    r->fn(r->arg, r->i);
+    return NULL;
+}
+
+void bptree_parallel_run(int nthreads, void (*fn)(void* arg, int i), void* arg) {
+    RunArg* ra = nthreads > 1 ? (RunArg*)malloc(sizeof(RunArg) * (size_t)nthreads) : 0;
+    if (!ra) {
+        for (int i = 0; i < nthreads; ++i) fn(arg, i);
+        return;
+    }
+    for (int i = 1; i < nthreads; ++i) {
+        ra[i].fn = fn;
+        ra[i].arg = arg;
+        ra[i].i = i;
+        ra[i].started = pthread_create(&ra[i].th, NULL, run_thread, &ra[i]) == 0;
+    }
+    fn(arg, 0);
+    for (int i = 1; i < nthreads; ++i) {
+        if (ra[i].started) pthread_join(ra[i].th, NULL);
+        else fn(arg, i);
+    }
+    free(ra);
+}
+
+void bptree_worker_init(BPTree* w, const BPTree* t) {
+    memcpy(w, t, sizeof(BPTree));
+    w->root = 0;
+    memset(w->pool_free, 0, sizeof(w->pool_free));
+    w->pool_chunks = 0;
+    w->pool_bytes = 0;
+    bptree_pool_init(w);
+    w->frozen = 0;
+    w->frozen_n = 0;
+    w->frozen_cap = 0;
+    w->concurrent = 0;
+    w->epoch = 0;
+    w->locked = 0;
+    w->n_locked = 0;
+    w->cap_locked = 0;
+    w->flush_msgs = 0;
+    w->flush_keys = 0;
+    w->flush_cap = 0;
+    w->finger = 0;
+    w->finger_lo = w->finger_hi = 0;
+    w->map = 0;
+    w->wal = 0;
+    memset(&w->counters, 0, sizeof(w->counters));
+}
+
+// nthreads <= 0: one per online CPU; no more than n keys keep busy
+static int thread_count(int nthreads, size_t n) {
+    if (nthreads <= 0) {
+        long c = sysconf(_SC_NPROCESSORS_ONLN);
+        nthreads = c > 0 ? (int)c : 1;
+    }
+    size_t most = n / BPTREE_PARALLEL_MIN_KEYS + 1;
+    return (size_t)nthreads < most ? nthreads : (int)most;
+}
+
+// -------------------- Sort --------------------
+
+typedef struct SortJob {
+    int nthreads;
+    const int* keys;
+    size_t n;
+    int* a;                     // the sorted runs of this pass
+    int* b;                     // the output of this pass
+    size_t* run;                // run r of a: [run[r], run[r + 1])
+    size_t nrun;
+    size_t parts;               // merge pass: threads per pair of runs
+    size_t* cnt;                // dedup: distinct keys of each slice, then its offset
+} SortJob;
+
+static int cmp_int(const void* a, const void* b) {
+    int x = *(const int*)a, y = *(const int*)b;
+    return (x > y) - (x < y);
+}
+
+// start of slice i of n entries over nthreads
+static size_t slice_at(size_t n, int i, int nthreads) {
+    return n * (size_t)i / (size_t)nthreads;
+}
+
+static void sort_slice_run(void* arg, int i) {
+    SortJob* s = (SortJob*)arg;
+    size_t lo = slice_at(s->n, i, s->nthreads), hi = slice_at(s->n, i + 1, s->nthreads);
+    memcpy(s->a + lo, s->keys + lo, sizeof(int) * (hi - lo));
+    qsort(s->a + lo, hi - lo, sizeof(int), cmp_int);
+}
+
+// entries of a[0, m) among the first k of the merge of a and b (ties from a first)
+static size_t co_rank(size_t k, const int* a, size_t m, const int* b, size_t l) {
+    size_t lo = k > l ? k - l : 0, hi = k < m ? k : m;
+    while (lo < hi) {
+        size_t i = lo + (hi - lo) / 2;
+        if (a[i] > b[k - i - 1]) hi = i;
+        else lo = i + 1;
+    }
+    return lo;
+}
+
+// runs 2p and 2p+1 of a into b, each pair's output cut into parts tasks
+static void merge_pass_run(void* arg, int i) {
+    SortJob* s = (SortJob*)arg;
+    size_t pairs = (s->nrun + 1) / 2, tasks = pairs * s->parts;
+    for (size_t task = (size_t)i; task < tasks; task += (size_t)s->nthreads) {
+        size_t r = 2 * (task / s->parts), q = task % s->parts;
+        size_t a0 = s->run[r], a1 = s->run[r + 1];
+        size_t b1 = r + 2 <= s->nrun ? s->run[r + 2] : a1; // a last odd run is copied
+        const int* x = s->a + a0;
+        const int* y = s->a + a1;
+        size_t m = a1 - a0, l = b1 - a1;
+        size_t k0 = (m + l) * q / s->parts, k1 = (m + l) * (q + 1) / s->parts;
+        size_t i0 = co_rank(k0, x, m, y, l), i1 = co_rank(k1, x, m, y, l);
+        size_t j0 = k0 - i0, j1 = k1 - i1;
+        int* out = s->b + a0 + k0;
+        while (i0 < i1 && j0 < j1) *out++ = x[i0] <= y[j0] ? x[i0++] : y[j0++];
+        while (i0 < i1) *out++ = x[i0++];
+        while (j0 < j1) *out++ = y[j0++];
+    }
+}
+
+static void count_distinct_run(void* arg, int i) {
+    SortJob* s = (SortJob*)arg;
+    size_t lo = slice_at(s->n, i, s->nthreads), hi = slice_at(s->n, i + 1, s->nthreads), c = 0;
+    for (size_t k = lo; k < hi; ++k) c += (k == 0 || s->a[k] != s->a[k - 1]);
+    s->cnt[i] = c;
+}
+
+static void compact_run(void* arg, int i) {
+    SortJob* s = (SortJob*)arg;
+    size_t lo = slice_at(s->n, i, s->nthreads), hi = slice_at(s->n, i + 1, s->nthreads);
+    int* out = s->b + s->cnt[i];
+    for (size_t k = lo; k < hi; ++k) {
+        if (k == 0 || s->a[k] != s->a[k - 1]) *out++ = s->a[k];
+    }
+}
+
+// keys[0, n) ascending without duplicates, in a new array of *out_n; NULL on OOM
+static int* sorted_distinct(const int* keys, size_t n, int nthreads, size_t* out_n) {
+    SortJob s = {nthreads, keys, n, 0, 0, 0, (size_t)nthreads, 1, 0};
+    s.a = (int*)malloc(sizeof(int) * (n ? n : 1));
+    s.b = (int*)malloc(sizeof(int) * (n ? n : 1));
+    s.run = (size_t*)malloc(sizeof(size_t) * ((size_t)nthreads + 1));
+    s.cnt = (size_t*)malloc(sizeof(size_t) * (size_t)nthreads);
+    if (!s.a || !s.b || !s.run || !s.cnt) {
+        free(s.a);
+        free(s.b);
+        free(s.run);
+        free(s.cnt);
+        return 0;
+    }
+
+    for (int i = 0; i <= nthreads; ++i) s.run[i] = slice_at(n, i, nthreads);
+    bptree_parallel_run(nthreads, sort_slice_run, &s);
+    while (s.nrun > 1) {
+        size_t pairs = (s.nrun + 1) / 2;
+        s.parts = (size_t)nthreads > pairs ? (size_t)nthreads / pairs : 1;
+        bptree_parallel_run(nthreads, merge_pass_run, &s);
+        for (size_t p = 0; p < pairs; ++p) s.run[p] = s.run[2 * p];
+        s.run[pairs] = n;
+        s.nrun = pairs;
+        int* tmp = s.a;
+        s.a = s.b;
+        s.b = tmp;
+    }
+
+    bptree_parallel_run(nthreads, count_distinct_run, &s);
+    size_t off = 0;
+    for (int i = 0; i < nthreads; ++i) {
+        size_t c = s.cnt[i];
+        s.cnt[i] = off;
+        off += c;
+    }
+    bptree_parallel_run(nthreads, compact_run, &s);
+    free(s.a);
+    free(s.run);
+    free(s.cnt);
+    *out_n = off;
+    return s.b;
+}
+
+static int strictly_ascending(const int* keys, size_t n) {
+    for (size_t i = 1; i < n; ++i) {
+        if (keys[i] <= keys[i - 1]) return 0;
+    }
+    return 1;
+}
+
+// -------------------- Public API --------------------
+
+int bptree_bulk_load_parallel(BPTree* t, const int* keys, size_t n, double fill_factor, int nthreads) {
+    if (!t || !t->root || (n && !keys)) return 0;
+    bptree_flush(t);
+    if (!t->root->is_leaf || t->root->ops->size(t->root->store) != 0) return 0; // not empty
+    if (!(fill_factor > 0.0 && fill_factor <= 1.0)) fill_factor = 1.0;
+    nthreads = thread_count(nthreads, n);
+
+    const int* u = keys;
+    size_t nu = n;
+    int* sorted = 0;
+    if (!strictly_ascending(keys, n)) {
+        sorted = sorted_distinct(keys, n, nthreads, &nu);
+        if (!sorted) return 0;
+        u = sorted;
+    }
+
+    int ok;
+    if (t->wal || nthreads < 2) { // a logged tree's new nodes go through its dirty list
+        ok = bptree_bulk_load(t, u, nu, fill_factor);
+    } else {
+        if (t->concurrent) bptree_olc_begin_write(t);
+        ok = t->impl->bulk_parallel(t, u, nu, fill_factor, nthreads);
+        if (ok && nu) t->frozen_stale = 1;
+        if (t->concurrent) bptree_olc_end_write(t);
+    }
+    free(sorted);
+    return ok;
+}
+
+static size_t apply_batch(BPTree* t, const int* keys, size_t n, int insert, int nthreads) {
+    if (!t || !t->root || !keys || n == 0) return 0;
+    nthreads = thread_count(nthreads, n);
+
+    const int* u = keys;
+    size_t nu = n;
+    int* sorted = 0;
+    if (!strictly_ascending(keys, n)) {
+        sorted = sorted_distinct(keys, n, nthreads, &nu);
+        if (!sorted) return 0;
+        u = sorted;
+    }
+    // workers bypass the writer's node locks, the message buffers and the log
+    if (t->concurrent || t->buffered || t->wal) nthreads = 1;
+
+    if (t->concurrent) bptree_olc_begin_write(t);
+    size_t done = t->impl->apply_batch(t, u, nu, insert, nthreads);
+    if (done) t->frozen_stale = 1;
+    if (t->wal) { // replaying a key the batch did not change is a no-op
+        for (size_t i = 0; i < nu; ++i) {
+            bptree_wal_log(t, insert ? BPTREE_WAL_INSERT : BPTREE_WAL_DELETE, u[i], u[i], 0);
+        }
+    }
+    if (t->concurrent) bptree_olc_end_write(t);
+    free(sorted);
+    return done;
+}
+
+size_t bptree_insert_batch(BPTree* t, const int* keys, size_t n, int nthreads) {
+    return apply_batch(t, keys, n, 1, nthreads);
+}
+
+size_t bptree_delete_batch(BPTree* t, const int* keys, size_t n, int nthreads) {
+    return apply_batch(t, keys, n, 0, nthreads);
+}
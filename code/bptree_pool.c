@@ -0,0 +1,139 @@
+// bptree_pool.c  (node pool of one tree)
+//
+// Nodes come from chunks that the tree allocates a batch of nodes at a time
+// and frees only in bptree_destroy. A freed node goes on the tree's free
+// list, linked through next, and the next node_create reuses it. Without
+// node_bytes the node keeps its store there, so a reused node needs no store
+// allocation either; with node_bytes the store is part of the block. Nodes
+// are pooled by store kind (an adaptive tree has up to three), and leaves
+// with keys-only stores (NodeStoreOps.create_keys) apart from the rest, so a
+// reused node always gets the store it needs.
+//
+// Chunks start small and double, up to BPTREE_POOL_CHUNK_BYTES, so a tiny
+// tree stays tiny and a large one makes one allocation per many nodes. The
+// pool is the writer's: in concurrent mode node_create and node_destroy run
+// under the writer mutex and the epoch hands retired nodes back from
+// bptree_olc_end_write, before the mutex is dropped.
+#include "bptree_internal.h"
+#include <assert.h>
+#include <stdlib.h>
+
+#define BPTREE_POOL_CHUNK_BYTES (64u * 1024u)
+#define BPTREE_POOL_FIRST_NODES 8u
+
+typedef struct PoolChunk {
+    struct PoolChunk* next;
+} PoolChunk;
+
+// chunk header padded to a cache line, so node_bytes blocks stay aligned
+#define POOL_CHUNK_HEADER ((size_t)BPTREE_CACHE_LINE)
+
+static size_t pool_block_bytes(const BPTree* t) {
+    return t->node_bytes ? t->node_bytes : sizeof(BPTreeNode);
+}
+
+void bptree_pool_init(BPTree* t) {
+    t->pool_chunk_nodes = BPTREE_POOL_FIRST_NODES;
+}
+
+// free list of the stores of kind ops, keys-only ones or not
+static int pool_list(const BPTree* t, const NodeStoreOps* ops, int keys_only) {
+    int kind = ops == t->ops ? 0 : (ops == t->adapt_read ? 1 : 2);
+    return 2 * kind + (keys_only ? 1 : 0);
+}
+
+// one more chunk, its nodes onto free list l; 0 on OOM
+static int pool_grow(BPTree* t, int l) {
+    size_t block = pool_block_bytes(t);
+    size_t n = t->pool_chunk_nodes;
+    size_t bytes = POOL_CHUNK_HEADER + n * block;
+    bytes = (bytes + BPTREE_CACHE_LINE - 1) & ~(size_t)(BPTREE_CACHE_LINE - 1);
+    PoolChunk* c = (PoolChunk*)aligned_alloc(BPTREE_CACHE_LINE, bytes);
+    if (!c) return 0;
+    c->next = (PoolChunk*)t->pool_chunks;
+    t->pool_chunks = c;
+    t->pool_bytes += bytes;
+
+    char* base = (char*)c + POOL_CHUNK_HEADER;
+    for (size_t i = n; i-- > 0;) { // lowest address first off the list
+        BPTreeNode* x = (BPTreeNode*)(base + i * block);
+        x->store = 0;
+        x->next = t->pool_free[l];
+        t->pool_free[l] = x;
+    }
+    if ((2 * n) * block <= BPTREE_POOL_CHUNK_BYTES) t->pool_chunk_nodes = 2 * n;
+    return 1;
+}
+
+BPTreeNode* bptree_pool_get(BPTree* t, const NodeStoreOps* ops, int keys_only) {
+    int l = pool_list(t, ops, keys_only);
+    if (!t->pool_free[l] && !pool_grow(t, l)) return 0;
+    BPTreeNode* x = t->pool_free[l];
+    t->pool_free[l] = x->next;
+    return x;
+}
+
+void bptree_pool_put(BPTree* t, BPTreeNode* x) {
+    int l = pool_list(t, x->ops, bptree_node_keys_only(t, x->is_leaf, x->ops));
+    x->next = t->pool_free[l];
+    t->pool_free[l] = x;
+}
+
+// the parallel ingest's worker trees (bptree_worker_init) share t's store
+// kinds, so their free lists line up with t's
+void bptree_pool_absorb(BPTree* t, BPTree* w) {
+    for (int l = 0; l < 2 * BPTREE_POOL_KINDS; ++l) {
+        BPTreeNode* x = w->pool_free[l];
+        if (!x) continue;
+        while (x->next) x = x->next;
+        x->next = t->pool_free[l];
+        t->pool_free[l] = w->pool_free[l];
+        w->pool_free[l] = 0;
+    }
+    PoolChunk* c = (PoolChunk*)w->pool_chunks;
+    if (c) {
+        while (c->next) c = c->next;
+        c->next = (PoolChunk*)t->pool_chunks;
+        t->pool_chunks = w->pool_chunks;
+        w->pool_chunks = 0;
+    }
+    if (w->pool_chunk_nodes > t->pool_chunk_nodes) t->pool_chunk_nodes = w->pool_chunk_nodes;
+    t->pool_bytes += w->pool_bytes;
+    w->pool_bytes = 0;
+
+    // every field of BPTreeCounters is a uint64_t count
+    uint64_t* tc = (uint64_t*)&t->counters;
+    uint64_t* wc = (uint64_t*)&w->counters;
+    for (size_t i = 0; i < sizeof(BPTreeCounters) / sizeof(uint64_t); ++i) tc[i] += wc[i];
+    memset(&w->counters, 0, sizeof(w->counters));
+}
+
+size_t bptree_pool_bytes(const BPTree* t) {
+    size_t bytes = t->pool_bytes;
+    if (t->node_bytes) return bytes;
+    for (int l = 0; l < 2 * BPTREE_POOL_KINDS; ++l) {
+        for (const BPTreeNode* x = t->pool_free[l]; x; x = x->next) {
+            if (x->store && x->ops->bytes) bytes += x->ops->bytes(x->store);
+        }
+    }
+    return bytes;
+}
+
+void bptree_pool_fini(BPTree* t) {
+    for (int l = 0; l < 2 * BPTREE_POOL_KINDS; ++l) {
+        if (!t->node_bytes) {
+            for (BPTreeNode* x = t->pool_free[l]; x; x = x->next) {
+                if (x->store) x->ops->destroy(x->store);
+            }
+        }
+        t->pool_free[l] = 0;
+    }
+    PoolChunk* c = (PoolChunk*)t->pool_chunks;
+    while (c) {
+        PoolChunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    t->pool_chunks = 0;
+    t->pool_bytes = 0;
+}
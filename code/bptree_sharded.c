@@ -0,0 +1,371 @@
+// bptree_sharded.c  (range-partitioned front-end over independent trees)
+//
+// Every operation holds the directory lock shared while it looks up its shard
+// and works on it, so a split (directory lock exclusive) never sees a shard in
+// use. A split rebuilds the shard into two bulk-loaded trees around the root
+// separator; nothing else ever moves keys between shards.
+#define _POSIX_C_SOURCE 200809L     // pthread_rwlock_t under -std=c11
+
+#include "bptree_sharded.h"
+#include "bptree_internal.h"
+#include <limits.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+
+// bulk-load fill of the two halves of a split: leave room for more inserts in
+// the range that just grew
+#define BPTREE_SHARD_FILL 0.7
+
+typedef struct Shard {
+    pthread_rwlock_t lock;          // shared: searches; exclusive: writes
+    BPTree* t;
+    size_t n;                       // keys in t, under lock
+    char pad[BPTREE_CACHE_LINE];    // keep neighbouring shards' locks apart
+} Shard;
+
+struct ShardedBPTree {
+    int order_M;
+    NodeStoreKind kind;
+    int max_shards;
+
+    pthread_rwlock_t dir;           // shared: any operation; exclusive: split
+    int n_shards;
+    int* lo;                        // lo[i]: smallest key of shard i, lo[0] = INT_MIN
+    Shard** shards;                 // max_shards slots
+};
+
+static BPTree* shard_tree_create(const ShardedBPTree* st) {
+    BPTree* t = bptree_create_static(st->order_M, st->kind);
+    return t ? t : bptree_create(st->order_M, nodestore_get_ops(st->kind));
+}
+
+static Shard* shard_create(BPTree* t) {
+    Shard* s = (Shard*)malloc(sizeof(Shard));
+    if (!s) return NULL;
+    if (pthread_rwlock_init(&s->lock, NULL) != 0) {
+        free(s);
+        return NULL;
+    }
+    s->t = t;
+    s->n = 0;
+    return s;
+}
+
+static void shard_destroy(Shard* s) {
+    if (!s) return;
+    bptree_destroy(s->t);
+    pthread_rwlock_destroy(&s->lock);
+    free(s);
+}
+
+ShardedBPTree* bptree_sharded_create(int order_M, NodeStoreKind kind, int max_shards) {
+    if (max_shards < 1 || !nodestore_get_ops(kind)) return NULL;
+    ShardedBPTree* st = (ShardedBPTree*)calloc(1, sizeof(ShardedBPTree));
+    if (!st) return NULL;
+    st->order_M = order_M;
+    st->kind = kind;
+    st->max_shards = max_shards;
+
+    st->lo = (int*)malloc(sizeof(int) * (size_t)max_shards);
+    st->shards = (Shard**)calloc((size_t)max_shards, sizeof(Shard*));
+    BPTree* t = (st->lo && st->shards) ? shard_tree_create(st) : NULL;
+    Shard* s = t ? shard_create(t) : NULL;
+    if (!s || pthread_rwlock_init(&st->dir, NULL) != 0) {
+        if (s) shard_destroy(s);
+        else bptree_destroy(t);
+        free(st->lo);
+        free(st->shards);
+        free(st);
+        return NULL;
+    }
+    st->lo[0] = INT_MIN;
+    st->shards[0] = s;
+    st->n_shards = 1;
+    return st;
+}
+
+void bptree_sharded_destroy(ShardedBPTree* st) {
+    if (!st) return;
+    for (int i = 0; i < st->n_shards; ++i) shard_destroy(st->shards[i]);
+    pthread_rwlock_destroy(&st->dir);
+    free(st->lo);
+    free(st->shards);
+    free(st);
+}
+
+const char* bptree_sharded_impl_name(const ShardedBPTree* st) {
+    return st ? bptree_impl_name(st->shards[0]->t) : "";
+}
+
+// shard whose range holds key: last i with lo[i] <= key (directory held)
+static int shard_of(const ShardedBPTree* st, int key) {
+    int lo = 1, hi = st->n_shards;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (st->lo[mid] <= key) lo = mid + 1;
+        else hi = mid;
+    }
+    return lo - 1;
+}
+
+// ---- splitting ----
+
+typedef struct KeyBuf {
+    int* keys;
+    size_t n;
+} KeyBuf;
+
+static int append_slice(const int* keys, size_t n, void* arg) {
+    KeyBuf* b = (KeyBuf*)arg;
+    memcpy(b->keys + b->n, keys, n * sizeof(int));
+    b->n += n;
+    return 0;
+}
+
+// Split shard i at its root's middle separator (directory held exclusively).
+// 0 if it cannot be split or on allocation failure; the shard is then intact.
+static int split_shard(ShardedBPTree* st, int i) {
+    Shard* s = st->shards[i];
+    KeyBuf b = {(int*)malloc(sizeof(int) * (s->n ? s->n : 1)), 0};
+    if (!b.keys) return 0;
+    bptree_range_scan(s->t, INT_MIN, INT_MAX, append_slice, &b);
+
+    // a root leaf (huge M) has no separator: use the median key
+    const BPTreeNode* root = s->t->root;
+    int sep = b.keys[b.n / 2];
+    if (!root->is_leaf) {
+        int nk = root->ops->size(root->store);
+        sep = root->ops->key_at(root->store, nk / 2);
+    }
+    size_t p = 0;
+    while (p < b.n && b.keys[p] < sep) ++p;
+    if (p == 0 || p == b.n) {
+        free(b.keys);
+        return 0;
+    }
+
+    BPTree* left = shard_tree_create(st);
+    BPTree* right = shard_tree_create(st);
+    Shard* rs = right ? shard_create(right) : NULL;
+    if (!left || !rs || !bptree_bulk_load(left, b.keys, p, BPTREE_SHARD_FILL) ||
+        !bptree_bulk_load(right, b.keys + p, b.n - p, BPTREE_SHARD_FILL)) {
+        bptree_destroy(left);
+        if (rs) shard_destroy(rs);
+        else bptree_destroy(right);
+        free(b.keys);
+        return 0;
+    }
+    free(b.keys);
+
+    bptree_destroy(s->t);
+    s->t = left;
+    rs->n = s->n - p;
+    s->n = p;
+
+    memmove(&st->shards[i + 2], &st->shards[i + 1], sizeof(Shard*) * (size_t)(st->n_shards - i - 1));
+    memmove(&st->lo[i + 2], &st->lo[i + 1], sizeof(int) * (size_t)(st->n_shards - i - 1));
+    st->shards[i + 1] = rs;
+    st->lo[i + 1] = sep;
+    st->n_shards++;
+    return 1;
+}
+
+// split the largest shard while it is over the threshold and slots remain
+static void split_oversized(ShardedBPTree* st) {
+    pthread_rwlock_wrlock(&st->dir);
+    while (st->n_shards < st->max_shards) {
+        int big = 0;
+        for (int i = 1; i < st->n_shards; ++i) {
+            if (st->shards[i]->n > st->shards[big]->n) big = i;
+        }
+        if (st->shards[big]->n <= BPTREE_SHARD_SPLIT_KEYS || !split_shard(st, big)) break;
+    }
+    pthread_rwlock_unlock(&st->dir);
+}
+
+// directory held (shared or exclusive)
+static int wants_split(const ShardedBPTree* st, const Shard* s) {
+    return s->n > BPTREE_SHARD_SPLIT_KEYS && st->n_shards < st->max_shards;
+}
+
+// ---- point operations ----
+
+int bptree_sharded_search(ShardedBPTree* st, int key) {
+    pthread_rwlock_rdlock(&st->dir);
+    Shard* s = st->shards[shard_of(st, key)];
+    pthread_rwlock_rdlock(&s->lock);
+    int found = bptree_search(s->t, key);
+    pthread_rwlock_unlock(&s->lock);
+    pthread_rwlock_unlock(&st->dir);
+    return found;
+}
+
+int bptree_sharded_insert(ShardedBPTree* st, int key) {
+    pthread_rwlock_rdlock(&st->dir);
+    Shard* s = st->shards[shard_of(st, key)];
+    pthread_rwlock_wrlock(&s->lock);
+    int added = bptree_insert(s->t, key);
+    s->n += (size_t)added;
+    int split = added && wants_split(st, s);
+    pthread_rwlock_unlock(&s->lock);
+    pthread_rwlock_unlock(&st->dir);
+
+    if (split) split_oversized(st);
+    return added;
+}
+
+int bptree_sharded_delete(ShardedBPTree* st, int key) {
+    pthread_rwlock_rdlock(&st->dir);
+    Shard* s = st->shards[shard_of(st, key)];
+    pthread_rwlock_wrlock(&s->lock);
+    int removed = bptree_delete(s->t, key);
+    s->n -= (size_t)removed;
+    pthread_rwlock_unlock(&s->lock);
+    pthread_rwlock_unlock(&st->dir);
+    return removed;
+}
+
+// ---- batches ----
+
+// Bucket keys by shard (directory held): r->keys[off[s] .. off[s+1]) are the
+// keys of shard s, and perm maps each back to its index in keys. 0 on OOM.
+typedef struct Routing {
+    size_t* off;                    // n_shards + 1 bucket offsets
+    size_t* perm;
+    int* keys;
+} Routing;
+
+static int route(const ShardedBPTree* st, const int* keys, size_t n, Routing* r) {
+    int ns = st->n_shards;
+    r->off = (size_t*)calloc((size_t)ns + 1, sizeof(size_t));
+    r->perm = (size_t*)malloc(sizeof(size_t) * n);
+    r->keys = (int*)malloc(sizeof(int) * n);
+    int* sid = (int*)malloc(sizeof(int) * n);
+    if (!r->off || !r->perm || !r->keys || !sid) {
+        free(r->off);
+        free(r->perm);
+        free(r->keys);
+        free(sid);
+        return 0;
+    }
+
+    for (size_t i = 0; i < n; ++i) {
+        sid[i] = shard_of(st, keys[i]);
+        r->off[sid[i] + 1]++;
+    }
+    for (int s = 0; s < ns; ++s) r->off[s + 1] += r->off[s];
+    // scatter with a moving cursor per bucket, then restore the offsets
+    for (size_t i = 0; i < n; ++i) {
+        size_t at = r->off[sid[i]]++;
+        r->keys[at] = keys[i];
+        r->perm[at] = i;
+    }
+    for (int s = ns; s > 0; --s) r->off[s] = r->off[s - 1];
+    r->off[0] = 0;
+    free(sid);
+    return 1;
+}
+
+static void routing_free(Routing* r) {
+    free(r->off);
+    free(r->perm);
+    free(r->keys);
+}
+
+void bptree_sharded_search_batch(ShardedBPTree* st, const int* keys, size_t n, uint8_t* found) {
+    if (!st || n == 0) return;
+    pthread_rwlock_rdlock(&st->dir);
+    Routing r;
+    uint8_t* hit = NULL;
+    if (route(st, keys, n, &r)) {
+        hit = (uint8_t*)malloc(n);
+        if (!hit) routing_free(&r);
+    }
+    if (!hit) {
+        pthread_rwlock_unlock(&st->dir);
+        for (size_t i = 0; i < n; ++i) found[i] = (uint8_t)bptree_sharded_search(st, keys[i]);
+        return;
+    }
+
+    for (int s = 0; s < st->n_shards; ++s) {
+        size_t c = r.off[s + 1] - r.off[s];
+        if (c == 0) continue;
+        Shard* sh = st->shards[s];
+        pthread_rwlock_rdlock(&sh->lock);
+        bptree_search_batch(sh->t, r.keys + r.off[s], c, hit + r.off[s]);
+        pthread_rwlock_unlock(&sh->lock);
+    }
+    pthread_rwlock_unlock(&st->dir);
+
+    for (size_t j = 0; j < n; ++j) found[r.perm[j]] = hit[j];
+    free(hit);
+    routing_free(&r);
+}
+
+size_t bptree_sharded_insert_batch(ShardedBPTree* st, const int* keys, size_t n) {
+    if (!st || n == 0) return 0;
+    size_t added = 0;
+    pthread_rwlock_rdlock(&st->dir);
+    Routing r;
+    if (!route(st, keys, n, &r)) {
+        pthread_rwlock_unlock(&st->dir);
+        for (size_t i = 0; i < n; ++i) added += (size_t)bptree_sharded_insert(st, keys[i]);
+        return added;
+    }
+
+    int split = 0;
+    for (int s = 0; s < st->n_shards; ++s) {
+        size_t c = r.off[s + 1] - r.off[s];
+        if (c == 0) continue;
+        Shard* sh = st->shards[s];
+        pthread_rwlock_wrlock(&sh->lock);
+        size_t before = sh->n;
+        for (size_t j = r.off[s]; j < r.off[s + 1]; ++j) sh->n += (size_t)bptree_insert(sh->t, r.keys[j]);
+        added += sh->n - before;
+        split |= wants_split(st, sh);
+        pthread_rwlock_unlock(&sh->lock);
+    }
+    pthread_rwlock_unlock(&st->dir);
+    routing_free(&r);
+
+    if (split) split_oversized(st);
+    return added;
+}
+
+// ---- stats ----
+
+int bptree_sharded_count(ShardedBPTree* st) {
+    if (!st) return 0;
+    pthread_rwlock_rdlock(&st->dir);
+    int n = st->n_shards;
+    pthread_rwlock_unlock(&st->dir);
+    return n;
+}
+
+size_t bptree_sharded_size(ShardedBPTree* st) {
+    if (!st) return 0;
+    size_t n = 0;
+    pthread_rwlock_rdlock(&st->dir);
+    for (int i = 0; i < st->n_shards; ++i) {
+        pthread_rwlock_rdlock(&st->shards[i]->lock);
+        n += st->shards[i]->n;
+        pthread_rwlock_unlock(&st->shards[i]->lock);
+    }
+    pthread_rwlock_unlock(&st->dir);
+    return n;
+}
+
+int bptree_sharded_height(ShardedBPTree* st) {
+    if (!st) return 0;
+    int h = 0;
+    pthread_rwlock_rdlock(&st->dir);
+    for (int i = 0; i < st->n_shards; ++i) {
+        pthread_rwlock_rdlock(&st->shards[i]->lock);
+        int sh = bptree_height(st->shards[i]->t);
+        if (sh > h) h = sh;
+        pthread_rwlock_unlock(&st->shards[i]->lock);
+    }
+    pthread_rwlock_unlock(&st->dir);
+    return h;
+}
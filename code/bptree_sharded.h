@@ -0,0 +1,39 @@
+#ifndef BPTREE_SHARDED_H
+#define BPTREE_SHARDED_H
+
+#include "bptree.h"
+
+// Range-partitioned front-end for write-heavy multi-threaded use: the key
+// space is cut into up to max_shards ranges, each held by an independent
+// BPTree behind its own reader/writer lock, so writers to different ranges
+// never touch the same root. A shard tree is the store-specialized one when
+// bptree_create_static has one for kind, bptree_create otherwise.
+//
+// It starts as one shard over all keys. A shard that grows past
+// BPTREE_SHARD_SPLIT_KEYS is cut at its root's middle separator (the tree's
+// own split point, so both halves get about the same number of leaves) until
+// max_shards exist; the directory of shard bounds is only write-locked for
+// that rebuild. Shards are never merged back. All calls may come from any
+// thread.
+typedef struct ShardedBPTree ShardedBPTree;
+
+#define BPTREE_SHARD_SPLIT_KEYS 4096
+
+ShardedBPTree* bptree_sharded_create(int order_M, NodeStoreKind kind, int max_shards);
+void    bptree_sharded_destroy(ShardedBPTree* st);
+const char* bptree_sharded_impl_name(const ShardedBPTree* st); // impl of the shard trees
+
+int     bptree_sharded_search(ShardedBPTree* st, int key);
+int     bptree_sharded_insert(ShardedBPTree* st, int key);  // 1 if the key was added
+int     bptree_sharded_delete(ShardedBPTree* st, int key);  // 1 if the key was removed
+
+// Batched forms. One pass buckets the keys by shard; each shard is then locked
+// once and handed its bucket (searches through bptree_search_batch).
+void    bptree_sharded_search_batch(ShardedBPTree* st, const int* keys, size_t n, uint8_t* found);
+size_t  bptree_sharded_insert_batch(ShardedBPTree* st, const int* keys, size_t n); // keys added
+
+int     bptree_sharded_count(ShardedBPTree* st);            // current number of shards
+size_t  bptree_sharded_size(ShardedBPTree* st);             // keys over all shards
+int     bptree_sharded_height(ShardedBPTree* st);           // tallest shard
+
+#endif
@@ -0,0 +1,23 @@
+// bptree_static_array.c
+//
+// bptree_impl.h specialized for the array store (NODESTORE_ARRAY):
+// store accesses are direct calls into nodestore_array_impl.h and inline.
+#include "nodestore_array_impl.h"
+
+#define NS_SIZE(t, x)                  ((void)(t), ns_size((x)->store))
+#define NS_KEY_AT(t, x, i)             ((void)(t), ns_key_at((x)->store, (i)))
+#define NS_VAL_AT(t, x, i)             ((void)(t), ns_val_at((x)->store, (i)))
+#define NS_SET_VAL(t, x, i, v)         ((void)(t), ns_set_val((x)->store, (i), (v)))
+#define NS_SET_KEY(t, x, i, k)         ((void)(t), ns_set_key((x)->store, (i), (k)))
+#define NS_LOWER_BOUND(t, x, k)        ((void)(t), ns_lower_bound((x)->store, (k)))
+#define NS_INSERT_AT(t, x, i, k, v)    ((void)(t), ns_insert_at((x)->store, (i), (k), (v)))
+#define NS_ERASE_AT(t, x, i)           ((void)(t), ns_erase_at((x)->store, (i)))
+#define NS_CLEAR(t, x)                 ((void)(t), ns_clear((x)->store))
+#define NS_APPEND_FROM(t, x, y, i)     ((void)(t), ns_append_from((x)->store, (y)->store, (i)))
+#define NS_PREFETCH(t, x)              ((void)(t), ns_prefetch((x)->store))
+#define NS_KEY_DATA(t, x)              ((void)(t), ns_key_data((x)->store))
+#define NS_VAL_DATA(t, x)              ((void)(t), ns_val_data((x)->store))
+
+#define BPTREE_IMPL_NAME  bptree_array_impl
+#define BPTREE_IMPL_LABEL "array-static"
+#include "bptree_impl.h"
@@ -0,0 +1,733 @@
+// bptree_wal.c  (logged trees: write-ahead log, checkpoints, recovery)
+//
+// A logged tree pairs an image (the bptree_mmap.c format) with a log of the
+// writes made since the image. Every effective write appends one fixed-size
+// record; records gather in a buffer and reach the file in one write(2) per
+// buffer or sync, and an fdatasync covers every sync_every records, so the
+// cost of a sync is shared by a group of writes.
+//
+// Log and image carry a generation. A checkpoint writes an image holding the
+// log's generation g as wal_gen g + 1, makes it durable, then restarts the log
+// empty as generation g + 1. Recovery replays the log only if its generation
+// is the image's wal_gen: anything older is already in the image, whichever
+// step a crash interrupted.
+//
+// Checkpoints are incremental. Each node remembers its slot in the image, and
+// node_write / node_create (bptree_impl.h) queue a node on the dirty list the
+// first time it changes. A checkpoint gives new nodes free or fresh slots and
+// rewrites only the dirty ones in place. The pages plus the new header go to
+// a journal first, then into the image: a crash mid-way leaves the journal
+// for recovery to apply again. The journal names the image generation it
+// starts from, so a stale one is never applied to a later image. The first
+// checkpoint of a tree, and any where most nodes changed, rewrite the whole
+// image into a temporary file and rename it over the old one instead.
+//
+// Recovery never descends the tree: the image's keys (read from its leaf
+// chain) and the log's records are merged as sorted arrays, and the result
+// is one bulk load.
+#define _POSIX_C_SOURCE 200809L     // pwrite, fsync, fdatasync, ftruncate under -std=c11
+
+#include "bptree_internal.h"
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define BPTREE_WAL_MAGIC      "BPTWAL01"
+#define BPTREE_JOURNAL_MAGIC  "BPTJRN01"
+#define BPTREE_WAL_VERSION    1u
+#define BPTREE_WAL_BUF        (1u << 16)  // bytes of records gathered per write(2)
+#define BPTREE_WAL_RECOVER_FILL 0.7       // recovered leaves keep room for the writes that follow
+
+typedef struct WalHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t rec_bytes;
+    uint64_t value_size;
+    uint64_t gen;
+} WalHeader;
+
+// followed by value_size bytes: the value of an upsert, zeros otherwise
+typedef struct WalRecord {
+    int32_t op;
+    int32_t key;                // delete range: lo
+    int32_t hi;                 // delete range: hi; otherwise key
+    uint32_t check;             // wal_check of the rest, torn writes fail it
+} WalRecord;
+
+// then the new header page, n_pages node pages each after its uint64_t
+// offset, and a uint64_t journal_check of everything before it
+typedef struct JournalHeader {
+    char magic[8];
+    uint64_t base_gen;          // wal_gen of the image the pages apply to
+    uint64_t n_pages;
+    uint64_t node_bytes;
+} JournalHeader;
+
+struct BPTreeWal {
+    char* image_path;
+    char* wal_path;
+    int fd;                     // the log
+    uint64_t gen;               // generation of the log; the image's wal_gen
+    uint64_t end;               // bytes of the log on file
+    size_t rec_bytes;
+    unsigned char* buf;         // records not yet written
+    size_t n_buf;
+    unsigned sync_every;        // 0: only bptree_wal_sync, checkpoints and destroy
+    unsigned unsynced;          // records since the last fdatasync
+    int failed;                 // a log write failed; sticky
+
+    // image: slots of the nodes; dirty and new nodes since the last checkpoint
+    uint32_t n_slots;           // 0: no image of this tree's nodes yet
+    uint32_t* free_slots;       // slots of destroyed nodes, reusable by the next checkpoint
+    size_t n_free;
+    size_t cap_free;
+    BPTreeNode** dirty;         // NULL entries: destroyed since queued
+    size_t n_dirty;
+    size_t cap_dirty;
+    int lost_dirty;             // the list could not grow: the next checkpoint is a full one
+};
+
+// -------------------- Files --------------------
+
+static uint64_t fnv1a(uint64_t h, const void* p, size_t n) {
+    const unsigned char* b = (const unsigned char*)p;
+    for (size_t i = 0; i < n; ++i) {
+        h ^= b[i];
+        h *= 1099511628211ull;
+    }
+    return h;
+}
+
+#define FNV_BASIS 14695981039346656037ull
+
+static uint32_t wal_check(const unsigned char* rec, size_t rec_bytes, uint64_t gen) {
+    uint64_t h = fnv1a(FNV_BASIS, &gen, sizeof gen);
+    h = fnv1a(h, rec, offsetof(WalRecord, check));
+    h = fnv1a(h, rec + sizeof(WalRecord), rec_bytes - sizeof(WalRecord));
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static int pwrite_all(int fd, const void* p, size_t n, uint64_t off) {
+    const unsigned char* b = (const unsigned char*)p;
+    while (n) {
+        ssize_t r = pwrite(fd, b, n, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 0;
+        b += r;
+        n -= (size_t)r;
+        off += (uint64_t)r;
+    }
+    return 1;
+}
+
+static int pread_all(int fd, void* p, size_t n, uint64_t off) {
+    unsigned char* b = (unsigned char*)p;
+    while (n) {
+        ssize_t r = pread(fd, b, n, (off_t)off);
+        if (r < 0 && errno == EINTR) continue;
+        if (r <= 0) return 0;
+        b += r;
+        n -= (size_t)r;
+        off += (uint64_t)r;
+    }
+    return 1;
+}
+
+static int file_exists(const char* path) {
+    struct stat st;
+    return stat(path, &st) == 0;
+}
+
+// makes a rename or unlink in path's directory durable
+static int sync_dir(const char* path) {
+    const char* slash = strrchr(path, '/');
+    char dir[4096];
+    if (!slash) {
+        strcpy(dir, ".");
+    } else {
+        size_t n = (size_t)(slash - path);
+        if (n == 0) n = 1; // "/file"
+        if (n >= sizeof dir) return 0;
+        memcpy(dir, path, n);
+        dir[n] = 0;
+    }
+    int fd = open(dir, O_RDONLY);
+    if (fd < 0) return 0;
+    int ok = fsync(fd) == 0;
+    close(fd);
+    return ok;
+}
+
+static char* path_with(const char* path, const char* suffix) {
+    size_t a = strlen(path), b = strlen(suffix);
+    char* s = (char*)malloc(a + b + 1);
+    if (!s) return 0;
+    memcpy(s, path, a);
+    memcpy(s + a, suffix, b + 1);
+    return s;
+}
+
+// -------------------- Log --------------------
+
+// empties the log and starts generation gen
+static int wal_restart(BPTreeWal* w, const BPTree* t, uint64_t gen) {
+    WalHeader h;
+    memset(&h, 0, sizeof h);
+    memcpy(h.magic, BPTREE_WAL_MAGIC, sizeof h.magic);
+    h.version = BPTREE_WAL_VERSION;
+    h.rec_bytes = (uint32_t)w->rec_bytes;
+    h.value_size = t->value_size;
+    h.gen = gen;
+    if (ftruncate(w->fd, 0) != 0 || !pwrite_all(w->fd, &h, sizeof h, 0) || fsync(w->fd) != 0) return 0;
+    w->gen = gen;
+    w->end = sizeof h;
+    w->n_buf = 0;
+    w->unsynced = 0;
+    return 1;
+}
+
+static int wal_write(BPTreeWal* w) {
+    if (!w->n_buf) return 1;
+    if (!pwrite_all(w->fd, w->buf, w->n_buf, w->end)) return 0;
+    w->end += w->n_buf;
+    w->n_buf = 0;
+    return 1;
+}
+
+static int wal_flush(BPTreeWal* w) {
+    if (w->failed) return 0;
+    if (!wal_write(w) || fdatasync(w->fd) != 0) {
+        w->failed = 1;
+        return 0;
+    }
+    w->unsynced = 0;
+    return 1;
+}
+
+void bptree_wal_log(BPTree* t, int op, int key, int hi, const void* val) {
+    BPTreeWal* w = t->wal;
+    if (w->failed) return;
+    if (w->n_buf + w->rec_bytes > BPTREE_WAL_BUF && !wal_write(w)) {
+        w->failed = 1;
+        return;
+    }
+    unsigned char* rec = w->buf + w->n_buf;
+    WalRecord r;
+    r.op = op;
+    r.key = key;
+    r.hi = hi;
+    r.check = 0;
+    memcpy(rec, &r, sizeof r);
+    memset(rec + sizeof r, 0, w->rec_bytes - sizeof r);
+    if (val) memcpy(rec + sizeof r, val, t->value_size);
+    r.check = wal_check(rec, w->rec_bytes, w->gen);
+    memcpy(rec + offsetof(WalRecord, check), &r.check, sizeof r.check);
+    w->n_buf += w->rec_bytes;
+
+    if (w->sync_every && ++w->unsynced >= w->sync_every) wal_flush(w);
+}
+
+int bptree_wal_sync(BPTree* t) {
+    if (!t || !t->wal) return 0;
+    if (t->concurrent) bptree_olc_begin_write(t);
+    int ok = wal_flush(t->wal);
+    if (t->concurrent) bptree_olc_end_write(t);
+    return ok;
+}
+
+// -------------------- Dirty nodes --------------------
+
+void bptree_wal_dirty(BPTree* t, BPTreeNode* x) {
+    BPTreeWal* w = t->wal;
+    if (w->n_dirty == w->cap_dirty) {
+        size_t cap = w->cap_dirty ? w->cap_dirty * 2 : 256;
+        BPTreeNode** d = cap <= UINT32_MAX ? (BPTreeNode**)realloc(w->dirty, sizeof(*d) * cap) : 0;
+        if (!d) {
+            w->lost_dirty = 1;
+            return;
+        }
+        w->dirty = d;
+        w->cap_dirty = cap;
+    }
+    w->dirty[w->n_dirty++] = x;
+    x->dirty = (uint32_t)w->n_dirty;
+}
+
+void bptree_wal_forget(BPTree* t, BPTreeNode* x) {
+    BPTreeWal* w = t->wal;
+    if (x->dirty) w->dirty[x->dirty - 1] = 0;
+    x->dirty = 0;
+    if (!x->slot) return;
+    if (w->n_free == w->cap_free) {
+        size_t cap = w->cap_free ? w->cap_free * 2 : 256;
+        uint32_t* f = (uint32_t*)realloc(w->free_slots, sizeof(*f) * cap);
+        if (!f) return; // the slot stays unused
+        w->free_slots = f;
+        w->cap_free = cap;
+    }
+    w->free_slots[w->n_free++] = x->slot - 1;
+    x->slot = 0;
+}
+
+static void dirty_clear(BPTreeWal* w) {
+    for (size_t i = 0; i < w->n_dirty; ++i) {
+        if (w->dirty[i]) w->dirty[i]->dirty = 0;
+    }
+    w->n_dirty = 0;
+}
+
+// -------------------- Checkpoints --------------------
+
+static BPTreeNode* leftmost_leaf(const BPTree* t) {
+    BPTreeNode* x = t->root;
+    while (!x->is_leaf) x = x->child0;
+    return x;
+}
+
+// whole image to image_path.tmp, renamed over image_path; every node gets
+// the slot it was written to
+static int checkpoint_full(BPTree* t) {
+    BPTreeWal* w = t->wal;
+    char* tmp = path_with(w->image_path, ".tmp");
+    if (!tmp) return 0;
+    FILE* f = fopen(tmp, "wb");
+    if (!f) {
+        free(tmp);
+        return 0;
+    }
+    w->lost_dirty = 1; // until every node has its new slot
+    size_t n = bptree_map_write(t, f, w->gen + 1, 1);
+    int ok = n != 0 && n <= UINT32_MAX;
+    ok = (fflush(f) == 0) && ok;
+    ok = (fsync(fileno(f)) == 0) && ok;
+    ok = (fclose(f) == 0) && ok;
+    ok = ok && rename(tmp, w->image_path) == 0 && sync_dir(w->image_path);
+    if (!ok) remove(tmp);
+    free(tmp);
+    if (!ok) return 0;
+
+    dirty_clear(w);
+    w->n_free = 0;
+    w->n_slots = (uint32_t)n;
+    w->lost_dirty = 0;
+    return 1;
+}
+
+// pages of the dirty nodes: to the journal, then in place into the image;
+// 1 once the journal is durable
+static int checkpoint_dirty(BPTree* t) {
+    BPTreeWal* w = t->wal;
+    size_t node_bytes = bptree_map_node_bytes(t);
+    uint64_t n_pages = 0;
+    for (size_t i = 0; i < w->n_dirty; ++i) {
+        BPTreeNode* x = w->dirty[i];
+        if (!x) continue;
+        if (!x->slot) {
+            if (w->n_free) x->slot = w->free_slots[--w->n_free] + 1;
+            else if (w->n_slots < UINT32_MAX) x->slot = ++w->n_slots;
+            else return !(w->lost_dirty = 1);
+        }
+        ++n_pages;
+    }
+
+    unsigned char* page = (unsigned char*)malloc(node_bytes > BPTREE_PAGE_SIZE ? node_bytes : BPTREE_PAGE_SIZE);
+    char* jpath = path_with(w->image_path, ".journal");
+    FILE* j = jpath ? fopen(jpath, "wb") : 0;
+    int ok = page && j;
+
+    JournalHeader jh;
+    memset(&jh, 0, sizeof jh);
+    memcpy(jh.magic, BPTREE_JOURNAL_MAGIC, sizeof jh.magic);
+    jh.base_gen = w->gen;
+    jh.n_pages = n_pages;
+    jh.node_bytes = node_bytes;
+    uint64_t check = FNV_BASIS;
+    if (ok) {
+        ok = fwrite(&jh, sizeof jh, 1, j) == 1;
+        check = fnv1a(check, &jh, sizeof jh);
+        bptree_map_header_page(t, page, w->n_slots, t->root->slot - 1, leftmost_leaf(t)->slot - 1, w->gen + 1);
+        ok = ok && fwrite(page, BPTREE_PAGE_SIZE, 1, j) == 1;
+        check = fnv1a(check, page, BPTREE_PAGE_SIZE);
+    }
+    for (size_t i = 0; ok && i < w->n_dirty; ++i) {
+        const BPTreeNode* x = w->dirty[i];
+        if (!x) continue;
+        uint64_t off = BPTREE_PAGE_SIZE + (uint64_t)(x->slot - 1) * node_bytes;
+        bptree_map_node_page(t, x, page);
+        ok = fwrite(&off, sizeof off, 1, j) == 1 && fwrite(page, node_bytes, 1, j) == 1;
+        check = fnv1a(fnv1a(check, &off, sizeof off), page, node_bytes);
+    }
+    if (j) {
+        ok = ok && fwrite(&check, sizeof check, 1, j) == 1;
+        ok = (fflush(j) == 0) && ok;
+        ok = (fsync(fileno(j)) == 0) && ok;
+        ok = (fclose(j) == 0) && ok;
+        ok = ok && sync_dir(jpath);
+        if (!ok) unlink(jpath); // the image is untouched
+    }
+    if (!ok) {
+        free(jpath);
+        free(page);
+        return 0;
+    }
+
+    // The journal is durable, which commits the checkpoint: recovery would
+    // apply it. Now the image, nodes before the header.
+    int fd = open(w->image_path, O_RDWR);
+    ok = fd >= 0;
+    for (size_t i = 0; ok && i < w->n_dirty; ++i) {
+        const BPTreeNode* x = w->dirty[i];
+        if (!x) continue;
+        bptree_map_node_page(t, x, page);
+        ok = pwrite_all(fd, page, node_bytes, BPTREE_PAGE_SIZE + (uint64_t)(x->slot - 1) * node_bytes);
+    }
+    if (ok) {
+        ok = fsync(fd) == 0;
+        bptree_map_header_page(t, page, w->n_slots, t->root->slot - 1, leftmost_leaf(t)->slot - 1, w->gen + 1);
+        ok = ok && pwrite_all(fd, page, BPTREE_PAGE_SIZE, 0) && fsync(fd) == 0;
+    }
+    if (fd >= 0) close(fd);
+    if (ok) {
+        unlink(jpath); // a leftover one names the old generation and is ignored
+        dirty_clear(w);
+    } else {
+        // the image needs the journal, which stays for recovery; the next
+        // checkpoint replaces them both with a whole image
+        w->lost_dirty = 1;
+    }
+    free(jpath);
+    free(page);
+    return 1;
+}
+
+int bptree_checkpoint(BPTree* t) {
+    if (!t || !t->wal) return 0;
+    if (t->buffered) bptree_flush(t);
+    if (t->concurrent) bptree_olc_begin_write(t);
+
+    BPTreeWal* w = t->wal;
+    int full = !w->n_slots || w->lost_dirty || w->n_dirty > w->n_slots / 2;
+    int ok = full ? checkpoint_full(t) : checkpoint_dirty(t);
+    // the image holds every record so far, unwritten ones included
+    ok = ok && wal_restart(w, t, w->gen + 1);
+    if (ok) w->failed = 0;
+
+    if (t->concurrent) bptree_olc_end_write(t);
+    return ok;
+}
+
+// -------------------- Recovery --------------------
+
+// applies a complete journal whose base generation is the image's
+static int journal_recover(const char* image_path) {
+    char* jpath = path_with(image_path, ".journal");
+    if (!jpath) return 0;
+    int jfd = open(jpath, O_RDONLY);
+    if (jfd < 0) {
+        free(jpath);
+        return 1; // nothing to do
+    }
+    int ok = 1, apply = 0;
+    struct stat st;
+    JournalHeader jh;
+    uint64_t image_gen = 0;
+    int ifd = open(image_path, O_RDWR);
+    BPTree* m = bptree_open_mmap(image_path);
+    if (m) {
+        image_gen = bptree_map_wal_gen(m);
+        bptree_destroy(m);
+    }
+    if (ifd >= 0 && m && fstat(jfd, &st) == 0 && pread_all(jfd, &jh, sizeof jh, 0) &&
+        memcmp(jh.magic, BPTREE_JOURNAL_MAGIC, sizeof jh.magic) == 0 && jh.base_gen == image_gen &&
+        jh.node_bytes && jh.n_pages <= ((uint64_t)st.st_size) / jh.node_bytes &&
+        (uint64_t)st.st_size == sizeof jh + BPTREE_PAGE_SIZE + jh.n_pages * (8 + jh.node_bytes) + 8) {
+        apply = 1;
+    }
+
+    // checksum first, then the pages: an incomplete journal is never applied
+    unsigned char* page = apply ? (unsigned char*)malloc(jh.node_bytes > BPTREE_PAGE_SIZE ? jh.node_bytes : BPTREE_PAGE_SIZE) : 0;
+    if (apply && !page) ok = apply = 0;
+    for (int pass = 0; apply && pass < 2; ++pass) {
+        uint64_t pos = sizeof jh, check = fnv1a(FNV_BASIS, &jh, sizeof jh), off, want;
+        apply = pread_all(jfd, page, BPTREE_PAGE_SIZE, pos);
+        check = fnv1a(check, page, BPTREE_PAGE_SIZE);
+        pos += BPTREE_PAGE_SIZE;
+        for (uint64_t i = 0; apply && i < jh.n_pages; ++i) {
+            apply = pread_all(jfd, &off, sizeof off, pos) && pread_all(jfd, page, jh.node_bytes, pos + 8);
+            check = fnv1a(fnv1a(check, &off, sizeof off), page, jh.node_bytes);
+            pos += 8 + jh.node_bytes;
+            if (apply && pass == 1) ok = pwrite_all(ifd, page, jh.node_bytes, off) && ok;
+        }
+        if (pass == 0) {
+            apply = apply && pread_all(jfd, &want, sizeof want, pos) && want == check;
+        } else if (ok) { // the header page last
+            ok = fsync(ifd) == 0 && pread_all(jfd, page, BPTREE_PAGE_SIZE, sizeof jh) &&
+                 pwrite_all(ifd, page, BPTREE_PAGE_SIZE, 0) && fsync(ifd) == 0;
+        }
+    }
+    free(page);
+    close(jfd);
+    if (ifd >= 0) close(ifd);
+    if (ok) {
+        unlink(jpath);
+        sync_dir(jpath);
+    }
+    free(jpath);
+    return ok;
+}
+
+// sorted entries: keys[] and, value_size bytes each, vals[]
+typedef struct Entries {
+    int* keys;
+    unsigned char* vals;        // NULL when value_size is 0
+    size_t n;
+} Entries;
+
+typedef struct WalOp {
+    int key;
+    uint32_t seq;               // record number, orders the ops on one key
+} WalOp;
+
+static int cmp_wal_op(const void* a, const void* b) {
+    const WalOp* x = (const WalOp*)a;
+    const WalOp* y = (const WalOp*)b;
+    if (x->key != y->key) return (x->key > y->key) - (x->key < y->key);
+    return (x->seq > y->seq) - (x->seq < y->seq);
+}
+
+static const WalRecord* rec_at(const unsigned char* recs, size_t rec_bytes, size_t i, WalRecord* r) {
+    memcpy(r, recs + rec_bytes * i, sizeof *r);
+    return r;
+}
+
+// cur with the records [lo, hi) applied; none of them is a range delete
+static int apply_segment(Entries* cur, const unsigned char* recs, size_t rec_bytes, size_t vs,
+                         size_t lo, size_t hi) {
+    size_t k = hi - lo;
+    if (!k) return 1;
+    WalOp* ops = (WalOp*)malloc(sizeof(WalOp) * k);
+    int* keys = (int*)malloc(sizeof(int) * (cur->n + k));
+    unsigned char* vals = vs ? (unsigned char*)malloc(vs * (cur->n + k)) : 0;
+    if (!ops || !keys || (vs && !vals)) {
+        free(ops);
+        free(keys);
+        free(vals);
+        return 0;
+    }
+    for (size_t i = 0; i < k; ++i) {
+        WalRecord r;
+        ops[i].key = rec_at(recs, rec_bytes, lo + i, &r)->key;
+        ops[i].seq = (uint32_t)(lo + i);
+    }
+    qsort(ops, k, sizeof(WalOp), cmp_wal_op);
+
+    size_t a = 0, out = 0;
+    for (size_t i = 0; i < k; ) {
+        int key = ops[i].key;
+        while (a < cur->n && cur->keys[a] < key) { // untouched entries
+            keys[out] = cur->keys[a];
+            if (vs) memcpy(vals + vs * out, cur->vals + vs * a, vs);
+            ++out, ++a;
+        }
+        int present = a < cur->n && cur->keys[a] == key;
+        const unsigned char* v = present && vs ? cur->vals + vs * a : 0; // NULL: zeros
+        if (present) ++a;
+        // the ops on key, in log order
+        for (; i < k && ops[i].key == key; ++i) {
+            WalRecord r;
+            rec_at(recs, rec_bytes, ops[i].seq, &r);
+            const unsigned char* rv = recs + rec_bytes * ops[i].seq + sizeof(WalRecord);
+            if (r.op == BPTREE_WAL_INSERT) {
+                if (!present) v = 0;
+                present = 1;
+            } else if (r.op == BPTREE_WAL_UPSERT) {
+                present = 1;
+                v = rv;
+            } else {
+                present = 0;
+            }
+        }
+        if (present) {
+            keys[out] = key;
+            if (vs) {
+                if (v) memcpy(vals + vs * out, v, vs);
+                else memset(vals + vs * out, 0, vs);
+            }
+            ++out;
+        }
+    }
+    for (; a < cur->n; ++a, ++out) {
+        keys[out] = cur->keys[a];
+        if (vs) memcpy(vals + vs * out, cur->vals + vs * a, vs);
+    }
+
+    free(ops);
+    free(cur->keys);
+    free(cur->vals);
+    cur->keys = keys;
+    cur->vals = vals;
+    cur->n = out;
+    return 1;
+}
+
+static void remove_range(Entries* cur, size_t vs, int lo, int hi) {
+    size_t out = 0;
+    for (size_t i = 0; i < cur->n; ++i) {
+        if (cur->keys[i] >= lo && cur->keys[i] <= hi) continue;
+        cur->keys[out] = cur->keys[i];
+        if (vs) memmove(cur->vals + vs * out, cur->vals + vs * i, vs);
+        ++out;
+    }
+    cur->n = out;
+}
+
+// the image's entries; gen is its wal_gen (0 without an image)
+static int image_load(BPTree* t, const char* image_path, Entries* cur, uint64_t* gen) {
+    *gen = 0;
+    if (!file_exists(image_path)) return 1;
+    BPTree* m = bptree_open_mmap(image_path);
+    if (!m) return 0;
+    int ok = 1;
+    if (bptree_value_size(m) != t->value_size) {
+        ok = t->value_size == 0 && bptree_set_value_size(t, bptree_value_size(m));
+    }
+    size_t n = ok ? bptree_map_entries(m, 0, 0) : 0;
+    if (ok) {
+        cur->keys = (int*)malloc(sizeof(int) * (n ? n : 1));
+        cur->vals = t->value_size ? (unsigned char*)malloc(t->value_size * (n ? n : 1)) : 0;
+        ok = cur->keys && (cur->vals || !t->value_size);
+    }
+    if (ok) {
+        cur->n = bptree_map_entries(m, cur->keys, cur->vals);
+        *gen = bptree_map_wal_gen(m);
+    }
+    bptree_destroy(m);
+    return ok;
+}
+
+// a record holds a value whatever its op
+static size_t wal_rec_bytes(const BPTree* t) {
+    return (sizeof(WalRecord) + t->value_size + 3) & ~(size_t)3;
+}
+
+// the valid records of the log at fd, if its generation is gen; a torn
+// tail is cut off. A log of an older generation is already in the image.
+// Without an image the tree takes the log's value size, if it has none.
+static int log_load(BPTreeWal* w, BPTree* t, uint64_t gen, unsigned char** recs, size_t* n_recs) {
+    *recs = 0;
+    *n_recs = 0;
+    struct stat st;
+    w->rec_bytes = wal_rec_bytes(t);
+    if (fstat(w->fd, &st) != 0) return 0;
+    if ((size_t)st.st_size < sizeof(WalHeader)) return wal_restart(w, t, gen); // new, or cut during a restart
+
+    WalHeader h;
+    if (!pread_all(w->fd, &h, sizeof h, 0) || memcmp(h.magic, BPTREE_WAL_MAGIC, sizeof h.magic) != 0 ||
+        h.version != BPTREE_WAL_VERSION || h.gen > gen) {
+        return 0; // not this tree's log
+    }
+    if (h.gen < gen) return wal_restart(w, t, gen);
+    if (h.value_size != t->value_size &&
+        (gen != 0 || t->value_size != 0 || !bptree_set_value_size(t, (size_t)h.value_size))) {
+        return 0;
+    }
+    w->rec_bytes = wal_rec_bytes(t);
+    if (h.rec_bytes != w->rec_bytes || w->rec_bytes > BPTREE_WAL_BUF) return 0;
+
+    size_t body = (size_t)st.st_size - sizeof h;
+    size_t n = body / w->rec_bytes;
+    unsigned char* r = (unsigned char*)malloc(n ? n * w->rec_bytes : 1);
+    if (!r || (n && !pread_all(w->fd, r, n * w->rec_bytes, sizeof h))) {
+        free(r);
+        return 0;
+    }
+    size_t valid = 0;
+    for (; valid < n; ++valid) {
+        WalRecord rec;
+        const unsigned char* p = r + w->rec_bytes * valid;
+        memcpy(&rec, p, sizeof rec);
+        if (rec.check != wal_check(p, w->rec_bytes, gen) || rec.op < BPTREE_WAL_INSERT || rec.op > BPTREE_WAL_DELETE_RANGE) break;
+    }
+    w->gen = gen;
+    w->end = sizeof h + valid * w->rec_bytes;
+    if ((uint64_t)st.st_size != w->end && (ftruncate(w->fd, (off_t)w->end) != 0 || fsync(w->fd) != 0)) {
+        free(r);
+        return 0;
+    }
+    *recs = r;
+    *n_recs = valid;
+    return 1;
+}
+
+static void wal_free(BPTreeWal* w) {
+    if (!w) return;
+    if (w->fd >= 0) close(w->fd);
+    free(w->image_path);
+    free(w->wal_path);
+    free(w->buf);
+    free(w->free_slots);
+    free(w->dirty);
+    free(w);
+}
+
+int bptree_wal_open(BPTree* t, const char* image_path, const char* wal_path, unsigned sync_every) {
+    if (!t || !t->root || t->wal || !image_path || !wal_path) return 0;
+    if (t->buffered) bptree_flush(t);
+    if (!t->root->is_leaf || t->root->ops->size(t->root->store) != 0) return 0; // not empty
+
+    BPTreeWal* w = (BPTreeWal*)calloc(1, sizeof(BPTreeWal));
+    if (!w) return 0;
+    w->fd = -1;
+    w->image_path = path_with(image_path, "");
+    w->wal_path = path_with(wal_path, "");
+    w->buf = (unsigned char*)malloc(BPTREE_WAL_BUF);
+    w->sync_every = sync_every;
+    Entries cur = {0, 0, 0};
+    unsigned char* recs = 0;
+    size_t n_recs = 0;
+    uint64_t gen = 0;
+    int ok = w->image_path && w->wal_path && w->buf && journal_recover(image_path) &&
+             image_load(t, image_path, &cur, &gen);
+    if (ok) {
+        w->fd = open(wal_path, O_RDWR | O_CREAT, 0644);
+        ok = w->fd >= 0 && log_load(w, t, gen, &recs, &n_recs);
+    }
+
+    // range deletes split the log into segments, each merged in one pass
+    size_t vs = t->value_size, lo = 0;
+    for (size_t i = 0; ok && i <= n_recs; ++i) {
+        WalRecord r;
+        if (i < n_recs && rec_at(recs, w->rec_bytes, i, &r)->op != BPTREE_WAL_DELETE_RANGE) continue;
+        ok = apply_segment(&cur, recs, w->rec_bytes, vs, lo, i);
+        if (ok && i < n_recs) remove_range(&cur, vs, r.key, r.hi);
+        lo = i + 1;
+    }
+    free(recs);
+
+    if (ok && cur.n) {
+        if (t->concurrent) bptree_olc_begin_write(t);
+        ok = t->impl->bulk_load(t, cur.keys, cur.vals, cur.n, BPTREE_WAL_RECOVER_FILL);
+        if (t->concurrent) bptree_olc_end_write(t);
+        t->frozen_stale = 1;
+    }
+    free(cur.keys);
+    free(cur.vals);
+    if (!ok) {
+        wal_free(w);
+        return 0;
+    }
+    t->wal = w; // nodes have no slots yet: the first checkpoint is a full one
+    return 1;
+}
+
+void bptree_wal_close(BPTree* t) {
+    BPTreeWal* w = t->wal;
+    wal_flush(w);
+    t->wal = 0;
+    wal_free(w);
+}
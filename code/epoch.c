@@ -0,0 +1,145 @@
+// epoch.c
+//
+// Global epoch g starts at 1. A thread publishes g in its slot on entry and 0
+// on exit. g may advance only when every active slot already shows g, so
+// memory retired while the epoch was e is unreachable for all threads once
+// g >= e + 2: the ones that entered at e or earlier have all left.
+#include "epoch.h"
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+
+typedef struct Retired {
+    void* p;
+    EpochFreeFn fn;
+    void* ctx;
+    uint64_t epoch;
+} Retired;
+
+typedef struct EpochSlot {
+    uint64_t epoch;                 // 0: not inside; else the epoch seen on entry
+    // retired memory of the thread owning the slot (only that thread touches it)
+    Retired* retired;
+    size_t n_retired;
+    size_t cap_retired;
+    char pad[64 - sizeof(uint64_t) - sizeof(Retired*) - 2 * sizeof(size_t)];
+} EpochSlot;
+
+struct Epoch {
+    uint64_t global;
+    char pad[64 - sizeof(uint64_t)];
+    EpochSlot slots[EPOCH_MAX_THREADS];
+};
+
+// -------------------- Thread slots --------------------
+
+static pthread_once_t g_slot_once = PTHREAD_ONCE_INIT;
+static pthread_key_t g_slot_key;
+static pthread_mutex_t g_slot_mu = PTHREAD_MUTEX_INITIALIZER;
+static unsigned char g_slot_used[EPOCH_MAX_THREADS];
+static _Thread_local int tls_slot = -1;
+
+static void slot_release(void* v) {
+    int s = (int)(intptr_t)v - 1;
+    pthread_mutex_lock(&g_slot_mu);
+    g_slot_used[s] = 0;
+    pthread_mutex_unlock(&g_slot_mu);
+}
+
+static void slot_key_init(void) {
+    pthread_key_create(&g_slot_key, slot_release);
+}
+
+static int thread_slot(void) {
+    if (tls_slot >= 0) return tls_slot;
+
+    pthread_once(&g_slot_once, slot_key_init);
+    int s = -1;
+    pthread_mutex_lock(&g_slot_mu);
+    for (int i = 0; i < EPOCH_MAX_THREADS; ++i) {
+        if (!g_slot_used[i]) {
+            g_slot_used[i] = 1;
+            s = i;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&g_slot_mu);
+    assert(s >= 0 && "more than EPOCH_MAX_THREADS threads");
+
+    pthread_setspecific(g_slot_key, (void*)(intptr_t)(s + 1)); // released at thread exit
+    tls_slot = s;
+    return s;
+}
+
+// -------------------- Epoch --------------------
+
+Epoch* epoch_create(void) {
+    Epoch* e = (Epoch*)calloc(1, sizeof(Epoch));
+    if (!e) return NULL;
+    e->global = 1;
+    return e;
+}
+
+void epoch_destroy(Epoch* e) {
+    if (!e) return;
+    for (int s = 0; s < EPOCH_MAX_THREADS; ++s) {
+        EpochSlot* slot = &e->slots[s];
+        for (size_t i = 0; i < slot->n_retired; ++i) slot->retired[i].fn(slot->retired[i].p, slot->retired[i].ctx);
+        free(slot->retired);
+    }
+    free(e);
+}
+
+void epoch_enter(Epoch* e) {
+    EpochSlot* s = &e->slots[thread_slot()];
+    // seq_cst: the slot is visible before any shared pointer is read
+    __atomic_store_n(&s->epoch, __atomic_load_n(&e->global, __ATOMIC_ACQUIRE), __ATOMIC_SEQ_CST);
+}
+
+void epoch_exit(Epoch* e) {
+    __atomic_store_n(&e->slots[thread_slot()].epoch, 0, __ATOMIC_RELEASE);
+}
+
+void epoch_retire(Epoch* e, void* p, EpochFreeFn fn, void* ctx) {
+    EpochSlot* slot = &e->slots[thread_slot()];
+    if (slot->n_retired == slot->cap_retired) {
+        size_t ncap = slot->cap_retired ? slot->cap_retired * 2 : 64;
+        Retired* r = (Retired*)realloc(slot->retired, ncap * sizeof(Retired));
+        assert(r);
+        slot->retired = r;
+        slot->cap_retired = ncap;
+    }
+    Retired* r = &slot->retired[slot->n_retired++];
+    r->p = p;
+    r->fn = fn;
+    r->ctx = ctx;
+    r->epoch = __atomic_load_n(&e->global, __ATOMIC_SEQ_CST);
+}
+
+void epoch_collect(Epoch* e) {
+    EpochSlot* slot = &e->slots[thread_slot()];
+    if (slot->n_retired == 0) return;
+
+    uint64_t g = __atomic_load_n(&e->global, __ATOMIC_SEQ_CST);
+    int can_advance = 1;
+    for (int i = 0; i < EPOCH_MAX_THREADS; ++i) {
+        uint64_t s = __atomic_load_n(&e->slots[i].epoch, __ATOMIC_SEQ_CST);
+        if (s != 0 && s != g) {
+            can_advance = 0;
+            break;
+        }
+    }
+    // a failed CAS means another thread advanced it: reload
+    if (can_advance && __atomic_compare_exchange_n(&e->global, &g, g + 1, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST)) {
+        g++;
+    }
+
+    // free what was retired at g-2 or earlier, keep the rest in order
+    size_t kept = 0;
+    for (size_t i = 0; i < slot->n_retired; ++i) {
+        Retired r = slot->retired[i];
+        if (r.epoch + 2 <= g) r.fn(r.p, r.ctx);
+        else slot->retired[kept++] = r;
+    }
+    slot->n_retired = kept;
+}
@@ -0,0 +1,29 @@
+// epoch.h
+//
+// Epoch-based reclamation for optimistic readers. Threads bracket every
+// operation with epoch_enter/epoch_exit. A thread that unlinks memory hands it
+// to epoch_retire, and epoch_collect frees it once every thread that might
+// still hold a pointer to it has left. All calls but destroy may come from any
+// thread: retired memory goes to the calling thread's own list, which its
+// later epoch_collect calls drain. Each thread uses one of EPOCH_MAX_THREADS
+// process-wide slots, held until the thread exits.
+#ifndef EPOCH_H
+#define EPOCH_H
+
+#include <stdint.h>
+
+#define EPOCH_MAX_THREADS 128
+
+typedef struct Epoch Epoch;
+typedef void (*EpochFreeFn)(void* p, void* ctx);
+
+Epoch* epoch_create(void);
+void   epoch_destroy(Epoch* e);     // frees all retired memory; no thread may be inside
+
+void   epoch_enter(Epoch* e);
+void   epoch_exit(Epoch* e);
+
+void   epoch_retire(Epoch* e, void* p, EpochFreeFn fn, void* ctx);
+void   epoch_collect(Epoch* e);     // advance the epoch if possible, free this thread's safe memory
+
+#endif
@@ -4,12 +4,42 @@
 const NodeStoreOps* nodestore_array_ops(void);
 const NodeStoreOps* nodestore_list_ops(void);
 const NodeStoreOps* nodestore_skip_ops(void);
+const NodeStoreOps* nodestore_inline_ops(void);
+const NodeStoreOps* nodestore_array_simd_ops(void);
+const NodeStoreOps* nodestore_packed_ops(void);
+const NodeStoreOps* nodestore_gapped_ops(void);
+void nodestore_skip_set_seed(uint64_t seed);
 
 const NodeStoreOps* nodestore_get_ops(NodeStoreKind kind) {
     switch (kind) {
         case NODESTORE_ARRAY:    return nodestore_array_ops();
         case NODESTORE_LINKED:   return nodestore_list_ops();
         case NODESTORE_SKIPLIST: return nodestore_skip_ops();
+        case NODESTORE_INLINE:   return nodestore_inline_ops();
+        case NODESTORE_ARRAY_SIMD: return nodestore_array_simd_ops();
+        case NODESTORE_PACKED:   return nodestore_packed_ops();
+        case NODESTORE_GAPPED:   return nodestore_gapped_ops();
         default: return 0;
     }
 }
+
+void nodestore_set_seed(uint64_t seed) {
+    nodestore_skip_set_seed(seed);
+}
+
+NodeStoreCounters nodestore_counters_g;
+
+void nodestore_counters(NodeStoreCounters* out) {
+    if (!out) return;
+    out->skip_rebuilds = __atomic_load_n(&nodestore_counters_g.skip_rebuilds, __ATOMIC_RELAXED);
+    out->skip_towers = __atomic_load_n(&nodestore_counters_g.skip_towers, __ATOMIC_RELAXED);
+    out->packed_repacks = __atomic_load_n(&nodestore_counters_g.packed_repacks, __ATOMIC_RELAXED);
+    out->gapped_respreads = __atomic_load_n(&nodestore_counters_g.gapped_respreads, __ATOMIC_RELAXED);
+}
+
+void nodestore_counters_reset(void) {
+    __atomic_store_n(&nodestore_counters_g.skip_rebuilds, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&nodestore_counters_g.skip_towers, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&nodestore_counters_g.packed_repacks, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&nodestore_counters_g.gapped_respreads, 0, __ATOMIC_RELAXED);
+}
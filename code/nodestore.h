@@ -2,6 +2,9 @@
 #ifndef NODESTORE_H
 #define NODESTORE_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -19,23 +22,86 @@ typedef struct NodeStoreOps {
     int        (*key_at)(const NodeStore* s, int idx);
     void*      (*val_at)(const NodeStore* s, int idx);
     void       (*set_val)(NodeStore* s, int idx, void* v);
+    void       (*set_key)(NodeStore* s, int idx, int key); // key must keep idx's order
 
     int        (*lower_bound)(const NodeStore* s, int key);
 
     void       (*insert_at)(NodeStore* s, int idx, int key, void* val);
     void       (*erase_at)(NodeStore* s, int idx);
 
-    int        (*split)(NodeStore* left, NodeStore* right);
+    // Moves src's entries [from, size) to the end of dst in one step, keys
+    // and vals in order; src keeps [0, from). Every moved key is greater than
+    // dst's keys and dst has room. A split is append_from into an empty right
+    // node, a merge is append_from(left, right, 0).
+    void       (*append_from)(NodeStore* dst, NodeStore* src, int from);
+
+    // Optional in-place construction (NULL if unsupported): footprint(cap) bytes
+    // of caller memory, 8-byte aligned, hold the whole store, so the tree can
+    // co-allocate it with the node header. Such a store owns no other memory;
+    // releasing the caller's block releases it.
+    size_t     (*footprint)(int capacity);
+    NodeStore* (*init)(void* mem, int capacity);
+
+    // Optional (NULL if unsupported): prefetch hint for the lines lower_bound
+    // is about to read. Batched search issues it for every in-flight lookup.
+    void       (*prefetch)(const NodeStore* s);
+
+    // Optional (NULL if not array-backed): the keys as one contiguous array,
+    // key_data(s)[i] == key_at(s, i), valid until the store is modified.
+    const int* (*key_data)(const NodeStore* s);
+    void* const* (*val_data)(const NodeStore* s);   // same for the vals
+
+    // Optional (NULL if every store holds vals): like create, for a store
+    // whose vals are all NULL and take no memory (val_at returns NULL,
+    // set_val and insert_at accept only NULL). Key-only trees' leaves use it.
+    // The array, packed and gapped stores have it. The inline store does
+    // not: its vals sit in the node block, whose size is one per tree.
+    NodeStore* (*create_keys)(int capacity);
+
+    // Optional (NULL if unknown): bytes the store occupies, itself included,
+    // as create made it (for a store built by init, the caller's block holds
+    // all of it). bptree_stats sums it over nodes whose store is not in place.
+    size_t     (*bytes)(const NodeStore* s);
 } NodeStoreOps;
 
 typedef enum {
     NODESTORE_ARRAY   = 1,
     NODESTORE_LINKED  = 2,
-    NODESTORE_SKIPLIST= 3
+    NODESTORE_SKIPLIST= 3,
+    NODESTORE_INLINE  = 4,  // array layout, header+keys+vals in one block
+    NODESTORE_ARRAY_SIMD = 5, // array store with a vectorized lower_bound
+    NODESTORE_PACKED  = 6,  // frame-of-reference keys in 1/2/4-byte deltas, see nodestore_packed.c
+    NODESTORE_GAPPED  = 7   // sorted slots with spread-out gaps, short insert shifts, see nodestore_gapped.c
 } NodeStoreKind;
 
 const NodeStoreOps* nodestore_get_ops(NodeStoreKind kind);
 
+// Seed for randomized stores (tower heights of the skip-list store).
+// Stores created afterwards derive their own seeds from it in creation order,
+// so the same seed and the same operation sequence give the same layout.
+void nodestore_set_seed(uint64_t seed);
+
+// Rebuilds inside stores, counted for all stores of the process when built
+// with -DBPTREE_STATS (see bptree_stats) and always 0 otherwise: work a
+// split or merge costs beyond moving entries, or a write beyond its shift.
+typedef struct NodeStoreCounters {
+    uint64_t skip_rebuilds;     // skip-list store splits and merges (towers copied between arenas)
+    uint64_t skip_towers;       // towers they copied
+    uint64_t packed_repacks;    // packed store re-encodings to another base or width
+    uint64_t gapped_respreads;  // gapped store windows spread out again
+} NodeStoreCounters;
+
+void nodestore_counters(NodeStoreCounters* out);
+void nodestore_counters_reset(void);
+
+extern NodeStoreCounters nodestore_counters_g;   // stores count into it
+#ifdef BPTREE_STATS
+#define NODESTORE_COUNT(field, n) \
+    ((void)__atomic_add_fetch(&nodestore_counters_g.field, (uint64_t)(n), __ATOMIC_RELAXED))
+#else
+#define NODESTORE_COUNT(field, n) ((void)0)
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,108 @@
+// nodestore_array_impl.h
+//
+// Layout and hot accessors of the array store, as static inline functions so
+// that bptree_static_array.c / bptree_static_simd.c can call them directly.
+// nodestore_array.c builds its NodeStoreOps tables from the same functions.
+#ifndef NODESTORE_ARRAY_IMPL_H
+#define NODESTORE_ARRAY_IMPL_H
+
+#include "nodestore.h"
+#include "nodestore_search.h"
+#include <assert.h>
+#include <string.h>
+
+struct NodeStore {
+    int cap;
+    int n;
+    int* keys;
+    void** vals;    // NULL in a keys-only store (create_keys)
+};
+
+static inline int ns_size(const NodeStore* s) { return s ? s->n : 0; }
+static inline int ns_capacity(const NodeStore* s) { return s ? s->cap : 0; }
+static inline void ns_clear(NodeStore* s) { if (s) s->n = 0; }
+
+static inline int ns_key_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    return s->keys[idx];
+}
+static inline void* ns_val_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    return s->vals ? s->vals[idx] : NULL;
+}
+static inline void ns_set_val(NodeStore* s, int idx, void* v) {
+    assert(s && idx >= 0 && idx < s->n);
+    assert(s->vals || !v);
+    if (s->vals) s->vals[idx] = v;
+}
+static inline void ns_set_key(NodeStore* s, int idx, int key) {
+    assert(s && idx >= 0 && idx < s->n);
+    s->keys[idx] = key;
+}
+
+static inline int ns_lower_bound(const NodeStore* s, int key) {
+    assert(s);
+    int l = 0, r = s->n;
+    while (l < r) {
+        int m = l + (r - l) / 2;
+        if (s->keys[m] < key) l = m + 1;
+        else r = m;
+    }
+    return l;
+}
+
+static inline int ns_lower_bound_vec(const NodeStore* s, int key) {
+    assert(s);
+    return ns_lower_bound_simd(s->keys, s->n, key);
+}
+
+static inline void ns_insert_at(NodeStore* s, int idx, int key, void* val) {
+    assert(s);
+    assert(idx >= 0 && idx <= s->n);
+    assert(s->n < s->cap);
+    assert(s->vals || !val);
+    size_t tail = (size_t)(s->n - idx);
+    memmove(s->keys + idx + 1, s->keys + idx, sizeof(int) * tail);
+    s->keys[idx] = key;
+    if (s->vals) {
+        memmove(s->vals + idx + 1, s->vals + idx, sizeof(void*) * tail);
+        s->vals[idx] = val;
+    }
+    s->n++;
+}
+
+static inline void ns_erase_at(NodeStore* s, int idx) {
+    assert(s);
+    assert(idx >= 0 && idx < s->n);
+    size_t tail = (size_t)(s->n - idx - 1);
+    memmove(s->keys + idx, s->keys + idx + 1, sizeof(int) * tail);
+    if (s->vals) memmove(s->vals + idx, s->vals + idx + 1, sizeof(void*) * tail);
+    s->n--;
+}
+
+static inline void ns_append_from(NodeStore* dst, NodeStore* src, int from) {
+    assert(dst && src && from >= 0 && from <= src->n);
+    int move = src->n - from;
+    assert(dst->n + move <= dst->cap);
+    memcpy(dst->keys + dst->n, src->keys + from, sizeof(int) * (size_t)move);
+    if (dst->vals) {
+        if (src->vals) memcpy(dst->vals + dst->n, src->vals + from, sizeof(void*) * (size_t)move);
+        else memset(dst->vals + dst->n, 0, sizeof(void*) * (size_t)move);
+    }
+    dst->n += move;
+    src->n = from;
+}
+
+// prefetch hint for the key lines lower_bound reads (at most four)
+static inline void ns_prefetch(const NodeStore* s) {
+    const char* p = (const char*)s->keys;
+    size_t bytes = sizeof(int) * (size_t)s->n;
+    if (bytes > 256) bytes = 256;
+    for (size_t off = 0; off < bytes; off += 64) __builtin_prefetch(p + off);
+}
+
+// keys are one contiguous array: range scans hand out slices of it
+static inline const int* ns_key_data(const NodeStore* s) { return s->keys; }
+static inline void* const* ns_val_data(const NodeStore* s) { return s->vals; } // NULL if keys-only
+
+#endif
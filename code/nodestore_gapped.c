@@ -0,0 +1,332 @@
+// nodestore_gapped.c
+//
+// Gapped array store (a packed-memory array per node): the slots form
+// segments of GAP_SEG keys, one cache line each, and every segment keeps its
+// entries at its front with the rest of it free. An insert shifts only the
+// entries of its own segment; a full segment first has its entries spread
+// out over the smallest aligned window of segments around it that is at most
+// 3/4 full, which the whole store always is.
+//
+//   segment g: keys[g * GAP_SEG ..] = [ entries start[g] .. start[g+1)-1 | free ]
+//
+// A free slot holds the first key of the next segment that has entries
+// (INT_MAX past the last), so keys[] is non-decreasing and lower_bound is one
+// search over all the slots. start[] is non-decreasing too: the segment of an
+// index is a search over it, and an insert or erase adds to the starts behind
+// its segment. append_from spreads both stores out again, so the halves of a
+// split start evenly gapped.
+#include "nodestore.h"
+#include "nodestore_search.h"
+#include <assert.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GAP_SEG 16              // slots per segment: 64 bytes of keys
+
+struct NodeStore {
+    int n;
+    int cap;
+    int nseg;
+    int* start;                 // index of each segment's first entry; start[nseg] = n
+    int* keys;                  // nseg * GAP_SEG slots
+    void** vals;                // NULL in a keys-only store
+};
+
+static int* seg_keys(const NodeStore* s, int g) { return s->keys + (size_t)g * GAP_SEG; }
+
+static void** seg_vals(const NodeStore* s, int g) {
+    return s->vals ? s->vals + (size_t)g * GAP_SEG : NULL;
+}
+
+static int seg_n(const NodeStore* s, int g) { return s->start[g + 1] - s->start[g]; }
+
+// segment and offset of entry idx < n: the last segment starting at or before it
+static int locate(const NodeStore* s, int idx, int* off) {
+    int g = ns_lower_bound_simd(s->start, s->nseg + 1, idx + 1) - 1;
+    *off = idx - s->start[g];
+    return g;
+}
+
+// segment and offset an insert at idx <= n goes to: the first segment that
+// ends at or past it
+static int locate_insert(const NodeStore* s, int idx, int* off) {
+    int g = ns_lower_bound_simd(s->start + 1, s->nseg, idx);
+    *off = idx - s->start[g];
+    return g;
+}
+
+// entries of segment g changed by d
+static void shift_starts(NodeStore* s, int g, int d) {
+    for (int h = g + 1; h <= s->nseg; ++h) s->start[h] += d;
+}
+
+// first key of segment g or of the first one after it with entries
+static int first_from(const NodeStore* s, int g) {
+    for (; g < s->nseg; ++g) {
+        if (seg_n(s, g)) return seg_keys(s, g)[0];
+    }
+    return INT_MAX;
+}
+
+static void fill_free(NodeStore* s, int g, int key) {
+    int* k = seg_keys(s, g);
+    for (int i = seg_n(s, g); i < GAP_SEG; ++i) k[i] = key;
+}
+
+// free slots of segment g and of the segments in front of it, back to the
+// last one with entries, after g's entries changed
+static void refill(NodeStore* s, int g) {
+    int key = first_from(s, g + 1);
+    fill_free(s, g, key);
+    if (seg_n(s, g)) key = seg_keys(s, g)[0];
+    while (--g >= 0) {
+        fill_free(s, g, key);
+        if (seg_n(s, g)) break;
+    }
+}
+
+// entries of segments [lo, hi) to the front of the window, in order
+static int compact(NodeStore* s, int lo, int hi) {
+    int* dst = seg_keys(s, lo);
+    void** dv = seg_vals(s, lo);
+    int m = 0;
+    for (int g = lo; g < hi; ++g) {
+        int c = seg_n(s, g);
+        if (c && seg_keys(s, g) != dst + m) {
+            memmove(dst + m, seg_keys(s, g), sizeof(int) * (size_t)c);
+            if (dv) memmove(dv + m, seg_vals(s, g), sizeof(void*) * (size_t)c);
+        }
+        m += c;
+    }
+    return m;
+}
+
+// the m entries at the front of window [lo, hi) spread out evenly over its
+// segments; sets the window's starts and refills its free slots
+static void distribute(NodeStore* s, int lo, int hi, int m) {
+    int w = hi - lo;
+    int* src = seg_keys(s, lo);
+    void** sv = seg_vals(s, lo);
+    int base = m / w, extra = m % w;
+    int at = m;
+    for (int j = w - 1; j >= 0; --j) { // back to front: targets are at or past sources
+        int c = base + (j < extra);
+        int g = lo + j;
+        at -= c;
+        if (c && src + at != seg_keys(s, g)) {
+            memmove(seg_keys(s, g), src + at, sizeof(int) * (size_t)c);
+            if (sv) memmove(seg_vals(s, g), sv + at, sizeof(void*) * (size_t)c);
+        }
+        s->start[g + 1] = s->start[lo] + at + c;
+    }
+    int key = first_from(s, hi);
+    for (int g = hi - 1; g >= lo; --g) {
+        fill_free(s, g, key);
+        if (seg_n(s, g)) key = seg_keys(s, g)[0];
+    }
+}
+
+// full segment g: spread the smallest aligned window around it with room
+static void rebalance(NodeStore* s, int g) {
+    for (int w = 2;; w *= 2) {
+        int lo = w >= s->nseg ? 0 : g / w * w;
+        int hi = lo + w < s->nseg ? lo + w : s->nseg;
+        int m = s->start[hi] - s->start[lo];
+        if (hi - lo == s->nseg || 4 * m <= 3 * GAP_SEG * (hi - lo)) {
+            NODESTORE_COUNT(gapped_respreads, 1);
+            distribute(s, lo, hi, compact(s, lo, hi));
+            return;
+        }
+    }
+}
+
+static NodeStore* store_new(int capacity, int with_vals) {
+    if (capacity <= 0) capacity = 1;
+    // at most 3/4 full: a spread-out store has room in every segment
+    int nseg = (4 * capacity + 3 * GAP_SEG - 1) / (3 * GAP_SEG);
+    size_t slots = (size_t)nseg * GAP_SEG;
+    NodeStore* s = (NodeStore*)calloc(1, sizeof(NodeStore));
+    if (!s) return NULL;
+    s->cap = capacity;
+    s->nseg = nseg;
+    s->start = (int*)calloc((size_t)nseg + 1, sizeof(int));
+    s->keys = (int*)aligned_alloc(64, sizeof(int) * slots);
+    if (with_vals) s->vals = (void**)malloc(sizeof(void*) * slots);
+    if (!s->start || !s->keys || (with_vals && !s->vals)) {
+        free(s->start);
+        free(s->keys);
+        free(s->vals);
+        free(s);
+        return NULL;
+    }
+    for (size_t i = 0; i < slots; ++i) s->keys[i] = INT_MAX;
+    return s;
+}
+
+static NodeStore* ns_create(int capacity) { return store_new(capacity, 1); }
+static NodeStore* ns_create_keys(int capacity) { return store_new(capacity, 0); }
+
+static void ns_destroy(NodeStore* s) {
+    if (!s) return;
+    free(s->start);
+    free(s->keys);
+    free(s->vals);
+    free(s);
+}
+
+static size_t ns_bytes(const NodeStore* s) {
+    size_t slots = (size_t)s->nseg * GAP_SEG;
+    return sizeof(NodeStore) + sizeof(int) * ((size_t)s->nseg + 1) + sizeof(int) * slots +
+           (s->vals ? sizeof(void*) * slots : 0);
+}
+
+static int ns_size(const NodeStore* s) { return s ? s->n : 0; }
+static int ns_capacity(const NodeStore* s) { return s ? s->cap : 0; }
+
+static void ns_clear(NodeStore* s) {
+    if (!s) return;
+    s->n = 0;
+    memset(s->start, 0, sizeof(int) * ((size_t)s->nseg + 1));
+    for (size_t i = 0; i < (size_t)s->nseg * GAP_SEG; ++i) s->keys[i] = INT_MAX;
+}
+
+static int ns_key_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    int off, g = locate(s, idx, &off);
+    return seg_keys(s, g)[off];
+}
+
+static void* ns_val_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    if (!s->vals) return NULL;
+    int off, g = locate(s, idx, &off);
+    return seg_vals(s, g)[off];
+}
+
+static void ns_set_val(NodeStore* s, int idx, void* v) {
+    assert(s && idx >= 0 && idx < s->n);
+    assert(s->vals || !v);
+    if (!s->vals) return;
+    int off, g = locate(s, idx, &off);
+    seg_vals(s, g)[off] = v;
+}
+
+static void ns_set_key(NodeStore* s, int idx, int key) {
+    assert(s && idx >= 0 && idx < s->n);
+    int off, g = locate(s, idx, &off);
+    seg_keys(s, g)[off] = key;
+    if (off == 0) refill(s, g);
+}
+
+static int ns_lower_bound(const NodeStore* s, int key) {
+    assert(s);
+    if (s->n == 0) return 0;
+    int p = ns_lower_bound_simd(s->keys, s->nseg * GAP_SEG, key);
+    if (p == s->nseg * GAP_SEG) return s->n;
+    int g = p / GAP_SEG, off = p % GAP_SEG;
+    int c = seg_n(s, g);
+    return s->start[g] + (off < c ? off : c); // in the free slots: past g's entries
+}
+
+static void ns_insert_at(NodeStore* s, int idx, int key, void* val) {
+    assert(s);
+    assert(idx >= 0 && idx <= s->n);
+    assert(s->n < s->cap);
+    assert(s->vals || !val);
+
+    int off, g = locate_insert(s, idx, &off);
+    if (seg_n(s, g) == GAP_SEG) {
+        rebalance(s, g);
+        g = locate_insert(s, idx, &off);
+    }
+    assert(seg_n(s, g) < GAP_SEG);
+    int tail = seg_n(s, g) - off;
+    int* k = seg_keys(s, g);
+    memmove(k + off + 1, k + off, sizeof(int) * (size_t)tail);
+    k[off] = key;
+    if (s->vals) {
+        void** v = seg_vals(s, g);
+        memmove(v + off + 1, v + off, sizeof(void*) * (size_t)tail);
+        v[off] = val;
+    }
+    shift_starts(s, g, 1);
+    s->n++;
+    if (off == 0) refill(s, g); // a new first key of g
+}
+
+static void ns_erase_at(NodeStore* s, int idx) {
+    assert(s);
+    assert(idx >= 0 && idx < s->n);
+    int off, g = locate(s, idx, &off);
+    int c = seg_n(s, g) - 1;
+    int tail = c - off;
+    int* k = seg_keys(s, g);
+    memmove(k + off, k + off + 1, sizeof(int) * (size_t)tail);
+    if (s->vals) {
+        void** v = seg_vals(s, g);
+        memmove(v + off, v + off + 1, sizeof(void*) * (size_t)tail);
+    }
+    shift_starts(s, g, -1);
+    s->n--;
+    if (off == 0 || c + 1 == GAP_SEG) {
+        refill(s, g);
+    } else {
+        k[c] = k[c + 1]; // the freed slot joins g's free slots
+    }
+}
+
+static void ns_append_from(NodeStore* dst, NodeStore* src, int from) {
+    assert(dst && src && from >= 0 && from <= src->n);
+    int move = src->n - from;
+    assert(dst->n + move <= dst->cap);
+    if (move == 0) return;
+
+    // dst's entries to its front, src's right after them, then spread out
+    int m = compact(dst, 0, dst->nseg);
+    int off, g = locate_insert(src, from, &off);
+    for (int h = g; h < src->nseg; ++h, off = 0) {
+        int c = seg_n(src, h) - off;
+        if (c <= 0) continue;
+        memcpy(dst->keys + m, seg_keys(src, h) + off, sizeof(int) * (size_t)c);
+        if (dst->vals) {
+            if (src->vals) memcpy(dst->vals + m, seg_vals(src, h) + off, sizeof(void*) * (size_t)c);
+            else memset(dst->vals + m, 0, sizeof(void*) * (size_t)c);
+        }
+        m += c;
+    }
+    for (int h = g + 1; h <= src->nseg; ++h) src->start[h] = from;
+    dst->n += move;
+    distribute(dst, 0, dst->nseg, m);
+    src->n = from;
+    distribute(src, 0, src->nseg, compact(src, 0, src->nseg));
+}
+
+// prefetch hint for the key lines lower_bound reads (at most four)
+static void ns_prefetch(const NodeStore* s) {
+    const char* p = (const char*)s->keys;
+    size_t bytes = sizeof(int) * (size_t)s->nseg * GAP_SEG;
+    if (bytes > 256) bytes = 256;
+    for (size_t off = 0; off < bytes; off += 64) __builtin_prefetch(p + off);
+}
+
+static const NodeStoreOps g_ops = {
+    .create      = ns_create,
+    .destroy     = ns_destroy,
+    .size        = ns_size,
+    .capacity    = ns_capacity,
+    .clear       = ns_clear,
+    .key_at      = ns_key_at,
+    .val_at      = ns_val_at,
+    .set_val     = ns_set_val,
+    .set_key     = ns_set_key,
+    .lower_bound = ns_lower_bound,
+    .insert_at   = ns_insert_at,
+    .erase_at    = ns_erase_at,
+    .append_from = ns_append_from,
+    .prefetch    = ns_prefetch,
+    .create_keys = ns_create_keys,
+    .bytes       = ns_bytes,
+};
+
+const NodeStoreOps* nodestore_gapped_ops(void) { return &g_ops; }
@@ -0,0 +1,61 @@
+// nodestore_inline.c
+//
+// Array store whose header, keys and vals live in one contiguous block:
+//
+//   [ n | cap | keys[0..cap) | pad to 8 | vals[0..cap) ]
+//
+// The first cache line holds the size and the first keys, so a lookup starts
+// without chasing a pointer. Through footprint/init the tree places the block
+// right behind its node header in a single cache-line-aligned allocation.
+#include "nodestore_inline_impl.h"
+#include <stdlib.h>
+
+static size_t ns_footprint(int capacity) {
+    if (capacity <= 0) capacity = 1;
+    return vals_offset(capacity) + sizeof(void*) * (size_t)capacity;
+}
+
+static NodeStore* ns_init(void* mem, int capacity) {
+    if (!mem) return NULL;
+    if (capacity <= 0) capacity = 1;
+    NodeStore* s = (NodeStore*)mem;
+    s->n = 0;
+    s->cap = capacity;
+    return s;
+}
+
+static NodeStore* ns_create(int capacity) {
+    return ns_init(malloc(ns_footprint(capacity)), capacity);
+}
+
+static void ns_destroy(NodeStore* s) {
+    free(s);
+}
+
+static size_t ns_bytes(const NodeStore* s) {
+    return ns_footprint(s->cap);
+}
+
+static const NodeStoreOps g_ops = {
+    .create      = ns_create,
+    .destroy     = ns_destroy,
+    .size        = ns_size,
+    .capacity    = ns_capacity,
+    .clear       = ns_clear,
+    .key_at      = ns_key_at,
+    .val_at      = ns_val_at,
+    .set_val     = ns_set_val,
+    .set_key     = ns_set_key,
+    .lower_bound = ns_lower_bound,
+    .insert_at   = ns_insert_at,
+    .erase_at    = ns_erase_at,
+    .append_from = ns_append_from,
+    .footprint   = ns_footprint,
+    .init        = ns_init,
+    .prefetch    = ns_prefetch,
+    .key_data    = ns_key_data,
+    .val_data    = ns_val_data,
+    .bytes       = ns_bytes,
+};
+
+const NodeStoreOps* nodestore_inline_ops(void) { return &g_ops; }
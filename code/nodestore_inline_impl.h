@@ -0,0 +1,107 @@
+// nodestore_inline_impl.h
+//
+// Layout and hot accessors of the inline store (see nodestore_inline.c), as
+// static inline functions shared with bptree_static_inline.c.
+#ifndef NODESTORE_INLINE_IMPL_H
+#define NODESTORE_INLINE_IMPL_H
+
+#include "nodestore.h"
+#include <assert.h>
+#include <string.h>
+
+struct NodeStore {
+    int n;
+    int cap;
+    int keys[];     // followed by vals, see vals_of()
+};
+
+static inline size_t vals_offset(int capacity) {
+    size_t off = sizeof(NodeStore) + sizeof(int) * (size_t)capacity;
+    return (off + sizeof(void*) - 1) & ~(sizeof(void*) - 1);
+}
+
+static inline void** vals_of(const NodeStore* s) {
+    return (void**)((char*)s + vals_offset(s->cap));
+}
+
+static inline int ns_size(const NodeStore* s) { return s ? s->n : 0; }
+static inline int ns_capacity(const NodeStore* s) { return s ? s->cap : 0; }
+static inline void ns_clear(NodeStore* s) { if (s) s->n = 0; }
+
+static inline int ns_key_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    return s->keys[idx];
+}
+static inline void* ns_val_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    return vals_of(s)[idx];
+}
+static inline void ns_set_val(NodeStore* s, int idx, void* v) {
+    assert(s && idx >= 0 && idx < s->n);
+    vals_of(s)[idx] = v;
+}
+static inline void ns_set_key(NodeStore* s, int idx, int key) {
+    assert(s && idx >= 0 && idx < s->n);
+    s->keys[idx] = key;
+}
+
+// branch-free lower_bound: the loop trip count depends only on n
+static inline int ns_lower_bound(const NodeStore* s, int key) {
+    assert(s);
+    int n = s->n;
+    if (n == 0) return 0;
+    const int* base = s->keys;
+    while (n > 1) {
+        int half = n / 2;
+        base = (base[half] < key) ? base + half : base;
+        n -= half;
+    }
+    return (int)(base - s->keys) + (*base < key);
+}
+
+static inline void ns_insert_at(NodeStore* s, int idx, int key, void* val) {
+    assert(s);
+    assert(idx >= 0 && idx <= s->n);
+    assert(s->n < s->cap);
+    void** vals = vals_of(s);
+    size_t tail = (size_t)(s->n - idx);
+    memmove(s->keys + idx + 1, s->keys + idx, sizeof(int) * tail);
+    memmove(vals + idx + 1, vals + idx, sizeof(void*) * tail);
+    s->keys[idx] = key;
+    vals[idx] = val;
+    s->n++;
+}
+
+static inline void ns_erase_at(NodeStore* s, int idx) {
+    assert(s);
+    assert(idx >= 0 && idx < s->n);
+    void** vals = vals_of(s);
+    size_t tail = (size_t)(s->n - idx - 1);
+    memmove(s->keys + idx, s->keys + idx + 1, sizeof(int) * tail);
+    memmove(vals + idx, vals + idx + 1, sizeof(void*) * tail);
+    s->n--;
+}
+
+static inline void ns_append_from(NodeStore* dst, NodeStore* src, int from) {
+    assert(dst && src && from >= 0 && from <= src->n);
+    int move = src->n - from;
+    assert(dst->n + move <= dst->cap);
+    memcpy(dst->keys + dst->n, src->keys + from, sizeof(int) * (size_t)move);
+    memcpy(vals_of(dst) + dst->n, vals_of(src) + from, sizeof(void*) * (size_t)move);
+    dst->n += move;
+    src->n = from;
+}
+
+// prefetch hint for the key lines lower_bound reads (at most four)
+static inline void ns_prefetch(const NodeStore* s) {
+    const char* p = (const char*)s->keys;
+    size_t bytes = sizeof(int) * (size_t)s->n;
+    if (bytes > 256) bytes = 256;
+    for (size_t off = 0; off < bytes; off += 64) __builtin_prefetch(p + off);
+}
+
+// keys are one contiguous array: range scans hand out slices of it
+static inline const int* ns_key_data(const NodeStore* s) { return s->keys; }
+static inline void* const* ns_val_data(const NodeStore* s) { return vals_of(s); }
+
+#endif
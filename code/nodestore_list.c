@@ -54,6 +54,10 @@ static void ns_destroy(NodeStore* s) {
     free(s);
 }
 
+static size_t ns_bytes(const NodeStore* s) {
+    return sizeof(NodeStore) + sizeof(ListNode) * (size_t)s->n;
+}
+
 static int ns_size(const NodeStore* s) { return s ? s->n : 0; }
 static int ns_capacity(const NodeStore* s) { return s ? s->cap : 0; }
 
@@ -79,6 +83,11 @@ static void ns_set_val(NodeStore* s, int idx, void* v) {
     x->val = v;
 }
 
+static void ns_set_key(NodeStore* s, int idx, int key) {
+    ListNode* x = list_at(s, idx);
+    x->key = key;
+}
+
 static int ns_lower_bound(const NodeStore* s, int key) {
     assert(s);
     int idx = 0;
@@ -124,32 +133,22 @@ static void ns_erase_at(NodeStore* s, int idx) {
     s->n--;
 }
 
-static int ns_split(NodeStore* left, NodeStore* right) {
-    assert(left && right);
-    assert(right->n == 0);
-
-    int n = left->n;
-    int mid = n / 2;         // left keeps [0..mid-1], right gets [mid..n-1]
-    if (mid == 0) mid = 1;
-
-    ListNode* prev = NULL;
-    ListNode* cur = left->head;
-    for (int i = 0; i < mid; ++i) {
-        prev = cur;
-        cur = cur->next;
-    }
-
-    // cur is the first node for right
-    right->head = cur;
-    right->n = n - mid;
-
-    // cut left
-    if (prev) prev->next = NULL;
-    left->n = mid;
-
-    // separator key = first key in right
-    assert(right->head);
-    return right->head->key;
+// relinks src's nodes [from, n) behind dst's last node; nothing is copied
+static void ns_append_from(NodeStore* dst, NodeStore* src, int from) {
+    assert(dst && src && from >= 0 && from <= src->n);
+    int move = src->n - from;
+    assert(dst->n + move <= dst->cap);
+    if (move == 0) return;
+
+    ListNode** cut = &src->head;
+    for (int i = 0; i < from; ++i) cut = &(*cut)->next;
+    ListNode** tail = &dst->head;
+    while (*tail) tail = &(*tail)->next;
+
+    *tail = *cut;
+    *cut = NULL;
+    dst->n += move;
+    src->n = from;
 }
 
 static const NodeStoreOps g_ops = {
@@ -161,10 +160,12 @@ static const NodeStoreOps g_ops = {
     .key_at      = ns_key_at,
     .val_at      = ns_val_at,
     .set_val     = ns_set_val,
+    .set_key     = ns_set_key,
     .lower_bound = ns_lower_bound,
     .insert_at   = ns_insert_at,
     .erase_at    = ns_erase_at,
-    .split       = ns_split,
+    .append_from = ns_append_from,
+    .bytes       = ns_bytes,
 };
 
 const NodeStoreOps* nodestore_list_ops(void) { return &g_ops; }
@@ -0,0 +1,261 @@
+// nodestore_packed.c
+//
+// Array store with frame-of-reference keys: a per-store base and, per key,
+// its unsigned delta from the base in the narrowest of 1, 2 or 4 bytes that
+// holds the store's key span. Clustered and monotonic key sets fill a leaf
+// with keys a few hundred apart, so most keys take one or two bytes.
+//
+//   [ n | cap | base | width | vals | deltas | room[cap * 2] ]
+//
+// Deltas live in the room behind the header up to width 2 and in a block of
+// their own at width 4. A key that does not fit (below base, or past the
+// span of the width) re-encodes the store first, which costs the same O(n)
+// as the shift an insert does anyway; a split narrows both halves again.
+// lower_bound turns the key into a delta and searches the packed deltas with
+// the SIMD kernels of nodestore_search.c.
+//
+// create_keys makes a store without vals: a key-only tree's leaves never
+// read theirs, so they pay for the deltas only.
+#include "nodestore.h"
+#include "nodestore_search.h"
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct NodeStore {
+    int n;
+    int cap;
+    int base;               // key i = base + delta i (mod 2^32)
+    int width;              // bytes per delta: 1, 2 or 4
+    void** vals;            // NULL in a keys-only store
+    unsigned char* deltas;  // room, or a block of cap * 4 bytes at width 4
+    unsigned char room[];   // cap * 2 bytes
+};
+
+static uint32_t delta_get(const unsigned char* d, int width, int i) {
+    switch (width) {
+        case 1:  return d[i];
+        case 2:  return ((const uint16_t*)d)[i];
+        default: return ((const uint32_t*)d)[i];
+    }
+}
+
+static void delta_put(unsigned char* d, int width, int i, uint32_t v) {
+    switch (width) {
+        case 1:  d[i] = (uint8_t)v; break;
+        case 2:  ((uint16_t*)d)[i] = (uint16_t)v; break;
+        default: ((uint32_t*)d)[i] = v; break;
+    }
+}
+
+static int width_for(uint32_t span) {
+    return span <= UINT8_MAX ? 1 : (span <= UINT16_MAX ? 2 : 4);
+}
+
+static int key_of(const NodeStore* s, int i) {
+    return (int)((uint32_t)s->base + delta_get(s->deltas, s->width, i));
+}
+
+// every delta again against base nb in width nw
+static void repack(NodeStore* s, int nb, int nw) {
+    NODESTORE_COUNT(packed_repacks, s->n > 0); // an empty store just takes its first base
+    unsigned char* old = s->deltas;
+    int ob = s->base, ow = s->width;
+    unsigned char* d = old;
+    if (nw <= 2) d = s->room;
+    else if (ow != 4) d = (unsigned char*)malloc(sizeof(uint32_t) * (size_t)s->cap);
+    assert(d);
+
+    // in place, a wider entry overlaps later narrower ones: go back to front
+    if (d != old || nw > ow) {
+        for (int i = s->n - 1; i >= 0; --i) {
+            uint32_t k = (uint32_t)ob + delta_get(old, ow, i);
+            delta_put(d, nw, i, k - (uint32_t)nb);
+        }
+    } else {
+        for (int i = 0; i < s->n; ++i) {
+            uint32_t k = (uint32_t)ob + delta_get(old, ow, i);
+            delta_put(d, nw, i, k - (uint32_t)nb);
+        }
+    }
+    if (old != s->room && old != d) free(old);
+    s->deltas = d;
+    s->base = nb;
+    s->width = nw;
+}
+
+// makes room in the encoding for keys in [lo, hi]
+static void fit(NodeStore* s, int lo, int hi) {
+    if (s->n == 0) {
+        repack(s, lo, width_for((uint32_t)hi - (uint32_t)lo));
+        return;
+    }
+    int first = key_of(s, 0), last = key_of(s, s->n - 1);
+    int nb = lo < first ? lo : s->base;
+    int top = hi > last ? hi : last;
+    int nw = width_for((uint32_t)top - (uint32_t)nb);
+    if (nb != s->base || nw > s->width) repack(s, nb, nw > s->width ? nw : s->width);
+}
+
+// narrows the encoding if the keys left span less than its width holds
+static void refit(NodeStore* s) {
+    if (s->n == 0) return;
+    int first = key_of(s, 0);
+    int nw = width_for((uint32_t)key_of(s, s->n - 1) - (uint32_t)first);
+    if (nw < s->width) repack(s, first, nw);
+}
+
+static NodeStore* store_new(int capacity, int with_vals) {
+    if (capacity <= 0) capacity = 1;
+    NodeStore* s = (NodeStore*)calloc(1, sizeof(NodeStore) + sizeof(uint16_t) * (size_t)capacity);
+    if (!s) return NULL;
+    s->cap = capacity;
+    s->width = 1;
+    s->deltas = s->room;
+    if (with_vals) {
+        s->vals = (void**)malloc(sizeof(void*) * (size_t)capacity);
+        if (!s->vals) {
+            free(s);
+            return NULL;
+        }
+    }
+    return s;
+}
+
+static NodeStore* ns_create(int capacity) { return store_new(capacity, 1); }
+static NodeStore* ns_create_keys(int capacity) { return store_new(capacity, 0); }
+
+static void ns_destroy(NodeStore* s) {
+    if (!s) return;
+    if (s->deltas != s->room) free(s->deltas);
+    free(s->vals);
+    free(s);
+}
+
+static size_t ns_bytes(const NodeStore* s) {
+    size_t b = sizeof(NodeStore) + sizeof(uint16_t) * (size_t)s->cap;
+    if (s->deltas != s->room) b += sizeof(uint32_t) * (size_t)s->cap;
+    if (s->vals) b += sizeof(void*) * (size_t)s->cap;
+    return b;
+}
+
+static int ns_size(const NodeStore* s) { return s ? s->n : 0; }
+static int ns_capacity(const NodeStore* s) { return s ? s->cap : 0; }
+
+static void ns_clear(NodeStore* s) {
+    if (!s) return;
+    s->n = 0;
+}
+
+static int ns_key_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    return key_of(s, idx);
+}
+
+static void* ns_val_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->n);
+    return s->vals ? s->vals[idx] : NULL;
+}
+
+static void ns_set_val(NodeStore* s, int idx, void* v) {
+    assert(s && idx >= 0 && idx < s->n);
+    assert(s->vals || !v);
+    if (s->vals) s->vals[idx] = v;
+}
+
+static void ns_set_key(NodeStore* s, int idx, int key) {
+    assert(s && idx >= 0 && idx < s->n);
+    fit(s, key, key);
+    delta_put(s->deltas, s->width, idx, (uint32_t)key - (uint32_t)s->base);
+}
+
+static int ns_lower_bound(const NodeStore* s, int key) {
+    assert(s);
+    if (s->n == 0 || key <= s->base) return 0;
+    uint32_t v = (uint32_t)key - (uint32_t)s->base;
+    switch (s->width) {
+        case 1:  return ns_lower_bound_u8(s->deltas, s->n, v);
+        case 2:  return ns_lower_bound_u16((const uint16_t*)s->deltas, s->n, v);
+        default: return ns_lower_bound_u32((const uint32_t*)s->deltas, s->n, v);
+    }
+}
+
+static void ns_insert_at(NodeStore* s, int idx, int key, void* val) {
+    assert(s);
+    assert(idx >= 0 && idx <= s->n);
+    assert(s->n < s->cap);
+    assert(s->vals || !val);
+    fit(s, key, key);
+
+    size_t w = (size_t)s->width;
+    memmove(s->deltas + w * (size_t)(idx + 1), s->deltas + w * (size_t)idx, w * (size_t)(s->n - idx));
+    delta_put(s->deltas, s->width, idx, (uint32_t)key - (uint32_t)s->base);
+    if (s->vals) {
+        memmove(s->vals + idx + 1, s->vals + idx, sizeof(void*) * (size_t)(s->n - idx));
+        s->vals[idx] = val;
+    }
+    s->n++;
+}
+
+static void ns_erase_at(NodeStore* s, int idx) {
+    assert(s);
+    assert(idx >= 0 && idx < s->n);
+    size_t w = (size_t)s->width;
+    memmove(s->deltas + w * (size_t)idx, s->deltas + w * (size_t)(idx + 1), w * (size_t)(s->n - idx - 1));
+    if (s->vals) memmove(s->vals + idx, s->vals + idx + 1, sizeof(void*) * (size_t)(s->n - idx - 1));
+    s->n--;
+}
+
+static void ns_append_from(NodeStore* dst, NodeStore* src, int from) {
+    assert(dst && src && from >= 0 && from <= src->n);
+    int move = src->n - from;
+    assert(dst->n + move <= dst->cap);
+    if (move == 0) return;
+
+    fit(dst, key_of(src, from), key_of(src, src->n - 1));
+    if (dst->width == src->width && dst->base == src->base) {
+        size_t w = (size_t)dst->width;
+        memcpy(dst->deltas + w * (size_t)dst->n, src->deltas + w * (size_t)from, w * (size_t)move);
+    } else {
+        for (int i = 0; i < move; ++i) {
+            uint32_t k = (uint32_t)key_of(src, from + i);
+            delta_put(dst->deltas, dst->width, dst->n + i, k - (uint32_t)dst->base);
+        }
+    }
+    if (dst->vals) {
+        if (src->vals) memcpy(dst->vals + dst->n, src->vals + from, sizeof(void*) * (size_t)move);
+        else memset(dst->vals + dst->n, 0, sizeof(void*) * (size_t)move);
+    }
+    dst->n += move;
+    src->n = from;
+    refit(src); // the left half of a split spans about half as much
+}
+
+// prefetch hint for the delta lines lower_bound reads (at most four)
+static void ns_prefetch(const NodeStore* s) {
+    const char* p = (const char*)s->deltas;
+    size_t bytes = (size_t)s->width * (size_t)s->n;
+    if (bytes > 256) bytes = 256;
+    for (size_t off = 0; off < bytes; off += 64) __builtin_prefetch(p + off);
+}
+
+static const NodeStoreOps g_ops = {
+    .create      = ns_create,
+    .destroy     = ns_destroy,
+    .size        = ns_size,
+    .capacity    = ns_capacity,
+    .clear       = ns_clear,
+    .key_at      = ns_key_at,
+    .val_at      = ns_val_at,
+    .set_val     = ns_set_val,
+    .set_key     = ns_set_key,
+    .lower_bound = ns_lower_bound,
+    .insert_at   = ns_insert_at,
+    .erase_at    = ns_erase_at,
+    .append_from = ns_append_from,
+    .prefetch    = ns_prefetch,
+    .create_keys = ns_create_keys,
+    .bytes       = ns_bytes,
+};
+
+const NodeStoreOps* nodestore_packed_ops(void) { return &g_ops; }
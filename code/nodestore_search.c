@@ -0,0 +1,265 @@
+// nodestore_search.c
+#include "nodestore_search.h"
+
+#if !defined(NODESTORE_NO_SIMD)
+#  if defined(__x86_64__) || defined(__i386__) || defined(_M_X64)
+#    define NS_SIMD_X86 1
+#    include <emmintrin.h>
+#    include <immintrin.h>
+#  elif defined(__aarch64__) || defined(__ARM_NEON)
+#    define NS_SIMD_NEON 1
+#    include <arm_neon.h>
+#  endif
+#endif
+
+int ns_lower_bound_scalar(const int* keys, int n, int key) {
+    int l = 0, r = n;
+    while (l < r) {
+        int m = l + (r - l) / 2;
+        if (keys[m] < key) l = m + 1;
+        else r = m;
+    }
+    return l;
+}
+
+#if defined(NS_SIMD_X86) || defined(NS_SIMD_NEON)
+
+// Branch-free narrowing: afterwards the answer lies in [base, base + len],
+// so it equals base + (number of keys < key in base[0..len)).
+static const int* narrow(const int* base, int* len, int key, int window) {
+    int n = *len;
+    while (n > window) {
+        int half = n / 2;
+        base = (base[half] < key) ? base + half : base;
+        n -= half;
+    }
+    *len = n;
+    return base;
+}
+
+static int count_less_scalar(const int* p, int n, int key) {
+    int c = 0;
+    for (int i = 0; i < n; ++i) c += (p[i] < key);
+    return c;
+}
+
+#endif
+
+#if defined(NS_SIMD_X86)
+
+#define SSE2_WINDOW 16
+#define AVX2_WINDOW 32
+
+static int lower_bound_sse2(const int* keys, int n, int key) {
+    int len = n;
+    const int* base = narrow(keys, &len, key, SSE2_WINDOW);
+
+    __m128i k = _mm_set1_epi32(key);
+    int c = 0, i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i*)(base + i));
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(v, k)));
+        c += __builtin_popcount((unsigned)mask);
+    }
+    c += count_less_scalar(base + i, len - i, key);
+    return (int)(base - keys) + c;
+}
+
+__attribute__((target("avx2")))
+static int lower_bound_avx2(const int* keys, int n, int key) {
+    int len = n;
+    const int* base = narrow(keys, &len, key, AVX2_WINDOW);
+
+    __m256i k = _mm256_set1_epi32(key);
+    int c = 0, i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)(base + i));
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(k, v)));
+        c += __builtin_popcount((unsigned)mask);
+    }
+    c += count_less_scalar(base + i, len - i, key);
+    return (int)(base - keys) + c;
+}
+
+typedef int (*lower_bound_fn)(const int* keys, int n, int key);
+
+// Resolved once at load time, before main and any thread, so the concurrent
+// trees read a kernel that is never written again. SSE2 is the baseline on
+// x86-64 and stands until then.
+static lower_bound_fn g_kernel = lower_bound_sse2;
+static const char* g_isa = "sse2";
+
+__attribute__((constructor))
+static void pick_kernel(void) {
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        g_kernel = lower_bound_avx2;
+        g_isa = "avx2";
+    }
+}
+
+int ns_lower_bound_simd(const int* keys, int n, int key) {
+    return g_kernel(keys, n, key);
+}
+
+const char* ns_lower_bound_simd_isa(void) {
+    return g_isa;
+}
+
+#elif defined(NS_SIMD_NEON)
+
+#define NEON_WINDOW 16
+
+int ns_lower_bound_simd(const int* keys, int n, int key) {
+    int len = n;
+    const int* base = narrow(keys, &len, key, NEON_WINDOW);
+
+    int32x4_t k = vdupq_n_s32(key);
+    int c = 0, i = 0;
+    for (; i + 4 <= len; i += 4) {
+        uint32x4_t lt = vcltq_s32(vld1q_s32(base + i), k);
+        c += (int)vaddvq_u32(vshrq_n_u32(lt, 31));
+    }
+    c += count_less_scalar(base + i, len - i, key);
+    return (int)(base - keys) + c;
+}
+
+const char* ns_lower_bound_simd_isa(void) { return "neon"; }
+
+#else
+
+int ns_lower_bound_simd(const int* keys, int n, int key) {
+    return ns_lower_bound_scalar(keys, n, key);
+}
+
+const char* ns_lower_bound_simd_isa(void) { return "scalar"; }
+
+#endif
+
+// -------------------- Unsigned deltas (packed store) --------------------
+
+// [base, base + *len] holds the answer afterwards, as in narrow()
+#define NARROW_DELTAS(T)                                                      \
+    static const T* narrow_##T(const T* base, int* len, uint32_t v, int window) { \
+        int n = *len;                                                         \
+        while (n > window) {                                                  \
+            int half = n / 2;                                                 \
+            base = (base[half] < v) ? base + half : base;                     \
+            n -= half;                                                        \
+        }                                                                     \
+        *len = n;                                                             \
+        return base;                                                          \
+    }
+NARROW_DELTAS(uint8_t)
+NARROW_DELTAS(uint16_t)
+NARROW_DELTAS(uint32_t)
+
+#define DELTA_WINDOW 32     // two SSE2 loads of bytes, four of halves, eight of words
+
+#if defined(NS_SIMD_X86)
+
+// unsigned a < b as signed compares after flipping the top bits
+int ns_lower_bound_u8(const uint8_t* d, int n, uint32_t v) {
+    if (v > UINT8_MAX) return n;
+    int len = n;
+    const uint8_t* base = narrow_uint8_t(d, &len, v, DELTA_WINDOW);
+    const __m128i bias = _mm_set1_epi8((char)0x80);
+    __m128i k = _mm_xor_si128(_mm_set1_epi8((char)v), bias);
+    int c = 0, i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(base + i)), bias);
+        c += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmplt_epi8(x, k)));
+    }
+    for (; i < len; ++i) c += (base[i] < v);
+    return (int)(base - d) + c;
+}
+
+int ns_lower_bound_u16(const uint16_t* d, int n, uint32_t v) {
+    if (v > UINT16_MAX) return n;
+    int len = n;
+    const uint16_t* base = narrow_uint16_t(d, &len, v, DELTA_WINDOW);
+    const __m128i bias = _mm_set1_epi16((short)0x8000);
+    __m128i k = _mm_xor_si128(_mm_set1_epi16((short)v), bias);
+    int c = 0, i = 0;
+    for (; i + 8 <= len; i += 8) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(base + i)), bias);
+        // two mask bits per lane
+        c += __builtin_popcount((unsigned)_mm_movemask_epi8(_mm_cmplt_epi16(x, k))) / 2;
+    }
+    for (; i < len; ++i) c += (base[i] < v);
+    return (int)(base - d) + c;
+}
+
+int ns_lower_bound_u32(const uint32_t* d, int n, uint32_t v) {
+    int len = n;
+    const uint32_t* base = narrow_uint32_t(d, &len, v, DELTA_WINDOW);
+    const __m128i bias = _mm_set1_epi32((int)0x80000000u);
+    __m128i k = _mm_xor_si128(_mm_set1_epi32((int)v), bias);
+    int c = 0, i = 0;
+    for (; i + 4 <= len; i += 4) {
+        __m128i x = _mm_xor_si128(_mm_loadu_si128((const __m128i*)(base + i)), bias);
+        c += __builtin_popcount((unsigned)_mm_movemask_ps(_mm_castsi128_ps(_mm_cmplt_epi32(x, k))));
+    }
+    for (; i < len; ++i) c += (base[i] < v);
+    return (int)(base - d) + c;
+}
+
+#elif defined(NS_SIMD_NEON)
+
+int ns_lower_bound_u8(const uint8_t* d, int n, uint32_t v) {
+    if (v > UINT8_MAX) return n;
+    int len = n;
+    const uint8_t* base = narrow_uint8_t(d, &len, v, DELTA_WINDOW);
+    uint8x16_t k = vdupq_n_u8((uint8_t)v);
+    int c = 0, i = 0;
+    for (; i + 16 <= len; i += 16) c += (int)vaddvq_u8(vshrq_n_u8(vcltq_u8(vld1q_u8(base + i), k), 7));
+    for (; i < len; ++i) c += (base[i] < v);
+    return (int)(base - d) + c;
+}
+
+int ns_lower_bound_u16(const uint16_t* d, int n, uint32_t v) {
+    if (v > UINT16_MAX) return n;
+    int len = n;
+    const uint16_t* base = narrow_uint16_t(d, &len, v, DELTA_WINDOW);
+    uint16x8_t k = vdupq_n_u16((uint16_t)v);
+    int c = 0, i = 0;
+    for (; i + 8 <= len; i += 8) c += (int)vaddvq_u16(vshrq_n_u16(vcltq_u16(vld1q_u16(base + i), k), 15));
+    for (; i < len; ++i) c += (base[i] < v);
+    return (int)(base - d) + c;
+}
+
+int ns_lower_bound_u32(const uint32_t* d, int n, uint32_t v) {
+    int len = n;
+    const uint32_t* base = narrow_uint32_t(d, &len, v, DELTA_WINDOW);
+    uint32x4_t k = vdupq_n_u32(v);
+    int c = 0, i = 0;
+    for (; i + 4 <= len; i += 4) c += (int)vaddvq_u32(vshrq_n_u32(vcltq_u32(vld1q_u32(base + i), k), 31));
+    for (; i < len; ++i) c += (base[i] < v);
+    return (int)(base - d) + c;
+}
+
+#else
+
+#define LOWER_BOUND_DELTAS(T)                                                 \
+    static int lower_bound_##T(const T* d, int n, uint32_t v) {               \
+        int len = n;                                                          \
+        const T* base = narrow_##T(d, &len, v, 1);                            \
+        return (int)(base - d) + (len == 1 && base[0] < v);                   \
+    }
+LOWER_BOUND_DELTAS(uint8_t)
+LOWER_BOUND_DELTAS(uint16_t)
+LOWER_BOUND_DELTAS(uint32_t)
+
+int ns_lower_bound_u8(const uint8_t* d, int n, uint32_t v) {
+    return v > UINT8_MAX ? n : lower_bound_uint8_t(d, n, v);
+}
+
+int ns_lower_bound_u16(const uint16_t* d, int n, uint32_t v) {
+    return v > UINT16_MAX ? n : lower_bound_uint16_t(d, n, v);
+}
+
+int ns_lower_bound_u32(const uint32_t* d, int n, uint32_t v) {
+    return lower_bound_uint32_t(d, n, v);
+}
+
+#endif
@@ -0,0 +1,35 @@
+// nodestore_search.h
+//
+// lower_bound kernels over a sorted int array, shared by the array-layout stores.
+#ifndef NODESTORE_SEARCH_H
+#define NODESTORE_SEARCH_H
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// first idx in [0..n] with keys[idx] >= key
+int ns_lower_bound_scalar(const int* keys, int n, int key);
+
+// Same result. Binary search narrows to a small window, then a vector
+// compare-and-popcount counts the keys < key inside it. Picks AVX2 / SSE2 /
+// NEON at runtime; builds with -DNODESTORE_NO_SIMD keep only the scalar path.
+int ns_lower_bound_simd(const int* keys, int n, int key);
+
+// name of the kernel ns_lower_bound_simd dispatches to ("avx2", "sse2", "neon", "scalar")
+const char* ns_lower_bound_simd_isa(void);
+
+// first idx in [0..n] with d[idx] >= v, over sorted unsigned deltas (the
+// packed store). Binary search narrows to a window, then SSE2 / NEON compare
+// all of it at once; scalar without SIMD.
+int ns_lower_bound_u8(const uint8_t* d, int n, uint32_t v);
+int ns_lower_bound_u16(const uint16_t* d, int n, uint32_t v);
+int ns_lower_bound_u32(const uint32_t* d, int n, uint32_t v);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -3,14 +3,25 @@
 #include "skiplist.h"
 #include <assert.h>
 #include <stdlib.h>
-#include <string.h>
 
+// 所有操作都直接落在可索引跳表上：
+//   按下标访问走 skiplist_at，lower_bound 走 skiplist_rank（都是 O(log n)），
+//   val 存在跳表节点里，不再维护平行的 keys[]/vals[] 数组。
+//
+// 取舍：每个 store 的跳表有自己的 arena（make_list）。插删不走 malloc/free，
+// 塔也更集中；代价是 split / merge（append_from）时两边不在同一个 arena，
+// skiplist_append 只能逐塔复制（O(移动条目数)，计入 skip_rebuilds），
+// 不再是无 arena 时 O(log n) 的整段重挂。每次 split 搬 ~M/2 个塔，均摊到
+// 两次 split 之间的 ~M/2 次插入上仍是 O(1)。
+// 内存上每个 store 有一份固定开销：arena 头（每种塔高一条空闲链表）、
+// 至少 8 层的 header 塔、一块 (cap+1)/2 个节点的 chunk，合计约 1 KiB。
+// M 小时它摊到每个 key 上最多，字节/key 远高于链表 store；
+// chunk 改小省不下多少（header 与 arena 头不变），所以按 M 取舍。
+// 整棵树共用一个 arena 需要 create 拿到树的上下文，并让并行建树的各线程
+// 共用 arena 的空闲链表，这里没有这样做。
 struct NodeStore {
     int cap;        // 最大可容纳条目数
-    int n;          // 当前条目数
-    int* keys;      // 按序存储 keys（为了 key_at/按下标操作）
-    void** vals;    // 与 keys 同步的 val（内部节点 child 指针）
-    SkipList* sl;   // 仅用于支持“按 key 查找/维护有序集合”（不存 val）
+    SkipList* sl;   // 有序 key 集合 + 每个 key 对应的 val（内部节点 child 指针）
 };
 
 static int pick_max_level(int cap) {
@@ -22,8 +33,24 @@ static int pick_max_level(int cap) {
     return lvl;
 }
 
+// 每个 store 的跳表种子 = 基础种子 + 创建序号（skiplist 内部再用 splitmix 打散）；
+// 分片树会在多个线程里同时建 store，序号原子递增
+static uint64_t g_seed_base = 0;
+static uint64_t g_seed_seq = 0;
+
+void nodestore_skip_set_seed(uint64_t seed) {
+    g_seed_base = seed;
+    g_seed_seq = 0;
+}
+
 static SkipList* make_list(int cap) {
-    return skiplist_create(pick_max_level(cap), 0.5);
+    // 节点频繁插删：塔从跳表私有 arena 分配，clear/destroy 不再逐个 free
+    SkipListOptions opt = {
+        .use_arena = true,
+        .arena_chunk_nodes = (cap + 1) / 2,
+        .seed = g_seed_base + __atomic_add_fetch(&g_seed_seq, 1, __ATOMIC_RELAXED),
+    };
+    return skiplist_create_ex(pick_max_level(cap), 0.5, &opt);
 }
 
 static NodeStore* ns_create(int capacity) {
@@ -33,20 +60,8 @@ static NodeStore* ns_create(int capacity) {
     if (!s) return NULL;
 
     s->cap = capacity;
-    s->n = 0;
-    s->keys = (int*)malloc(sizeof(int) * (size_t)capacity);
-    s->vals = (void**)malloc(sizeof(void*) * (size_t)capacity);
-    if (!s->keys || !s->vals) {
-        free(s->keys);
-        free(s->vals);
-        free(s);
-        return NULL;
-    }
-
     s->sl = make_list(capacity);
     if (!s->sl) {
-        free(s->keys);
-        free(s->vals);
         free(s);
         return NULL;
     }
@@ -57,137 +72,88 @@ static NodeStore* ns_create(int capacity) {
 static void ns_destroy(NodeStore* s) {
     if (!s) return;
     skiplist_destroy(s->sl);
-    free(s->keys);
-    free(s->vals);
     free(s);
 }
 
-static int ns_size(const NodeStore* s) { return s ? s->n : 0; }
+static int ns_size(const NodeStore* s) { return s ? s->sl->size : 0; }
 static int ns_capacity(const NodeStore* s) { return s ? s->cap : 0; }
 
 static void ns_clear(NodeStore* s) {
     if (!s) return;
-    s->n = 0;
-    // 直接重建跳表（比逐个删简单）
-    skiplist_destroy(s->sl);
-    s->sl = make_list(s->cap);
-    assert(s->sl);
+    skiplist_clear(s->sl);
 }
 
-// 线性 lower_bound：返回第一个 >= key 的位置
+// lower_bound：返回第一个 >= key 的位置 = 跳表中 < key 的元素个数
 static int ns_lower_bound(const NodeStore* s, int key) {
     assert(s);
-    int l = 0, r = s->n; // [l, r)
-    while (l < r) {
-        int m = l + (r - l) / 2;
-        if (s->keys[m] < key) l = m + 1;
-        else r = m;
-    }
-    return l;
+    return skiplist_rank(s->sl, key);
+}
+
+static SkipListNode* node_at(const NodeStore* s, int idx) {
+    assert(s && idx >= 0 && idx < s->sl->size);
+    SkipListNode* x = skiplist_at(s->sl, idx);
+    assert(x);
+    return x;
 }
 
 static int ns_key_at(const NodeStore* s, int idx) {
-    assert(s && idx >= 0 && idx < s->n);
-    return s->keys[idx];
+    return node_at(s, idx)->key;
 }
 
 static void* ns_val_at(const NodeStore* s, int idx) {
-    assert(s && idx >= 0 && idx < s->n);
-    return s->vals[idx];
+    return node_at(s, idx)->val;
 }
 
 static void ns_set_val(NodeStore* s, int idx, void* v) {
-    assert(s && idx >= 0 && idx < s->n);
-    s->vals[idx] = v;
+    node_at(s, idx)->val = v;
 }
 
-static void rebuild_skiplist_from_keys(NodeStore* s) {
-    // 用 keys[] 重新构建 sl（sl 只存 key）
-    skiplist_destroy(s->sl);
-    s->sl = make_list(s->cap);
-    assert(s->sl);
-
-    for (int i = 0; i < s->n; ++i) {
-        // keys[] 本来就是有序的
-        (void)skiplist_insert(s->sl, s->keys[i]);
-    }
+// 只改 key 不动塔：调用方保证新 key 仍在前后两个 key 之间，跳表顺序不变
+static void ns_set_key(NodeStore* s, int idx, int key) {
+    node_at(s, idx)->key = key;
 }
 
 static void ns_insert_at(NodeStore* s, int idx, int key, void* val) {
     assert(s);
-    assert(s->n < s->cap);
-    assert(idx >= 0 && idx <= s->n);
-
-    // bptree 一般会传 idx = lower_bound(key)，但在 borrow/merge 时 idx 可能是 0 或 end
-    // 我们保证“按 idx 插入”的语义正确，同时保持 keys 有序（若不有序，bptree 逻辑就会乱）
-    int lb = ns_lower_bound(s, key);
-    // 为了安全：如果 idx 与 lb 不一致，我们以 idx 为准插入，但要求结果仍有序。
-    // 若你的 bptree 合法，idx 应该总是等于 lb；不等说明上层传错或 key 关系被破坏。
-    if (idx != lb) {
-        // 这里不直接 assert，避免你调试时崩；改成“按 idx 插入但强制有序检查”
-        // 你也可以改成 assert(idx == lb);
-    }
-
-    // 检查重复 key（B+树通常不允许重复）
-    if (lb < s->n && s->keys[lb] == key) return;
+    assert(s->sl->size < s->cap);
+    assert(idx >= 0 && idx <= s->sl->size);
 
-    // 数组插入
-    for (int i = s->n; i > idx; --i) {
-        s->keys[i] = s->keys[i - 1];
-        s->vals[i] = s->vals[i - 1];
-    }
-    s->keys[idx] = key;
-    s->vals[idx] = val;
-    s->n++;
+    // 跳表按 key 定位，idx 只用来做一致性检查：
+    // bptree 在普通插入、borrow/merge 时传的 idx 都应该等于 lower_bound(key)
+    assert(idx == skiplist_rank(s->sl, key));
+    (void)idx;
 
-    // 更新 skiplist（只存 key）
-    // 最稳妥：直接 rebuild；也可以增量 insert，但 rebuild 简单且 cap 小（节点大小是 O(M)）
-    rebuild_skiplist_from_keys(s);
+    // 重复 key（B+树不允许重复）时 skiplist_insert_val 返回 false，保持原样
+    (void)skiplist_insert_val(s->sl, key, val);
 }
 
 static void ns_erase_at(NodeStore* s, int idx) {
     assert(s);
-    assert(idx >= 0 && idx < s->n);
+    assert(idx >= 0 && idx < s->sl->size);
 
-    // 数组删除
-    for (int i = idx; i < s->n - 1; ++i) {
-        s->keys[i] = s->keys[i + 1];
-        s->vals[i] = s->vals[i + 1];
-    }
-    s->n--;
-
-    rebuild_skiplist_from_keys(s);
+    bool ok = skiplist_erase_at(s->sl, idx);
+    assert(ok);
+    (void)ok;
 }
 
-// split：把 left 后半部分移动到 right，返回分隔键 sep（= right 的第一个 key）
-static int ns_split(NodeStore* left, NodeStore* right) {
-    assert(left && right);
-    assert(right->n == 0);
-
-    int n = left->n;
-    int mid = n / 2;
-    if (mid == 0) mid = 1;
-
-    int sep = left->keys[mid];
-
-    int move = n - mid;
-    assert(move >= 1);
-
-    // right 接收 [mid..n)
-    for (int i = 0; i < move; ++i) {
-        right->keys[i] = left->keys[mid + i];
-        right->vals[i] = left->vals[mid + i];
-    }
-    right->n = move;
-
-    // left 保留 [0..mid)
-    left->n = mid;
-
-    // 重建两个 skiplist
-    rebuild_skiplist_from_keys(left);
-    rebuild_skiplist_from_keys(right);
+// append_from：把 src 中下标 >= from 的节点整塔接到 dst 尾部（split 与 merge 共用）
+static void ns_append_from(NodeStore* dst, NodeStore* src, int from) {
+    assert(dst && src);
+    int n = src->sl->size;
+    assert(from >= 0 && from <= n);
+    assert(dst->sl->size + (n - from) <= dst->cap);
+    if (from == n) return;
+
+    int moved = skiplist_append(dst->sl, src->sl, ns_key_at(src, from));
+    assert(moved == n - from);
+    NODESTORE_COUNT(skip_rebuilds, 1); // 各有 arena：每个塔都是复制过去的
+    NODESTORE_COUNT(skip_towers, moved);
+    (void)moved;
+}
 
-    return sep;
+// 占用字节数：store 本身 + 跳表（含 arena 的全部 chunk）
+static size_t ns_bytes(const NodeStore* s) {
+    return sizeof(NodeStore) + skiplist_bytes(s->sl);
 }
 
 // ---- ops 表 ----
@@ -200,10 +166,12 @@ static const NodeStoreOps g_ops = {
     .key_at      = ns_key_at,
     .val_at      = ns_val_at,
     .set_val     = ns_set_val,
+    .set_key     = ns_set_key,
     .lower_bound = ns_lower_bound,
     .insert_at   = ns_insert_at,
     .erase_at    = ns_erase_at,
-    .split       = ns_split,
+    .append_from = ns_append_from,
+    .bytes       = ns_bytes,
 };
 
-const NodeStoreOps* nodestore_skip_ops(void) { return &g_ops; }
\ No newline at end of file
+const NodeStoreOps* nodestore_skip_ops(void) { return &g_ops; }
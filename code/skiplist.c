@@ -3,26 +3,218 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <limits.h>
+#include <string.h>
 
-static SkipListNode* create_node(int level, int key) {
-    SkipListNode* n = (SkipListNode*)malloc(sizeof(SkipListNode) + (size_t)level * sizeof(SkipListNode*));
-    if (!n) return NULL;
+static size_t node_bytes(int level) {
+    return sizeof(SkipListNode) + (size_t)level * sizeof(SkipListLink);
+}
+
+// ---- arena ----
+
+#define ARENA_DEFAULT_CHUNK_NODES 64
+
+static SkipListArena* arena_create(int max_level, int chunk_nodes) {
+    SkipListArena* a = (SkipListArena*)calloc(1, sizeof(SkipListArena));
+    if (!a) return NULL;
+
+    if (chunk_nodes <= 0) chunk_nodes = ARENA_DEFAULT_CHUNK_NODES;
+    // p=0.5 时期望塔高约为 2；chunk 至少能放下一个满高度的塔
+    size_t bytes = (size_t)chunk_nodes * node_bytes(2);
+    if (bytes < node_bytes(max_level)) bytes = node_bytes(max_level);
+    a->chunk_bytes = bytes;
+    return a;
+}
+
+static void arena_destroy(SkipListArena* a) {
+    if (!a) return;
+    SkipListArenaChunk* c = a->chunks;
+    while (c) {
+        SkipListArenaChunk* next = c->next;
+        free(c);
+        c = next;
+    }
+    free(a);
+}
+
+// 所有 chunk 保留下来，从第一块重新切分；free_list 里的塔都在这些 chunk 里，直接丢弃
+static void arena_reset(SkipListArena* a) {
+    a->cur = a->chunks;
+    a->used = 0;
+    for (int h = 0; h <= SKIPLIST_MAX_LEVEL; h++) a->free_list[h] = NULL;
+}
 
+static void* arena_alloc(SkipListArena* a, int level) {
+    // 1) 同高度的空闲塔直接复用（用 forward[0].next 串成链）
+    SkipListNode* x = a->free_list[level];
+    if (x) {
+        a->free_list[level] = x->forward[0].next;
+        return x;
+    }
+
+    // 2) 在当前 chunk 里顺序切分，不够就换下一块（没有就新分配）
+    size_t need = (node_bytes(level) + 7u) & ~(size_t)7u;
+    while (!a->cur || a->used + need > a->cur->bytes) {
+        if (a->cur && a->cur->next) {
+            a->cur = a->cur->next;
+            a->used = 0;
+            continue;
+        }
+        size_t bytes = a->chunk_bytes > need ? a->chunk_bytes : need;
+        SkipListArenaChunk* c = (SkipListArenaChunk*)malloc(sizeof(SkipListArenaChunk) + bytes);
+        if (!c) return NULL;
+        c->next = NULL;
+        c->bytes = bytes;
+        if (a->cur) a->cur->next = c;
+        else a->chunks = c;
+        a->cur = c;
+        a->used = 0;
+    }
+
+    void* p = (char*)(a->cur + 1) + a->used;
+    a->used += need;
+    return p;
+}
+
+static void arena_free(SkipListArena* a, SkipListNode* x) {
+    x->forward[0].next = a->free_list[x->level];
+    a->free_list[x->level] = x;
+}
+
+// ---- 节点 ----
+
+static void init_node(SkipListNode* n, int level, int key, void* val) {
     n->key = key;
     n->level = level;
-    for (int i = 0; i < level; i++) n->forward[i] = NULL;
+    n->val = val;
+    for (int i = 0; i < level; i++) {
+        n->forward[i].next = NULL;
+        n->forward[i].span = 0;
+    }
+}
+
+static SkipListNode* create_node(SkipList* sl, int level, int key, void* val) {
+    SkipListNode* n = sl->arena ? (SkipListNode*)arena_alloc(sl->arena, level)
+                                : (SkipListNode*)malloc(node_bytes(level));
+    if (!n) return NULL;
+    init_node(n, level, key, val);
+    return n;
+}
+
+static void free_node(SkipList* sl, SkipListNode* x) {
+    if (sl->arena) arena_free(sl->arena, x);
+    else free(x);
+}
+
+// ---- finger ----
+//
+// node[i] 都是同一个 key 的前驱，所以层越高 node[i] 越靠左、它的 next 越靠右。
+// 新 key 大于 node[0]->key 时，从第 0 层往上爬到第一个 next >= key 的层：
+// 这一层及以上的前驱不变，只需从下一层的 node 往右、往下走，代价随与上一个
+// key 的距离增长，而不是随跳表大小。insert/erase 之后 finger 换成新的前驱；
+// erase_at、clear、split/append 直接作废它（valid = false）。
+
+struct SkipListFinger {
+    bool valid;
+    SkipListNode* node[SKIPLIST_MAX_LEVEL];
+    int rank[SKIPLIST_MAX_LEVEL];   // node[i] 的排名（header 为 0）
+};
+
+static void finger_take(const SkipList* sl, SkipListNode** update, const int* rank) {
+    SkipListFinger* f = sl->finger;
+    for (int i = 0; i < sl->level; i++) {
+        f->node[i] = update[i];
+        f->rank[i] = rank[i];
+    }
+    f->valid = true;
+}
+
+static void finger_drop(SkipList* sl) {
+    if (sl->finger) sl->finger->valid = false;
+}
+
+// 各层最后一个 < key 的节点 update[i] 及其排名 rank[i]（header 为 0）
+static void find_preds(const SkipList* sl, int key, SkipListNode** update, int* rank) {
+    const SkipListFinger* f = sl->finger;
+    SkipListNode* x = sl->header;
+    int r = 0;
+    int top = sl->level;            // 从 top - 1 层开始往下找
+    if (f && f->valid && key > f->node[0]->key) {
+        top = 0;
+        while (top < sl->level && f->node[top]->forward[top].next &&
+               f->node[top]->forward[top].next->key < key) {
+            top++;
+        }
+        for (int i = top; i < sl->level; i++) {
+            update[i] = f->node[i];
+            rank[i] = f->rank[i];
+        }
+        if (top > 0) {
+            x = f->node[top - 1];
+            r = f->rank[top - 1];
+        }
+    }
+    for (int i = top - 1; i >= 0; i--) {
+        while (x->forward[i].next && x->forward[i].next->key < key) {
+            r += x->forward[i].span;
+            x = x->forward[i].next;
+        }
+        update[i] = x;
+        rank[i] = r;
+    }
+}
+
+// ---- 随机层高 ----
+
+#define SKIPLIST_DEFAULT_SEED 0x9E3779B97F4A7C15ull
+
+// splitmix64：把任意种子（包括相邻的小整数）打散成非 0 的初始状态
+static uint64_t seed_state(uint64_t seed) {
+    uint64_t z = (seed ? seed : SKIPLIST_DEFAULT_SEED) + 0x9E3779B97F4A7C15ull;
+    z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+    z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+    z ^= z >> 31;
+    return z ? z : SKIPLIST_DEFAULT_SEED;
+}
+
+// xorshift64*：状态只属于这一个跳表，没有 rand() 的全局状态
+static uint64_t next_random(SkipList* sl) {
+    uint64_t x = sl->rng;
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    sl->rng = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+static int ctz64(uint64_t x) {
+#if defined(__GNUC__) || defined(__clang__)
+    return __builtin_ctzll(x);
+#else
+    int n = 0;
+    while (!(x & 1u)) { x >>= 1; n++; }
     return n;
+#endif
 }
 
-static int random_level(const SkipList* sl) {
+static int random_level(SkipList* sl) {
     int lvl = 1;
-    while (((double)rand() / (double)RAND_MAX) < sl->p && lvl < sl->max_level) {
-        lvl++;
+    if (sl->p_shift) {
+        // 每个低位（p=1/4 时每两个低位）以概率 p 为 0：尾零个数就是几何分布的提升次数
+        uint64_t r = next_random(sl);
+        lvl += r ? ctz64(r) / sl->p_shift : 64 / sl->p_shift;
+    } else {
+        while (next_random(sl) < sl->p_threshold && lvl < sl->max_level) {
+            lvl++;
+        }
     }
-    return lvl;
+    return lvl < sl->max_level ? lvl : sl->max_level;
 }
 
 SkipList* skiplist_create(int max_level, double p) {
+    return skiplist_create_ex(max_level, p, NULL);
+}
+
+SkipList* skiplist_create_ex(int max_level, double p, const SkipListOptions* opt) {
     if (max_level <= 0 || max_level > SKIPLIST_MAX_LEVEL) return NULL;
     if (p <= 0.0 || p >= 1.0) return NULL;
 
@@ -33,129 +225,442 @@ SkipList* skiplist_create(int max_level, double p) {
     sl->p = p;
     sl->level = 1;
     sl->size = 0;
+    sl->arena = NULL;
+    sl->finger = NULL;
+
+    sl->rng = seed_state(opt ? opt->seed : 0);
+    sl->p_shift = (p == 0.5) ? 1 : (p == 0.25) ? 2 : 0;
+    double th = p * 18446744073709551616.0;                    // p * 2^64
+    sl->p_threshold = (th >= 18446744073709551615.0) ? UINT64_MAX : (uint64_t)th;
 
-    // header 是哨兵，key = INT_MIN；高度设为 max_level，保证每层都有起点
-    sl->header = create_node(max_level, INT_MIN);
+    if (opt && opt->use_arena) {
+        sl->arena = arena_create(max_level, opt->arena_chunk_nodes);
+        if (!sl->arena) {
+            free(sl);
+            return NULL;
+        }
+    }
+    if (opt && opt->use_finger) {
+        sl->finger = (SkipListFinger*)calloc(1, sizeof(SkipListFinger));
+        if (!sl->finger) {
+            arena_destroy(sl->arena);
+            free(sl);
+            return NULL;
+        }
+    }
+
+    // header 是哨兵，key = INT_MIN；高度设为 max_level，保证每层都有起点。
+    // header 不进 arena，这样 clear 重置 arena 时它不受影响
+    sl->header = (SkipListNode*)malloc(node_bytes(max_level));
     if (!sl->header) {
+        arena_destroy(sl->arena);
+        free(sl->finger);
         free(sl);
         return NULL;
     }
+    init_node(sl->header, max_level, INT_MIN, NULL);
     return sl;
 }
 
-void skiplist_destroy(SkipList* sl) {
-    if (!sl) return;
+// 没有 arena 时逐个释放所有真实节点
+static void free_all_nodes(SkipList* sl) {
+    if (sl->arena) {
+        arena_reset(sl->arena);
+        return;
+    }
 
-    // 从底层 L0 串起来释放所有真实节点
-    SkipListNode* x = sl->header->forward[0];
+    // 从底层 L0 串起来释放
+    SkipListNode* x = sl->header->forward[0].next;
     while (x) {
-        SkipListNode* next = x->forward[0];
+        SkipListNode* next = x->forward[0].next;
         free(x);
         x = next;
     }
+}
+
+void skiplist_destroy(SkipList* sl) {
+    if (!sl) return;
+
+    if (sl->arena) arena_destroy(sl->arena);   // O(chunk 数)
+    else free_all_nodes(sl);
     free(sl->header);
+    free(sl->finger);
     free(sl);
 }
 
+// finger 版的 search：顺便把 finger 换成 key 的前驱
+static bool finger_search(const SkipList* sl, int key) {
+    SkipListNode* update[SKIPLIST_MAX_LEVEL];
+    int rank[SKIPLIST_MAX_LEVEL];
+    find_preds(sl, key, update, rank);
+    finger_take(sl, update, rank);
+    const SkipListNode* x = update[0]->forward[0].next;
+    return (x && x->key == key);
+}
+
 bool skiplist_search(const SkipList* sl, int key) {
     if (!sl) return false;
+    if (sl->finger) return finger_search(sl, key);
 
     const SkipListNode* x = sl->header;
     for (int i = sl->level - 1; i >= 0; i--) {
-        while (x->forward[i] && x->forward[i]->key < key) {
-            x = x->forward[i];
+        while (x->forward[i].next && x->forward[i].next->key < key) {
+            x = x->forward[i].next;
         }
     }
-    x = x->forward[0];
+    x = x->forward[0].next;
     return (x && x->key == key);
 }
 
 bool skiplist_insert(SkipList* sl, int key) {
+    return skiplist_insert_val(sl, key, NULL);
+}
+
+bool skiplist_insert_val(SkipList* sl, int key, void* val) {
     if (!sl) return false;
 
     SkipListNode* update[SKIPLIST_MAX_LEVEL];
-    SkipListNode* x = sl->header;
+    int rank[SKIPLIST_MAX_LEVEL];   // rank[i]：update[i] 的排名（header 为 0）
 
-    // 1) 找每层前驱 update[i]
-    for (int i = sl->level - 1; i >= 0; i--) {
-        while (x->forward[i] && x->forward[i]->key < key) {
-            x = x->forward[i];
-        }
-        update[i] = x;
-    }
+    // 1) 找每层前驱 update[i]，顺便累计排名（有 finger 时从 finger 起步）
+    find_preds(sl, key, update, rank);
+    if (sl->finger) finger_take(sl, update, rank);
 
     // 2) 检查重复
-    x = x->forward[0];
+    SkipListNode* x = update[0]->forward[0].next;
     if (x && x->key == key) return false;
 
     // 3) 随机高度
     int lvl = random_level(sl);
 
-    // 4) 如果新节点更高，补齐 update，并提升 sl->level
+    // 4) 先创建节点，失败时不改动任何结构
+    SkipListNode* n = create_node(sl, lvl, key, val);
+    if (!n) return false;
+
+    // 5) 如果新节点更高，补齐 update，并提升 sl->level
     if (lvl > sl->level) {
-        for (int i = sl->level; i < lvl; i++) update[i] = sl->header;
+        for (int i = sl->level; i < lvl; i++) {
+            rank[i] = 0;
+            update[i] = sl->header;
+            update[i]->forward[i].span = sl->size;
+        }
         sl->level = lvl;
     }
 
-    // 5) 创建节点并在 0..lvl-1 层插入
-    SkipListNode* n = create_node(lvl, key);
-    if (!n) return false;
-
+    // 6) 在 0..lvl-1 层插入，并拆分跨度：rank[0] + 1 是新节点的排名
     for (int i = 0; i < lvl; i++) {
-        n->forward[i] = update[i]->forward[i];
-        update[i]->forward[i] = n;
+        n->forward[i].next = update[i]->forward[i].next;
+        update[i]->forward[i].next = n;
+
+        n->forward[i].span = update[i]->forward[i].span - (rank[0] - rank[i]);
+        update[i]->forward[i].span = (rank[0] - rank[i]) + 1;
+    }
+
+    // 7) 更高的层只是多跨过了一个节点
+    for (int i = lvl; i < sl->level; i++) {
+        update[i]->forward[i].span++;
     }
 
     sl->size++;
+
+    // 8) 下一个更大的 key 在低 lvl 层的前驱就是 n（排名之前的节点不受影响）
+    if (sl->finger) {
+        int r = rank[0] + 1;
+        for (int i = 0; i < lvl; i++) {
+            update[i] = n;
+            rank[i] = r;
+        }
+        finger_take(sl, update, rank);
+    }
     return true;
 }
 
+// 把 x 从各层摘掉（update[] 为各层前驱），并释放
+static void unlink_node(SkipList* sl, SkipListNode** update, SkipListNode* x) {
+    for (int i = 0; i < sl->level; i++) {
+        if (update[i]->forward[i].next == x) {
+            update[i]->forward[i].span += x->forward[i].span - 1;
+            update[i]->forward[i].next = x->forward[i].next;
+        } else {
+            update[i]->forward[i].span--;
+        }
+    }
+
+    free_node(sl, x);
+    sl->size--;
+
+    // 如果最高层空了，降低 sl->level
+    while (sl->level > 1 && sl->header->forward[sl->level - 1].next == NULL) {
+        sl->level--;
+    }
+}
+
 bool skiplist_erase(SkipList* sl, int key) {
     if (!sl) return false;
 
     SkipListNode* update[SKIPLIST_MAX_LEVEL];
-    SkipListNode* x = sl->header;
+    int rank[SKIPLIST_MAX_LEVEL];
+
+    // 1) 找每层前驱 update[i]（有 finger 时从 finger 起步）
+    find_preds(sl, key, update, rank);
 
-    // 1) 找每层前驱 update[i]
+    // 2) 目标节点应在 L0 的 update[0]->forward[0]
+    SkipListNode* x = update[0]->forward[0].next;
+    if (!x || x->key != key) {
+        if (sl->finger) finger_take(sl, update, rank);
+        return false;
+    }
+
+    // 3) 各层断开指针；前驱都排在 x 之前，删完仍是 finger
+    unlink_node(sl, update, x);
+    if (sl->finger) finger_take(sl, update, rank);
+    return true;
+}
+
+bool skiplist_erase_at(SkipList* sl, int rank) {
+    if (!sl || rank < 0 || rank >= sl->size) return false;
+    finger_drop(sl);
+
+    // 每层找排名 <= rank 的最后一个节点（目标排名为 rank + 1）
+    SkipListNode* update[SKIPLIST_MAX_LEVEL];
+    SkipListNode* x = sl->header;
+    int traversed = 0;
     for (int i = sl->level - 1; i >= 0; i--) {
-        while (x->forward[i] && x->forward[i]->key < key) {
-            x = x->forward[i];
+        while (x->forward[i].next && traversed + x->forward[i].span <= rank) {
+            traversed += x->forward[i].span;
+            x = x->forward[i].next;
         }
         update[i] = x;
     }
 
-    // 2) 目标节点应在 L0 的 update[0]->forward[0]
-    x = x->forward[0];
-    if (!x || x->key != key) return false;
+    unlink_node(sl, update, x->forward[0].next);
+    return true;
+}
 
-    // 3) 各层断开指针
-    for (int i = 0; i < sl->level; i++) {
-        if (update[i]->forward[i] == x) {
-            update[i]->forward[i] = x->forward[i];
+int skiplist_rank(const SkipList* sl, int key) {
+    if (!sl) return 0;
+
+    int rank = 0;
+    const SkipListNode* x = sl->header;
+    for (int i = sl->level - 1; i >= 0; i--) {
+        while (x->forward[i].next && x->forward[i].next->key < key) {
+            rank += x->forward[i].span;
+            x = x->forward[i].next;
         }
     }
+    return rank;
+}
 
-    free(x);
-    sl->size--;
+SkipListNode* skiplist_at(const SkipList* sl, int rank) {
+    if (!sl || rank < 0 || rank >= sl->size) return NULL;
 
-    // 4) 如果最高层空了，降低 sl->level
-    while (sl->level > 1 && sl->header->forward[sl->level - 1] == NULL) {
-        sl->level--;
+    int target = rank + 1;          // 节点排名从 1 开始
+    int traversed = 0;
+    SkipListNode* x = sl->header;
+    for (int i = sl->level - 1; i >= 0; i--) {
+        while (x->forward[i].next && traversed + x->forward[i].span <= target) {
+            traversed += x->forward[i].span;
+            x = x->forward[i].next;
+        }
+        if (traversed == target) return x;
     }
+    return NULL;
+}
+
+SkipListIter skiplist_range(const SkipList* sl, int lo, int hi) {
+    SkipListIter it = { NULL, hi };
+    if (!sl || lo > hi) return it;
 
+    // 定位到最后一个 < lo 的节点，它的后继就是第一个 >= lo 的节点
+    const SkipListNode* x = sl->header;
+    for (int i = sl->level - 1; i >= 0; i--) {
+        while (x->forward[i].next && x->forward[i].next->key < lo) {
+            x = x->forward[i].next;
+        }
+    }
+    x = x->forward[0].next;
+    if (x && x->key <= hi) it.cur = x;
+    return it;
+}
+
+bool skiplist_iter_next(SkipListIter* it, int* key, void** val) {
+    if (!it || !it->cur) return false;
+
+    const SkipListNode* x = it->cur;
+    if (key) *key = x->key;
+    if (val) *val = x->val;
+
+    const SkipListNode* nx = x->forward[0].next;
+    it->cur = (nx && nx->key <= it->hi) ? nx : NULL;
     return true;
 }
 
+void skiplist_clear(SkipList* sl) {
+    if (!sl) return;
+
+    finger_drop(sl);
+    free_all_nodes(sl);
+    for (int i = 0; i < sl->max_level; i++) {
+        sl->header->forward[i].next = NULL;
+        sl->header->forward[i].span = 0;
+    }
+    sl->level = 1;
+    sl->size = 0;
+}
+
+// append 的复制版本：update[0] 之后的每个塔按原高度在 sl 中重新分配，
+// 顺序追加到 sl 各层的尾部（tail / tail_rank），再把旧塔从 src 摘下还给 src 的 arena
+static int append_copy(SkipList* sl, SkipListNode** tail, int* tail_rank, SkipList* src, SkipListNode** update) {
+    int moved = 0;
+    SkipListNode* x;
+    while ((x = update[0]->forward[0].next) != NULL) {
+        SkipListNode* n = create_node(sl, x->level, x->key, x->val);
+        if (!n) break;          // 内存不足：剩下的留在 src 中，两边依然各自有序
+
+        moved++;
+        int pos = sl->size + 1;
+        for (int i = 0; i < n->level; i++) {
+            tail[i]->forward[i].next = n;
+            tail[i]->forward[i].span = pos - tail_rank[i];
+            tail[i] = n;
+            tail_rank[i] = pos;
+        }
+        if (n->level > sl->level) sl->level = n->level;
+        sl->size = pos;
+
+        unlink_node(src, update, x);
+    }
+    return moved;
+}
+
+int skiplist_append(SkipList* sl, SkipList* src, int key) {
+    if (!sl || !src || sl == src) return -1;
+    if (src->max_level != sl->max_level) return -1;
+    finger_drop(sl);
+    finger_drop(src);
+
+    // 1) src 中每层最后一个 < key 的前驱，切口就在 update[i] 之后
+    SkipListNode* update[SKIPLIST_MAX_LEVEL];
+    int rank[SKIPLIST_MAX_LEVEL] = {0};
+    SkipListNode* x = src->header;
+    for (int i = src->level - 1; i >= 0; i--) {
+        rank[i] = (i == src->level - 1) ? 0 : rank[i + 1];
+        while (x->forward[i].next && x->forward[i].next->key < key) {
+            rank[i] += x->forward[i].span;
+            x = x->forward[i].next;
+        }
+        update[i] = x;
+    }
+
+    // 2) sl 每层的尾节点及其排名（header 排名为 0）
+    SkipListNode* tail[SKIPLIST_MAX_LEVEL];
+    int tail_rank[SKIPLIST_MAX_LEVEL];
+    x = sl->header;
+    int r = 0;
+    for (int i = sl->max_level - 1; i >= 0; i--) {
+        if (i < sl->level) {
+            while (x->forward[i].next) {
+                r += x->forward[i].span;
+                x = x->forward[i].next;
+            }
+        }
+        tail[i] = i < sl->level ? x : sl->header;
+        tail_rank[i] = i < sl->level ? r : 0;
+    }
+
+    // 节点分属不同 arena 时不能直接挂过去，逐塔复制
+    if (sl->arena || src->arena) {
+        return append_copy(sl, tail, tail_rank, src, update);
+    }
+
+    // 3) 逐层把后半段整体挂到 sl 的尾节点上（节点本身不动）。
+    //    src 中排名 p 的节点在 sl 中的排名 = sl->size + p - rank[0]
+    int moved = src->size - rank[0];
+    for (int i = 0; i < src->level; i++) {
+        SkipListNode* n = update[i]->forward[i].next;
+        if (!n) continue;
+        int pos = rank[i] + update[i]->forward[i].span;
+        tail[i]->forward[i].next = n;
+        tail[i]->forward[i].span = sl->size + pos - rank[0] - tail_rank[i];
+        update[i]->forward[i].next = NULL;
+        if (i + 1 > sl->level) sl->level = i + 1;
+    }
+    sl->size += moved;
+    src->size = rank[0];
+
+    // 4) src 收缩层数
+    while (src->level > 1 && src->header->forward[src->level - 1].next == NULL) src->level--;
+
+    return moved;
+}
+
+int skiplist_split(SkipList* sl, int key, SkipList* right) {
+    if (!sl || !right) return -1;
+    if (right->size != 0) return -1;
+    return skiplist_append(right, sl, key);
+}
+
+// search 读到的节点数（与 skiplist_search 的无 finger 路径一致）
+static int search_path(const SkipList* sl, int key) {
+    const SkipListNode* x = sl->header;
+    int seen = 0;
+    for (int i = sl->level - 1; i >= 0; i--) {
+        const SkipListNode* nx;
+        while ((nx = x->forward[i].next) != NULL) {
+            seen++;
+            if (nx->key >= key) break;
+            x = nx;
+        }
+    }
+    return seen;
+}
+
+size_t skiplist_bytes(const SkipList* sl) {
+    if (!sl) return 0;
+    size_t bytes = sizeof(SkipList) + node_bytes(sl->max_level);
+    if (sl->finger) bytes += sizeof(SkipListFinger);
+    if (sl->arena) {
+        bytes += sizeof(SkipListArena);
+        for (const SkipListArenaChunk* c = sl->arena->chunks; c; c = c->next) {
+            bytes += sizeof(SkipListArenaChunk) + c->bytes;
+        }
+    } else {
+        for (const SkipListNode* x = sl->header->forward[0].next; x; x = x->forward[0].next) {
+            bytes += node_bytes(x->level);
+        }
+    }
+    return bytes;
+}
+
+void skiplist_stats(const SkipList* sl, SkipListStats* out) {
+    if (!out) return;
+    memset(out, 0, sizeof(*out));
+    if (!sl) return;
+
+    out->size = sl->size;
+    out->level = sl->level;
+    out->bytes = skiplist_bytes(sl);
+
+    uint64_t total = 0;
+    for (const SkipListNode* x = sl->header->forward[0].next; x; x = x->forward[0].next) {
+        out->towers[x->level]++;
+        int len = search_path(sl, x->key);
+        total += (uint64_t)len;
+        if (len > out->max_search_path) out->max_search_path = len;
+    }
+    if (sl->size > 0) out->avg_search_path = (double)total / (double)sl->size;
+}
+
 void skiplist_print(const SkipList* sl) {
     if (!sl) return;
     printf("SkipList(size=%d, levels=%d)\n", sl->size, sl->level);
     for (int i = sl->level - 1; i >= 0; i--) {
         printf("L%d: ", i);
-        const SkipListNode* x = sl->header->forward[i];
+        const SkipListNode* x = sl->header->forward[i].next;
         while (x) {
             printf("%d ", x->key);
-            x = x->forward[i];
+            x = x->forward[i].next;
         }
         printf("\n");
     }
-}
\ No newline at end of file
+}
@@ -2,26 +2,69 @@
 #define SKIPLIST_H
 
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 
 // 你可以按数据规模调大/调小（常用 16/32/64）
 #define SKIPLIST_MAX_LEVEL 32
 
+struct SkipListNode;
+
+typedef struct SkipListLink {
+    struct SkipListNode* next;      // 第 i 层的下一个节点
+    int span;                       // 从本节点走到 next 跨过的 L0 节点数（next 为 NULL 时无意义）
+} SkipListLink;
+
 typedef struct SkipListNode {
     int key;
     int level;                      // 该节点 forward[] 长度
-    struct SkipListNode* forward[]; // forward[i]：第 i 层的下一个节点
+    void* val;                      // 附带的值（独立使用时恒为 NULL）
+    SkipListLink forward[];         // forward[i]：第 i 层的链接
 } SkipListNode;
 
+// 节点塔的 arena：大块（chunk）顺序切分 + 按塔高分桶的空闲链表。
+// 释放的塔挂回 free_list[level] 复用；clear 只重置游标，destroy 只释放 chunk。
+typedef struct SkipListArenaChunk {
+    struct SkipListArenaChunk* next;
+    size_t bytes;                   // 可用字节数（不含本头部）
+} SkipListArenaChunk;
+
+typedef struct SkipListArena {
+    SkipListArenaChunk* chunks;     // 全部 chunk，按分配顺序
+    SkipListArenaChunk* cur;        // 正在切分的 chunk
+    size_t used;                    // cur 中已切出的字节数
+    size_t chunk_bytes;             // 新 chunk 的默认大小
+    SkipListNode* free_list[SKIPLIST_MAX_LEVEL + 1]; // free_list[h]：空闲的高度为 h 的塔
+} SkipListArena;
+
+typedef struct SkipListOptions {
+    bool use_arena;                 // 节点塔从本跳表私有的 arena 分配
+    int  arena_chunk_nodes;         // 每个 chunk 大约容纳的节点数（<=0 用默认值）
+    uint64_t seed;                  // 随机层高的种子（0 用固定默认值；相同种子可复现）
+    bool use_finger;                // search/insert/erase 从上一次操作的前驱起步（见下）
+} SkipListOptions;
+
+// finger：上一次 search/insert/erase 的各层前驱（update[]）及其排名。
+// 有序或近似有序的 key 流从这里往右找，不必每次都从 header 下降。
+// 开启后 search 也会改写 finger，同一个跳表不能再多线程并发 search。
+typedef struct SkipListFinger SkipListFinger;
+
 typedef struct SkipList {
     int max_level;                  // <= SKIPLIST_MAX_LEVEL
     double p;                       // 提升概率（常用 0.5）
     int level;                      // 当前跳表实际层数（>=1）
     int size;                       // 元素数量
-    SkipListNode* header;           // 头结点（哨兵）
+    uint64_t rng;                   // 本跳表私有的 xorshift64* 状态（非 0）
+    uint64_t p_threshold;           // 通用 p：一次抽样 < p_threshold 即提升一层
+    int p_shift;                    // p = 1/2 或 1/4 时为 1 / 2：一次抽样数尾零决定层高；否则 0
+    SkipListNode* header;           // 头结点（哨兵，始终 malloc 分配）
+    SkipListArena* arena;           // 可选；NULL 表示每个节点单独 malloc
+    SkipListFinger* finger;         // 可选；NULL 表示不用 finger
 } SkipList;
 
 // 创建 / 销毁
 SkipList* skiplist_create(int max_level, double p);
+SkipList* skiplist_create_ex(int max_level, double p, const SkipListOptions* opt); // opt 可为 NULL
 void skiplist_destroy(SkipList* sl);
 
 // 基本操作
@@ -29,6 +72,49 @@ bool skiplist_search(const SkipList* sl, int key);
 bool skiplist_insert(SkipList* sl, int key);  // 成功插入返回 true；重复 key 返回 false
 bool skiplist_erase(SkipList* sl, int key);   // 删除成功 true；不存在 false
 
+// 可索引操作（rank 从 0 开始，均为 O(log n)）
+bool skiplist_insert_val(SkipList* sl, int key, void* val); // 同 skiplist_insert，并记录 val
+int  skiplist_rank(const SkipList* sl, int key);            // < key 的元素个数（即 lower_bound 下标）
+SkipListNode* skiplist_at(const SkipList* sl, int rank);    // 第 rank 个节点；越界返回 NULL
+bool skiplist_erase_at(SkipList* sl, int rank);             // 删除第 rank 个节点
+
+// 区间迭代器：按 key 升序产出 [lo, hi] 内的节点，只做一次 O(log n) 定位，
+// 之后沿第 0 层顺序走。迭代期间不能修改跳表。
+typedef struct SkipListIter {
+    const SkipListNode* cur;        // 下一个要产出的节点；NULL 表示结束
+    int hi;                         // 区间上界（含）
+} SkipListIter;
+
+SkipListIter skiplist_range(const SkipList* sl, int lo, int hi);
+bool skiplist_iter_next(SkipListIter* it, int* key, void** val); // key/val 可为 NULL；结束返回 false
+
+// 清空全部元素（保留 header，可继续使用）；使用 arena 时为 O(1)
+void skiplist_clear(SkipList* sl);
+
+// 把所有 >= key 的节点整塔（tower）摘下挂到 right 上，不重新分配节点。
+// 要求 right 为空且 max_level 与 sl 相同；返回移动的节点数，失败返回 -1。
+// 两边的节点不属于同一个 arena 时，塔会按原高度复制到 right 的 arena 中。
+int skiplist_split(SkipList* sl, int key, SkipList* right);
+
+// 把 src 中所有 >= key 的节点整塔接到 sl 尾部；要求它们都大于 sl 中的 key，
+// 且两边 max_level 相同。返回移动的节点数，失败返回 -1。split 即 sl 为空的情形；
+// 节点不属于同一个 arena 时同样按原高度复制。
+int skiplist_append(SkipList* sl, SkipList* src, int key);
+
+// 结构统计：沿第 0 层走一遍，再对每个 key 模拟一次 search（O(n log n)），不修改跳表。
+// 查找路径长度 = 一次 search 读到的节点数：各层向右走过的节点，加上每层停下时看的那个 next。
+typedef struct SkipListStats {
+    int size;
+    int level;                              // 当前层数
+    int towers[SKIPLIST_MAX_LEVEL + 1];     // towers[h]：塔高恰为 h 的节点数（h = 1..max_level）
+    double avg_search_path;                 // 查找已有 key 的平均路径长度；空表为 0
+    int max_search_path;                    // 其中最长的一次
+    size_t bytes;                           // SkipList、header、finger、arena（或逐个 malloc 的塔）
+} SkipListStats;
+
+void skiplist_stats(const SkipList* sl, SkipListStats* out);
+size_t skiplist_bytes(const SkipList* sl);  // 即 stats.bytes；有 arena 时只走 chunk 链
+
 // 调试输出（可选）
 void skiplist_print(const SkipList* sl);
 
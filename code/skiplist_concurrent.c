@@ -0,0 +1,305 @@
+#include "skiplist_concurrent.h"
+#include "skiplist.h"
+#include "epoch.h"
+
+#include <stdlib.h>
+#include <limits.h>
+
+// next[i] 的最低位：本节点在第 i 层已被逻辑删除（节点至少 2 字节对齐，最低位空闲）
+#define MARK ((uintptr_t)1)
+
+static inline bool is_marked(uintptr_t p) { return (p & MARK) != 0; }
+
+// 节点的两个“所有者”各自结束时置一位，后到的那个负责交给 epoch 回收：
+// 插入方挂完（或放弃）高层、删除方摘完各层之后，节点才不可能再被挂回去
+#define OWN_LINKED   1u
+#define OWN_UNLINKED 2u
+
+typedef struct CNode {
+    int key;
+    int level;                      // next[] 长度
+    unsigned own;                   // OWN_* 位，原子操作
+    uintptr_t next[];               // 第 i 层的下一个节点 | MARK
+} CNode;
+
+struct ConcurrentSkipList {
+    int max_level;                  // <= SKIPLIST_MAX_LEVEL
+    double p;
+    uint64_t p_threshold;           // 一次抽样 < p_threshold 即提升一层
+    int level;                      // 用过的最高层数（只增不减，原子操作）
+    int size;                       // 元素数量（原子操作）
+    Epoch* epoch;                   // 摘下节点的延迟回收
+    CNode* header;                  // 哨兵，key 视为 -inf
+};
+
+static inline CNode* node_ptr(uintptr_t p) { return (CNode*)(p & ~MARK); }
+
+static inline uintptr_t load_next(const CNode* x, int i) {
+    return __atomic_load_n(&x->next[i], __ATOMIC_ACQUIRE);
+}
+
+static inline bool cas_next(CNode* x, int i, uintptr_t* expect, uintptr_t desired) {
+    return __atomic_compare_exchange_n(&x->next[i], expect, desired, false,
+                                       __ATOMIC_SEQ_CST, __ATOMIC_ACQUIRE);
+}
+
+static CNode* node_create(int key, int level) {
+    CNode* x = (CNode*)malloc(sizeof(CNode) + (size_t)level * sizeof(uintptr_t));
+    if (!x) return NULL;
+    x->key = key;
+    x->level = level;
+    x->own = 0;
+    for (int i = 0; i < level; i++) x->next[i] = 0;
+    return x;
+}
+
+static void node_free(void* p, void* ctx) {
+    (void)ctx;
+    free(p);
+}
+
+// ---- 随机层高（线程私有 xorshift64*，第一次使用时按线程序号播种） ----
+
+static uint64_t g_thread_seq = 0;
+static _Thread_local uint64_t tl_rng = 0;
+static _Thread_local unsigned tl_retired = 0;
+
+static uint64_t next_random(void) {
+    uint64_t x = tl_rng;
+    if (!x) {
+        // splitmix64 打散线程序号，保证非 0
+        uint64_t z = __atomic_add_fetch(&g_thread_seq, 1, __ATOMIC_RELAXED) * 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        z ^= z >> 31;
+        x = z ? z : 0x9E3779B97F4A7C15ull;
+    }
+    x ^= x >> 12;
+    x ^= x << 25;
+    x ^= x >> 27;
+    tl_rng = x;
+    return x * 0x2545F4914F6CDD1Dull;
+}
+
+static int random_level(const ConcurrentSkipList* sl) {
+    int lvl = 1;
+    while (lvl < sl->max_level && next_random() < sl->p_threshold) lvl++;
+    return lvl;
+}
+
+// ---- 创建 / 销毁 ----
+
+ConcurrentSkipList* cskiplist_create(int max_level, double p) {
+    if (max_level <= 0 || max_level > SKIPLIST_MAX_LEVEL) return NULL;
+    if (p <= 0.0 || p >= 1.0) return NULL;
+
+    ConcurrentSkipList* sl = (ConcurrentSkipList*)malloc(sizeof(ConcurrentSkipList));
+    if (!sl) return NULL;
+
+    sl->max_level = max_level;
+    sl->p = p;
+    double th = p * 18446744073709551616.0;                    // p * 2^64
+    sl->p_threshold = (th >= 18446744073709551615.0) ? UINT64_MAX : (uint64_t)th;
+    sl->level = 1;
+    sl->size = 0;
+
+    sl->epoch = epoch_create();
+    sl->header = node_create(INT_MIN, max_level);
+    if (!sl->epoch || !sl->header) {
+        epoch_destroy(sl->epoch);
+        free(sl->header);
+        free(sl);
+        return NULL;
+    }
+    return sl;
+}
+
+void cskiplist_destroy(ConcurrentSkipList* sl) {
+    if (!sl) return;
+    // 没有并发线程了：第 0 层上剩下的都是活节点，已摘下的都在 epoch 里
+    CNode* x = node_ptr(sl->header->next[0]);
+    while (x) {
+        CNode* next = node_ptr(x->next[0]);
+        free(x);
+        x = next;
+    }
+    free(sl->header);
+    epoch_destroy(sl->epoch);
+    free(sl);
+}
+
+// ---- 查找 ----
+
+// 自顶向下定位 key，沿途把带标记的节点从所在层摘掉（CAS 失败就从头再来）。
+// preds[i]/succs[i]：第 i 层 < key 的最后一个节点 / 它之后的第一个未删除节点。
+// past_equal 时连 == key 的节点也走过去：删除方用它摘自己的节点，
+// 因为同 key 的新节点可能已经挂在被删节点前面。
+static bool find(ConcurrentSkipList* sl, int key, CNode** preds, CNode** succs, bool past_equal) {
+retry:;
+    CNode* pred = sl->header;
+    for (int i = sl->max_level - 1; i >= 0; i--) {
+        CNode* curr = node_ptr(load_next(pred, i));
+        while (curr) {
+            uintptr_t succ = load_next(curr, i);
+            if (is_marked(succ)) {
+                uintptr_t expect = (uintptr_t)curr;
+                if (!cas_next(pred, i, &expect, succ & ~MARK)) goto retry;
+                curr = node_ptr(succ);
+                continue;
+            }
+            if (curr->key < key || (past_equal && curr->key == key)) {
+                pred = curr;
+                curr = node_ptr(succ);
+            } else {
+                break;
+            }
+        }
+        preds[i] = pred;
+        succs[i] = curr;
+    }
+    return succs[0] && succs[0]->key == key;
+}
+
+bool cskiplist_search(ConcurrentSkipList* sl, int key) {
+    epoch_enter(sl->epoch);
+    // 只读：带标记的节点直接跨过，不帮忙摘；从用过的最高层开始即可
+    const CNode* pred = sl->header;
+    const CNode* curr = NULL;
+    for (int i = __atomic_load_n(&sl->level, __ATOMIC_ACQUIRE) - 1; i >= 0; i--) {
+        curr = node_ptr(load_next(pred, i));
+        while (curr) {
+            uintptr_t succ = load_next(curr, i);
+            if (is_marked(succ)) {
+                curr = node_ptr(succ);
+            } else if (curr->key < key) {
+                pred = curr;
+                curr = node_ptr(succ);
+            } else {
+                break;
+            }
+        }
+    }
+    bool found = curr && curr->key == key;
+    epoch_exit(sl->epoch);
+    return found;
+}
+
+// ---- 插入 / 删除 ----
+
+// own 置位；两位都齐了的那一方把节点交给 epoch
+static void release(ConcurrentSkipList* sl, CNode* x, unsigned bit) {
+    unsigned prev = __atomic_fetch_or(&x->own, bit, __ATOMIC_ACQ_REL);
+    if ((prev | bit) == (OWN_LINKED | OWN_UNLINKED)) {
+        epoch_retire(sl->epoch, x, node_free, NULL);
+        tl_retired++;
+    }
+}
+
+// 每攒一批摘下的节点，在临界区外推进一次 epoch
+static void maybe_collect(ConcurrentSkipList* sl) {
+    if (tl_retired >= 32) {
+        tl_retired = 0;
+        epoch_collect(sl->epoch);
+    }
+}
+
+bool cskiplist_insert(ConcurrentSkipList* sl, int key) {
+    CNode* preds[SKIPLIST_MAX_LEVEL];
+    CNode* succs[SKIPLIST_MAX_LEVEL];
+    CNode* x = NULL;
+    int top = random_level(sl);
+
+    epoch_enter(sl->epoch);
+    // 1) 第 0 层：CAS 成功即插入成功
+    for (;;) {
+        if (find(sl, key, preds, succs, false)) {
+            epoch_exit(sl->epoch);
+            free(x);                // 还没发布出去，直接释放
+            return false;
+        }
+        if (!x) {
+            x = node_create(key, top);
+            if (!x) {
+                epoch_exit(sl->epoch);
+                return false;
+            }
+        }
+        for (int i = 0; i < top; i++) __atomic_store_n(&x->next[i], (uintptr_t)succs[i], __ATOMIC_RELAXED);
+        uintptr_t expect = (uintptr_t)succs[0];
+        if (cas_next(preds[0], 0, &expect, (uintptr_t)x)) break;
+    }
+    __atomic_add_fetch(&sl->size, 1, __ATOMIC_RELAXED);
+
+    // 先抬高层数再挂高层，search 从 level 往下走就不会漏
+    int lv = __atomic_load_n(&sl->level, __ATOMIC_RELAXED);
+    while (lv < top && !__atomic_compare_exchange_n(&sl->level, &lv, top, false,
+                                                    __ATOMIC_SEQ_CST, __ATOMIC_RELAXED)) {
+    }
+
+    // 2) 自底向上挂高层；节点在此期间被删除就停下
+    for (int i = 1; i < top; i++) {
+        for (;;) {
+            uintptr_t nx = load_next(x, i);
+            if (is_marked(nx)) goto linked;
+            if (node_ptr(nx) != succs[i] && !cas_next(x, i, &nx, (uintptr_t)succs[i])) continue;
+            uintptr_t expect = (uintptr_t)succs[i];
+            if (cas_next(preds[i], i, &expect, (uintptr_t)x)) break;
+            // 前驱变了：重新定位；x 已从第 0 层消失说明被删了
+            find(sl, key, preds, succs, false);
+            if (succs[0] != x) goto linked;
+        }
+    }
+
+linked:
+    // 挂层时被删了：删除方的查找可能早于后挂上的层，这里再摘一次
+    if (is_marked(load_next(x, 0))) find(sl, key, preds, succs, true);
+    release(sl, x, OWN_LINKED);
+    epoch_exit(sl->epoch);
+    maybe_collect(sl);
+    return true;
+}
+
+bool cskiplist_erase(ConcurrentSkipList* sl, int key) {
+    CNode* preds[SKIPLIST_MAX_LEVEL];
+    CNode* succs[SKIPLIST_MAX_LEVEL];
+
+    epoch_enter(sl->epoch);
+    if (!find(sl, key, preds, succs, false)) {
+        epoch_exit(sl->epoch);
+        return false;
+    }
+    CNode* x = succs[0];
+
+    // 1) 从顶层往下逐层打标记，高层指针先冻结
+    for (int i = x->level - 1; i >= 1; i--) {
+        uintptr_t nx = load_next(x, i);
+        while (!is_marked(nx) && !cas_next(x, i, &nx, nx | MARK)) {
+        }
+    }
+
+    // 2) 第 0 层打上标记的线程才算删除成功
+    uintptr_t nx = load_next(x, 0);
+    for (;;) {
+        if (is_marked(nx)) {
+            epoch_exit(sl->epoch);
+            return false;           // 别的线程先删掉了
+        }
+        if (cas_next(x, 0, &nx, nx | MARK)) break;
+    }
+    __atomic_sub_fetch(&sl->size, 1, __ATOMIC_RELAXED);
+
+    // 3) 物理摘除：查找途中会把 x 从它挂着的每一层摘下
+    find(sl, key, preds, succs, true);
+    release(sl, x, OWN_UNLINKED);
+    epoch_exit(sl->epoch);
+    maybe_collect(sl);
+    return true;
+}
+
+int cskiplist_size(const ConcurrentSkipList* sl) {
+    return __atomic_load_n(&sl->size, __ATOMIC_RELAXED);
+}
+
+int cskiplist_level(const ConcurrentSkipList* sl) {
+    return __atomic_load_n(&sl->level, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,28 @@
+#ifndef SKIPLIST_CONCURRENT_H
+#define SKIPLIST_CONCURRENT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// 无锁并发跳表（Harris/Fraser 风格），语义与 skiplist.h 的 search/insert/erase 相同：
+//   - 每层 next 指针的最低位是删除标记；erase 先从顶层往下逐层打标记，
+//     第 0 层标记成功的那个线程算删除成功（逻辑删除），随后一次查找把它从各层摘掉；
+//   - insert 先用 CAS 挂上第 0 层（此刻即插入成功），再自底向上逐层挂高层；
+//   - search 只读，不写任何共享内存，遇到带标记的节点直接跨过。
+// 摘下的节点交给 epoch.h 延迟释放：所有操作都在 epoch_enter/exit 之内，
+// 不会有线程拿着已释放的节点。层高随机数用线程私有状态，不同线程互不干扰。
+typedef struct ConcurrentSkipList ConcurrentSkipList;
+
+// 创建 / 销毁（destroy 时不能再有其它线程在用这个跳表）
+ConcurrentSkipList* cskiplist_create(int max_level, double p);
+void cskiplist_destroy(ConcurrentSkipList* sl);
+
+// 基本操作：任意线程可并发调用，均为无锁
+bool cskiplist_search(ConcurrentSkipList* sl, int key);
+bool cskiplist_insert(ConcurrentSkipList* sl, int key);  // 成功插入返回 true；重复 key 返回 false
+bool cskiplist_erase(ConcurrentSkipList* sl, int key);   // 删除成功 true；不存在 false
+
+int cskiplist_size(const ConcurrentSkipList* sl);        // 元素数量（并发修改时是近似值）
+int cskiplist_level(const ConcurrentSkipList* sl);       // 当前用到的最高层数（>=1）
+
+#endif